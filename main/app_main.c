@@ -30,49 +30,17 @@
 
 #include "mqtt_aws.h"
 #include "sensors.h"
-#include "rainsensor.h"
+#include "sampler.h"
+#include "radio_power.h"
+#include "local_metrics.h"
+#include "timesync.h"
+#include "archiver.h"
+#include "backfiller.h"
+#include "mem_budget.h"
 #include <wifi.h>
 
 static const char *TAG = "WSTN";
 
-/**
- * @brief Rain Sensor Event Handler
- *
- * @param event_handler_arg handler specific arguments
- * @param event_base event base, here is fixed to ESP_RAINSENSOR_EVENT
- * @param event_id event id
- * @param event_data event specific arguments
- */
-static void rainsensor_event_handler(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
-{
-    ESP_LOGW(TAG, "Event handler called");
-    rainsensor_t *rainsensor = NULL;
-    switch (event_id) {
-    case RAINSENSOR_UPDATE:
-        rainsensor = (rainsensor_t *)event_data;
-        /* print information parsed from rain sensor statements */
-        ESP_LOGI(TAG, "Data:\r\n"
-                 "\t\t\t\t\t\tAccumulator = %.02fmm\r\n"
-                 "\t\t\t\t\t\tEvent Accu  = %.02fmm\r\n"
-                 "\t\t\t\t\t\tTotal Rain  = %.02fmm\r\n"
-                 "\t\t\t\t\t\tmmper hour  = %.02fmmph",
-                 rainsensor->current_acc_rain, rainsensor->event_acc_rain, rainsensor->total_rain, rainsensor->mm_per_hour_rain);
-        break;
-    case RAINSENSOR_RESET_COMPLETE:
-        ESP_LOGW(TAG, "Rain Sensor reset complete");
-        break;
-    case RAINSENSOR_EVENT:
-        ESP_LOGW(TAG, "Rain Sensor sent a rain event");
-        break;
-    case RAINSENSOR_UNKNOWN:
-        /* print unknown statements */
-        ESP_LOGW(TAG, "Unknown statement:%s", (char *)event_data);
-        break;
-    default:
-        break;
-    }
-}
-
 void app_main()
 {
     ESP_LOGI(TAG, "[APP] Startup...");
@@ -86,34 +54,31 @@ void app_main()
     esp_log_level_set("OUTBOX", ESP_LOG_VERBOSE);
 
     ESP_LOGI(TAG, "[APP] Creating main thread...");
+    mem_budget_monitor_start();
 
-    configure_sensors();
-    rainsensor_parser_handle_t rainsensor_hdl = rainsensor_parser_init();
-    rainsensor_parser_add_handler(rainsensor_hdl, rainsensor_event_handler, NULL);
-    rainsensor_reset();
-
-#if 0
-    // Configuring WIFI
+#ifdef CONFIG_STATION_PUBLISH_ENABLE
+    // Configuring WIFI. Association runs in the background and the MQTT task waits for it,
+    // so sensor bring-up in the sampler task overlaps the connection and the TLS handshake.
     wifi_setup();
+    timesync_start();
+    radio_power_configure();
     wifi_connect();
-    wifi_waitforconnect();
-    start_mqtt();
-#else
-    while(1)
+#ifdef CONFIG_LOCAL_METRICS_ENABLE
+    local_metrics_start();
+#endif
+#ifdef CONFIG_ARCHIVE_ENABLE
+    if (archiver_start() == ESP_OK)
     {
-        rainsensor_read();
-        // sensorinfo =  get_sensors();
-        // ESP_LOGI(TAG, "Temperature: %0.02f", sensorinfo->temperature);
-        // ESP_LOGI(TAG, "Humidity: %0.02f", sensorinfo->humidity);
-        // ESP_LOGI(TAG, "Pressure: %0.02f", sensorinfo->pressure);
-        // ESP_LOGI(TAG, "Ground Temperature: %0.02f", sensorinfo->groundtemperature);
-        // ESP_LOGI(TAG, "Ground Moisture: %d", sensorinfo->groundmoisture);
-        // ESP_LOGI(TAG, "Ground Moisture Voltage: %d", sensorinfo->groundvoltage);
-        // ESP_LOGI(TAG, "Rain: %0.02f", sensorinfo->rainmm);
-        // ESP_LOGI(TAG, "UV Level: %d", sensorinfo->uvlevel);
-        // ESP_LOGI(TAG, "Light Level: %d", sensorinfo->lightlevel);
-        // ESP_LOGI(TAG, "==============");
-        vTaskDelay(5000 / portTICK_RATE_MS);
+#ifdef CONFIG_BACKFILL_ENABLE
+        backfiller_start();
+#endif
     }
+#endif
+    start_mqtt();
+    sampler_start();
+#else
+    // Sensor bench: the sampler task logs every window, nothing is sent
+    ESP_LOGI(TAG, "[APP] Publishing disabled (CONFIG_STATION_PUBLISH_ENABLE), sampling only");
+    sampler_start();
 #endif
 }
@@ -0,0 +1,1395 @@
+/**
+ * @brief On-card time-series archive. Plain C and stdio only, so the same code runs on the FAT
+ * mount of the station and against a directory on a host (see tools/archivebench).
+ */
+#include "sdkconfig.h"
+
+#ifdef CONFIG_ARCHIVE_ENABLE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+
+#define ARCHIVE_MAGIC (0x42415857)          // "WXAB"
+#define ARCHIVE_FLAG_SEALED (0x01)
+#define ARCHIVE_MAX_COLUMNS (3 * SENSOR_CH_COUNT)
+#define ARCHIVE_MAX_FILES (512)
+#define ARCHIVE_PATH_MAX (96)
+#define ARCHIVE_HOUR_MS (3600000LL)
+#define ARCHIVE_DAY_MS (24 * ARCHIVE_HOUR_MS)
+
+// Block header layout, little endian
+#define HDR_MAGIC (0)
+#define HDR_CRC (4)                         // over the rest of the block
+#define HDR_LEVEL (8)
+#define HDR_NCOLS (9)
+#define HDR_FLAGS (10)
+#define HDR_ROWS (12)
+#define HDR_USED (14)                       // header plus payload bytes
+#define HDR_VALID (16)
+#define HDR_T_FIRST (24)
+#define HDR_T_LAST (32)
+#define HDR_OFFSETS (40)                    // u16 per column: time, mask, then the values
+#define HDR_FIXED HDR_OFFSETS
+
+#define header_size(ncols) (HDR_OFFSETS + 2 * ((ncols) + 2) + 8 * (ncols))
+#define minmax_offset(ncols) (HDR_OFFSETS + 2 * ((ncols) + 2))
+
+/* Bit streams */
+
+typedef struct {
+    uint8_t *buf;                           // NULL to count bits only
+    size_t bits;
+} bitwriter_t;
+
+typedef struct {
+    const uint8_t *buf;
+    size_t bits;
+    size_t limit;
+} bitreader_t;
+
+static void put_bits(bitwriter_t *w, uint64_t value, int n)
+{
+    if (w->buf != NULL)
+    {
+        for (int i = n - 1; i >= 0; i--)
+        {
+            if ((value >> i) & 1)
+            {
+                w->buf[w->bits >> 3] |= 0x80 >> (w->bits & 7);
+            }
+            w->bits++;
+        }
+    }
+    else
+    {
+        w->bits += n;
+    }
+}
+
+static uint64_t get_bits(bitreader_t *r, int n)
+{
+    uint64_t value = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        value <<= 1;
+        if (r->bits < r->limit)
+        {
+            value |= (r->buf[r->bits >> 3] >> (7 - (r->bits & 7))) & 1;
+        }
+        r->bits++;
+    }
+    return value;
+}
+
+static int64_t sign_extend(uint64_t value, int n)
+{
+    uint64_t sign = 1ULL << (n - 1);
+
+    return (int64_t)((value ^ sign) - sign);
+}
+
+/* Timestamps: delta-of-delta in milliseconds, the first one is in the block header */
+
+typedef struct {
+    int64_t prev;
+    int64_t prev_delta;
+    bool started;
+} time_codec_t;
+
+static bool time_encode(bitwriter_t *w, time_codec_t *c, int64_t t)
+{
+    if (!c->started)
+    {
+        c->prev = t;
+        c->prev_delta = 0;
+        c->started = true;
+        return true;
+    }
+
+    int64_t delta = t - c->prev;
+    int64_t dod = delta - c->prev_delta;
+
+    if (dod == 0)
+    {
+        put_bits(w, 0, 1);
+    }
+    else if (dod >= -64 && dod <= 63)
+    {
+        put_bits(w, 0x2, 2);
+        put_bits(w, (uint64_t)dod, 7);
+    }
+    else if (dod >= -256 && dod <= 255)
+    {
+        put_bits(w, 0x6, 3);
+        put_bits(w, (uint64_t)dod, 9);
+    }
+    else if (dod >= -2048 && dod <= 2047)
+    {
+        put_bits(w, 0xe, 4);
+        put_bits(w, (uint64_t)dod, 12);
+    }
+    else if (dod >= INT32_MIN && dod <= INT32_MAX)
+    {
+        put_bits(w, 0xf, 4);
+        put_bits(w, (uint64_t)dod, 32);
+    }
+    else
+    {
+        // A gap this long starts a new block
+        return false;
+    }
+    c->prev = t;
+    c->prev_delta = delta;
+    return true;
+}
+
+static int64_t time_decode(bitreader_t *r, time_codec_t *c)
+{
+    int64_t dod;
+
+    if (get_bits(r, 1) == 0)
+    {
+        dod = 0;
+    }
+    else if (get_bits(r, 1) == 0)
+    {
+        dod = sign_extend(get_bits(r, 7), 7);
+    }
+    else if (get_bits(r, 1) == 0)
+    {
+        dod = sign_extend(get_bits(r, 9), 9);
+    }
+    else if (get_bits(r, 1) == 0)
+    {
+        dod = sign_extend(get_bits(r, 12), 12);
+    }
+    else
+    {
+        dod = sign_extend(get_bits(r, 32), 32);
+    }
+    c->prev_delta += dod;
+    c->prev += c->prev_delta;
+    return c->prev;
+}
+
+/* Valid masks: one bit when unchanged */
+
+typedef struct {
+    uint32_t prev;
+    bool started;
+} mask_codec_t;
+
+static void mask_encode(bitwriter_t *w, mask_codec_t *c, uint32_t mask)
+{
+    if (c->started)
+    {
+        if (mask == c->prev)
+        {
+            put_bits(w, 0, 1);
+            return;
+        }
+        put_bits(w, 1, 1);
+    }
+    put_bits(w, mask, SENSOR_CH_COUNT);
+    c->prev = mask;
+    c->started = true;
+}
+
+static uint32_t mask_decode(bitreader_t *r, mask_codec_t *c)
+{
+    if (!c->started || get_bits(r, 1))
+    {
+        c->prev = (uint32_t)get_bits(r, SENSOR_CH_COUNT);
+        c->started = true;
+    }
+    return c->prev;
+}
+
+/* Values: XOR against the previous value, storing only the meaningful bits */
+
+#define FLOAT_NO_WINDOW (0xff)
+
+typedef struct {
+    uint32_t prev;
+    uint8_t lead;
+    uint8_t trail;
+    bool started;
+} float_codec_t;
+
+static void float_encode(bitwriter_t *w, float_codec_t *c, float value)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    if (!c->started)
+    {
+        put_bits(w, bits, 32);
+        c->prev = bits;
+        c->lead = FLOAT_NO_WINDOW;
+        c->started = true;
+        return;
+    }
+
+    uint32_t x = bits ^ c->prev;
+
+    c->prev = bits;
+    if (x == 0)
+    {
+        put_bits(w, 0, 1);
+        return;
+    }
+
+    int lead = __builtin_clz(x);
+    int trail = __builtin_ctz(x);
+
+    put_bits(w, 1, 1);
+    if (c->lead != FLOAT_NO_WINDOW && lead >= c->lead && trail >= c->trail)
+    {
+        // Fits in the previous window
+        put_bits(w, 0, 1);
+        put_bits(w, x >> c->trail, 32 - c->lead - c->trail);
+        return;
+    }
+    put_bits(w, 1, 1);
+    put_bits(w, lead, 5);
+    put_bits(w, 32 - lead - trail - 1, 5);
+    put_bits(w, x >> trail, 32 - lead - trail);
+    c->lead = lead;
+    c->trail = trail;
+}
+
+static float float_decode(bitreader_t *r, float_codec_t *c)
+{
+    float value;
+
+    if (!c->started)
+    {
+        c->prev = (uint32_t)get_bits(r, 32);
+        c->lead = FLOAT_NO_WINDOW;
+        c->started = true;
+    }
+    else if (get_bits(r, 1))
+    {
+        if (get_bits(r, 1))
+        {
+            c->lead = (uint8_t)get_bits(r, 5);
+            int len = (int)get_bits(r, 5) + 1;
+            c->trail = 32 - c->lead - len;
+        }
+        c->prev ^= (uint32_t)get_bits(r, 32 - c->lead - c->trail) << c->trail;
+    }
+    memcpy(&value, &c->prev, sizeof(value));
+    return value;
+}
+
+/* Little endian helpers */
+
+static void put_u16(uint8_t *p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void put_u32(uint8_t *p, uint32_t v) { put_u16(p, v); put_u16(p + 2, v >> 16); }
+static void put_u64(uint8_t *p, uint64_t v) { put_u32(p, v); put_u32(p + 4, v >> 32); }
+static uint16_t get_u16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+static uint32_t get_u32(const uint8_t *p) { return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16); }
+static uint64_t get_u64(const uint8_t *p) { return get_u32(p) | ((uint64_t)get_u32(p + 4) << 32); }
+
+static void put_float(uint8_t *p, float v)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &v, sizeof(bits));
+    put_u32(p, bits);
+}
+
+static float get_float(const uint8_t *p)
+{
+    uint32_t bits = get_u32(p);
+    float v;
+
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+    static const uint32_t nibble[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    uint32_t crc = 0xffffffff;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ nibble[crc & 0x0f];
+        crc = (crc >> 4) ^ nibble[crc & 0x0f];
+    }
+    return ~crc;
+}
+
+/* Block builder: the rows of the open block, with the running size of every column */
+
+typedef struct {
+    archive_level_t level;
+    uint8_t ncols;
+    uint16_t cap_rows;
+    uint16_t rows;
+    int64_t *times;
+    uint32_t *masks;
+    float *values;                          // column major, cap_rows per column
+    time_codec_t tc;
+    mask_codec_t mc;
+    float_codec_t fc[ARCHIVE_MAX_COLUMNS];
+    size_t time_bits;
+    size_t mask_bits;
+    size_t col_bits[ARCHIVE_MAX_COLUMNS];
+} block_builder_t;
+
+static int64_t raw_times[ARCHIVE_RAW_ROWS];
+static uint32_t raw_masks[ARCHIVE_RAW_ROWS];
+static float raw_values[SENSOR_CH_COUNT * ARCHIVE_RAW_ROWS];
+static int64_t rollup_times[ARCHIVE_ROLLUP_ROWS];
+static uint32_t rollup_masks[ARCHIVE_ROLLUP_ROWS];
+static float rollup_values[ARCHIVE_MAX_COLUMNS * ARCHIVE_ROLLUP_ROWS];
+
+// Column c of a block holds channel c % SENSOR_CH_COUNT
+#define column_channel(c) ((c) % SENSOR_CH_COUNT)
+
+static void builder_reset(block_builder_t *b)
+{
+    b->rows = 0;
+    memset(&b->tc, 0, sizeof(b->tc));
+    memset(&b->mc, 0, sizeof(b->mc));
+    memset(b->fc, 0, sizeof(b->fc));
+    b->time_bits = 0;
+    b->mask_bits = 0;
+    memset(b->col_bits, 0, sizeof(b->col_bits));
+}
+
+static size_t builder_payload(const block_builder_t *b, size_t time_bits, size_t mask_bits, const size_t *col_bits)
+{
+    size_t bytes = header_size(b->ncols) + (time_bits + 7) / 8 + (mask_bits + 7) / 8;
+
+    for (int c = 0; c < b->ncols; c++)
+    {
+        bytes += (col_bits[c] + 7) / 8;
+    }
+    return bytes;
+}
+
+/**
+ * @brief Add a row to the open block if it still fits. Missing values repeat the previous value of
+ * the column, which costs one bit.
+ */
+static bool builder_add(block_builder_t *b, int64_t t, uint32_t mask, const float *row)
+{
+    bitwriter_t w = { NULL, 0 };
+    time_codec_t tc = b->tc;
+    mask_codec_t mc = b->mc;
+    float_codec_t fc[ARCHIVE_MAX_COLUMNS];
+    size_t col_bits[ARCHIVE_MAX_COLUMNS];
+    float value[ARCHIVE_MAX_COLUMNS];
+    size_t time_bits, mask_bits;
+
+    if (b->rows >= b->cap_rows)
+    {
+        return false;
+    }
+    if (!time_encode(&w, &tc, t))
+    {
+        return false;
+    }
+    time_bits = b->time_bits + w.bits;
+    w.bits = 0;
+    mask_encode(&w, &mc, mask);
+    mask_bits = b->mask_bits + w.bits;
+
+    memcpy(fc, b->fc, sizeof(fc[0]) * b->ncols);
+    for (int c = 0; c < b->ncols; c++)
+    {
+        if (mask & SENSOR_CH_BIT(column_channel(c)))
+        {
+            value[c] = row[c];
+        }
+        else
+        {
+            value[c] = b->rows ? b->values[c * b->cap_rows + b->rows - 1] : 0.0f;
+        }
+        w.bits = 0;
+        float_encode(&w, &fc[c], value[c]);
+        col_bits[c] = b->col_bits[c] + w.bits;
+    }
+    if (builder_payload(b, time_bits, mask_bits, col_bits) > ARCHIVE_BLOCK_SIZE)
+    {
+        return false;
+    }
+
+    b->tc = tc;
+    b->mc = mc;
+    memcpy(b->fc, fc, sizeof(fc[0]) * b->ncols);
+    b->time_bits = time_bits;
+    b->mask_bits = mask_bits;
+    memcpy(b->col_bits, col_bits, sizeof(col_bits[0]) * b->ncols);
+    b->times[b->rows] = t;
+    b->masks[b->rows] = mask;
+    for (int c = 0; c < b->ncols; c++)
+    {
+        b->values[c * b->cap_rows + b->rows] = value[c];
+    }
+    b->rows++;
+    return true;
+}
+
+static void builder_encode(const block_builder_t *b, uint8_t *block, bool sealed)
+{
+    size_t offset = header_size(b->ncols);
+    uint32_t valid = 0;
+    bitwriter_t w;
+
+    memset(block, 0, ARCHIVE_BLOCK_SIZE);
+
+    // Time column
+    time_codec_t tc = { 0 };
+    w.buf = block + offset;
+    w.bits = 0;
+    put_u16(block + HDR_OFFSETS, offset);
+    for (int i = 0; i < b->rows; i++)
+    {
+        time_encode(&w, &tc, b->times[i]);
+    }
+    offset += (w.bits + 7) / 8;
+
+    // Mask column
+    mask_codec_t mc = { 0 };
+    w.buf = block + offset;
+    w.bits = 0;
+    put_u16(block + HDR_OFFSETS + 2, offset);
+    for (int i = 0; i < b->rows; i++)
+    {
+        mask_encode(&w, &mc, b->masks[i]);
+        valid |= b->masks[i];
+    }
+    offset += (w.bits + 7) / 8;
+
+    // Value columns, with their min/max over the rows where the channel is present
+    for (int c = 0; c < b->ncols; c++)
+    {
+        const float *column = &b->values[c * b->cap_rows];
+        uint32_t bit = SENSOR_CH_BIT(column_channel(c));
+        float_codec_t fc = { 0 };
+        float min = 0.0f, max = 0.0f;
+        bool seen = false;
+
+        w.buf = block + offset;
+        w.bits = 0;
+        put_u16(block + HDR_OFFSETS + 4 + 2 * c, offset);
+        for (int i = 0; i < b->rows; i++)
+        {
+            float_encode(&w, &fc, column[i]);
+            if (b->masks[i] & bit)
+            {
+                if (!seen || column[i] < min)
+                {
+                    min = column[i];
+                }
+                if (!seen || column[i] > max)
+                {
+                    max = column[i];
+                }
+                seen = true;
+            }
+        }
+        offset += (w.bits + 7) / 8;
+        put_float(block + minmax_offset(b->ncols) + 8 * c, min);
+        put_float(block + minmax_offset(b->ncols) + 8 * c + 4, max);
+    }
+
+    put_u32(block + HDR_MAGIC, ARCHIVE_MAGIC);
+    block[HDR_LEVEL] = b->level;
+    block[HDR_NCOLS] = b->ncols;
+    block[HDR_FLAGS] = sealed ? ARCHIVE_FLAG_SEALED : 0;
+    put_u16(block + HDR_ROWS, b->rows);
+    put_u16(block + HDR_USED, offset);
+    put_u32(block + HDR_VALID, valid);
+    put_u64(block + HDR_T_FIRST, b->rows ? b->times[0] : 0);
+    put_u64(block + HDR_T_LAST, b->rows ? b->times[b->rows - 1] : 0);
+    put_u32(block + HDR_CRC, crc32(block + HDR_LEVEL, ARCHIVE_BLOCK_SIZE - HDR_LEVEL));
+}
+
+static bool block_check(const uint8_t *block, archive_level_t level)
+{
+    return get_u32(block + HDR_MAGIC) == ARCHIVE_MAGIC
+        && block[HDR_LEVEL] == level
+        && get_u32(block + HDR_CRC) == crc32(block + HDR_LEVEL, ARCHIVE_BLOCK_SIZE - HDR_LEVEL);
+}
+
+static void block_column(const uint8_t *block, int column, bitreader_t *r)
+{
+    int ncols = block[HDR_NCOLS];
+    size_t start = get_u16(block + HDR_OFFSETS + 2 * column);
+    size_t end = column + 1 < ncols + 2 ? get_u16(block + HDR_OFFSETS + 2 * (column + 1)) : get_u16(block + HDR_USED);
+
+    r->buf = block + start;
+    r->bits = 0;
+    r->limit = end > start && end <= ARCHIVE_BLOCK_SIZE ? (end - start) * 8 : 0;
+}
+
+static void block_times(const uint8_t *block, int64_t *times)
+{
+    int rows = get_u16(block + HDR_ROWS);
+    time_codec_t tc = { .prev = (int64_t)get_u64(block + HDR_T_FIRST), .prev_delta = 0, .started = true };
+    bitreader_t r;
+
+    block_column(block, 0, &r);
+    for (int i = 0; i < rows; i++)
+    {
+        times[i] = i ? time_decode(&r, &tc) : tc.prev;
+    }
+}
+
+static void block_masks(const uint8_t *block, uint32_t *masks)
+{
+    int rows = get_u16(block + HDR_ROWS);
+    mask_codec_t mc = { 0 };
+    bitreader_t r;
+
+    block_column(block, 1, &r);
+    for (int i = 0; i < rows; i++)
+    {
+        masks[i] = mask_decode(&r, &mc);
+    }
+}
+
+static void block_values(const uint8_t *block, int column, float *values)
+{
+    int rows = get_u16(block + HDR_ROWS);
+    float_codec_t fc = { 0 };
+    bitreader_t r;
+
+    block_column(block, column + 2, &r);
+    for (int i = 0; i < rows; i++)
+    {
+        values[i] = float_decode(&r, &fc);
+    }
+}
+
+/* Series: the files of one level and its open block */
+
+typedef struct {
+    archive_level_t level;
+    const char *dir;
+    block_builder_t builder;
+    FILE *file;
+    uint32_t key;                           // YYYYMMDD or YYYYMM of the open file, 0 if none
+    long slot;                              // block index of the open block in the file
+    uint16_t checkpointed;                  // rows of the open block already on the card
+    int64_t last_ms;                        // newest row, -1 if none
+} archive_series_t;
+
+static char archive_root[ARCHIVE_PATH_MAX];
+static uint32_t archive_checkpoint_rows;
+static archive_series_t series[ARCHIVE_LEVEL_COUNT] = {
+    [ARCHIVE_LEVEL_RAW] = {
+        .level = ARCHIVE_LEVEL_RAW,
+        .dir = "raw",
+        .builder = {
+            .level = ARCHIVE_LEVEL_RAW, .ncols = SENSOR_CH_COUNT, .cap_rows = ARCHIVE_RAW_ROWS,
+            .times = raw_times, .masks = raw_masks, .values = raw_values,
+        },
+    },
+    [ARCHIVE_LEVEL_HOURLY] = {
+        .level = ARCHIVE_LEVEL_HOURLY,
+        .dir = "hourly",
+        .builder = {
+            .level = ARCHIVE_LEVEL_HOURLY, .ncols = ARCHIVE_MAX_COLUMNS, .cap_rows = ARCHIVE_ROLLUP_ROWS,
+            .times = rollup_times, .masks = rollup_masks, .values = rollup_values,
+        },
+    },
+};
+static archive_write_stats_t write_stats;
+static int64_t compact_cursor_ms = -1;
+static uint8_t write_block[ARCHIVE_BLOCK_SIZE];
+static uint8_t read_block[ARCHIVE_BLOCK_SIZE];
+
+static uint32_t series_key(archive_level_t level, int64_t time_ms)
+{
+    time_t t;
+    struct tm tm;
+
+    // Open ended ranges
+    if (time_ms <= 0)
+    {
+        return 0;
+    }
+    if (time_ms / 1000 > INT32_MAX)
+    {
+        return UINT32_MAX;
+    }
+    t = (time_t)(time_ms / 1000);
+    if (gmtime_r(&t, &tm) == NULL)
+    {
+        return UINT32_MAX;
+    }
+    if (level == ARCHIVE_LEVEL_RAW)
+    {
+        return (tm.tm_year + 1900) * 10000 + (tm.tm_mon + 1) * 100 + tm.tm_mday;
+    }
+    return (tm.tm_year + 1900) * 100 + (tm.tm_mon + 1);
+}
+
+static void series_path(const archive_series_t *s, uint32_t key, char *path, size_t len)
+{
+    snprintf(path, len, "%s/%s/%u.BLK", archive_root, s->dir, (unsigned)key);
+}
+
+static long file_blocks(FILE *f)
+{
+    if (fseek(f, 0, SEEK_END) != 0)
+    {
+        return 0;
+    }
+    return ftell(f) / ARCHIVE_BLOCK_SIZE;
+}
+
+static int series_write(archive_series_t *s, bool sealed)
+{
+    block_builder_t *b = &s->builder;
+
+    if (s->file == NULL || b->rows == 0)
+    {
+        return 0;
+    }
+    builder_encode(b, write_block, sealed);
+    if (fseek(s->file, s->slot * ARCHIVE_BLOCK_SIZE, SEEK_SET) != 0
+        || fwrite(write_block, ARCHIVE_BLOCK_SIZE, 1, s->file) != 1
+        || fflush(s->file) != 0)
+    {
+        return -1;
+    }
+    fsync(fileno(s->file));
+    write_stats.device_bytes += ARCHIVE_BLOCK_SIZE;
+    if (sealed)
+    {
+        write_stats.blocks_sealed++;
+        s->slot++;
+        s->checkpointed = 0;
+        builder_reset(b);
+    }
+    else
+    {
+        write_stats.checkpoints++;
+        s->checkpointed = b->rows;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reload an unsealed block into the builder so appending carries on where it stopped
+ */
+static void series_resume(archive_series_t *s)
+{
+    block_builder_t *b = &s->builder;
+    static int64_t times[ARCHIVE_RAW_ROWS];
+    static uint32_t masks[ARCHIVE_RAW_ROWS];
+    float row[ARCHIVE_MAX_COLUMNS];
+    int rows;
+
+    if (s->slot == 0
+        || fseek(s->file, (s->slot - 1) * ARCHIVE_BLOCK_SIZE, SEEK_SET) != 0
+        || fread(read_block, ARCHIVE_BLOCK_SIZE, 1, s->file) != 1
+        || !block_check(read_block, s->level)
+        || (read_block[HDR_FLAGS] & ARCHIVE_FLAG_SEALED)
+        || read_block[HDR_NCOLS] != b->ncols)
+    {
+        return;
+    }
+    rows = get_u16(read_block + HDR_ROWS);
+    if (rows > b->cap_rows)
+    {
+        return;
+    }
+    block_times(read_block, times);
+    block_masks(read_block, masks);
+    for (int c = 0; c < b->ncols; c++)
+    {
+        block_values(read_block, c, &b->values[c * b->cap_rows]);
+    }
+    // builder_add reads the values back from the builder itself, so copy each row out first
+    for (int i = 0; i < rows; i++)
+    {
+        for (int c = 0; c < b->ncols; c++)
+        {
+            row[c] = b->values[c * b->cap_rows + i];
+        }
+        builder_add(b, times[i], masks[i], row);
+    }
+    s->slot--;
+    s->checkpointed = b->rows;
+}
+
+static int series_switch(archive_series_t *s, uint32_t key)
+{
+    char path[ARCHIVE_PATH_MAX + 32];
+
+    if (s->file != NULL)
+    {
+        if (series_write(s, true) != 0)
+        {
+            return -1;
+        }
+        fclose(s->file);
+        s->file = NULL;
+    }
+    builder_reset(&s->builder);
+    s->key = key;
+    s->slot = 0;
+    s->checkpointed = 0;
+
+    series_path(s, key, path, sizeof(path));
+    s->file = fopen(path, "r+b");
+    if (s->file == NULL)
+    {
+        s->file = fopen(path, "w+b");
+    }
+    if (s->file == NULL)
+    {
+        s->key = 0;
+        return -1;
+    }
+    s->slot = file_blocks(s->file);
+    series_resume(s);
+    return 0;
+}
+
+static int series_append(archive_series_t *s, int64_t t, uint32_t mask, const float *row)
+{
+    block_builder_t *b = &s->builder;
+    uint32_t key = series_key(s->level, t);
+
+    if (t <= s->last_ms)
+    {
+        return -1;
+    }
+    if (key != s->key && series_switch(s, key) != 0)
+    {
+        return -1;
+    }
+    if (!builder_add(b, t, mask, row))
+    {
+        if (series_write(s, true) != 0 || !builder_add(b, t, mask, row))
+        {
+            return -1;
+        }
+    }
+    s->last_ms = t;
+    if (archive_checkpoint_rows && (uint32_t)(b->rows - s->checkpointed) >= archive_checkpoint_rows)
+    {
+        return series_write(s, false);
+    }
+    return 0;
+}
+
+static int key_compare(const void *a, const void *b)
+{
+    uint32_t ka = *(const uint32_t *)a, kb = *(const uint32_t *)b;
+
+    return ka < kb ? -1 : ka > kb;
+}
+
+/**
+ * @brief List the file keys of a level in [from, to], sorted. Directory order is arbitrary, so this
+ * scans the whole directory.
+ */
+static int series_list(const archive_series_t *s, uint32_t from, uint32_t to, uint32_t *keys, int max)
+{
+    static char path[ARCHIVE_PATH_MAX + 16];
+    struct dirent *entry;
+    int count = 0;
+    DIR *dir;
+
+    snprintf(path, sizeof(path), "%s/%s", archive_root, s->dir);
+    dir = opendir(path);
+    if (dir == NULL)
+    {
+        return 0;
+    }
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char *end;
+        unsigned long key = strtoul(entry->d_name, &end, 10);
+
+        if (end == entry->d_name || strcasecmp(end, ".BLK") != 0 || key < from || key > to)
+        {
+            continue;
+        }
+        if (count < max)
+        {
+            keys[count++] = key;
+            continue;
+        }
+        // Too many files: keep the oldest ones, the caller carries on from there
+        int newest = 0;
+        for (int i = 1; i < count; i++)
+        {
+            if (keys[i] > keys[newest])
+            {
+                newest = i;
+            }
+        }
+        if (key < keys[newest])
+        {
+            keys[newest] = key;
+        }
+    }
+    closedir(dir);
+    qsort(keys, count, sizeof(keys[0]), key_compare);
+    return count;
+}
+
+static uint32_t series_newest(const archive_series_t *s)
+{
+    char path[ARCHIVE_PATH_MAX + 16];
+    struct dirent *entry;
+    uint32_t newest = 0;
+    DIR *dir;
+
+    snprintf(path, sizeof(path), "%s/%s", archive_root, s->dir);
+    dir = opendir(path);
+    if (dir == NULL)
+    {
+        return 0;
+    }
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char *end;
+        unsigned long key = strtoul(entry->d_name, &end, 10);
+
+        if (end != entry->d_name && strcasecmp(end, ".BLK") == 0 && key > newest)
+        {
+            newest = key;
+        }
+    }
+    closedir(dir);
+    return newest;
+}
+
+static int64_t series_last_time(archive_series_t *s)
+{
+    if (s->builder.rows)
+    {
+        return s->builder.times[s->builder.rows - 1];
+    }
+    if (s->file != NULL && s->slot > 0
+        && fseek(s->file, (s->slot - 1) * ARCHIVE_BLOCK_SIZE, SEEK_SET) == 0
+        && fread(read_block, ARCHIVE_BLOCK_SIZE, 1, s->file) == 1
+        && block_check(read_block, s->level))
+    {
+        return (int64_t)get_u64(read_block + HDR_T_LAST);
+    }
+    return -1;
+}
+
+int archive_open(const char *root, uint32_t checkpoint_rows)
+{
+    char path[ARCHIVE_PATH_MAX + 16];
+
+    if (strlen(root) >= sizeof(archive_root))
+    {
+        return -1;
+    }
+    strcpy(archive_root, root);
+    archive_checkpoint_rows = checkpoint_rows;
+    memset(&write_stats, 0, sizeof(write_stats));
+    compact_cursor_ms = -1;
+
+    mkdir(archive_root, 0775);
+    for (int level = 0; level < ARCHIVE_LEVEL_COUNT; level++)
+    {
+        archive_series_t *s = &series[level];
+        uint32_t newest;
+
+        snprintf(path, sizeof(path), "%s/%s", archive_root, s->dir);
+        mkdir(path, 0775);
+
+        // Carry on in the newest file, so a partly written block is resumed
+        builder_reset(&s->builder);
+        s->file = NULL;
+        s->key = 0;
+        newest = series_newest(s);
+        if (newest != 0 && series_switch(s, newest) != 0)
+        {
+            return -1;
+        }
+        s->last_ms = series_last_time(s);
+    }
+
+    // Compaction resumes after the last hour rolled up
+    if (series[ARCHIVE_LEVEL_HOURLY].last_ms >= 0)
+    {
+        compact_cursor_ms = series[ARCHIVE_LEVEL_HOURLY].last_ms + ARCHIVE_HOUR_MS;
+    }
+    return 0;
+}
+
+int archive_flush(void)
+{
+    int ret = 0;
+
+    for (int level = 0; level < ARCHIVE_LEVEL_COUNT; level++)
+    {
+        archive_series_t *s = &series[level];
+
+        if (s->builder.rows > s->checkpointed && series_write(s, false) != 0)
+        {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+
+void archive_close(void)
+{
+    archive_flush();
+    for (int level = 0; level < ARCHIVE_LEVEL_COUNT; level++)
+    {
+        if (series[level].file != NULL)
+        {
+            fclose(series[level].file);
+            series[level].file = NULL;
+        }
+        series[level].key = 0;
+        series[level].last_ms = -1;
+        builder_reset(&series[level].builder);
+    }
+}
+
+int archive_append(int64_t time_ms, uint32_t valid, const float *value)
+{
+    if (series_append(&series[ARCHIVE_LEVEL_RAW], time_ms, valid, value) != 0)
+    {
+        return -1;
+    }
+    write_stats.rows++;
+    write_stats.logical_bytes += sizeof(int64_t) + sizeof(uint32_t) + SENSOR_CH_COUNT * sizeof(float);
+    return 0;
+}
+
+/* Compaction */
+
+typedef struct {
+    int64_t hour;
+    uint32_t valid;
+    uint32_t count[SENSOR_CH_COUNT];
+    double sum[SENSOR_CH_COUNT];
+    float min[SENSOR_CH_COUNT];
+    float max[SENSOR_CH_COUNT];
+    int produced;
+    bool failed;
+} rollup_t;
+
+static void rollup_emit(rollup_t *r)
+{
+    float row[ARCHIVE_MAX_COLUMNS];
+
+    if (r->valid == 0)
+    {
+        return;
+    }
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        row[ch] = r->count[ch] ? (float)(r->sum[ch] / r->count[ch]) : 0.0f;
+        row[SENSOR_CH_COUNT + ch] = r->min[ch];
+        row[2 * SENSOR_CH_COUNT + ch] = r->max[ch];
+    }
+    if (series_append(&series[ARCHIVE_LEVEL_HOURLY], r->hour, r->valid, row) != 0)
+    {
+        r->failed = true;
+        return;
+    }
+    r->produced++;
+    write_stats.rollups++;
+}
+
+static bool rollup_add(const archive_point_t *point, void *arg)
+{
+    rollup_t *r = arg;
+    int64_t hour = point->time_ms - point->time_ms % ARCHIVE_HOUR_MS;
+
+    if (hour != r->hour)
+    {
+        rollup_emit(r);
+        memset(r->count, 0, sizeof(r->count));
+        memset(r->sum, 0, sizeof(r->sum));
+        r->valid = 0;
+        r->hour = hour;
+    }
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (!(point->valid & SENSOR_CH_BIT(ch)))
+        {
+            continue;
+        }
+        float v = point->value[ch];
+
+        if (r->count[ch] == 0 || v < r->min[ch])
+        {
+            r->min[ch] = v;
+        }
+        if (r->count[ch] == 0 || v > r->max[ch])
+        {
+            r->max[ch] = v;
+        }
+        r->sum[ch] += v;
+        r->count[ch]++;
+        r->valid |= SENSOR_CH_BIT(ch);
+    }
+    return !r->failed;
+}
+
+static void raw_retention(int64_t now_ms, uint32_t days)
+{
+    static uint32_t keys[ARCHIVE_MAX_FILES];
+    archive_series_t *s = &series[ARCHIVE_LEVEL_RAW];
+    char path[ARCHIVE_PATH_MAX + 32];
+    int64_t keep_from = now_ms - (int64_t)days * ARCHIVE_DAY_MS;
+    int count;
+
+    // Never drop raw data that has not been rolled up yet
+    if (keep_from > compact_cursor_ms)
+    {
+        keep_from = compact_cursor_ms;
+    }
+    if (keep_from < ARCHIVE_DAY_MS)
+    {
+        return;
+    }
+    // Files strictly before the day of keep_from are complete and old enough
+    count = series_list(s, 0, series_key(ARCHIVE_LEVEL_RAW, keep_from) - 1, keys, ARCHIVE_MAX_FILES);
+    for (int i = 0; i < count; i++)
+    {
+        if (keys[i] == s->key)
+        {
+            continue;
+        }
+        series_path(s, keys[i], path, sizeof(path));
+        remove(path);
+    }
+}
+
+int archive_compact(int64_t now_ms, uint32_t raw_retention_days)
+{
+    static rollup_t rollup;
+    int64_t end = now_ms - now_ms % ARCHIVE_HOUR_MS;
+    int64_t start = compact_cursor_ms >= 0 ? compact_cursor_ms : 0;
+
+    if (start >= end)
+    {
+        return 0;
+    }
+    memset(&rollup, 0, sizeof(rollup));
+    rollup.hour = -1;
+    if (archive_query(ARCHIVE_LEVEL_RAW, start, end - 1, UINT32_MAX, NULL, rollup_add, &rollup, NULL) < 0)
+    {
+        return -1;
+    }
+    rollup_emit(&rollup);
+    if (rollup.failed)
+    {
+        return -1;
+    }
+    compact_cursor_ms = end;
+    // Rollups are written out right away: raw files are only deleted once they are on the card
+    archive_series_t *hourly = &series[ARCHIVE_LEVEL_HOURLY];
+    if (hourly->builder.rows > hourly->checkpointed && series_write(hourly, false) != 0)
+    {
+        return -1;
+    }
+    if (raw_retention_days)
+    {
+        raw_retention(now_ms, raw_retention_days);
+    }
+    return rollup.produced;
+}
+
+/* Queries */
+
+typedef struct {
+    archive_level_t level;
+    int64_t from;
+    int64_t to;
+    uint32_t channels;
+    const archive_filter_t *filter;
+    archive_query_cb_t cb;
+    void *arg;
+    archive_query_stats_t stats;
+    bool stopped;
+} query_t;
+
+static bool filter_match(const archive_filter_t *filter, float min, float max)
+{
+    return max >= filter->min && min <= filter->max;
+}
+
+/**
+ * @brief Hand one row over to the callback
+ *
+ * @param value column major row values, stride apart
+ */
+static void query_emit(query_t *q, int64_t t, uint32_t mask, const float *values, int stride, int row)
+{
+    archive_point_t point;
+    int ncols = q->level == ARCHIVE_LEVEL_RAW ? SENSOR_CH_COUNT : ARCHIVE_MAX_COLUMNS;
+
+    if (t < q->from || t > q->to || !(mask & q->channels))
+    {
+        return;
+    }
+    point.time_ms = t;
+    point.valid = mask & q->channels;
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (!(point.valid & SENSOR_CH_BIT(ch)))
+        {
+            point.value[ch] = point.min[ch] = point.max[ch] = 0.0f;
+            continue;
+        }
+        point.value[ch] = values[ch * stride + row];
+        point.min[ch] = ncols > SENSOR_CH_COUNT ? values[(SENSOR_CH_COUNT + ch) * stride + row] : point.value[ch];
+        point.max[ch] = ncols > SENSOR_CH_COUNT ? values[(2 * SENSOR_CH_COUNT + ch) * stride + row] : point.value[ch];
+    }
+    if (q->filter != NULL)
+    {
+        int ch = q->filter->channel;
+
+        if (!(point.valid & SENSOR_CH_BIT(ch)) || !filter_match(q->filter, point.min[ch], point.max[ch]))
+        {
+            return;
+        }
+    }
+    q->stats.points++;
+    if (!q->cb(&point, q->arg))
+    {
+        q->stopped = true;
+    }
+}
+
+/**
+ * @brief Decide from the header alone whether a block can hold matching rows
+ */
+static bool block_wanted(const query_t *q, const uint8_t *block)
+{
+    int ncols = block[HDR_NCOLS];
+
+    if ((int64_t)get_u64(block + HDR_T_LAST) < q->from || (int64_t)get_u64(block + HDR_T_FIRST) > q->to)
+    {
+        return false;
+    }
+    if (!(get_u32(block + HDR_VALID) & q->channels))
+    {
+        return false;
+    }
+    if (q->filter != NULL)
+    {
+        int ch = q->filter->channel;
+        // The min column of a rollup holds the smallest values, its max column the largest
+        int min_col = ncols > SENSOR_CH_COUNT ? SENSOR_CH_COUNT + ch : ch;
+        int max_col = ncols > SENSOR_CH_COUNT ? 2 * SENSOR_CH_COUNT + ch : ch;
+
+        if (!(get_u32(block + HDR_VALID) & SENSOR_CH_BIT(ch)))
+        {
+            return false;
+        }
+        if (!filter_match(q->filter, get_float(block + minmax_offset(ncols) + 8 * min_col),
+                          get_float(block + minmax_offset(ncols) + 8 * max_col + 4)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Room for the values of either kind of block
+#define QUERY_VALUES (SENSOR_CH_COUNT * ARCHIVE_RAW_ROWS > ARCHIVE_MAX_COLUMNS * ARCHIVE_ROLLUP_ROWS ? \
+                      SENSOR_CH_COUNT * ARCHIVE_RAW_ROWS : ARCHIVE_MAX_COLUMNS * ARCHIVE_ROLLUP_ROWS)
+
+static void query_block(query_t *q, const uint8_t *block)
+{
+    static int64_t times[ARCHIVE_RAW_ROWS];
+    static uint32_t masks[ARCHIVE_RAW_ROWS];
+    static float values[QUERY_VALUES];
+    int ncols = block[HDR_NCOLS];
+    int rows = get_u16(block + HDR_ROWS);
+    int stride = ncols > SENSOR_CH_COUNT ? ARCHIVE_ROLLUP_ROWS : ARCHIVE_RAW_ROWS;
+
+    if (rows > stride || ncols > ARCHIVE_MAX_COLUMNS)
+    {
+        return;
+    }
+    block_times(block, times);
+    block_masks(block, masks);
+    // Only the columns of the wanted channels are decoded
+    for (int c = 0; c < ncols; c++)
+    {
+        if (q->channels & SENSOR_CH_BIT(column_channel(c)))
+        {
+            block_values(block, c, &values[c * stride]);
+        }
+    }
+    for (int i = 0; i < rows && !q->stopped; i++)
+    {
+        query_emit(q, times[i], masks[i], values, stride, i);
+    }
+}
+
+static int query_file(query_t *q, archive_series_t *s, uint32_t key)
+{
+    char path[ARCHIVE_PATH_MAX + 32];
+    bool open_file = key == s->key && s->file != NULL;
+    FILE *f;
+    long blocks, lo, hi;
+    size_t header = header_size(s->builder.ncols);
+
+    if (open_file)
+    {
+        // Blocks from the open slot on are served from RAM
+        f = s->file;
+        blocks = s->slot;
+    }
+    else
+    {
+        series_path(s, key, path, sizeof(path));
+        f = fopen(path, "rb");
+        if (f == NULL)
+        {
+            return 0;
+        }
+        blocks = file_blocks(f);
+    }
+    q->stats.files++;
+
+    // Binary search for the first block ending at or after the start of the range
+    lo = 0;
+    hi = blocks;
+    while (lo < hi)
+    {
+        long mid = (lo + hi) / 2;
+
+        if (fseek(f, mid * ARCHIVE_BLOCK_SIZE, SEEK_SET) != 0 || fread(read_block, HDR_FIXED, 1, f) != 1)
+        {
+            break;
+        }
+        q->stats.bytes_read += HDR_FIXED;
+        if ((int64_t)get_u64(read_block + HDR_T_LAST) < q->from)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    for (long i = lo; i < blocks && !q->stopped; i++)
+    {
+        if (fseek(f, i * ARCHIVE_BLOCK_SIZE, SEEK_SET) != 0 || fread(read_block, header, 1, f) != 1)
+        {
+            break;
+        }
+        q->stats.bytes_read += header;
+        if ((int64_t)get_u64(read_block + HDR_T_FIRST) > q->to)
+        {
+            break;
+        }
+        if (!block_wanted(q, read_block))
+        {
+            q->stats.blocks_skipped++;
+            continue;
+        }
+        if (fread(read_block + header, ARCHIVE_BLOCK_SIZE - header, 1, f) != 1)
+        {
+            break;
+        }
+        q->stats.bytes_read += ARCHIVE_BLOCK_SIZE - header;
+        if (!block_check(read_block, s->level))
+        {
+            q->stats.blocks_skipped++;
+            continue;
+        }
+        q->stats.blocks_read++;
+        query_block(q, read_block);
+    }
+
+    if (!open_file)
+    {
+        fclose(f);
+    }
+    else
+    {
+        const block_builder_t *b = &s->builder;
+
+        for (int i = 0; i < b->rows && !q->stopped; i++)
+        {
+            query_emit(q, b->times[i], b->masks[i], b->values, b->cap_rows, i);
+        }
+    }
+    return 0;
+}
+
+int archive_query(archive_level_t level, int64_t from_ms, int64_t to_ms, uint32_t channels,
+                  const archive_filter_t *filter, archive_query_cb_t cb, void *arg,
+                  archive_query_stats_t *stats)
+{
+    static uint32_t keys[ARCHIVE_MAX_FILES];
+    static query_t q;
+    archive_series_t *s;
+    int count;
+
+    if (level >= ARCHIVE_LEVEL_COUNT || archive_root[0] == '\0')
+    {
+        return -1;
+    }
+    s = &series[level];
+    memset(&q, 0, sizeof(q));
+    q.level = level;
+    q.from = from_ms;
+    q.to = to_ms;
+    q.channels = channels;
+    q.filter = filter;
+    q.cb = cb;
+    q.arg = arg;
+
+    count = series_list(s, series_key(level, from_ms < 0 ? 0 : from_ms), series_key(level, to_ms), keys, ARCHIVE_MAX_FILES);
+    for (int i = 0; i < count && !q.stopped; i++)
+    {
+        query_file(&q, s, keys[i]);
+    }
+    if (stats != NULL)
+    {
+        *stats = q.stats;
+    }
+    return q.stats.points;
+}
+
+void archive_get_write_stats(archive_write_stats_t *stats)
+{
+    *stats = write_stats;
+}
+
+size_t archive_static_size(void)
+{
+    // File scope buffers plus the static scratch of the decode, file name, file list and query code
+    return sizeof(raw_times) + sizeof(raw_masks) + sizeof(raw_values) +
+           sizeof(rollup_times) + sizeof(rollup_masks) + sizeof(rollup_values) +
+           sizeof(archive_root) + sizeof(series) + sizeof(write_block) + sizeof(read_block) +
+           2 * ARCHIVE_RAW_ROWS * (sizeof(int64_t) + sizeof(uint32_t)) + QUERY_VALUES * sizeof(float) +
+           (ARCHIVE_PATH_MAX + 16) + 2 * ARCHIVE_MAX_FILES * sizeof(uint32_t);
+}
+
+#endif
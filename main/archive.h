@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sensors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Size of an archive block: four 512 byte sectors. Blocks are always written whole.
+ *
+ * Each block holds a time ordered run of rows stored column by column: delta-of-delta encoded
+ * timestamps, the valid channel masks, then one Gorilla style XOR compressed float column per value.
+ * The header carries the time range, the channels present, the min/max of every column and the
+ * offset of every column, so a query can skip a block from its header alone and decode only the
+ * columns it needs.
+ *
+ * Raw rows go to one file per UTC day (raw/YYYYMMDD.BLK), hourly rollups (mean, min and max of
+ * every channel) to one file per UTC month (hourly/YYYYMM.BLK). The block being filled is kept in
+ * RAM and rewritten in place as a checkpoint every few rows, so at most a checkpoint interval is
+ * lost on a reset; it is picked up again by archive_open().
+ */
+#define ARCHIVE_BLOCK_SIZE (2048)
+
+/**
+ * @brief Maximum rows in a raw block and in a rollup block
+ */
+#define ARCHIVE_RAW_ROWS (128)
+#define ARCHIVE_ROLLUP_ROWS (48)
+
+typedef enum {
+    ARCHIVE_LEVEL_RAW = 0,              /*!< One row per archived window */
+    ARCHIVE_LEVEL_HOURLY,               /*!< One row per hour: mean, min and max of each channel */
+    ARCHIVE_LEVEL_COUNT
+} archive_level_t;
+
+/**
+ * @brief A row returned by a query
+ */
+typedef struct {
+    int64_t time_ms;                    /*!< Unix time in milliseconds, start of the hour for rollups */
+    uint32_t valid;                     /*!< SENSOR_CH_BIT mask of the channels present */
+    float value[SENSOR_CH_COUNT];       /*!< Raw value, or hourly mean */
+    float min[SENSOR_CH_COUNT];         /*!< Hourly min, equal to value for raw rows */
+    float max[SENSOR_CH_COUNT];         /*!< Hourly max, equal to value for raw rows */
+} archive_point_t;
+
+/**
+ * @brief Optional value filter of a query. Blocks whose min/max index for the channel cannot match
+ * are skipped without being decoded, and only rows with the channel in range are returned.
+ */
+typedef struct {
+    sensor_channel_t channel;
+    float min;
+    float max;
+} archive_filter_t;
+
+/**
+ * @brief Query callback
+ *
+ * @return false to stop the query
+ */
+typedef bool (*archive_query_cb_t)(const archive_point_t *point, void *arg);
+
+typedef struct {
+    uint32_t files;                     /*!< Files opened */
+    uint32_t blocks_read;               /*!< Blocks read and decoded */
+    uint32_t blocks_skipped;            /*!< Blocks skipped on their header */
+    uint32_t points;                    /*!< Rows returned */
+    uint64_t bytes_read;                /*!< Bytes read from the card */
+} archive_query_stats_t;
+
+typedef struct {
+    uint64_t rows;                      /*!< Raw rows appended */
+    uint64_t logical_bytes;             /*!< Uncompressed size of the appended rows */
+    uint64_t device_bytes;              /*!< Bytes written to the card, checkpoints and rollups included */
+    uint32_t blocks_sealed;             /*!< Full blocks written */
+    uint32_t checkpoints;               /*!< Partial block rewrites */
+    uint32_t rollups;                   /*!< Hourly rows produced by compaction */
+} archive_write_stats_t;
+
+/**
+ * @brief Open the archive under a directory, creating it if needed, and resume any partially
+ * written blocks.
+ *
+ * @param root archive directory, e.g. /sdcard/archive
+ * @param checkpoint_rows rewrite the open block after this many new rows, 0 to write full blocks only
+ * @return 0 on success, -1 on error
+ */
+int archive_open(const char *root, uint32_t checkpoint_rows);
+
+/**
+ * @brief Write out the open blocks and close the archive
+ */
+void archive_close(void);
+
+/**
+ * @brief Append a raw row. Rows must be appended in time order; older rows are rejected.
+ *
+ * @param time_ms Unix time in milliseconds
+ * @param valid SENSOR_CH_BIT mask of the channels present
+ * @param value values, indexed by channel
+ * @return 0 on success, -1 on error or if the row is out of order
+ */
+int archive_append(int64_t time_ms, uint32_t valid, const float *value);
+
+/**
+ * @brief Checkpoint the open blocks now
+ *
+ * @return 0 on success, -1 on error
+ */
+int archive_flush(void);
+
+/**
+ * @brief Roll up every complete hour not rolled up yet, then delete raw files that are older than
+ * the retention and already rolled up.
+ *
+ * @param now_ms current Unix time in milliseconds
+ * @param raw_retention_days raw files to keep, 0 to keep them all
+ * @return number of hourly rows produced, -1 on error
+ */
+int archive_compact(int64_t now_ms, uint32_t raw_retention_days);
+
+/**
+ * @brief Return the rows of a level in a time range, in time order. Only the files and blocks
+ * overlapping the range are read, and only the columns of the requested channels are decoded.
+ *
+ * @param level raw rows or hourly rollups
+ * @param from_ms start of the range, inclusive
+ * @param to_ms end of the range, inclusive
+ * @param channels SENSOR_CH_BIT mask of the channels wanted, rows without any of them are skipped
+ * @param filter optional value filter, NULL for none
+ * @param cb called for each row
+ * @param arg passed to cb
+ * @param stats optional, filled in with the work done
+ * @return number of rows returned, -1 on error
+ */
+int archive_query(archive_level_t level, int64_t from_ms, int64_t to_ms, uint32_t channels,
+                  const archive_filter_t *filter, archive_query_cb_t cb, void *arg,
+                  archive_query_stats_t *stats);
+
+/**
+ * @brief Write statistics since archive_open()
+ */
+void archive_get_write_stats(archive_write_stats_t *stats);
+
+/**
+ * @brief Bytes of static storage used by the archive: block buffers, row builders and file names
+ */
+size_t archive_static_size(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,162 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_ARCHIVE_ENABLE
+
+#include <sys/time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "archiver.h"
+#include "archive.h"
+#include "sdcard.h"
+#include "timesync.h"
+#include "mem_budget.h"
+
+static const char *TAG = "ARCHIVER";
+
+#define ARCHIVER_TASK_STACK_SIZE (4096)
+#define ARCHIVER_TASK_PRIORITY (3)
+#define ARCHIVER_HOUR_MS (3600000LL)
+// Windows of an hour can still be queued just after it ends; roll it up a little later
+#define ARCHIVER_COMPACT_DELAY_MS (5 * 60 * 1000LL)
+
+static QueueHandle_t archive_queue = NULL;
+// The archive code shares its block buffers between writing and reading
+static SemaphoreHandle_t archive_lock = NULL;
+
+static StaticSemaphore_t archive_lock_buf;
+static StaticQueue_t archive_queue_buf;
+static uint8_t archive_queue_storage[CONFIG_ARCHIVE_QUEUE_LENGTH * sizeof(sensor_window_t)];
+static StaticTask_t archiver_tcb;
+static StackType_t archiver_stack[ARCHIVER_TASK_STACK_SIZE];
+
+static int64_t archiver_now_ms(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static void archiver_append(const sensor_window_t *window)
+{
+    float value[SENSOR_CH_COUNT];
+    int64_t unix_us;
+    int ret;
+
+    if (!timesync_to_unix_us(window->last_us, &unix_us))
+    {
+        return;
+    }
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        value[ch] = (window->valid & SENSOR_CH_BIT(ch)) ? (float)window->stats[ch].mean : 0.0f;
+    }
+    xSemaphoreTake(archive_lock, portMAX_DELAY);
+    ret = archive_append(unix_us / 1000, window->valid, value);
+    xSemaphoreGive(archive_lock);
+    if (ret != 0)
+    {
+        ESP_LOGW(TAG, "Could not archive window %u", window->seq);
+    }
+}
+
+static void archiver_task(void *param)
+{
+    sensor_window_t window;
+    int64_t next_compact = 0;
+    int rollups;
+
+    // Rolling over to a new series file and reading one back for compaction opens files on the card:
+    // newlib and the FAT layer allocate the FILE and its buffers, so the task is not guarded
+    for (;;)
+    {
+        // The archive is indexed by Unix time: leave the windows queued until the clock is set
+        if (!timesync_synced())
+        {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            continue;
+        }
+        if (xQueueReceive(archive_queue, &window, pdMS_TO_TICKS(CONFIG_PUBLISH_INTERVAL_MS)) == pdTRUE)
+        {
+            archiver_append(&window);
+        }
+
+        int64_t now = archiver_now_ms();
+        if (next_compact == 0)
+        {
+            // First pass after the clock was set: the windows held back until now go in before any
+            // hour they belong to is rolled up
+            next_compact = now + ARCHIVER_COMPACT_DELAY_MS;
+        }
+        if (now >= next_compact && uxQueueMessagesWaiting(archive_queue) == 0)
+        {
+            xSemaphoreTake(archive_lock, portMAX_DELAY);
+            rollups = archive_compact(now - ARCHIVER_COMPACT_DELAY_MS, CONFIG_ARCHIVE_RAW_RETENTION_DAYS);
+            xSemaphoreGive(archive_lock);
+            if (rollups < 0)
+            {
+                ESP_LOGW(TAG, "Compaction failed");
+            }
+            else if (rollups > 0)
+            {
+                ESP_LOGI(TAG, "Rolled up %d hours", rollups);
+            }
+            next_compact = now - now % ARCHIVER_HOUR_MS + ARCHIVER_HOUR_MS + ARCHIVER_COMPACT_DELAY_MS;
+        }
+    }
+}
+
+esp_err_t archiver_start(void)
+{
+    esp_err_t ret = sdcard_mount();
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    if (archive_open(CONFIG_ARCHIVE_ROOT, CONFIG_ARCHIVE_CHECKPOINT_ROWS) != 0)
+    {
+        ESP_LOGE(TAG, "Could not open the archive in %s", CONFIG_ARCHIVE_ROOT);
+        return ESP_FAIL;
+    }
+    archive_lock = xSemaphoreCreateMutexStatic(&archive_lock_buf);
+    archive_queue = xQueueCreateStatic(CONFIG_ARCHIVE_QUEUE_LENGTH, sizeof(sensor_window_t), archive_queue_storage,
+                                       &archive_queue_buf);
+    mem_budget_add("archiver", archive_static_size() + sizeof(archive_queue_storage) + sizeof(archive_queue_buf) +
+                   sizeof(archive_lock_buf) +
+                   sizeof(archiver_tcb) + sizeof(archiver_stack), 0);
+    xTaskCreateStatic(archiver_task, "archiver", ARCHIVER_TASK_STACK_SIZE, NULL, ARCHIVER_TASK_PRIORITY, archiver_stack,
+                      &archiver_tcb);
+    ESP_LOGI(TAG, "Archiving to %s", CONFIG_ARCHIVE_ROOT);
+    return ESP_OK;
+}
+
+void archiver_submit(const sensor_window_t *window)
+{
+    if (archive_queue != NULL && xQueueSend(archive_queue, window, 0) != pdTRUE)
+    {
+        ESP_LOGW(TAG, "Archive queue full, window %u not archived", window->seq);
+    }
+}
+
+int archiver_query(archive_level_t level, int64_t from_ms, int64_t to_ms, uint32_t channels,
+                   const archive_filter_t *filter, archive_query_cb_t cb, void *arg,
+                   archive_query_stats_t *stats)
+{
+    int ret;
+
+    if (archive_lock == NULL)
+    {
+        return -1;
+    }
+    xSemaphoreTake(archive_lock, portMAX_DELAY);
+    ret = archive_query(level, from_ms, to_ms, channels, filter, cb, arg, stats);
+    xSemaphoreGive(archive_lock);
+    return ret;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "esp_err.h"
+#include "sampler.h"
+#include "archive.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Mount the SD card, open the archive under CONFIG_ARCHIVE_ROOT and start the archiver task.
+ * The task appends the mean of every window to the archive and rolls complete hours up into the
+ * hourly series. Windows are held until the clock is synchronised, as the archive is indexed by
+ * Unix time.
+ *
+ * @return ESP_OK if the archive is open and the task is running
+ */
+esp_err_t archiver_start(void);
+
+/**
+ * @brief Queue a closed window for the archive. Never blocks: if the card is behind, the window
+ * is dropped from the archive (it is still published).
+ *
+ * @param window closed window
+ */
+void archiver_submit(const sensor_window_t *window);
+
+/**
+ * @brief archive_query() for other tasks. The archiver task is held off while the query runs, so
+ * keep queries short, e.g. by stopping from the callback; windows queue up meanwhile.
+ *
+ * @return number of rows returned, -1 on error or if the archive is not open
+ */
+int archiver_query(archive_level_t level, int64_t from_ms, int64_t to_ms, uint32_t channels,
+                   const archive_filter_t *filter, archive_query_cb_t cb, void *arg,
+                   archive_query_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
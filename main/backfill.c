@@ -0,0 +1,391 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_BACKFILL_ENABLE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "backfill.h"
+#include "telemetry.h"
+
+// Longest message from the backend: a request naming every field
+#define BACKFILL_MESSAGE_MAX (512)
+#define CHUNK_TRAILER "], \"more\": false}"
+
+/*
+ * Messages from the backend. They are small and flat, so a key is found by its quoted name and the
+ * value read from after the colon.
+ */
+
+static const char *json_value(const char *json, const char *key)
+{
+    char quoted[16];
+    const char *p = json;
+    size_t len = snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+
+    while ((p = strstr(p, quoted)) != NULL)
+    {
+        p += len;
+        while (isspace((unsigned char)*p))
+        {
+            p++;
+        }
+        if (*p == ':')
+        {
+            p++;
+            while (isspace((unsigned char)*p))
+            {
+                p++;
+            }
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static bool json_int(const char *json, const char *key, int64_t *value)
+{
+    const char *p = json_value(json, key);
+    char *end;
+
+    if (p == NULL)
+    {
+        return false;
+    }
+    *value = strtoll(p, &end, 10);
+    return end != p;
+}
+
+/**
+ * @brief Read the string value at p into buf
+ *
+ * @return pointer past the closing quote, NULL if p is not a string or it does not fit
+ */
+static const char *json_string(const char *p, char *buf, size_t len)
+{
+    const char *end;
+
+    if (*p != '"' || (end = strchr(p + 1, '"')) == NULL || (size_t)(end - p - 1) >= len)
+    {
+        return NULL;
+    }
+    memcpy(buf, p + 1, end - p - 1);
+    buf[end - p - 1] = 0;
+    return end + 1;
+}
+
+static int channel_by_name(const char *name)
+{
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (strcmp(telemetry_channel_name(ch), name) == 0)
+        {
+            return ch;
+        }
+    }
+    return -1;
+}
+
+static int parse_fields(const char *p, uint32_t *channels)
+{
+    char name[32];
+    int ch;
+
+    if (*p++ != '[')
+    {
+        return -1;
+    }
+    *channels = 0;
+    for (;;)
+    {
+        while (isspace((unsigned char)*p) || *p == ',')
+        {
+            p++;
+        }
+        if (*p == ']')
+        {
+            return *channels ? 0 : -1;
+        }
+        if ((p = json_string(p, name, sizeof(name))) == NULL || (ch = channel_by_name(name)) < 0)
+        {
+            return -1;
+        }
+        *channels |= SENSOR_CH_BIT(ch);
+    }
+}
+
+int backfill_parse(const char *buf, size_t len, backfill_msg_t *msg)
+{
+    char json[BACKFILL_MESSAGE_MAX];
+    char level[16];
+    const char *p;
+    int64_t value;
+
+    if (len >= sizeof(json))
+    {
+        return -1;
+    }
+    memcpy(json, buf, len);
+    json[len] = 0;
+    memset(msg, 0, sizeof(backfill_msg_t));
+
+    if (!json_int(json, "id", &value) || value < 0 || value > UINT32_MAX)
+    {
+        return -1;
+    }
+    msg->id = value;
+
+    if ((p = json_value(json, "cancel")) != NULL)
+    {
+        msg->type = BACKFILL_MSG_CANCEL;
+        return strncmp(p, "true", 4) == 0 ? 0 : -1;
+    }
+    if (json_int(json, "ack", &value))
+    {
+        msg->type = BACKFILL_MSG_ACK;
+        msg->ack = value;
+        return value >= 0 && value <= UINT32_MAX ? 0 : -1;
+    }
+
+    msg->type = BACKFILL_MSG_REQUEST;
+    if (!json_int(json, "from", &msg->from_ms) || !json_int(json, "to", &msg->to_ms) || msg->to_ms < msg->from_ms)
+    {
+        return -1;
+    }
+    msg->channels = (1 << SENSOR_CH_COUNT) - 1;
+    if ((p = json_value(json, "fields")) != NULL && parse_fields(p, &msg->channels) != 0)
+    {
+        return -1;
+    }
+    msg->level = ARCHIVE_LEVEL_RAW;
+    if ((p = json_value(json, "level")) != NULL)
+    {
+        if (json_string(p, level, sizeof(level)) == NULL)
+        {
+            return -1;
+        }
+        if (strcmp(level, "hourly") == 0)
+        {
+            msg->level = ARCHIVE_LEVEL_HOURLY;
+        }
+        else if (strcmp(level, "raw") != 0)
+        {
+            return -1;
+        }
+    }
+    if (json_int(json, "window", &value))
+    {
+        msg->window = value < 1 ? 1 : (value > BACKFILL_WINDOW_MAX ? BACKFILL_WINDOW_MAX : value);
+    }
+    return 0;
+}
+
+/*
+ * Session
+ */
+
+void backfill_init(backfill_session_t *session, uint32_t ack_timeout_ms)
+{
+    memset(session, 0, sizeof(backfill_session_t));
+    session->ack_timeout_us = (int64_t)ack_timeout_ms * 1000;
+}
+
+void backfill_handle(backfill_session_t *session, const backfill_msg_t *msg, uint32_t default_window)
+{
+    switch (msg->type)
+    {
+    case BACKFILL_MSG_REQUEST:
+        if (session->active)
+        {
+            session->stats.cancelled++;
+        }
+        session->active = true;
+        session->id = msg->id;
+        session->level = msg->level;
+        session->channels = msg->channels;
+        session->cursor_ms = msg->from_ms;
+        session->to_ms = msg->to_ms;
+        session->window = msg->window ? msg->window : default_window;
+        if (session->window < 1 || session->window > BACKFILL_WINDOW_MAX)
+        {
+            session->window = session->window < 1 ? 1 : BACKFILL_WINDOW_MAX;
+        }
+        session->next_seq = 0;
+        session->acked = 0;
+        session->stalled_us = 0;
+        session->stats.queries++;
+        break;
+
+    case BACKFILL_MSG_ACK:
+        // Acks are cumulative; a late or repeated one changes nothing
+        if (session->active && msg->id == session->id && msg->ack < session->next_seq && msg->ack >= session->acked)
+        {
+            session->acked = msg->ack + 1;
+        }
+        break;
+
+    case BACKFILL_MSG_CANCEL:
+        if (session->active && msg->id == session->id)
+        {
+            session->active = false;
+            session->stats.cancelled++;
+        }
+        break;
+    }
+}
+
+bool backfill_ready(backfill_session_t *session, int64_t now_us)
+{
+    if (!session->active)
+    {
+        return false;
+    }
+    if (session->next_seq - session->acked < session->window)
+    {
+        session->stalled_us = 0;
+        return true;
+    }
+    if (session->stalled_us == 0)
+    {
+        session->stalled_us = now_us;
+    }
+    else if (now_us - session->stalled_us >= session->ack_timeout_us)
+    {
+        session->active = false;
+        session->stats.timeouts++;
+    }
+    return false;
+}
+
+/*
+ * Chunks
+ */
+
+typedef struct {
+    char *buf;
+    size_t limit;                       // Buffer size less the room kept for the trailer
+    int pos;
+    archive_level_t level;
+    uint32_t channels;
+    uint32_t rows;
+    int64_t last_ms;
+    bool full;
+} chunk_t;
+
+static int chunk_append(char *buf, size_t len, int pos, const char *fmt, ...)
+{
+    va_list args;
+    int written;
+
+    if (pos < 0 || (size_t)pos >= len)
+    {
+        return -1;
+    }
+    va_start(args, fmt);
+    written = vsnprintf(buf + pos, len - pos, fmt, args);
+    va_end(args);
+    return (written < 0 || (size_t)(pos + written) >= len) ? -1 : pos + written;
+}
+
+/**
+ * @brief Query callback: append a row, or stop the query once the chunk is full
+ */
+static bool chunk_row(const archive_point_t *point, void *arg)
+{
+    chunk_t *c = arg;
+    int pos = chunk_append(c->buf, c->limit, c->pos, "%s[%lld", c->rows ? ", " : "", (long long)point->time_ms);
+
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (!(c->channels & SENSOR_CH_BIT(ch)))
+        {
+            continue;
+        }
+        if (!(point->valid & SENSOR_CH_BIT(ch)))
+        {
+            pos = chunk_append(c->buf, c->limit, pos, ", null");
+        }
+        else if (c->level == ARCHIVE_LEVEL_HOURLY)
+        {
+            pos = chunk_append(c->buf, c->limit, pos, ", [%.6g, %.6g, %.6g]", point->value[ch], point->min[ch],
+                               point->max[ch]);
+        }
+        else
+        {
+            pos = chunk_append(c->buf, c->limit, pos, ", %.6g", point->value[ch]);
+        }
+    }
+    pos = chunk_append(c->buf, c->limit, pos, "]");
+    if (pos < 0)
+    {
+        // Left out, it starts the next chunk
+        c->full = true;
+        return false;
+    }
+    c->pos = pos;
+    c->rows++;
+    c->last_ms = point->time_ms;
+    return true;
+}
+
+int backfill_next_chunk(backfill_session_t *session, backfill_query_t query, char *buf, size_t len)
+{
+    chunk_t c = {
+        .buf = buf,
+        .limit = len - sizeof(CHUNK_TRAILER),
+        .level = session->level,
+        .channels = session->channels,
+    };
+    archive_query_stats_t stats;
+    bool first = true;
+    int pos;
+
+    pos = chunk_append(buf, c.limit, 0, "{\"id\": %u, \"seq\": %u, \"fields\": [", session->id, session->next_seq);
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (session->channels & SENSOR_CH_BIT(ch))
+        {
+            pos = chunk_append(buf, c.limit, pos, "%s\"%s\"", first ? "" : ", ", telemetry_channel_name(ch));
+            first = false;
+        }
+    }
+    pos = chunk_append(buf, c.limit, pos, session->level == ARCHIVE_LEVEL_HOURLY ?
+                       "], \"stats\": [\"mean\", \"min\", \"max\"], \"rows\": [" : "], \"rows\": [");
+    if (pos < 0)
+    {
+        session->active = false;
+        return -1;
+    }
+    c.pos = pos;
+
+    if (query(session->level, session->cursor_ms, session->to_ms, session->channels, NULL, chunk_row, &c, &stats) < 0 ||
+        (c.full && c.rows == 0))
+    {
+        // The archive is gone, or a single row does not fit in a chunk
+        session->active = false;
+        return -1;
+    }
+    pos = c.pos + snprintf(buf + c.pos, len - c.pos, "], \"more\": %s}", c.full ? "true" : "false");
+
+    session->stats.chunks++;
+    session->stats.rows += c.rows;
+    session->stats.bytes += pos;
+    session->stats.bytes_read += stats.bytes_read;
+    session->next_seq++;
+    if (c.full)
+    {
+        // Rows are keyed by time, the next chunk starts just after the last one sent
+        session->cursor_ms = c.last_ms + 1;
+    }
+    else
+    {
+        session->active = false;
+        session->stats.completed++;
+    }
+    return pos;
+}
+
+#endif
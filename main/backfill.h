@@ -0,0 +1,161 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "archive.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Historical data query over MQTT, used by the backend to fill gaps in what it received.
+ *
+ * The backend publishes a request naming a time range and the fields it wants:
+ *
+ *     {"id": 42, "from": 1767225600000, "to": 1767312000000, "fields": ["temperature", "pressure"],
+ *      "level": "raw", "window": 4}
+ *
+ * Times are Unix milliseconds, both ends inclusive. "fields" defaults to every channel, "level" to
+ * "raw" ("hourly" returns the rollups) and "window" to CONFIG_BACKFILL_WINDOW. The station answers
+ * with chunks, each holding as many rows as fit in a chunk:
+ *
+ *     {"id": 42, "seq": 0, "fields": ["temperature", "pressure"],
+ *      "rows": [[1767225610000, 8.21, 1013.4], [1767225620000, 8.23, null]], "more": true}
+ *
+ * A row is the time followed by one value per field, null where the channel was not valid. Hourly
+ * chunks add "stats": ["mean", "min", "max"] and each value is an array of those three. The last
+ * chunk has "more": false; an empty range is answered by a single chunk with no rows.
+ *
+ * Flow control is by credit: at most "window" chunks are sent ahead of the backend's acks,
+ *
+ *     {"id": 42, "ack": 3}
+ *
+ * which acknowledge every chunk up to that seq. {"id": 42, "cancel": true} ends the query. If the
+ * window stays full for CONFIG_BACKFILL_ACK_TIMEOUT_MS the query is dropped: chunks are QoS0, so
+ * the backend asks again from the time of the last row it has. A new request replaces the running
+ * one.
+ *
+ * This file is plain C, so the same code runs in the station and in tools/backfillbench.
+ */
+
+/**
+ * @brief Smallest chunk buffer: room for the envelope, every field and one hourly row
+ */
+#define BACKFILL_CHUNK_MIN (1024)
+
+/**
+ * @brief Largest chunk window a request may ask for
+ */
+#define BACKFILL_WINDOW_MAX (16)
+
+typedef enum {
+    BACKFILL_MSG_REQUEST,               /*!< Start a query */
+    BACKFILL_MSG_ACK,                   /*!< Chunks received up to ack */
+    BACKFILL_MSG_CANCEL,                /*!< Stop the query */
+} backfill_msg_type_t;
+
+/**
+ * @brief A parsed message from the backend
+ */
+typedef struct {
+    backfill_msg_type_t type;
+    uint32_t id;                        /*!< Query the message belongs to */
+    int64_t from_ms;                    /*!< Request: start of the range */
+    int64_t to_ms;                      /*!< Request: end of the range */
+    uint32_t channels;                  /*!< Request: SENSOR_CH_BIT mask of the fields */
+    archive_level_t level;              /*!< Request: raw rows or hourly rollups */
+    uint32_t window;                    /*!< Request: chunks in flight, 0 for the default */
+    uint32_t ack;                       /*!< Ack: highest seq received */
+} backfill_msg_t;
+
+/**
+ * @brief Query function the chunks are read with, archive_query() or a locked wrapper around it
+ */
+typedef int (*backfill_query_t)(archive_level_t level, int64_t from_ms, int64_t to_ms, uint32_t channels,
+                                const archive_filter_t *filter, archive_query_cb_t cb, void *arg,
+                                archive_query_stats_t *stats);
+
+typedef struct {
+    uint32_t queries;                   /*!< Requests started */
+    uint32_t completed;                 /*!< Queries that sent their last chunk */
+    uint32_t cancelled;                 /*!< Queries cancelled or replaced by a new request */
+    uint32_t timeouts;                  /*!< Queries dropped for lack of acks */
+    uint32_t chunks;                    /*!< Chunks built */
+    uint64_t rows;                      /*!< Rows sent */
+    uint64_t bytes;                     /*!< Chunk bytes built */
+    uint64_t bytes_read;                /*!< Bytes read from the archive */
+} backfill_stats_t;
+
+/**
+ * @brief State of the running query. Each chunk is read with a query of its own, starting just
+ * after the last row sent, so the archive is only held for the time it takes to fill one chunk.
+ */
+typedef struct {
+    bool active;
+    uint32_t id;
+    archive_level_t level;
+    uint32_t channels;
+    int64_t cursor_ms;                  /*!< Time of the next row to send */
+    int64_t to_ms;
+    uint32_t window;
+    uint32_t next_seq;                  /*!< Seq of the next chunk */
+    uint32_t acked;                     /*!< Chunks acknowledged: every seq below this */
+    int64_t ack_timeout_us;
+    int64_t stalled_us;                 /*!< Time the window filled up, 0 while it has room */
+    backfill_stats_t stats;
+} backfill_session_t;
+
+/**
+ * @brief Parse a message from the backend
+ *
+ * @param buf payload, need not be 0 terminated
+ * @param len payload length
+ * @param msg filled in
+ * @return 0 on success, -1 if the payload is not a valid message
+ */
+int backfill_parse(const char *buf, size_t len, backfill_msg_t *msg);
+
+/**
+ * @brief Set up an idle session
+ *
+ * @param session session
+ * @param ack_timeout_ms drop a query when its window stays full for this long
+ */
+void backfill_init(backfill_session_t *session, uint32_t ack_timeout_ms);
+
+/**
+ * @brief Handle a message from the backend. Messages for another query than the running one are
+ * ignored, except requests, which replace it.
+ *
+ * @param session session
+ * @param msg parsed message
+ * @param default_window window used when the request does not name one
+ */
+void backfill_handle(backfill_session_t *session, const backfill_msg_t *msg, uint32_t default_window);
+
+/**
+ * @brief Check whether a chunk can be sent now: a query is running and its window has room. Drops
+ * the query if the window has been full for longer than the ack timeout.
+ *
+ * @param session session
+ * @param now_us current time in microseconds
+ */
+bool backfill_ready(backfill_session_t *session, int64_t now_us);
+
+/**
+ * @brief Build the next chunk. Ends the query after its last chunk.
+ *
+ * @param session session, backfill_ready() must have returned true
+ * @param query function the rows are read with
+ * @param buf chunk buffer, at least BACKFILL_CHUNK_MIN bytes
+ * @param len size of buf
+ * @return length of the chunk, -1 if the archive could not be read, which ends the query
+ */
+int backfill_next_chunk(backfill_session_t *session, backfill_query_t query, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,178 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_BACKFILL_ENABLE
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "backfiller.h"
+#include "backfill.h"
+#include "archiver.h"
+#include "mem_budget.h"
+
+static const char *TAG = "BACKFILL";
+
+#define BACKFILLER_TASK_STACK_SIZE (4096)
+// Below the archiver, so a query never holds off archiving
+#define BACKFILLER_TASK_PRIORITY (2)
+#define BACKFILLER_MESSAGE_QUEUE_LENGTH (4)
+#define BACKFILLER_CHUNK_QUEUE_LENGTH (2)
+// How often a full window is checked for its ack timeout
+#define BACKFILLER_POLL_MS (100)
+
+typedef struct {
+    size_t len;
+    char payload[CONFIG_BACKFILL_CHUNK_SIZE];
+} backfiller_chunk_t;
+
+static QueueHandle_t message_queue = NULL;
+static QueueHandle_t chunk_queue = NULL;
+static backfill_session_t session;
+static int64_t query_start_us;
+
+static StaticQueue_t message_queue_buf;
+static uint8_t message_queue_storage[BACKFILLER_MESSAGE_QUEUE_LENGTH * sizeof(backfill_msg_t)];
+static StaticQueue_t chunk_queue_buf;
+static uint8_t chunk_queue_storage[BACKFILLER_CHUNK_QUEUE_LENGTH * sizeof(backfiller_chunk_t)];
+// One chunk being built by the task, one being published by the MQTT task
+static backfiller_chunk_t build_chunk;
+static backfiller_chunk_t publish_chunk;
+static StaticTask_t backfiller_tcb;
+static StackType_t backfiller_stack[BACKFILLER_TASK_STACK_SIZE];
+
+static void query_log_end(const backfill_stats_t *before)
+{
+    const char *outcome = "failed";
+
+    if (session.stats.completed != before->completed)
+    {
+        outcome = "complete";
+    }
+    else if (session.stats.cancelled != before->cancelled)
+    {
+        outcome = "cancelled";
+    }
+    else if (session.stats.timeouts != before->timeouts)
+    {
+        outcome = "no acks, dropped";
+    }
+    ESP_LOGI(TAG, "Query %u %s: %u chunks, %llu rows, %llu bytes sent, %llu bytes read in %lldms", session.id, outcome,
+             session.stats.chunks - before->chunks, session.stats.rows - before->rows,
+             session.stats.bytes - before->bytes, session.stats.bytes_read - before->bytes_read,
+             (esp_timer_get_time() - query_start_us) / 1000);
+}
+
+static void backfiller_task(void *param)
+{
+    backfill_msg_t msg;
+    backfill_stats_t before = { 0 };
+    bool was_active = false;
+    int len;
+
+    // Each chunk is read with a query of its own, which opens files on the card and so allocates: the
+    // task is not guarded
+    for (;;)
+    {
+        TickType_t wait = !session.active ? portMAX_DELAY :
+                          (backfill_ready(&session, esp_timer_get_time()) ? 0 : pdMS_TO_TICKS(BACKFILLER_POLL_MS));
+
+        while (xQueueReceive(message_queue, &msg, wait) == pdTRUE)
+        {
+            if (msg.type == BACKFILL_MSG_REQUEST && session.active)
+            {
+                ESP_LOGI(TAG, "Query %u replaced by query %u", session.id, msg.id);
+            }
+            backfill_handle(&session, &msg, CONFIG_BACKFILL_WINDOW);
+            if (msg.type == BACKFILL_MSG_REQUEST)
+            {
+                ESP_LOGI(TAG, "Query %u: %s rows %lld to %lld, channels 0x%x", msg.id,
+                         msg.level == ARCHIVE_LEVEL_HOURLY ? "hourly" : "raw", (long long)msg.from_ms,
+                         (long long)msg.to_ms, msg.channels);
+                before = session.stats;
+                query_start_us = esp_timer_get_time();
+                was_active = true;
+            }
+            wait = 0;
+        }
+
+        if (backfill_ready(&session, esp_timer_get_time()))
+        {
+            len = backfill_next_chunk(&session, archiver_query, build_chunk.payload, sizeof(build_chunk.payload));
+            if (len < 0)
+            {
+                ESP_LOGW(TAG, "Query %u: could not read the archive", session.id);
+            }
+            else
+            {
+                build_chunk.len = len;
+                // The MQTT task takes a chunk every pass; if it does not for this long it is not connected
+                if (xQueueSend(chunk_queue, &build_chunk, pdMS_TO_TICKS(CONFIG_BACKFILL_ACK_TIMEOUT_MS)) != pdTRUE)
+                {
+                    ESP_LOGW(TAG, "Query %u: chunks are not going out, dropped", session.id);
+                    session.active = false;
+                }
+            }
+        }
+
+        if (was_active && !session.active)
+        {
+            query_log_end(&before);
+            was_active = false;
+        }
+    }
+}
+
+esp_err_t backfiller_start(void)
+{
+    backfill_init(&session, CONFIG_BACKFILL_ACK_TIMEOUT_MS);
+    message_queue = xQueueCreateStatic(BACKFILLER_MESSAGE_QUEUE_LENGTH, sizeof(backfill_msg_t), message_queue_storage,
+                                       &message_queue_buf);
+    chunk_queue = xQueueCreateStatic(BACKFILLER_CHUNK_QUEUE_LENGTH, sizeof(backfiller_chunk_t), chunk_queue_storage,
+                                     &chunk_queue_buf);
+    mem_budget_add("backfill", sizeof(message_queue_storage) + sizeof(message_queue_buf) + sizeof(chunk_queue_storage) +
+                   sizeof(chunk_queue_buf) + sizeof(build_chunk) + sizeof(publish_chunk) + sizeof(session) +
+                   sizeof(backfiller_tcb) + sizeof(backfiller_stack), 0);
+    xTaskCreateStatic(backfiller_task, "backfill", BACKFILLER_TASK_STACK_SIZE, NULL, BACKFILLER_TASK_PRIORITY,
+                      backfiller_stack, &backfiller_tcb);
+    return ESP_OK;
+}
+
+void backfiller_receive(const char *payload, size_t len)
+{
+    backfill_msg_t msg;
+
+    if (message_queue == NULL)
+    {
+        return;
+    }
+    if (backfill_parse(payload, len, &msg) != 0)
+    {
+        ESP_LOGW(TAG, "Ignoring malformed message: %.*s", (int)len, payload);
+        return;
+    }
+    if (xQueueSend(message_queue, &msg, 0) != pdTRUE)
+    {
+        ESP_LOGW(TAG, "Message queue full, message for query %u dropped", msg.id);
+    }
+}
+
+bool backfiller_active(void)
+{
+    return chunk_queue != NULL && (session.active || uxQueueMessagesWaiting(chunk_queue) > 0);
+}
+
+bool backfiller_take(const char **payload, size_t *len)
+{
+    if (chunk_queue == NULL || xQueueReceive(chunk_queue, &publish_chunk, 0) != pdTRUE)
+    {
+        return false;
+    }
+    *payload = publish_chunk.payload;
+    *len = publish_chunk.len;
+    return true;
+}
+
+#endif
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start the task that answers historical data queries (see backfill.h) from the archive.
+ * Call once archiver_start() has succeeded.
+ *
+ * @return ESP_OK if the task is running
+ */
+esp_err_t backfiller_start(void);
+
+/**
+ * @brief Hand a message from the backend over to the task. Called from the MQTT subscription
+ * callback; never blocks, a message that does not fit in the queue is dropped.
+ *
+ * @param payload message payload
+ * @param len payload length
+ */
+void backfiller_receive(const char *payload, size_t len);
+
+/**
+ * @brief Check whether a query is running, so the MQTT task keeps its loop turning for the chunks
+ * and acks instead of idling until the next window
+ */
+bool backfiller_active(void);
+
+/**
+ * @brief Take the next chunk to publish. Never blocks.
+ *
+ * @param payload set to the chunk, valid until the next call
+ * @param len set to the chunk length
+ * @return true if there was a chunk
+ */
+bool backfiller_take(const char **payload, size_t *len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,72 @@
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "boot_metrics.h"
+#include "mem_budget.h"
+
+static const char *TAG = "BOOT";
+
+static portMUX_TYPE boot_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t stage_us[BOOT_STAGE_COUNT];
+
+static const char *stage_names[BOOT_STAGE_COUNT] = {
+    [BOOT_STAGE_SENSORS_READY]  = "sensors ready",
+    [BOOT_STAGE_FIRST_SAMPLE]   = "first sample",
+    [BOOT_STAGE_NETWORK_UP]     = "network up",
+    [BOOT_STAGE_MQTT_CONNECTED] = "mqtt connected",
+    [BOOT_STAGE_FIRST_PUBLISH]  = "first publish",
+};
+
+void boot_metrics_mark(boot_stage_t stage)
+{
+    int64_t now = esp_timer_get_time();
+    bool first = false;
+
+    if (stage >= BOOT_STAGE_COUNT)
+    {
+        return;
+    }
+    portENTER_CRITICAL(&boot_lock);
+    if (stage_us[stage] == 0)
+    {
+        stage_us[stage] = now;
+        first = true;
+    }
+    portEXIT_CRITICAL(&boot_lock);
+    if (!first)
+    {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Boot stage %s reached after %dms", stage_names[stage], (int)(now / 1000));
+    if (stage == BOOT_STAGE_FIRST_PUBLISH)
+    {
+        for (int i = 0; i < BOOT_STAGE_COUNT; i++)
+        {
+            ESP_LOGI(TAG, "  %-16s %6dms", stage_names[i], (int)(boot_metrics_get(i) / 1000));
+        }
+        mem_budget_report();
+    }
+}
+
+int64_t boot_metrics_get(boot_stage_t stage)
+{
+    int64_t us;
+
+    if (stage >= BOOT_STAGE_COUNT)
+    {
+        return 0;
+    }
+    portENTER_CRITICAL(&boot_lock);
+    us = stage_us[stage];
+    portEXIT_CRITICAL(&boot_lock);
+    return us;
+}
+
+const char *boot_metrics_stage_name(boot_stage_t stage)
+{
+    return (stage < BOOT_STAGE_COUNT) ? stage_names[stage] : "unknown";
+}
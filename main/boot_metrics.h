@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Boot milestones. Sensor bring-up and the network connection run in parallel, so the
+ * stages are not reached in a fixed order.
+ */
+typedef enum {
+    BOOT_STAGE_SENSORS_READY = 0,       /*!< All sensor drivers initialised */
+    BOOT_STAGE_FIRST_SAMPLE,            /*!< First acquisition cycle done */
+    BOOT_STAGE_NETWORK_UP,              /*!< Wi-Fi associated and IP address obtained */
+    BOOT_STAGE_MQTT_CONNECTED,          /*!< TLS and MQTT connection established */
+    BOOT_STAGE_FIRST_PUBLISH,           /*!< First window published */
+    BOOT_STAGE_COUNT
+} boot_stage_t;
+
+/**
+ * @brief Record that a boot stage was reached. Only the first call for each stage is kept.
+ * Reaching BOOT_STAGE_FIRST_PUBLISH logs all the boot metrics and the memory budget.
+ *
+ * @param stage stage reached
+ */
+void boot_metrics_mark(boot_stage_t stage);
+
+/**
+ * @brief Time from boot to a stage
+ *
+ * @param stage stage to query
+ * @return microseconds since boot when the stage was reached, 0 if it was not reached yet
+ */
+int64_t boot_metrics_get(boot_stage_t stage);
+
+/**
+ * @brief Name of a boot stage
+ */
+const char *boot_metrics_stage_name(boot_stage_t stage);
+
+#ifdef __cplusplus
+}
+#endif
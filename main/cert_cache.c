@@ -0,0 +1,259 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_AWS_CERT_CACHE
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "mbedtls/x509_crt.h"
+#include "mbedtls/pk.h"
+
+#include "cert_cache.h"
+#include "sdcard.h"
+#include "mem_budget.h"
+
+static const char *TAG = "CERTCACHE";
+
+#define CERT_CACHE_NAMESPACE "certcache"
+#define CERT_CACHE_SOURCE_KEY "source"
+
+enum {
+    CERT_ROOT_CA,
+    CERT_DEVICE,
+    CERT_PRIVATE_KEY,
+    CERT_FILES
+};
+
+typedef struct {
+    const char *path;                   // File the PEM is read from
+    const char *key;                    // NVS key of the cached copy
+    char pem[CERT_CACHE_PEM_MAX];
+} cert_file_t;
+
+/**
+ * @brief Size and modification time of the files a cached copy was made from
+ */
+typedef struct {
+    uint32_t size[CERT_FILES];
+    int64_t mtime[CERT_FILES];
+} cert_source_t;
+
+static cert_file_t files[CERT_FILES] = {
+    [CERT_ROOT_CA] = { .path = CONFIG_AWS_ROOT_CA_PATH, .key = "ca" },
+    [CERT_DEVICE] = { .path = CONFIG_AWS_CERTIFICATE_PATH, .key = "crt" },
+    [CERT_PRIVATE_KEY] = { .path = CONFIG_AWS_PRIVATE_KEY_PATH, .key = "key" },
+};
+static bool loaded = false;
+
+static bool source_stat(cert_source_t *source)
+{
+    struct stat st;
+
+    memset(source, 0, sizeof(cert_source_t));
+    for (int i = 0; i < CERT_FILES; i++)
+    {
+        if (stat(files[i].path, &st) != 0)
+        {
+            ESP_LOGW(TAG, "%s not found", files[i].path);
+            return false;
+        }
+        source->size[i] = st.st_size;
+        source->mtime[i] = st.st_mtime;
+    }
+    return true;
+}
+
+static esp_err_t files_read(void)
+{
+    for (int i = 0; i < CERT_FILES; i++)
+    {
+        FILE *f = fopen(files[i].path, "r");
+        size_t len;
+
+        if (f == NULL)
+        {
+            ESP_LOGE(TAG, "Cannot open %s", files[i].path);
+            return ESP_ERR_NOT_FOUND;
+        }
+        len = fread(files[i].pem, 1, CERT_CACHE_PEM_MAX, f);
+        fclose(f);
+        if (len >= CERT_CACHE_PEM_MAX)
+        {
+            ESP_LOGE(TAG, "%s is larger than %d bytes", files[i].path, CERT_CACHE_PEM_MAX - 1);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        files[i].pem[len] = 0;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Parse the certificates and the key, and check the key belongs to the device certificate
+ */
+static esp_err_t certs_check(void)
+{
+    mbedtls_x509_crt ca;
+    mbedtls_x509_crt crt;
+    mbedtls_pk_context key;
+    esp_err_t err = ESP_ERR_INVALID_ARG;
+    int ret;
+
+    mbedtls_x509_crt_init(&ca);
+    mbedtls_x509_crt_init(&crt);
+    mbedtls_pk_init(&key);
+    // The PEM parsers want the length including the terminating 0
+    if ((ret = mbedtls_x509_crt_parse(&ca, (const unsigned char *)files[CERT_ROOT_CA].pem,
+                                      strlen(files[CERT_ROOT_CA].pem) + 1)) != 0)
+    {
+        ESP_LOGE(TAG, "Root CA certificate does not parse: -0x%x", -ret);
+    }
+    else if ((ret = mbedtls_x509_crt_parse(&crt, (const unsigned char *)files[CERT_DEVICE].pem,
+                                           strlen(files[CERT_DEVICE].pem) + 1)) != 0)
+    {
+        ESP_LOGE(TAG, "Device certificate does not parse: -0x%x", -ret);
+    }
+    else if ((ret = mbedtls_pk_parse_key(&key, (const unsigned char *)files[CERT_PRIVATE_KEY].pem,
+                                         strlen(files[CERT_PRIVATE_KEY].pem) + 1, NULL, 0)) != 0)
+    {
+        ESP_LOGE(TAG, "Private key does not parse: -0x%x", -ret);
+    }
+    else if ((ret = mbedtls_pk_check_pair(&crt.pk, &key)) != 0)
+    {
+        ESP_LOGE(TAG, "Private key does not match the device certificate: -0x%x", -ret);
+    }
+    else
+    {
+        err = ESP_OK;
+    }
+    mbedtls_pk_free(&key);
+    mbedtls_x509_crt_free(&crt);
+    mbedtls_x509_crt_free(&ca);
+    return err;
+}
+
+/**
+ * @brief Load the cached copy
+ *
+ * @param nvs open NVS handle
+ * @param expected files the copy has to be made from, NULL to take whatever is cached
+ */
+static esp_err_t nvs_load(nvs_handle_t nvs, const cert_source_t *expected)
+{
+    cert_source_t source;
+    size_t len = sizeof(source);
+    esp_err_t err = nvs_get_blob(nvs, CERT_CACHE_SOURCE_KEY, &source, &len);
+
+    if (err != ESP_OK || len != sizeof(source))
+    {
+        return err != ESP_OK ? err : ESP_ERR_INVALID_SIZE;
+    }
+    if (expected && memcmp(&source, expected, sizeof(source)) != 0)
+    {
+        ESP_LOGI(TAG, "Certificate files changed since they were cached");
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < CERT_FILES; i++)
+    {
+        len = CERT_CACHE_PEM_MAX;
+        err = nvs_get_blob(nvs, files[i].key, files[i].pem, &len);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        files[i].pem[CERT_CACHE_PEM_MAX - 1] = 0;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t nvs_store(nvs_handle_t nvs, const cert_source_t *source)
+{
+    esp_err_t err;
+
+    // The source is dropped first and written last, so an interrupted update is not mistaken for a good copy
+    err = nvs_erase_key(nvs, CERT_CACHE_SOURCE_KEY);
+    if (err == ESP_ERR_NVS_NOT_FOUND)
+    {
+        err = ESP_OK;
+    }
+    for (int i = 0; i < CERT_FILES && err == ESP_OK; i++)
+    {
+        err = nvs_set_blob(nvs, files[i].key, files[i].pem, strlen(files[i].pem) + 1);
+    }
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(nvs, CERT_CACHE_SOURCE_KEY, source, sizeof(cert_source_t));
+    }
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(nvs);
+    }
+    return err;
+}
+
+esp_err_t cert_cache_load(cert_cache_t *certs)
+{
+    int64_t start = esp_timer_get_time();
+    cert_source_t source;
+    bool have_source;
+    bool have_nvs;
+    nvs_handle_t nvs = 0;
+    esp_err_t err;
+
+    if (!loaded)
+    {
+#ifdef CONFIG_AWS_SDCARD_CERTS
+        have_source = sdcard_mount() == ESP_OK && source_stat(&source);
+#else
+        have_source = source_stat(&source);
+#endif
+#ifdef CONFIG_AWS_CERT_CACHE_NVS
+        have_nvs = nvs_open(CERT_CACHE_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK;
+#else
+        // The copy would hold the private key, which only goes into encrypted NVS
+        have_nvs = false;
+#endif
+        if (have_source && have_nvs && nvs_load(nvs, &source) == ESP_OK)
+        {
+            ESP_LOGI(TAG, "Certificates unchanged, using the copy in NVS");
+            loaded = true;
+        }
+        else if (have_source && files_read() == ESP_OK && certs_check() == ESP_OK)
+        {
+            loaded = true;
+            if (have_nvs)
+            {
+                err = nvs_store(nvs, &source);
+                if (err != ESP_OK)
+                {
+                    ESP_LOGW(TAG, "Could not cache the certificates in NVS: %s", esp_err_to_name(err));
+                }
+            }
+        }
+        else if (have_nvs && nvs_load(nvs, NULL) == ESP_OK)
+        {
+            ESP_LOGW(TAG, "Certificate files unavailable or unusable, using the copy in NVS");
+            loaded = true;
+        }
+        if (have_nvs)
+        {
+            nvs_close(nvs);
+        }
+        if (!loaded)
+        {
+            ESP_LOGE(TAG, "No usable certificates");
+            return ESP_ERR_NOT_FOUND;
+        }
+        ESP_LOGI(TAG, "Certificates ready in %lldms", (esp_timer_get_time() - start) / 1000);
+        mem_budget_add("certcache", sizeof(files), 0);
+    }
+    certs->root_ca = files[CERT_ROOT_CA].pem;
+    certs->certificate = files[CERT_DEVICE].pem;
+    certs->private_key = files[CERT_PRIVATE_KEY].pem;
+    return ESP_OK;
+}
+
+#endif
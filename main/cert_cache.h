@@ -0,0 +1,40 @@
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Largest PEM file the cache holds, including the terminating 0
+ */
+#define CERT_CACHE_PEM_MAX (2048)
+
+/**
+ * @brief Certificates for the MQTT client, as the 0 terminated PEM strings the TLS layer takes
+ */
+typedef struct {
+    const char *root_ca;                /*!< Root CA certificate */
+    const char *certificate;            /*!< Device certificate */
+    const char *private_key;            /*!< Device private key */
+} cert_cache_t;
+
+/**
+ * @brief Load the certificates.
+ *
+ * The first call of a boot reads the files, parses the certificates and the key and checks they
+ * belong together. With CONFIG_AWS_CERT_CACHE_NVS it first compares the files with the copy kept in
+ * NVS by their size and modification time: when they match the NVS copy is used and the files are
+ * not read, when they changed, or there is no copy yet, the checked files are stored in NVS, and if
+ * the filesystem cannot be mounted the NVS copy is used as it is. Later calls, e.g. for an MQTT
+ * reconnect, return the copy already in RAM.
+ *
+ * @param certs filled in with the certificates, which stay valid until reboot
+ * @return ESP_OK, or an error if neither the files nor the NVS copy hold a usable set
+ */
+esp_err_t cert_cache_load(cert_cache_t *certs);
+
+#ifdef __cplusplus
+}
+#endif
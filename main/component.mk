@@ -12,3 +12,8 @@ $(COMPONENT_PATH)/certs/weathersynders-certificate.pem.crt $(COMPONENT_PATH)/cer
 	@echo "Missing PEM file $@. This file identifies the ESP32 to AWS, see README for details."
 	exit 1
 endif
+
+ifdef CONFIG_MEMORY_ALLOC_GUARD
+# Route the C allocation functions through the steady state guard in mem_budget.c
+COMPONENT_ADD_LDFLAGS += -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc
+endif
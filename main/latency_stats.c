@@ -0,0 +1,65 @@
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "latency_stats.h"
+
+static const char *TAG = "LATENCY";
+
+void latency_series_init(latency_series_t *series, const char *name)
+{
+    memset(series, 0, sizeof(latency_series_t));
+    series->name = name;
+}
+
+void latency_series_add(latency_series_t *series, int64_t us)
+{
+    if (us < 0)
+    {
+        us = 0;
+    }
+    else if (us > UINT32_MAX)
+    {
+        us = UINT32_MAX;
+    }
+    series->samples_us[series->next] = (uint32_t)us;
+    series->next = (series->next + 1) % LATENCY_SERIES_SIZE;
+    if (series->count < LATENCY_SERIES_SIZE)
+    {
+        series->count++;
+    }
+}
+
+uint32_t latency_series_percentile(const latency_series_t *series, int pct)
+{
+    uint32_t sorted[LATENCY_SERIES_SIZE];
+    uint32_t n = series->count;
+    uint32_t rank;
+
+    if (n == 0)
+    {
+        return 0;
+    }
+    memcpy(sorted, series->samples_us, n * sizeof(uint32_t));
+    // Insertion sort, the ring is small
+    for (uint32_t i = 1; i < n; i++)
+    {
+        uint32_t value = sorted[i];
+        uint32_t j = i;
+        while (j > 0 && sorted[j - 1] > value)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+    rank = (n * (uint32_t)pct + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+void latency_series_log(const latency_series_t *series)
+{
+    ESP_LOGI(TAG, "%s over %u windows: p50 %.3fms p90 %.3fms p99 %.3fms max %.3fms", series->name, series->count,
+             latency_series_percentile(series, 50) / 1000.0, latency_series_percentile(series, 90) / 1000.0,
+             latency_series_percentile(series, 99) / 1000.0, latency_series_percentile(series, 100) / 1000.0);
+}
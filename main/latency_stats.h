@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Number of recent measurements a latency series keeps
+ */
+#define LATENCY_SERIES_SIZE (64)
+
+/**
+ * @brief Ring of recent latency measurements of one pipeline stage
+ */
+typedef struct {
+    const char *name;                           /*!< Stage name used in log messages */
+    uint32_t count;                             /*!< Measurements in the ring */
+    uint32_t next;                              /*!< Ring slot for the next measurement */
+    uint32_t samples_us[LATENCY_SERIES_SIZE];   /*!< Measurements, microseconds */
+} latency_series_t;
+
+/**
+ * @brief Initialise an empty series
+ *
+ * @param series series object
+ * @param name stage name used in log messages
+ */
+void latency_series_init(latency_series_t *series, const char *name);
+
+/**
+ * @brief Add a measurement, replacing the oldest once the ring is full
+ *
+ * @param series series object
+ * @param us latency in microseconds, negative values count as 0
+ */
+void latency_series_add(latency_series_t *series, int64_t us);
+
+/**
+ * @brief Percentile of the measurements in the ring (nearest rank)
+ *
+ * @param series series object
+ * @param pct percentile, 0 to 100
+ * @return latency in microseconds, 0 if the series is empty
+ */
+uint32_t latency_series_percentile(const latency_series_t *series, int pct);
+
+/**
+ * @brief Log p50, p90, p99 and max of a series
+ */
+void latency_series_log(const latency_series_t *series);
+
+#ifdef __cplusplus
+}
+#endif
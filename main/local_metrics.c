@@ -0,0 +1,319 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_LOCAL_METRICS_ENABLE
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_http_server.h"
+
+#include "local_metrics.h"
+#include "telemetry.h"
+#include "supervisor.h"
+#include "radio_power.h"
+#ifdef CONFIG_SENSOR_RAIN_ENABLE
+#include "sensor_driver.h"
+#include "rainsensor.h"
+#endif
+
+static const char *TAG = "METRICS";
+
+#define METRICS_PROMETHEUS_SIZE (4096)
+#define METRICS_JSON_SIZE (1536)
+
+/**
+ * @brief Everything a response is rendered from
+ */
+typedef struct {
+    uint32_t seq;                       /*!< Acquisition cycle number, 0 before the first one */
+    int64_t time_us;                    /*!< Time of the cycle */
+    sensor_data data;                   /*!< Readings of the cycle */
+    supervisor_status_t subsystems[SUPERVISOR_COUNT]; /*!< Restart counters of the supervised subsystems */
+    radio_power_stats_t radio;          /*!< Publish burst counters */
+#ifdef CONFIG_SENSOR_RAIN_ENABLE
+    bool rain_valid;                    /*!< The rain sensor answered at least once */
+    rainsensor_t rain;                  /*!< Latest full rain sensor report */
+#endif
+} metrics_snapshot_t;
+
+/**
+ * @brief A response rendered from a given snapshot. Only the server task touches it.
+ */
+typedef struct {
+    uint32_t seq;                       /*!< Snapshot the buffer was rendered from */
+    int len;                            /*!< Length of the response, -1 if it did not fit */
+    char *buf;                          /*!< Response body */
+} metrics_cache_t;
+
+static portMUX_TYPE snapshot_lock = portMUX_INITIALIZER_UNLOCKED;
+static metrics_snapshot_t snapshot;
+
+static char prometheus_buf[METRICS_PROMETHEUS_SIZE];
+static char json_buf[METRICS_JSON_SIZE];
+static metrics_cache_t prometheus_cache = { .seq = UINT32_MAX, .len = -1, .buf = prometheus_buf };
+static metrics_cache_t json_cache = { .seq = UINT32_MAX, .len = -1, .buf = json_buf };
+
+static httpd_handle_t server = NULL;
+
+static int metrics_append(char *buf, size_t len, int pos, const char *fmt, ...)
+{
+    va_list args;
+    int written;
+
+    if (pos < 0 || (size_t)pos >= len)
+    {
+        return -1;
+    }
+    va_start(args, fmt);
+    written = vsnprintf(buf + pos, len - pos, fmt, args);
+    va_end(args);
+    return (written < 0 || (size_t)(pos + written) >= len) ? -1 : pos + written;
+}
+
+static int render_prometheus(const metrics_snapshot_t *snap, char *buf, size_t len)
+{
+    const sensor_data *data = &snap->data;
+    int pos = metrics_append(buf, len, 0,
+                             "# HELP weather_samples_total Acquisition cycles since boot\n"
+                             "# TYPE weather_samples_total counter\n"
+                             "weather_samples_total %u\n"
+                             "# HELP weather_sample_time_seconds Uptime at the acquisition cycle\n"
+                             "# TYPE weather_sample_time_seconds gauge\n"
+                             "weather_sample_time_seconds %.3f\n"
+                             "# HELP weather_sensor_value Latest reading of a sensor channel\n"
+                             "# TYPE weather_sensor_value gauge\n",
+                             snap->seq, snap->time_us / 1000000.0);
+
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (data->valid & SENSOR_CH_BIT(ch))
+        {
+            pos = metrics_append(buf, len, pos, "weather_sensor_value{channel=\"%s\"} %.3f\n",
+                                 telemetry_channel_name(ch), data->value[ch]);
+        }
+    }
+    pos = metrics_append(buf, len, pos,
+                         "# HELP weather_sensor_age_seconds Seconds since the channel was last read successfully\n"
+                         "# TYPE weather_sensor_age_seconds gauge\n");
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        pos = metrics_append(buf, len, pos, "weather_sensor_age_seconds{channel=\"%s\"} %u\n",
+                             telemetry_channel_name(ch), data->age[ch]);
+    }
+#ifdef CONFIG_SENSOR_RAIN_ENABLE
+    if (snap->rain_valid)
+    {
+        pos = metrics_append(buf, len, pos,
+                             "# HELP weather_rain_mm Rain sensor accumulators\n"
+                             "# TYPE weather_rain_mm gauge\n"
+                             "weather_rain_mm{accumulator=\"current\"} %.2f\n"
+                             "weather_rain_mm{accumulator=\"event\"} %.2f\n"
+                             "weather_rain_mm{accumulator=\"total\"} %.2f\n"
+                             "# HELP weather_rain_rate_mm_per_hour Predicted rain rate of the current event\n"
+                             "# TYPE weather_rain_rate_mm_per_hour gauge\n"
+                             "weather_rain_rate_mm_per_hour %.2f\n",
+                             snap->rain.current_acc_rain, snap->rain.event_acc_rain,
+                             snap->rain.total_rain, snap->rain.mm_per_hour_rain);
+    }
+#endif
+    pos = metrics_append(buf, len, pos,
+                         "# HELP weather_subsystem_up Subsystem running, 0 while it waits to be restarted\n"
+                         "# TYPE weather_subsystem_up gauge\n");
+    for (int sub = 0; sub < SUPERVISOR_COUNT; sub++)
+    {
+        pos = metrics_append(buf, len, pos, "weather_subsystem_up{subsystem=\"%s\"} %d\n",
+                             snap->subsystems[sub].name, snap->subsystems[sub].up);
+    }
+    pos = metrics_append(buf, len, pos,
+                         "# HELP weather_subsystem_faults_total Faults since boot\n"
+                         "# TYPE weather_subsystem_faults_total counter\n");
+    for (int sub = 0; sub < SUPERVISOR_COUNT; sub++)
+    {
+        pos = metrics_append(buf, len, pos, "weather_subsystem_faults_total{subsystem=\"%s\"} %u\n",
+                             snap->subsystems[sub].name, snap->subsystems[sub].faults);
+    }
+    pos = metrics_append(buf, len, pos,
+                         "# HELP weather_subsystem_restarts_total Restart attempts since boot\n"
+                         "# TYPE weather_subsystem_restarts_total counter\n");
+    for (int sub = 0; sub < SUPERVISOR_COUNT; sub++)
+    {
+        pos = metrics_append(buf, len, pos, "weather_subsystem_restarts_total{subsystem=\"%s\"} %u\n",
+                             snap->subsystems[sub].name, snap->subsystems[sub].restarts);
+    }
+    return metrics_append(buf, len, pos,
+                          "# HELP weather_publish_cycles_total Completed publish cycles since boot\n"
+                          "# TYPE weather_publish_cycles_total counter\n"
+                          "weather_publish_cycles_total %u\n"
+                          "# HELP weather_publish_cycle_seconds_total Length of all publish cycles\n"
+                          "# TYPE weather_publish_cycle_seconds_total counter\n"
+                          "weather_publish_cycle_seconds_total %.3f\n"
+                          "# HELP weather_publish_burst_seconds_total Wall time spent in MQTT yield and publish\n"
+                          "# TYPE weather_publish_burst_seconds_total counter\n"
+                          "weather_publish_burst_seconds_total %.3f\n",
+                          snap->radio.cycles, snap->radio.total_cycle_us / 1000000.0,
+                          snap->radio.total_burst_us / 1000000.0);
+}
+
+static int render_json(const metrics_snapshot_t *snap, char *buf, size_t len)
+{
+    const sensor_data *data = &snap->data;
+    int pos = metrics_append(buf, len, 0, "{\"seq\": %u, \"time\": %.3f, \"valid\": %u",
+                             snap->seq, snap->time_us / 1000000.0, data->valid);
+
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (data->valid & SENSOR_CH_BIT(ch))
+        {
+            pos = metrics_append(buf, len, pos, ", \"%s\": %.3f", telemetry_channel_name(ch), data->value[ch]);
+        }
+        else
+        {
+            pos = metrics_append(buf, len, pos, ", \"%s\": null", telemetry_channel_name(ch));
+        }
+    }
+    pos = metrics_append(buf, len, pos, ", \"age\": {");
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        pos = metrics_append(buf, len, pos, "%s\"%s\": %u", ch ? ", " : "", telemetry_channel_name(ch), data->age[ch]);
+    }
+    pos = metrics_append(buf, len, pos, "}");
+#ifdef CONFIG_SENSOR_RAIN_ENABLE
+    if (snap->rain_valid)
+    {
+        pos = metrics_append(buf, len, pos,
+                             ", \"rainsensor\": {\"current\": %.2f, \"event\": %.2f, \"total\": %.2f, \"mmperhour\": %.2f}",
+                             snap->rain.current_acc_rain, snap->rain.event_acc_rain,
+                             snap->rain.total_rain, snap->rain.mm_per_hour_rain);
+    }
+#endif
+    pos = metrics_append(buf, len, pos, ", \"restarts\": {");
+    for (int sub = 0; sub < SUPERVISOR_COUNT; sub++)
+    {
+        pos = metrics_append(buf, len, pos, "%s\"%s\": %u", sub ? ", " : "", snap->subsystems[sub].name,
+                             snap->subsystems[sub].restarts);
+    }
+    return metrics_append(buf, len, pos, "}}");
+}
+
+/**
+ * @brief Serve a cached response, re-rendering it first if a new cycle arrived since
+ */
+static esp_err_t serve_cached(httpd_req_t *req, metrics_cache_t *cache, size_t size,
+                              int (*render)(const metrics_snapshot_t *, char *, size_t))
+{
+    static metrics_snapshot_t snap;
+    uint32_t seq;
+
+    portENTER_CRITICAL(&snapshot_lock);
+    seq = snapshot.seq;
+    if (seq != cache->seq)
+    {
+        snap = snapshot;
+    }
+    portEXIT_CRITICAL(&snapshot_lock);
+
+    if (seq == 0)
+    {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "No sample yet\n", HTTPD_RESP_USE_STRLEN);
+    }
+    if (seq != cache->seq)
+    {
+        cache->len = render(&snap, cache->buf, size);
+        cache->seq = seq;
+        if (cache->len < 0)
+        {
+            ESP_LOGE(TAG, "Response for %s does not fit in %u bytes", req->uri, (unsigned)size);
+        }
+    }
+    if (cache->len < 0)
+    {
+        return httpd_resp_send_500(req);
+    }
+    return httpd_resp_send(req, cache->buf, cache->len);
+}
+
+static esp_err_t prometheus_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    return serve_cached(req, &prometheus_cache, sizeof(prometheus_buf), render_prometheus);
+}
+
+static esp_err_t json_handler(httpd_req_t *req)
+{
+    httpd_resp_set_type(req, "application/json");
+    return serve_cached(req, &json_cache, sizeof(json_buf), render_json);
+}
+
+static const httpd_uri_t prometheus_uri = {
+    .uri = "/metrics",
+    .method = HTTP_GET,
+    .handler = prometheus_handler,
+    .user_ctx = NULL
+};
+
+static const httpd_uri_t json_uri = {
+    .uri = "/sensors",
+    .method = HTTP_GET,
+    .handler = json_handler,
+    .user_ctx = NULL
+};
+
+void local_metrics_update(const sensor_data *data)
+{
+#ifdef CONFIG_SENSOR_RAIN_ENABLE
+    rainsensor_t rain;
+    bool rain_valid = rain_driver_get_data(&rain);
+#endif
+    supervisor_status_t subsystems[SUPERVISOR_COUNT];
+    radio_power_stats_t radio;
+
+    radio_power_get_stats(&radio);
+    for (int sub = 0; sub < SUPERVISOR_COUNT; sub++)
+    {
+        subsystems[sub] = *supervisor_status(sub);
+    }
+
+    portENTER_CRITICAL(&snapshot_lock);
+    snapshot.seq++;
+    if (snapshot.seq == 0)
+    {
+        // 0 means no sample
+        snapshot.seq = 1;
+    }
+    snapshot.time_us = data->time_us;
+    snapshot.data = *data;
+    memcpy(snapshot.subsystems, subsystems, sizeof(subsystems));
+    snapshot.radio = radio;
+#ifdef CONFIG_SENSOR_RAIN_ENABLE
+    snapshot.rain_valid = rain_valid;
+    snapshot.rain = rain;
+#endif
+    portEXIT_CRITICAL(&snapshot_lock);
+}
+
+esp_err_t local_metrics_start(void)
+{
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    esp_err_t err;
+
+    config.server_port = CONFIG_LOCAL_METRICS_PORT;
+    // Scrapers hold their connections open, drop the oldest rather than refuse a new one
+    config.lru_purge_enable = true;
+
+    err = httpd_start(&server, &config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not start the metrics server on port %d: %s", CONFIG_LOCAL_METRICS_PORT, esp_err_to_name(err));
+        return err;
+    }
+    httpd_register_uri_handler(server, &prometheus_uri);
+    httpd_register_uri_handler(server, &json_uri);
+    ESP_LOGI(TAG, "Serving /metrics and /sensors on port %d", CONFIG_LOCAL_METRICS_PORT);
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "esp_err.h"
+#include "sensors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start the local HTTP endpoint. It serves the latest acquisition cycle on
+ * /metrics (Prometheus text format) and /sensors (JSON) on CONFIG_LOCAL_METRICS_PORT.
+ *
+ * @return ESP_OK if the server started
+ */
+esp_err_t local_metrics_start(void);
+
+/**
+ * @brief Hand the result of an acquisition cycle to the endpoint. This only copies the
+ * snapshot; the responses are rendered on the first request after it and then served from
+ * the cache until the next cycle.
+ *
+ * @param data readings of the cycle
+ */
+void local_metrics_update(const sensor_data *data);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+#include "mem_budget.h"
+
+static const char *TAG = "MEMORY";
+
+#define MEM_GUARD_MAX_TASKS (8)
+
+typedef struct {
+    const char *subsystem;
+    size_t static_bytes;
+    size_t heap_bytes;
+} mem_budget_entry_t;
+
+static portMUX_TYPE budget_lock = portMUX_INITIALIZER_UNLOCKED;
+static mem_budget_entry_t entries[MEM_BUDGET_MAX_ENTRIES];
+static int entry_count = 0;
+
+// Smallest largest free block seen by the monitor, a measure of fragmentation
+static size_t lowest_largest_block = SIZE_MAX;
+
+void mem_budget_add(const char *subsystem, size_t static_bytes, size_t heap_bytes)
+{
+    int i;
+
+    portENTER_CRITICAL(&budget_lock);
+    for (i = 0; i < entry_count; i++)
+    {
+        if (entries[i].subsystem == subsystem)
+        {
+            break;
+        }
+    }
+    if (i == entry_count && entry_count < MEM_BUDGET_MAX_ENTRIES)
+    {
+        entries[entry_count++].subsystem = subsystem;
+    }
+    if (i < entry_count)
+    {
+        entries[i].static_bytes += static_bytes;
+        entries[i].heap_bytes += heap_bytes;
+    }
+    portEXIT_CRITICAL(&budget_lock);
+}
+
+void mem_budget_report(void)
+{
+    mem_budget_entry_t copy[MEM_BUDGET_MAX_ENTRIES];
+    size_t total_static = 0;
+    size_t total_heap = 0;
+    int count;
+
+    portENTER_CRITICAL(&budget_lock);
+    count = entry_count;
+    for (int i = 0; i < count; i++)
+    {
+        copy[i] = entries[i];
+    }
+    portEXIT_CRITICAL(&budget_lock);
+
+    ESP_LOGI(TAG, "Memory budget:");
+    ESP_LOGI(TAG, "  %-16s %8s %8s", "subsystem", "static", "heap");
+    for (int i = 0; i < count; i++)
+    {
+        ESP_LOGI(TAG, "  %-16s %8u %8u", copy[i].subsystem, copy[i].static_bytes, copy[i].heap_bytes);
+        total_static += copy[i].static_bytes;
+        total_heap += copy[i].heap_bytes;
+    }
+    ESP_LOGI(TAG, "  %-16s %8u %8u", "total", total_static, total_heap);
+    ESP_LOGI(TAG, "Heap: free %u, lowest %u, largest block %u",
+             heap_caps_get_free_size(MALLOC_CAP_8BIT), heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+             heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+}
+
+static void monitor_callback(void *arg)
+{
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+    if (largest < lowest_largest_block)
+    {
+        lowest_largest_block = largest;
+    }
+    ESP_LOGI(TAG, "Heap: free %u, lowest %u, largest block %u (smallest seen %u)",
+             heap_caps_get_free_size(MALLOC_CAP_8BIT), heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT),
+             largest, lowest_largest_block);
+}
+
+void mem_budget_monitor_start(void)
+{
+#if CONFIG_MEMORY_REPORT_INTERVAL_S > 0
+    static esp_timer_handle_t monitor_timer = NULL;
+    esp_timer_create_args_t timer_args = {
+        .callback = monitor_callback,
+        .name = "mem_monitor",
+    };
+
+    if (monitor_timer != NULL)
+    {
+        return;
+    }
+    if (esp_timer_create(&timer_args, &monitor_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not create the heap monitor timer");
+        return;
+    }
+    esp_timer_start_periodic(monitor_timer, CONFIG_MEMORY_REPORT_INTERVAL_S * 1000000LL);
+#endif
+}
+
+#ifdef CONFIG_MEMORY_ALLOC_GUARD
+
+/*
+ * The allocator has no hook in this IDF version, so the guard wraps the C allocation functions at
+ * link time (-Wl,--wrap=malloc etc, see CMakeLists.txt). Allocations made through heap_caps_*(),
+ * pvPortMalloc() or newlib's _malloc_r() (stdio) are not seen.
+ */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+static TaskHandle_t guarded[MEM_GUARD_MAX_TASKS];
+
+static int guard_find(TaskHandle_t task)
+{
+    for (int i = 0; i < MEM_GUARD_MAX_TASKS; i++)
+    {
+        if (guarded[i] == task)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void guard_check(const char *func, size_t size, void *caller)
+{
+    TaskHandle_t task;
+
+    if (size == 0 || xTaskGetSchedulerState() != taskSCHEDULER_RUNNING)
+    {
+        return;
+    }
+    task = xTaskGetCurrentTaskHandle();
+    if (guard_find(task) >= 0)
+    {
+        // The logging functions can allocate, use the ROM printf
+        ESP_EARLY_LOGE(TAG, "%s(%u) from %p in the steady state of task %s", func, size, caller,
+                       pcTaskGetTaskName(NULL));
+        abort();
+    }
+}
+
+void *__wrap_malloc(size_t size)
+{
+    guard_check("malloc", size, __builtin_return_address(0));
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    guard_check("calloc", n * size, __builtin_return_address(0));
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    guard_check("realloc", size, __builtin_return_address(0));
+    return __real_realloc(ptr, size);
+}
+
+void mem_budget_guard_enter(void)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    int slot;
+
+    portENTER_CRITICAL(&budget_lock);
+    if (guard_find(task) < 0 && (slot = guard_find(NULL)) >= 0)
+    {
+        guarded[slot] = task;
+    }
+    portEXIT_CRITICAL(&budget_lock);
+}
+
+void mem_budget_guard_leave(void)
+{
+    int slot;
+
+    portENTER_CRITICAL(&budget_lock);
+    if ((slot = guard_find(xTaskGetCurrentTaskHandle())) >= 0)
+    {
+        guarded[slot] = NULL;
+    }
+    portEXIT_CRITICAL(&budget_lock);
+}
+
+#else
+
+void mem_budget_guard_enter(void)
+{
+}
+
+void mem_budget_guard_leave(void)
+{
+}
+
+#endif
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum number of subsystems in the memory budget
+ */
+#define MEM_BUDGET_MAX_ENTRIES (16)
+
+/**
+ * @brief Record the memory a subsystem sets aside at init. Calling it again for the same subsystem
+ * adds to its entry.
+ *
+ * @param subsystem name shown in the report, must stay valid
+ * @param static_bytes statically sized buffers: task stacks, queues, arenas
+ * @param heap_bytes heap taken once at init by the drivers and libraries it uses
+ */
+void mem_budget_add(const char *subsystem, size_t static_bytes, size_t heap_bytes);
+
+/**
+ * @brief Log the footprint of every subsystem and the state of the heap. Called once the station
+ * has published its first window, when everything has been set up.
+ */
+void mem_budget_report(void);
+
+/**
+ * @brief Log the free heap, the lowest it has been and the largest free block every
+ * CONFIG_MEMORY_REPORT_INTERVAL_S seconds
+ */
+void mem_budget_monitor_start(void);
+
+/**
+ * @brief Mark the calling task as being in its steady state loop. With CONFIG_MEMORY_ALLOC_GUARD
+ * set, any malloc(), calloc() or realloc() from the task aborts with the caller's address.
+ * No-op otherwise.
+ *
+ * Only calls to those three functions are caught. heap_caps_malloc() and pvPortMalloc() go to the
+ * heap directly, and so does newlib's _malloc_r(), which fopen() and the rest of stdio allocate
+ * through: a guarded task that touches files is not checked, so tasks that do are left unguarded.
+ */
+void mem_budget_guard_enter(void);
+
+/**
+ * @brief Allow the calling task to allocate again, e.g. around a reconnect
+ */
+void mem_budget_guard_leave(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -12,8 +12,8 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
-#include "esp_vfs_fat.h"
-#include "driver/sdmmc_host.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 
 #include "nvs.h"
 #include "nvs_flash.h"
@@ -22,9 +22,30 @@
 #include "aws_iot_log.h"
 #include "aws_iot_version.h"
 #include "aws_iot_mqtt_client_interface.h"
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+#include "aws_iot_mqtt_client_common_internal.h"
+#include "timer_interface.h"
+#endif
 
 #include <wifi.h>
-#include "sensors.h"
+#include "sampler.h"
+#include "telemetry.h"
+#include "radio_power.h"
+#include "boot_metrics.h"
+#include "timesync.h"
+#include "latency_stats.h"
+#include "sdcard.h"
+#include "mem_budget.h"
+#include "supervisor.h"
+#ifdef CONFIG_AWS_CERT_CACHE
+#include "cert_cache.h"
+#endif
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+#include "mqtt_outbox.h"
+#endif
+#ifdef CONFIG_BACKFILL_ENABLE
+#include "backfiller.h"
+#endif
 
 static const char *TAG = "MQTTAWS";
 
@@ -91,87 +112,280 @@ void disconnectCallbackHandler(AWS_IoT_Client *pClient, void *data) {
     }
 }
 
-#define MAX_ID_STRING (32)
+#define MAX_ID_STRING (TELEMETRY_ID_MAX + 1)
+#define MQTT_TASK_STACK_SIZE (9216)
+#define MQTT_TASK_PRIORITY (5)
+#define MQTT_TASK_CORE (1)
 
-static char *create_id_string(void)
+#ifndef CONFIG_TELEMETRY_FORMAT_BINARY
+// A window is published as one message: fixed header, topic and packet id, then the payload
+_Static_assert(5 + 2 + sizeof(CONFIG_AWS_TOPIC "/") + TELEMETRY_ID_MAX + 2 + TELEMETRY_JSON_MAX <= AWS_IOT_MQTT_TX_BUF_LEN,
+               "JSON windows do not fit in CONFIG_AWS_IOT_MQTT_TX_BUF_LEN");
+#endif
+
+static StaticTask_t mqtt_tcb;
+static StackType_t mqtt_stack[MQTT_TASK_STACK_SIZE];
+
+static latency_series_t queue_latency;
+static latency_series_t publish_latency;
+static latency_series_t total_latency;
+
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+/**
+ * @brief How long each pass waits for PUBACKs while messages are in flight
+ */
+#define ACK_POLL_MS (100)
+
+static mqtt_outbox_t outbox;
+#endif
+
+#ifdef CONFIG_BACKFILL_ENABLE
+/**
+ * @brief How long each pass reads the connection while a historical query runs, instead of the
+ * usual 100ms, so its chunks go out and its acks come in without waiting for the next window
+ */
+#define BACKFILL_YIELD_MS (10)
+
+#define BACKFILL_REQUEST_SUFFIX "/backfill/req"
+#define BACKFILL_RESPONSE_SUFFIX "/backfill/resp"
+
+// A chunk is published as one QoS0 message: fixed header, topic, then the payload
+_Static_assert(5 + 2 + sizeof(CONFIG_AWS_TOPIC "/") + TELEMETRY_ID_MAX + sizeof(BACKFILL_RESPONSE_SUFFIX) +
+               CONFIG_BACKFILL_CHUNK_SIZE <= AWS_IOT_MQTT_TX_BUF_LEN,
+               "CONFIG_BACKFILL_CHUNK_SIZE chunks do not fit in CONFIG_AWS_IOT_MQTT_TX_BUF_LEN");
+
+/* The SDK keeps the topic pointer of a subscription */
+static char backfill_request_topic[128];
+static char backfill_response_topic[128];
+
+static void backfill_request_handler(AWS_IoT_Client *pClient, char *topicName, uint16_t topicNameLen,
+                                     IoT_Publish_Message_Params *params, void *pData) {
+    backfiller_receive(params->payload, params->payloadLen);
+}
+
+/**
+ * @brief Publish the chunks the backfill task has ready. Called after the live window of the pass,
+ * which goes first.
+ */
+static void publish_backfill(AWS_IoT_Client *client) {
+    IoT_Publish_Message_Params params = { .qos = QOS0, .isRetained = 0 };
+    const char *chunk;
+    size_t len;
+
+    while (backfiller_take(&chunk, &len)) {
+        params.payload = (void *)chunk;
+        params.payloadLen = len;
+        if (aws_iot_mqtt_publish(client, backfill_response_topic, strlen(backfill_response_topic), &params) != SUCCESS) {
+            // The backend notices the gap in the seqs and asks again
+            ESP_LOGW(TAG, "Could not publish a backfill chunk of %u bytes", (unsigned)len);
+        }
+    }
+}
+#endif
+
+/**
+ * @brief Time to wait for the next window. While a historical query runs the loop does not idle,
+ * its chunks and acks are moved every pass.
+ */
+static TickType_t window_wait(TickType_t wait) {
+#ifdef CONFIG_BACKFILL_ENABLE
+    if (backfiller_active()) {
+        return 0;
+    }
+#endif
+    return wait;
+}
+
+static uint32_t yield_ms(void) {
+#ifdef CONFIG_BACKFILL_ENABLE
+    if (backfiller_active()) {
+        return BACKFILL_YIELD_MS;
+    }
+#endif
+    return 100;
+}
+
+/**
+ * @brief Record the pipeline latencies of a delivered window and log a report every
+ * CONFIG_LATENCY_REPORT_WINDOWS windows. With QoS1 a window counts as delivered when it is acked.
+ */
+static void record_latency(int64_t acquired_us, int64_t enqueued_us, int64_t published_us)
 {
-    uint8_t mac[6];
-    char *id_string = calloc(1, MAX_ID_STRING);
-    if (id_string != NULL)
-    {
-        esp_read_mac(mac, ESP_MAC_WIFI_STA);
-        snprintf(id_string, MAX_ID_STRING,  "%s_%02x%02X%02X", CONFIG_DEVICE_LOCATION_NAME, mac[3], mac[4], mac[5]);
+    static uint32_t windows = 0;
+
+    latency_series_add(&queue_latency, enqueued_us - acquired_us);
+    latency_series_add(&publish_latency, published_us - enqueued_us);
+    latency_series_add(&total_latency, published_us - acquired_us);
+    if (++windows % CONFIG_LATENCY_REPORT_WINDOWS == 0) {
+        latency_series_log(&queue_latency);
+        latency_series_log(&publish_latency);
+        latency_series_log(&total_latency);
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+        mqtt_outbox_log(&outbox);
+#endif
     }
-    return id_string;
 }
 
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+typedef struct {
+    AWS_IoT_Client *client;
+    const char *topic;
+    uint16_t topic_len;
+} publish_target_t;
 
-void aws_iot_task(void *param) {
-    static char cPayload[1024] = {0};
-    static char topic[256] = {0};
-    int topic_len = 0;
-    sensor_data *sensorinfo = NULL;
+/**
+ * @brief Write a QoS1 PUBLISH to the connection without waiting for its PUBACK.
+ *
+ * aws_iot_mqtt_publish() blocks on the PUBACK of every QoS1 message, which holds publishing to one
+ * message per round trip. The packet is built here instead and written with the SDK's transport;
+ * poll_acks() collects the acks and the outbox does the bookkeeping.
+ */
+static int publish_qos1(uint16_t packet_id, bool dup, const uint8_t *payload, size_t len, void *ctx)
+{
+    publish_target_t *target = ctx;
+    AWS_IoT_Client *client = target->client;
+    unsigned char *buf = client->clientData.writeBuf;
+    size_t remaining = 2 + target->topic_len + 2 + len;
+    size_t pos = 0;
+    Timer timer;
+
+    if (!aws_iot_mqtt_is_client_connected(client) || remaining + 5 > AWS_IOT_MQTT_TX_BUF_LEN) {
+        return -1;
+    }
+    buf[pos++] = (PUBLISH << 4) | (dup ? 0x08 : 0) | (QOS1 << 1);
+    do {
+        uint8_t byte = remaining & 0x7f;
+        remaining >>= 7;
+        buf[pos++] = byte | (remaining ? 0x80 : 0);
+    } while (remaining);
+    buf[pos++] = target->topic_len >> 8;
+    buf[pos++] = target->topic_len & 0xff;
+    memcpy(&buf[pos], target->topic, target->topic_len);
+    pos += target->topic_len;
+    buf[pos++] = packet_id >> 8;
+    buf[pos++] = packet_id & 0xff;
+    memcpy(&buf[pos], payload, len);
+    pos += len;
+
+    init_timer(&timer);
+    countdown_ms(&timer, client->clientData.commandTimeout_ms);
+    return aws_iot_mqtt_internal_send_packet(client, pos, &timer) == SUCCESS ? 0 : -1;
+}
 
-    IoT_Error_t rc = FAILURE;
+static void window_acked(int64_t acquired_us, int64_t enqueued_us, int64_t acked_us, void *ctx)
+{
+    record_latency(acquired_us, enqueued_us, acked_us);
+    boot_metrics_mark(BOOT_STAGE_FIRST_PUBLISH);
+}
 
-    AWS_IoT_Client client;
-    IoT_Client_Init_Params mqttInitParams = iotClientInitParamsDefault;
-    IoT_Client_Connect_Params connectParams = iotClientConnectParamsDefault;
+/**
+ * @brief Read PUBACKs for up to wait_ms, or until nothing is in flight. PUBACKs that arrive during
+ * aws_iot_mqtt_yield() are dropped by the SDK; those messages are simply sent again on timeout.
+ */
+static void poll_acks(AWS_IoT_Client *client, uint32_t wait_ms)
+{
+    Timer timer;
+    uint8_t packet_type;
+    unsigned char type;
+    unsigned char dup;
+    uint16_t packet_id;
+
+    init_timer(&timer);
+    countdown_ms(&timer, wait_ms);
+    while (mqtt_outbox_inflight(&outbox) > 0 && !has_timer_expired(&timer)) {
+        packet_type = 0;
+        if (aws_iot_mqtt_internal_cycle_read(client, &timer, &packet_type) != SUCCESS) {
+            break;
+        }
+        if (packet_type == PUBACK &&
+            aws_iot_mqtt_internal_deserialize_ack(&type, &dup, &packet_id, client->clientData.readBuf,
+                                                  AWS_IOT_MQTT_RX_BUF_LEN) == SUCCESS) {
+            mqtt_outbox_ack(&outbox, packet_id, esp_timer_get_time());
+        }
+    }
+}
+#endif
 
-    IoT_Publish_Message_Params paramsQOS0;
+/**
+ * @brief Convert the window times from esp_timer time to Unix time once SNTP has set the clock
+ */
+static void window_to_unix_time(sensor_window_t *window)
+{
+    window->unix_time = timesync_to_unix_us(window->first_us, &window->first_us) &&
+                        timesync_to_unix_us(window->last_us, &window->last_us) &&
+                        timesync_to_unix_us(window->enqueued_us, &window->enqueued_us) &&
+                        timesync_to_unix_us(window->sent_us, &window->sent_us);
+}
 
-    mqttInitParams.enableAutoReconnect = false; // We enable this later below
-    mqttInitParams.pHostURL = HostAddress;
-    mqttInitParams.port = port;
+static char *create_id_string(void)
+{
+    static char id_string[MAX_ID_STRING];
+    uint8_t mac[6];
 
-#if defined(CONFIG_AWS_EMBEDDED_CERTS)
-    mqttInitParams.pRootCALocation = (const char *)aws_root_ca_pem_start;
-    mqttInitParams.pDeviceCertLocation = (const char *)certificate_pem_crt_start;
-    mqttInitParams.pDevicePrivateKeyLocation = (const char *)private_pem_key_start;
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(id_string, MAX_ID_STRING,  "%s_%02x%02X%02X", CONFIG_DEVICE_LOCATION_NAME, mac[3], mac[4], mac[5]);
+    return id_string;
+}
 
-#elif defined(CONFIG_AWS_FILESYSTEM_CERTS)
-    mqttInitParams.pRootCALocation = ROOT_CA_PATH;
-    mqttInitParams.pDeviceCertLocation = DEVICE_CERTIFICATE_PATH;
-    mqttInitParams.pDevicePrivateKeyLocation = DEVICE_PRIVATE_KEY_PATH;
+
+static char cPayload[TELEMETRY_JSON_MAX] = {0};
+static char topic[256] = {0};
+static int topic_len = 0;
+static sensor_window_t window;
+static sensor_window_t stamped;
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+static publish_target_t target;
 #endif
 
-    mqttInitParams.mqttCommandTimeout_ms = 20000;
-    mqttInitParams.tlsHandshakeTimeout_ms = 5000;
-    mqttInitParams.isSSLHostnameVerify = true;
-    mqttInitParams.disconnectHandler = disconnectCallbackHandler;
-    mqttInitParams.disconnectHandlerData = NULL;
+/* The client lives across sessions, it is torn down and set up again when the session fails */
+static AWS_IoT_Client client;
+static bool client_initialised = false;
+static IoT_Client_Init_Params mqttInitParams;
+static IoT_Client_Connect_Params connectParams;
+
+/**
+ * @brief Connect, register and publish windows until the connection fails in a way auto reconnect
+ * does not recover from
+ *
+ * @return why the session ended
+ */
+static const char *mqtt_session(void) {
+    static bool budgeted = false;
+    int payload_len = 0;
+    char *payload;
+    size_t payload_size;
+    IoT_Error_t rc = FAILURE;
+    IoT_Publish_Message_Params paramsQOS0;
+
+#if defined(CONFIG_AWS_CERT_CACHE)
+    cert_cache_t certs;
 
-#ifdef CONFIG_AWS_SDCARD_CERTS
-    ESP_LOGI(TAG, "Mounting SD card...");
-    sdmmc_host_t host = SDMMC_HOST_DEFAULT();
-    sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
-    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
-        .format_if_mount_failed = false,
-        .max_files = 3,
-    };
-    sdmmc_card_t* card;
-    esp_err_t ret = esp_vfs_fat_sdmmc_mount("/sdcard", &host, &slot_config, &mount_config, &card);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Failed to mount SD card VFAT filesystem. Error: %s", esp_err_to_name(ret));
-        abort();
+    /* The TLS layer takes PEM strings as well as paths, so the files are only read once */
+    if (cert_cache_load(&certs) != ESP_OK) {
+        return "no usable certificates";
+    }
+    mqttInitParams.pRootCALocation = certs.root_ca;
+    mqttInitParams.pDeviceCertLocation = certs.certificate;
+    mqttInitParams.pDevicePrivateKeyLocation = certs.private_key;
+#elif defined(CONFIG_AWS_SDCARD_CERTS)
+    if (sdcard_mount() != ESP_OK) {
+        return "SD card mount failed";
     }
 #endif
 
     rc = aws_iot_mqtt_init(&client, &mqttInitParams);
     if(SUCCESS != rc) {
         ESP_LOGE(TAG, "aws_iot_mqtt_init returned error : %d ", rc);
-        abort();
+        return "aws_iot_mqtt_init failed";
     }
+    client_initialised = true;
 
-    connectParams.keepAliveIntervalInSec = 10;
-    connectParams.isCleanSession = true;
-    connectParams.MQTTVersion = MQTT_3_1_1;
-    /* Client ID is is generated from the WIFI MAC address */
-    connectParams.pClientID = create_id_string();
-    connectParams.clientIDLen = (uint16_t) strlen(connectParams.pClientID);
-    connectParams.isWillMsgPresent = false;
+    /* Wi-Fi association was started by app_main and runs while the sensors come up */
+    wifi_waitforconnect();
+    boot_metrics_mark(BOOT_STAGE_NETWORK_UP);
 
     ESP_LOGI(TAG, "Connecting to AWS: %s:%d...", mqttInitParams.pHostURL, mqttInitParams.port);
+    size_t free_before_connect = heap_caps_get_free_size(MALLOC_CAP_8BIT);
     do {
         rc = aws_iot_mqtt_connect(&client, &connectParams);
         if(SUCCESS != rc) {
@@ -180,6 +394,18 @@ void aws_iot_task(void *param) {
         }
     } while(SUCCESS != rc);
     ESP_LOGI(TAG, "Connected");
+    boot_metrics_mark(BOOT_STAGE_MQTT_CONNECTED);
+    if (!budgeted) {
+        // The TLS session is the one large heap user; other tasks allocate meanwhile, so this is approximate
+        size_t free_after_connect = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        mem_budget_add("mqtt", sizeof(mqtt_stack) + sizeof(mqtt_tcb) + sizeof(client) + sizeof(cPayload) + sizeof(topic) +
+                       2 * sizeof(sensor_window_t) + 3 * sizeof(latency_series_t)
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+                       + sizeof(outbox)
+#endif
+                       , free_before_connect > free_after_connect ? free_before_connect - free_after_connect : 0);
+        budgeted = true;
+    }
 
     /*
      * Enable Auto Reconnect functionality. Minimum and Maximum time of Exponential backoff are set in aws_iot_config.h
@@ -189,54 +415,224 @@ void aws_iot_task(void *param) {
     rc = aws_iot_mqtt_autoreconnect_set_status(&client, true);
     if(SUCCESS != rc) {
         ESP_LOGE(TAG, "Unable to set Auto Reconnect to true - %d", rc);
-        abort();
+        return "auto reconnect setup failed";
     }
+    supervisor_up(SUPERVISOR_MQTT, esp_timer_get_time());
+
+    paramsQOS0.qos = QOS0;
+    paramsQOS0.payload = (void *) cPayload;
+    paramsQOS0.isRetained = 0;
 
-    sprintf(topic, "%s/%s", CONFIG_AWS_TOPIC, connectParams.pClientID);
+#ifdef CONFIG_TELEMETRY_FORMAT_BINARY
+    /* The static identity is sent once, retained, so the readings do not have to repeat it */
+    snprintf(topic, sizeof(topic), "%s/%s/register", CONFIG_AWS_TOPIC, connectParams.pClientID);
+    payload_len = telemetry_encode_registration(connectParams.pClientID, cPayload, sizeof(cPayload));
+    if (payload_len > 0) {
+        paramsQOS0.isRetained = 1;
+        paramsQOS0.payloadLen = payload_len;
+        ESP_LOGI(TAG, "Registering on %s: %s", topic, cPayload);
+        rc = aws_iot_mqtt_publish(&client, topic, strlen(topic), &paramsQOS0);
+        paramsQOS0.isRetained = 0;
+    }
+    snprintf(topic, sizeof(topic), "%s/%s/bin", CONFIG_AWS_TOPIC, connectParams.pClientID);
+#else
+    snprintf(topic, sizeof(topic), "%s/%s", CONFIG_AWS_TOPIC, connectParams.pClientID);
+#endif
     topic_len = strlen(topic);
 
     ESP_LOGI(TAG, "Publishing to topic: %s", topic);
 
-    paramsQOS0.qos = QOS0;
-    paramsQOS0.payload = (void *) cPayload;
-    paramsQOS0.isRetained = 0;
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+    target.topic_len = topic_len;
+    // The session is clean, so whatever was in flight when the last one failed has to go again
+    mqtt_outbox_requeue(&outbox);
+#endif
 
+#ifdef CONFIG_BACKFILL_ENABLE
+    // Auto reconnect subscribes again by itself; a new session has to
+    snprintf(backfill_request_topic, sizeof(backfill_request_topic), "%s/%s" BACKFILL_REQUEST_SUFFIX, CONFIG_AWS_TOPIC, connectParams.pClientID);
+    snprintf(backfill_response_topic, sizeof(backfill_response_topic), "%s/%s" BACKFILL_RESPONSE_SUFFIX, CONFIG_AWS_TOPIC, connectParams.pClientID);
+    if (aws_iot_mqtt_subscribe(&client, backfill_request_topic, strlen(backfill_request_topic), QOS0,
+                               backfill_request_handler, NULL) == SUCCESS) {
+        ESP_LOGI(TAG, "Answering historical data queries on %s", backfill_request_topic);
+    } else {
+        ESP_LOGW(TAG, "Could not subscribe to %s, no historical data queries this session", backfill_request_topic);
+    }
+#endif
+
+    mem_budget_guard_enter();
     while((NETWORK_ATTEMPTING_RECONNECT == rc || NETWORK_RECONNECTED == rc || SUCCESS == rc)) {
+        // Wait for the sampler to close a window while the radio idles, so the network work happens in one
+        // short burst. Still service the connection if no window arrives.
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+        // While messages are in flight only take what is already queued, the acks are read below. With
+        // the outbox full the windows wait in the sampler queue.
+        bool have_window = false;
+        if (mqtt_outbox_has_room(&outbox)) {
+            have_window = sampler_receive(&window, mqtt_outbox_inflight(&outbox) ? 0 : window_wait(pdMS_TO_TICKS(2 * CONFIG_PUBLISH_INTERVAL_MS)));
+        } else if (mqtt_outbox_inflight(&outbox) == 0) {
+            // Full of messages that could not be sent yet: wait for the connection
+            vTaskDelay(pdMS_TO_TICKS(ACK_POLL_MS));
+        }
+#else
+        bool have_window = sampler_receive(&window, window_wait(pdMS_TO_TICKS(2 * CONFIG_PUBLISH_INTERVAL_MS)));
+#endif
 
+        radio_power_burst_begin();
+        // A reconnect sets up a new TLS session, which allocates
+        bool reconnecting = !aws_iot_mqtt_is_client_connected(&client);
+        if (reconnecting) {
+            mem_budget_guard_leave();
+        }
         //Max time the yield function will wait for read messages
-        rc = aws_iot_mqtt_yield(&client, 100);
+        rc = aws_iot_mqtt_yield(&client, yield_ms());
+        if (reconnecting) {
+            mem_budget_guard_enter();
+        }
         if(NETWORK_ATTEMPTING_RECONNECT == rc) {
             // If the client is attempting to reconnect we will skip the rest of the loop.
+            radio_power_burst_end();
             continue;
         }
-        vTaskDelay(1000 / portTICK_RATE_MS);
-
-        sensorinfo = get_sensors();
-
-        sprintf(cPayload, "{\"location\":\"%s\", \"type\": \"%s\", \"id\": \"%s\", \"temperature\": %0.01f, \"humidity\": %0.01f, \"rain\": %0.01f, \"groundtemperature\": %0.01f, \"groundmoisture\": %d, \"pressure\": %0.02f}",
-             CONFIG_DEVICE_LOCATION_NAME,
-             CONFIG_DEVICE_TYPE_NAME,
-             connectParams.pClientID,
-             sensorinfo->temperature,
-             sensorinfo->humidity,
-             sensorinfo->rainmm,
-             sensorinfo->groundtemperature,
-             sensorinfo->groundmoisture,
-             sensorinfo->pressure
-        );
-        paramsQOS0.payloadLen = strlen(cPayload);
-        ESP_LOGI(TAG, "Sending to %s: %s", topic, cPayload);
-        rc = aws_iot_mqtt_publish(&client, topic, topic_len, &paramsQOS0);
-
-        vTaskDelay(10000 / portTICK_RATE_MS);
-    }
-
-    ESP_LOGE(TAG, "An error occurred in the main loop.");
-    abort();
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+        if (NETWORK_RECONNECTED == rc) {
+            // The session is clean, so whatever was in flight has to go again
+            mqtt_outbox_requeue(&outbox);
+        }
+#endif
+
+        if (have_window) {
+            // Latency is measured on the monotonic clock, the payload carries the converted times
+            window.sent_us = esp_timer_get_time();
+            stamped = window;
+            window_to_unix_time(&stamped);
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+            // Encoded straight into the outbox slot it is sent from
+            payload = (char *)mqtt_outbox_reserve(&outbox, &payload_size);
+#else
+            payload = cPayload;
+            payload_size = sizeof(cPayload);
+#endif
+#ifdef CONFIG_TELEMETRY_FORMAT_BINARY
+            payload_len = telemetry_encode_binary(&stamped, (uint8_t *)payload, payload_size);
+            ESP_LOGI(TAG, "Sending %d bytes to %s", payload_len, topic);
+#else
+            payload_len = telemetry_encode_json(&stamped, connectParams.pClientID, payload, payload_size);
+            ESP_LOGI(TAG, "Sending to %s: %s", topic, payload);
+#endif
+            if (payload_len <= 0) {
+                ESP_LOGE(TAG, "Payload does not fit in the payload buffer");
+            }
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+            mqtt_outbox_commit(&outbox, payload_len > 0 ? payload_len : 0, window.last_us, window.enqueued_us);
+#else
+            if (payload_len > 0) {
+                paramsQOS0.payloadLen = payload_len;
+                rc = aws_iot_mqtt_publish(&client, topic, topic_len, &paramsQOS0);
+                if (SUCCESS == rc) {
+                    record_latency(window.last_us, window.enqueued_us, esp_timer_get_time());
+                    boot_metrics_mark(BOOT_STAGE_FIRST_PUBLISH);
+                }
+            }
+#endif
+        }
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+        if (mqtt_outbox_service(&outbox, esp_timer_get_time()) != 0) {
+            ESP_LOGW(TAG, "Publish failed, the outbox will send it again");
+        }
+        poll_acks(&client, ACK_POLL_MS);
+#endif
+#ifdef CONFIG_BACKFILL_ENABLE
+        publish_backfill(&client);
+#endif
+        radio_power_burst_end();
+    }
+
+    ESP_LOGE(TAG, "An error occurred in the main loop: %d", rc);
+    // Tearing the session down and setting up the next one allocates
+    mem_budget_guard_leave();
+    return "connection lost";
+}
+
+/**
+ * @brief Release the client of a failed session so the next one starts from scratch
+ */
+static void mqtt_teardown(void) {
+    if (!client_initialised) {
+        return;
+    }
+    if (aws_iot_mqtt_is_client_connected(&client)) {
+        aws_iot_mqtt_disconnect(&client);
+    }
+    aws_iot_mqtt_free(&client);
+    client_initialised = false;
+}
+
+void aws_iot_task(void *param) {
+    const char *fault;
+
+    mqttInitParams = iotClientInitParamsDefault;
+    connectParams = iotClientConnectParamsDefault;
+
+    mqttInitParams.enableAutoReconnect = false; // We enable this later below
+    mqttInitParams.pHostURL = HostAddress;
+    mqttInitParams.port = port;
+
+#if defined(CONFIG_AWS_EMBEDDED_CERTS)
+    mqttInitParams.pRootCALocation = (const char *)aws_root_ca_pem_start;
+    mqttInitParams.pDeviceCertLocation = (const char *)certificate_pem_crt_start;
+    mqttInitParams.pDevicePrivateKeyLocation = (const char *)private_pem_key_start;
+
+#elif defined(CONFIG_AWS_FILESYSTEM_CERTS)
+    mqttInitParams.pRootCALocation = ROOT_CA_PATH;
+    mqttInitParams.pDeviceCertLocation = DEVICE_CERTIFICATE_PATH;
+    mqttInitParams.pDevicePrivateKeyLocation = DEVICE_PRIVATE_KEY_PATH;
+#endif
+
+    mqttInitParams.mqttCommandTimeout_ms = 20000;
+    mqttInitParams.tlsHandshakeTimeout_ms = 5000;
+    mqttInitParams.isSSLHostnameVerify = true;
+    mqttInitParams.disconnectHandler = disconnectCallbackHandler;
+    mqttInitParams.disconnectHandlerData = NULL;
+
+    connectParams.keepAliveIntervalInSec = radio_power_keepalive_sec();
+    connectParams.isCleanSession = true;
+    connectParams.MQTTVersion = MQTT_3_1_1;
+    /* Client ID is is generated from the WIFI MAC address */
+    connectParams.pClientID = create_id_string();
+    connectParams.clientIDLen = (uint16_t) strlen(connectParams.pClientID);
+    connectParams.isWillMsgPresent = false;
+
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+    latency_series_init(&queue_latency, "Acquisition to enqueue");
+    latency_series_init(&publish_latency, "Enqueue to ack");
+    latency_series_init(&total_latency, "Acquisition to ack");
+    target.client = &client;
+    target.topic = topic;
+    mqtt_outbox_init(&outbox, CONFIG_MQTT_INFLIGHT_WINDOW, CONFIG_MQTT_ACK_TIMEOUT_MS, publish_qos1, window_acked, &target);
+#else
+    latency_series_init(&queue_latency, "Acquisition to enqueue");
+    latency_series_init(&publish_latency, "Enqueue to publish");
+    latency_series_init(&total_latency, "Acquisition to publish");
+#endif
+
+    /*
+     * A failed session only restarts the MQTT client, with backoff. Acquisition carries on meanwhile
+     * and the sampler queue keeps the newest windows, which go out once the client is back.
+     */
+    for (;;) {
+        fault = mqtt_session();
+        mqtt_teardown();
+        supervisor_fault(SUPERVISOR_MQTT, fault, esp_timer_get_time());
+        while (!supervisor_restart_due(SUPERVISOR_MQTT, esp_timer_get_time())) {
+            vTaskDelay(pdMS_TO_TICKS(supervisor_wait_ms(SUPERVISOR_MQTT, esp_timer_get_time())));
+        }
+    }
 }
 
 void start_mqtt(void)
 {
     ESP_LOGI(TAG, "AWS IoT SDK Version %d.%d.%d-%s", VERSION_MAJOR, VERSION_MINOR, VERSION_PATCH, VERSION_TAG);
-   xTaskCreatePinnedToCore(&aws_iot_task, "aws_iot_task", 9216, NULL, 5, NULL, 1);
+   xTaskCreateStaticPinnedToCore(&aws_iot_task, "aws_iot_task", MQTT_TASK_STACK_SIZE, NULL, MQTT_TASK_PRIORITY,
+                                 mqtt_stack, &mqtt_tcb, MQTT_TASK_CORE);
 }
\ No newline at end of file
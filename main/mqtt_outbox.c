@@ -0,0 +1,212 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_MQTT_DELIVERY_QOS1
+
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "mqtt_outbox.h"
+
+static const char *TAG = "OUTBOX";
+
+void mqtt_outbox_init(mqtt_outbox_t *outbox, uint32_t window, uint32_t ack_timeout_ms,
+                      mqtt_outbox_send_t send, mqtt_outbox_acked_t acked, void *ctx)
+{
+    memset(outbox, 0, sizeof(mqtt_outbox_t));
+    outbox->window = (window > 0) ? window : 1;
+    outbox->ack_timeout_us = (int64_t)ack_timeout_ms * 1000;
+    outbox->next_packet_id = 1;
+    outbox->reserved = -1;
+    outbox->send = send;
+    outbox->acked = acked;
+    outbox->ctx = ctx;
+    latency_series_init(&outbox->ack_latency, "Publish to ack");
+}
+
+uint32_t mqtt_outbox_inflight(const mqtt_outbox_t *outbox)
+{
+    return outbox->inflight;
+}
+
+bool mqtt_outbox_has_room(const mqtt_outbox_t *outbox)
+{
+    return outbox->inflight + outbox->queued < CONFIG_MQTT_OUTBOX_LENGTH;
+}
+
+uint8_t *mqtt_outbox_reserve(mqtt_outbox_t *outbox, size_t *capacity)
+{
+    for (int i = 0; i < CONFIG_MQTT_OUTBOX_LENGTH; i++)
+    {
+        if (outbox->slots[i].state == MQTT_OUTBOX_FREE)
+        {
+            outbox->reserved = i;
+            *capacity = sizeof(outbox->slots[i].payload);
+            return outbox->slots[i].payload;
+        }
+    }
+    return NULL;
+}
+
+void mqtt_outbox_commit(mqtt_outbox_t *outbox, size_t len, int64_t acquired_us, int64_t enqueued_us)
+{
+    mqtt_outbox_slot_t *slot;
+
+    if (outbox->reserved < 0)
+    {
+        return;
+    }
+    slot = &outbox->slots[outbox->reserved];
+    outbox->reserved = -1;
+    if (len == 0 || len > sizeof(slot->payload))
+    {
+        return;
+    }
+    slot->state = MQTT_OUTBOX_QUEUED;
+    slot->len = len;
+    slot->retries = 0;
+    slot->order = outbox->next_order++;
+    slot->acquired_us = acquired_us;
+    slot->enqueued_us = enqueued_us;
+    outbox->queued++;
+}
+
+/**
+ * @brief Next packet identifier: non-zero and not held by another message in flight
+ */
+static uint16_t next_packet_id(mqtt_outbox_t *outbox)
+{
+    for (;;)
+    {
+        uint16_t id = outbox->next_packet_id++;
+        bool taken = false;
+
+        if (id == 0)
+        {
+            continue;
+        }
+        for (int i = 0; i < CONFIG_MQTT_OUTBOX_LENGTH && !taken; i++)
+        {
+            taken = outbox->slots[i].state == MQTT_OUTBOX_INFLIGHT && outbox->slots[i].packet_id == id;
+        }
+        if (!taken)
+        {
+            return id;
+        }
+    }
+}
+
+static int slot_send(mqtt_outbox_t *outbox, mqtt_outbox_slot_t *slot, bool dup, int64_t now_us)
+{
+    if (outbox->send(slot->packet_id, dup, slot->payload, slot->len, outbox->ctx) != 0)
+    {
+        return -1;
+    }
+    slot->sent_us = now_us;
+    return 0;
+}
+
+int mqtt_outbox_service(mqtt_outbox_t *outbox, int64_t now_us)
+{
+    // Resend what timed out first, so a lost packet is not overtaken by the whole backlog
+    for (int i = 0; i < CONFIG_MQTT_OUTBOX_LENGTH; i++)
+    {
+        mqtt_outbox_slot_t *slot = &outbox->slots[i];
+
+        if (slot->state == MQTT_OUTBOX_INFLIGHT && now_us - slot->sent_us >= outbox->ack_timeout_us)
+        {
+            if (slot_send(outbox, slot, true, now_us) != 0)
+            {
+                return -1;
+            }
+            slot->retries++;
+            outbox->stats.retransmits++;
+            ESP_LOGW(TAG, "No ack for packet %u, sent again (%u)", slot->packet_id, slot->retries);
+        }
+    }
+
+    // Then fill the window, oldest message first
+    while (outbox->queued > 0 && outbox->inflight < outbox->window)
+    {
+        mqtt_outbox_slot_t *oldest = NULL;
+
+        for (int i = 0; i < CONFIG_MQTT_OUTBOX_LENGTH; i++)
+        {
+            mqtt_outbox_slot_t *slot = &outbox->slots[i];
+
+            if (slot->state == MQTT_OUTBOX_QUEUED && (oldest == NULL || (int32_t)(slot->order - oldest->order) < 0))
+            {
+                oldest = slot;
+            }
+        }
+        if (oldest == NULL)
+        {
+            break;
+        }
+        oldest->packet_id = next_packet_id(outbox);
+        if (slot_send(outbox, oldest, false, now_us) != 0)
+        {
+            return -1;
+        }
+        oldest->state = MQTT_OUTBOX_INFLIGHT;
+        oldest->first_sent_us = now_us;
+        outbox->queued--;
+        outbox->inflight++;
+        if (outbox->inflight > outbox->stats.max_inflight)
+        {
+            outbox->stats.max_inflight = outbox->inflight;
+        }
+        outbox->stats.depth_sum += outbox->inflight;
+        outbox->stats.depth_samples++;
+    }
+    return 0;
+}
+
+bool mqtt_outbox_ack(mqtt_outbox_t *outbox, uint16_t packet_id, int64_t now_us)
+{
+    for (int i = 0; i < CONFIG_MQTT_OUTBOX_LENGTH; i++)
+    {
+        mqtt_outbox_slot_t *slot = &outbox->slots[i];
+
+        if (slot->state == MQTT_OUTBOX_INFLIGHT && slot->packet_id == packet_id)
+        {
+            latency_series_add(&outbox->ack_latency, now_us - slot->first_sent_us);
+            outbox->stats.acked++;
+            if (outbox->acked != NULL)
+            {
+                outbox->acked(slot->acquired_us, slot->enqueued_us, now_us, outbox->ctx);
+            }
+            slot->state = MQTT_OUTBOX_FREE;
+            outbox->inflight--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void mqtt_outbox_requeue(mqtt_outbox_t *outbox)
+{
+    for (int i = 0; i < CONFIG_MQTT_OUTBOX_LENGTH; i++)
+    {
+        mqtt_outbox_slot_t *slot = &outbox->slots[i];
+
+        // Sent again right away on the next service, with the DUP flag
+        if (slot->state == MQTT_OUTBOX_INFLIGHT)
+        {
+            slot->sent_us -= outbox->ack_timeout_us;
+        }
+    }
+}
+
+void mqtt_outbox_log(const mqtt_outbox_t *outbox)
+{
+    const mqtt_outbox_stats_t *stats = &outbox->stats;
+
+    ESP_LOGI(TAG, "In flight %u (max %u, mean %.1f of %u), acked %u, retransmits %u",
+             outbox->inflight, stats->max_inflight,
+             stats->depth_samples ? (double)stats->depth_sum / stats->depth_samples : 0.0,
+             outbox->window, stats->acked, stats->retransmits);
+    latency_series_log(&outbox->ack_latency);
+}
+
+#endif
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+#include "latency_stats.h"
+#include "telemetry.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Largest payload an outbox slot holds: any window in the configured telemetry format
+ */
+#ifdef CONFIG_TELEMETRY_FORMAT_BINARY
+#define MQTT_OUTBOX_PAYLOAD_SIZE (TELEMETRY_BINARY_MAX)
+#else
+#define MQTT_OUTBOX_PAYLOAD_SIZE (TELEMETRY_JSON_MAX)
+#endif
+
+/**
+ * @brief Send one QoS1 PUBLISH
+ *
+ * @param packet_id MQTT packet identifier
+ * @param dup true when this is a retransmission
+ * @param payload message payload
+ * @param len payload length
+ * @param ctx context passed to mqtt_outbox_init()
+ * @return 0 if the packet was written to the connection
+ */
+typedef int (*mqtt_outbox_send_t)(uint16_t packet_id, bool dup, const uint8_t *payload, size_t len, void *ctx);
+
+/**
+ * @brief Called when a message is acknowledged, just before its slot is released
+ *
+ * @param acquired_us acquisition time the message was committed with
+ * @param enqueued_us enqueue time the message was committed with
+ * @param acked_us time of the PUBACK
+ * @param ctx context passed to mqtt_outbox_init()
+ */
+typedef void (*mqtt_outbox_acked_t)(int64_t acquired_us, int64_t enqueued_us, int64_t acked_us, void *ctx);
+
+typedef enum {
+    MQTT_OUTBOX_FREE = 0,
+    MQTT_OUTBOX_QUEUED,                 /*!< Waiting for room in the in-flight window */
+    MQTT_OUTBOX_INFLIGHT,               /*!< Sent, waiting for its PUBACK */
+} mqtt_outbox_state_t;
+
+typedef struct {
+    mqtt_outbox_state_t state;
+    uint16_t packet_id;
+    uint8_t retries;                    /*!< Retransmissions so far */
+    uint32_t order;                     /*!< Commit order, messages are sent oldest first */
+    int64_t acquired_us;
+    int64_t enqueued_us;
+    int64_t first_sent_us;              /*!< First transmission, ack latency is measured from here */
+    int64_t sent_us;                    /*!< Last transmission, the ack timeout runs from here */
+    size_t len;
+    uint8_t payload[MQTT_OUTBOX_PAYLOAD_SIZE];
+} mqtt_outbox_slot_t;
+
+typedef struct {
+    uint32_t acked;                     /*!< Messages acknowledged */
+    uint32_t retransmits;               /*!< PUBLISHes sent again after a timeout or reconnect */
+    uint32_t max_inflight;              /*!< Deepest in-flight window seen */
+    uint32_t depth_samples;             /*!< Sends the depth sum covers */
+    uint64_t depth_sum;                 /*!< In-flight depth summed at each send */
+} mqtt_outbox_stats_t;
+
+/**
+ * @brief Messages waiting for a PUBACK. Up to a window of them are in flight at once, so publishing
+ * is not held to one message per round trip; each stays in its slot until acknowledged and is sent
+ * again, flagged DUP, if the ack does not arrive in time or the connection drops.
+ */
+typedef struct {
+    mqtt_outbox_slot_t slots[CONFIG_MQTT_OUTBOX_LENGTH];
+    uint32_t window;
+    int64_t ack_timeout_us;
+    uint32_t inflight;
+    uint32_t queued;
+    uint32_t next_order;
+    uint16_t next_packet_id;
+    int reserved;                       /*!< Slot handed out by mqtt_outbox_reserve(), -1 if none */
+    mqtt_outbox_send_t send;
+    mqtt_outbox_acked_t acked;
+    void *ctx;
+    mqtt_outbox_stats_t stats;
+    latency_series_t ack_latency;
+} mqtt_outbox_t;
+
+/**
+ * @brief Initialise an empty outbox
+ *
+ * @param outbox outbox object
+ * @param window most messages in flight at once
+ * @param ack_timeout_ms time to wait for a PUBACK before sending again
+ * @param send transport hook
+ * @param acked ack hook, may be NULL
+ * @param ctx passed to the hooks
+ */
+void mqtt_outbox_init(mqtt_outbox_t *outbox, uint32_t window, uint32_t ack_timeout_ms,
+                      mqtt_outbox_send_t send, mqtt_outbox_acked_t acked, void *ctx);
+
+/**
+ * @brief Reserve a free slot to encode the next message into, in place
+ *
+ * @param outbox outbox object
+ * @param capacity set to the payload capacity
+ * @return payload buffer, NULL if every slot is taken
+ */
+uint8_t *mqtt_outbox_reserve(mqtt_outbox_t *outbox, size_t *capacity);
+
+/**
+ * @brief Queue the reserved slot for sending
+ *
+ * @param outbox outbox object
+ * @param len payload length, 0 to give the slot back
+ * @param acquired_us acquisition time, handed back on ack
+ * @param enqueued_us enqueue time, handed back on ack
+ */
+void mqtt_outbox_commit(mqtt_outbox_t *outbox, size_t len, int64_t acquired_us, int64_t enqueued_us);
+
+/**
+ * @brief Send queued messages while the window has room, and resend those whose PUBACK timed out
+ *
+ * @return 0, or -1 if a send failed and the connection needs attention
+ */
+int mqtt_outbox_service(mqtt_outbox_t *outbox, int64_t now_us);
+
+/**
+ * @brief Handle a PUBACK and release its slot
+ *
+ * @return true if the packet id was in flight
+ */
+bool mqtt_outbox_ack(mqtt_outbox_t *outbox, uint16_t packet_id, int64_t now_us);
+
+/**
+ * @brief Mark every in-flight message for resending, after the connection was re-established
+ */
+void mqtt_outbox_requeue(mqtt_outbox_t *outbox);
+
+/**
+ * @brief Messages sent and not acknowledged yet
+ */
+uint32_t mqtt_outbox_inflight(const mqtt_outbox_t *outbox);
+
+/**
+ * @brief Whether a message can be reserved
+ */
+bool mqtt_outbox_has_room(const mqtt_outbox_t *outbox);
+
+/**
+ * @brief Log the in-flight depth, retransmissions and ack latency percentiles
+ */
+void mqtt_outbox_log(const mqtt_outbox_t *outbox);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,289 @@
+#include <math.h>
+#include <string.h>
+
+#include "pressure_trend.h"
+
+// Changes within 0.1 hPa, the resolution the tendency is reported in, count as steady
+#define STEADY_PA (10.0)
+
+// Three hour change that makes the Zambretti barometer rising or falling
+#define ZAMBRETTI_CHANGE_PA (160.0f)
+
+#define SLOTS_PER_HOUR (3600.0 / PRESSURE_TREND_SLOT_S)
+
+// Zambretti number 1-32 to forecast letter: falling 1-9, steady 10-19, rising 20-32
+static const char zambretti_letters[] = "ABDHORUXZ" "ABEKNPSWXZ" "ABCFGIJLMQTYZ";
+
+static const char *forecast_texts[26] = {
+    "Settled fine",
+    "Fine weather",
+    "Becoming fine",
+    "Fine, becoming less settled",
+    "Fine, possible showers",
+    "Fairly fine, improving",
+    "Fairly fine, possible showers early",
+    "Fairly fine, showery later",
+    "Showery early, improving",
+    "Changeable, mending",
+    "Fairly fine, showers likely",
+    "Rather unsettled, clearing later",
+    "Unsettled, probably improving",
+    "Showery, bright intervals",
+    "Showery, becoming less settled",
+    "Changeable, some rain",
+    "Unsettled, short fine intervals",
+    "Unsettled, rain later",
+    "Unsettled, some rain",
+    "Mostly very unsettled",
+    "Occasional rain, worsening",
+    "Rain at times, very unsettled",
+    "Rain at frequent intervals",
+    "Rain, very unsettled",
+    "Stormy, may improve",
+    "Stormy, much rain",
+};
+
+static void fit_update(pressure_fit_t *fit, double x, double y, int sign)
+{
+    fit->n += sign;
+    fit->sx += sign * x;
+    fit->sy += sign * y;
+    fit->sxx += sign * x * x;
+    fit->sxy += sign * x * y;
+}
+
+/**
+ * @brief Least squares line y = a + b x through the slots of a fit
+ */
+static bool fit_line(const pressure_fit_t *fit, double *a, double *b)
+{
+    double d = fit->n * fit->sxx - fit->sx * fit->sx;
+
+    if (fit->n < 2 || d <= 0.0)
+    {
+        return false;
+    }
+    *b = (fit->n * fit->sxy - fit->sx * fit->sy) / d;
+    *a = (fit->sy - *b * fit->sx) / fit->n;
+    return true;
+}
+
+static int slot_index(int64_t slot)
+{
+    return (int)(slot % PRESSURE_TREND_SLOTS);
+}
+
+/**
+ * @brief Recompute both fits from the ring, measuring x from the oldest slot
+ */
+static void trend_rebase(pressure_trend_t *trend)
+{
+    memset(&trend->older, 0, sizeof(pressure_fit_t));
+    memset(&trend->newer, 0, sizeof(pressure_fit_t));
+    trend->base = trend->head - PRESSURE_TREND_SLOTS + 1;
+    for (int age = 0; age < PRESSURE_TREND_SLOTS; age++)
+    {
+        int64_t slot = trend->head - age;
+        int i = slot_index(slot);
+
+        if (slot >= 0 && trend->count[i] > 0)
+        {
+            fit_update(age < PRESSURE_TREND_HALF ? &trend->newer : &trend->older, slot - trend->base, trend->mean[i], 1);
+        }
+    }
+}
+
+/**
+ * @brief Move the ring on by a slot: the slot turning 90 minutes old moves to the older half and
+ * the slot turning 180 minutes old drops out
+ */
+static void trend_advance(pressure_trend_t *trend)
+{
+    int64_t moving;
+    int i;
+
+    trend->head++;
+    moving = trend->head - PRESSURE_TREND_HALF;
+    i = slot_index(moving);
+    if (moving >= 0 && trend->count[i] > 0)
+    {
+        fit_update(&trend->newer, moving - trend->base, trend->mean[i], -1);
+        fit_update(&trend->older, moving - trend->base, trend->mean[i], 1);
+    }
+    // The new head reuses the place of the slot dropping out
+    i = slot_index(trend->head);
+    if (trend->count[i] > 0)
+    {
+        fit_update(&trend->older, trend->head - PRESSURE_TREND_SLOTS - trend->base, trend->mean[i], -1);
+    }
+    trend->mean[i] = 0.0f;
+    trend->count[i] = 0;
+}
+
+void pressure_trend_init(pressure_trend_t *trend)
+{
+    memset(trend, 0, sizeof(pressure_trend_t));
+    trend->head = -1;
+}
+
+void pressure_trend_add(pressure_trend_t *trend, int64_t time_us, float pressure_pa)
+{
+    int64_t slot = time_us / (PRESSURE_TREND_SLOT_S * 1000000LL);
+    int i;
+
+    if (!isfinite(pressure_pa) || slot < 0)
+    {
+        return;
+    }
+    if (trend->head < 0 || slot < trend->head || slot - trend->head >= PRESSURE_TREND_SLOTS)
+    {
+        // First reading, or a gap longer than the ring: start over
+        pressure_trend_init(trend);
+        trend->head = slot;
+        trend->base = slot;
+    }
+    while (trend->head < slot)
+    {
+        trend_advance(trend);
+    }
+    if (trend->head - trend->base >= 2 * PRESSURE_TREND_SLOTS)
+    {
+        trend_rebase(trend);
+    }
+
+    i = slot_index(slot);
+    if (trend->count[i] > 0)
+    {
+        fit_update(&trend->newer, slot - trend->base, trend->mean[i], -1);
+    }
+    if (trend->count[i] < UINT16_MAX)
+    {
+        trend->count[i]++;
+    }
+    trend->mean[i] += (pressure_pa - trend->mean[i]) / trend->count[i];
+    fit_update(&trend->newer, slot - trend->base, trend->mean[i], 1);
+}
+
+bool pressure_trend_slope(const pressure_trend_t *trend, float *pa_per_hour)
+{
+    pressure_fit_t all = trend->older;
+    double a, b;
+
+    all.n += trend->newer.n;
+    all.sx += trend->newer.sx;
+    all.sy += trend->newer.sy;
+    all.sxx += trend->newer.sxx;
+    all.sxy += trend->newer.sxy;
+    if (!fit_line(&all, &a, &b))
+    {
+        return false;
+    }
+    *pa_per_hour = (float)(b * SLOTS_PER_HOUR);
+    return true;
+}
+
+static int direction(double change)
+{
+    return (change > STEADY_PA) ? 1 : (change < -STEADY_PA) ? -1 : 0;
+}
+
+int pressure_trend_tendency(const pressure_trend_t *trend, float *change_pa)
+{
+    double a1, b1, a2, b2;
+    double now_x = trend->head - trend->base;
+    double change, first, second;
+    int net, u1, u2;
+    bool slower, faster;
+
+    if (trend->older.n < PRESSURE_TREND_HALF / 2 || trend->newer.n < PRESSURE_TREND_HALF / 2 ||
+        !fit_line(&trend->older, &a1, &b1) || !fit_line(&trend->newer, &a2, &b2))
+    {
+        return PRESSURE_TENDENCY_UNKNOWN;
+    }
+    // Now from the newer half's line, three hours ago from the older half's line
+    change = (a2 + b2 * now_x) - (a1 + b1 * (now_x - PRESSURE_TREND_SLOTS + 1));
+    if (change_pa != NULL)
+    {
+        *change_pa = (float)change;
+    }
+    // Change over each half, which gives the characteristic
+    first = b1 * PRESSURE_TREND_HALF;
+    second = b2 * PRESSURE_TREND_HALF;
+    net = direction(change);
+    u1 = direction(first);
+    u2 = direction(second);
+    slower = fabs(second) < fabs(first) / 2;
+    faster = fabs(second) > fabs(first) * 2;
+
+    if (net > 0)
+    {
+        if (u1 > 0)
+        {
+            return (u2 < 0) ? 0 : (u2 == 0 || slower) ? 1 : faster ? 3 : 2;
+        }
+        return (u2 > 0) ? 3 : 2;
+    }
+    if (net < 0)
+    {
+        if (u1 < 0)
+        {
+            return (u2 > 0) ? 5 : (u2 == 0 || slower) ? 6 : faster ? 8 : 7;
+        }
+        return (u2 < 0) ? 8 : 7;
+    }
+    if (u1 > 0 && u2 < 0)
+    {
+        return 0;
+    }
+    if (u1 < 0 && u2 > 0)
+    {
+        return 5;
+    }
+    return 4;
+}
+
+char pressure_trend_zambretti(float pressure_pa, float change_pa, int altitude_m, float temperature, float humidity)
+{
+    float t = isnan(temperature) ? 15.0f : temperature;
+    float h = 0.0065f * altitude_m;
+    float sea_hpa = pressure_pa * powf(1.0f - h / (t + h + 273.15f), -5.257f) / 100.0f;
+    int z, lo, hi;
+
+    if (change_pa < -ZAMBRETTI_CHANGE_PA)
+    {
+        z = (int)lroundf(127.0f - 0.12f * sea_hpa);
+        lo = 1;
+        hi = 9;
+        if (!isnan(temperature) && temperature <= 5.0f)
+        {
+            z++;
+        }
+    }
+    else if (change_pa > ZAMBRETTI_CHANGE_PA)
+    {
+        z = (int)lroundf(185.0f - 0.16f * sea_hpa);
+        lo = 20;
+        hi = 32;
+        if (!isnan(temperature) && temperature >= 20.0f)
+        {
+            z--;
+        }
+    }
+    else
+    {
+        z = (int)lroundf(144.0f - 0.13f * sea_hpa);
+        lo = 10;
+        hi = 19;
+    }
+    if (!isnan(humidity))
+    {
+        z += (humidity >= 90.0f) ? 1 : (humidity <= 40.0f) ? -1 : 0;
+    }
+    z = (z < lo) ? lo : (z > hi) ? hi : z;
+    return zambretti_letters[z - 1];
+}
+
+const char *pressure_trend_forecast_text(char forecast)
+{
+    return (forecast >= 'A' && forecast <= 'Z') ? forecast_texts[forecast - 'A'] : "unknown";
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief The ring holds one slot per minute over the three hours the WMO tendency is defined on
+ */
+#define PRESSURE_TREND_SLOT_S (60)
+#define PRESSURE_TREND_SLOTS (180)
+#define PRESSURE_TREND_HALF (PRESSURE_TREND_SLOTS / 2)
+
+/**
+ * @brief WMO pressure tendency code (code table 0200), or PRESSURE_TENDENCY_UNKNOWN before three
+ * hours of readings
+ */
+#define PRESSURE_TENDENCY_UNKNOWN (-1)
+
+/**
+ * @brief Running least squares sums over a set of slots. x is the slot number relative to the
+ * ring's base, y the slot's mean pressure.
+ */
+typedef struct {
+    uint32_t n;
+    double sx;
+    double sy;
+    double sxx;
+    double sxy;
+} pressure_fit_t;
+
+/**
+ * @brief Pressure trend over the last three hours.
+ *
+ * Readings are averaged into one minute slots. The slots of the older and of the newer 90 minutes
+ * each keep running regression sums, updated as a reading arrives and as slots move from one half
+ * to the other or drop out, so the slope and the tendency cost the same however many readings are
+ * taken. The sums are recomputed from the ring once per lap to stop rounding errors building up.
+ */
+typedef struct {
+    float mean[PRESSURE_TREND_SLOTS];       /*!< Mean of the readings in each slot */
+    uint16_t count[PRESSURE_TREND_SLOTS];   /*!< Readings in each slot, 0 for an empty slot */
+    int64_t head;                           /*!< Slot number (minutes since boot) of the newest slot, -1 before the first reading */
+    int64_t base;                           /*!< Slot number x is measured from */
+    pressure_fit_t older;                   /*!< Slots 90 to 179 minutes old */
+    pressure_fit_t newer;                   /*!< Slots up to 89 minutes old */
+} pressure_trend_t;
+
+/**
+ * @brief Clear the trend
+ */
+void pressure_trend_init(pressure_trend_t *trend);
+
+/**
+ * @brief Add a pressure reading
+ *
+ * @param trend trend
+ * @param time_us monotonic time of the reading
+ * @param pressure_pa station pressure in Pa
+ */
+void pressure_trend_add(pressure_trend_t *trend, int64_t time_us, float pressure_pa);
+
+/**
+ * @brief Least squares slope over the whole ring
+ *
+ * @param trend trend
+ * @param pa_per_hour slope in Pa per hour
+ * @return false with fewer than two slots filled
+ */
+bool pressure_trend_slope(const pressure_trend_t *trend, float *pa_per_hour);
+
+/**
+ * @brief Classify the last three hours with the WMO tendency code:
+ *   0 rising then falling, same or higher     5 falling then rising, same or lower
+ *   1 rising then steady, or rising slower    6 falling then steady, or falling slower
+ *   2 rising steadily or unsteadily           7 falling steadily or unsteadily
+ *   3 steady or falling then rising, or       8 steady or rising then falling, or
+ *     rising faster                             falling faster
+ *   4 steady, same as three hours ago
+ *
+ * @param trend trend
+ * @param change_pa filled in with the pressure change over the three hours, may be NULL
+ * @return tendency code, PRESSURE_TENDENCY_UNKNOWN until both halves of the ring are at least half full
+ */
+int pressure_trend_tendency(const pressure_trend_t *trend, float *change_pa);
+
+/**
+ * @brief Zambretti style forecast from the station pressure and its three hour change.
+ *
+ * The pressure is reduced to sea level with the station altitude and the temperature, then placed
+ * on the falling, steady or rising Zambretti scale (a change of more than 1.6 hPa counts as
+ * falling or rising). Humidity and temperature move the result one step: very humid air (90% or
+ * more) towards rain and dry air (40% or less) towards fair, and, standing in for the season of the
+ * original tables, a rising barometer on a warm day (20 C or more) towards fair and a falling one
+ * on a cold day (5 C or less) towards rain.
+ *
+ * @param pressure_pa station pressure in Pa
+ * @param change_pa pressure change over the last three hours in Pa
+ * @param altitude_m station altitude in metres
+ * @param temperature air temperature in C, NAN when unknown
+ * @param humidity relative humidity in %, NAN when unknown
+ * @return forecast letter 'A' (settled fine) to 'Z' (stormy, much rain)
+ */
+char pressure_trend_zambretti(float pressure_pa, float change_pa, int altitude_m, float temperature, float humidity);
+
+/**
+ * @brief Text of a Zambretti forecast letter
+ */
+const char *pressure_trend_forecast_text(char forecast);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,127 @@
+#include "sdkconfig.h"
+
+#if defined(CONFIG_SENSOR_RAIN_BUCKET_ENABLE) || defined(CONFIG_SENSOR_ANEMOMETER_ENABLE)
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "pulse_counter.h"
+
+static const char *TAG = "PULSE";
+
+// Counter high limit. The counter resets to 0 and interrupts when it gets there.
+#define PULSE_COUNTER_LIMIT (32767)
+
+static portMUX_TYPE pulse_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool isr_service_installed = false;
+
+/**
+ * @brief High limit interrupt, only event enabled on the unit
+ */
+static void IRAM_ATTR pulse_counter_isr(void *arg)
+{
+    pulse_counter_t *pc = (pulse_counter_t *)arg;
+
+    portENTER_CRITICAL_ISR(&pulse_lock);
+    pc->overflows++;
+    portEXIT_CRITICAL_ISR(&pulse_lock);
+}
+
+esp_err_t pulse_counter_init(pulse_counter_t *pc, pcnt_unit_t unit, int gpio)
+{
+    esp_err_t err;
+    pcnt_config_t config = {
+        .pulse_gpio_num = gpio,
+        .ctrl_gpio_num = PCNT_PIN_NOT_USED,
+        .lctrl_mode = PCNT_MODE_KEEP,
+        .hctrl_mode = PCNT_MODE_KEEP,
+        .pos_mode = PCNT_COUNT_INC,
+        .neg_mode = PCNT_COUNT_DIS,
+        .counter_h_lim = PULSE_COUNTER_LIMIT,
+        .counter_l_lim = 0,
+        .unit = unit,
+        .channel = PCNT_CHANNEL_0,
+    };
+
+    if (pc->configured)
+    {
+        return ESP_OK;
+    }
+    pc->unit = unit;
+    pc->gpio = gpio;
+    pc->overflows = 0;
+    pc->last_total = 0;
+
+    err = pcnt_unit_config(&config);
+    if (err == ESP_OK)
+    {
+        // Pulses shorter than the filter length (in 80MHz APB cycles) are ignored
+        err = pcnt_set_filter_value(unit, CONFIG_PULSE_FILTER_APB_CYCLES);
+    }
+    if (err == ESP_OK)
+    {
+        err = (CONFIG_PULSE_FILTER_APB_CYCLES > 0) ? pcnt_filter_enable(unit) : pcnt_filter_disable(unit);
+    }
+    if (err == ESP_OK)
+    {
+        err = pcnt_event_enable(unit, PCNT_EVT_H_LIM);
+    }
+    if (err == ESP_OK && !isr_service_installed)
+    {
+        err = pcnt_isr_service_install(0);
+        isr_service_installed = (err == ESP_OK);
+    }
+    if (err == ESP_OK)
+    {
+        err = pcnt_isr_handler_add(unit, pulse_counter_isr, pc);
+    }
+    if (err == ESP_OK)
+    {
+        pcnt_counter_pause(unit);
+        pcnt_counter_clear(unit);
+        err = pcnt_counter_resume(unit);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not configure PCNT unit %d on pin %d: %s", unit, gpio, esp_err_to_name(err));
+        return err;
+    }
+    pc->configured = true;
+    ESP_LOGI(TAG, "Counting pulses on pin %d with PCNT unit %d", gpio, unit);
+    return ESP_OK;
+}
+
+esp_err_t pulse_counter_read(pulse_counter_t *pc, uint32_t *total)
+{
+    int16_t count;
+    uint32_t overflows;
+    uint32_t value;
+    esp_err_t err;
+
+    if (!pc->configured)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Re-read if an overflow was folded in while the counter was being read
+    do
+    {
+        overflows = pc->overflows;
+        err = pcnt_get_counter_value(pc->unit, &count);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    } while (overflows != pc->overflows);
+
+    value = overflows * PULSE_COUNTER_LIMIT + (uint16_t)count;
+    // The counter wrapped but the interrupt has not run yet: the count can only go up
+    if ((int32_t)(value - pc->last_total) < 0)
+    {
+        value += PULSE_COUNTER_LIMIT;
+    }
+    pc->last_total = value;
+    *total = value;
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "driver/pcnt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Pulse input counted by a PCNT unit
+ *
+ * The hardware counts rising edges with its glitch filter enabled and nothing runs on the CPU per
+ * pulse. The 16 bit counter interrupts only when it reaches its high limit, where it is folded into
+ * a 32 bit software total, so the CPU cost does not depend on the pulse rate.
+ */
+typedef struct {
+    pcnt_unit_t unit;                   /*!< PCNT unit counting the input */
+    int gpio;                           /*!< Pulse input pin */
+    bool configured;                    /*!< Unit and overflow interrupt are set up */
+    volatile uint32_t overflows;        /*!< High limit events since boot, written by the ISR */
+    uint32_t last_total;                /*!< Total returned by the previous read */
+} pulse_counter_t;
+
+/**
+ * @brief Configure a PCNT unit to count rising edges on a pin. Calling it again on a configured
+ * counter is a no-op, so the count survives a driver re-init.
+ *
+ * @param pc counter object, must stay valid while the unit runs
+ * @param unit PCNT unit to use
+ * @param gpio pulse input pin, pulled up
+ * @return ESP_OK on success
+ */
+esp_err_t pulse_counter_init(pulse_counter_t *pc, pcnt_unit_t unit, int gpio);
+
+/**
+ * @brief Read the number of pulses since the counter was configured. A read that lands between a
+ * counter wrap and its interrupt is corrected as long as fewer than 32767 pulses (one counter) arrived
+ * since the previous read, far more than a rain gauge or anemometer gives between two samples.
+ *
+ * @param pc counter object
+ * @param total set to the pulse count, wraps at 2^32
+ * @return ESP_OK on success
+ */
+esp_err_t pulse_counter_read(pulse_counter_t *pc, uint32_t *total);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,110 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "esp_wifi.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "radio_power.h"
+
+static const char *TAG = "RADIO";
+
+/* AWS IoT accepts keepalive intervals between 30 and 1200 seconds */
+#define KEEPALIVE_MIN_SEC (30)
+#define KEEPALIVE_MAX_SEC (1200)
+
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static radio_power_stats_t stats = {0};
+static int64_t cycle_start_us = 0;
+static int64_t burst_start_us = 0;
+
+void radio_power_configure(void)
+{
+    wifi_config_t wifi_config;
+    wifi_ps_type_t ps_type = WIFI_PS_NONE;
+
+#if defined(CONFIG_WIFI_PS_MAX_MODEM)
+    ps_type = WIFI_PS_MAX_MODEM;
+#elif defined(CONFIG_WIFI_PS_MIN_MODEM)
+    ps_type = WIFI_PS_MIN_MODEM;
+#endif
+
+    if (esp_wifi_get_config(ESP_IF_WIFI_STA, &wifi_config) == ESP_OK)
+    {
+        // Only used in max modem sleep: the number of beacon intervals the station may sleep through
+        wifi_config.sta.listen_interval = CONFIG_WIFI_LISTEN_INTERVAL;
+        if (esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Could not set the Wi-Fi listen interval");
+        }
+    }
+    if (esp_wifi_set_ps(ps_type) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not set the Wi-Fi power save mode");
+    }
+    ESP_LOGI(TAG, "Wi-Fi power save mode %d, listen interval %d, keepalive %ds, publish every %dms",
+             ps_type, CONFIG_WIFI_LISTEN_INTERVAL, radio_power_keepalive_sec(), CONFIG_PUBLISH_INTERVAL_MS);
+}
+
+uint16_t radio_power_keepalive_sec(void)
+{
+    // The MQTT client only services its ping timer while yielding, which only happens in a publish
+    // burst. Using a whole number of publish cycles means the ping rides along with a publish
+    // instead of waking the radio on its own.
+    uint32_t interval_sec = (CONFIG_PUBLISH_INTERVAL_MS + 999) / 1000;
+    uint32_t keepalive = interval_sec * CONFIG_MQTT_KEEPALIVE_PUBLISH_CYCLES;
+
+    if (keepalive < KEEPALIVE_MIN_SEC)
+    {
+        keepalive = ((KEEPALIVE_MIN_SEC + interval_sec - 1) / interval_sec) * interval_sec;
+    }
+    if (keepalive > KEEPALIVE_MAX_SEC)
+    {
+        keepalive = KEEPALIVE_MAX_SEC;
+    }
+    return keepalive;
+}
+
+void radio_power_burst_begin(void)
+{
+    burst_start_us = esp_timer_get_time();
+}
+
+void radio_power_burst_end(void)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t burst = now - burst_start_us;
+    radio_power_stats_t copy;
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.last_burst_us = burst;
+    stats.total_burst_us += burst;
+    if (cycle_start_us)
+    {
+        // A cycle runs from the start of one burst to the start of the next
+        stats.last_cycle_us = burst_start_us - cycle_start_us;
+        stats.total_cycle_us += stats.last_cycle_us;
+        stats.cycles++;
+    }
+    copy = stats;
+    portEXIT_CRITICAL(&stats_lock);
+    cycle_start_us = burst_start_us;
+
+    if (copy.last_cycle_us > 0)
+    {
+        ESP_LOGI(TAG, "Yield and publish took %lldms of %lldms cycle (%lld%%), average %lld%% over %u cycles",
+                 burst / 1000, copy.last_cycle_us / 1000,
+                 (burst * 100) / copy.last_cycle_us,
+                 copy.total_cycle_us ? (copy.total_burst_us * 100) / copy.total_cycle_us : 0,
+                 copy.cycles);
+    }
+}
+
+void radio_power_get_stats(radio_power_stats_t *out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    memcpy(out, &stats, sizeof(radio_power_stats_t));
+    portEXIT_CRITICAL(&stats_lock);
+}
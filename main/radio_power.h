@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Publish burst accounting, in microseconds. A burst is the wall time from the start of the MQTT
+ * yield to the end of the publish; the radio is awake for at least that long, but this is not a
+ * measurement of the radio itself.
+ */
+typedef struct {
+    uint32_t cycles;                /*!< Number of completed publish cycles */
+    int64_t last_cycle_us;          /*!< Length of the last publish cycle */
+    int64_t last_burst_us;          /*!< Yield and publish wall time in the last publish cycle */
+    int64_t total_cycle_us;         /*!< Sum of all publish cycle lengths */
+    int64_t total_burst_us;         /*!< Sum of all yield and publish wall time */
+} radio_power_stats_t;
+
+/**
+ * @brief Apply the Wi-Fi power save mode and listen interval. Call after wifi_setup() and before wifi_connect().
+ */
+void radio_power_configure(void);
+
+/**
+ * @brief MQTT keepalive aligned to the publish schedule, so the ping goes out in the same burst as a publish
+ *
+ * @return keepalive interval in seconds
+ */
+uint16_t radio_power_keepalive_sec(void);
+
+/**
+ * @brief Mark the start of a burst of radio activity (MQTT yield and publish)
+ */
+void radio_power_burst_begin(void);
+
+/**
+ * @brief Mark the end of a burst of radio activity and account for the publish cycle
+ */
+void radio_power_burst_end(void);
+
+/**
+ * @brief Get the publish burst counters, served by the local metrics endpoint
+ *
+ * @param stats filled in with a copy of the counters
+ */
+void radio_power_get_stats(radio_power_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
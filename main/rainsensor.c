@@ -1,6 +1,10 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_SENSOR_RAIN_ENABLE
 
 #include <stdio.h>
 #include <string.h>
+#include <stdbool.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/event_groups.h"
@@ -9,8 +13,10 @@
 #include "driver/gpio.h"
 #include "esp_log.h"
 #include "esp_event.h"
+#include "esp_timer.h"
 
 #include "rainsensor.h"
+#include "mem_budget.h"
 
 static const char *TAG = "RSEN";
 
@@ -41,6 +47,16 @@ typedef struct {
 
 #define GOT_DATA_BIT BIT0
 
+#define RAINSENSOR_RESET_PULSE_MS (500)
+
+static esp_timer_handle_t mclr_timer = NULL;
+
+/* There is only one rain sensor: the parser lives in static storage rather than on the heap */
+static esp_rainsensor_t rainsensor_instance;
+static uint8_t rainsensor_buffer[RAINSENSOR_PARSER_RUNTIME_BUFFER_SIZE];
+static bool rainsensor_in_use = false;
+static bool rainsensor_budgeted = false;
+
 /**
  * @brief Parse Rain Sensor statements from Rain Sensor receiver. We receive a line at a time and parse
  * it as requires. For our purposes, we are really only interested in three items:
@@ -195,16 +211,38 @@ static void sendcmd(char cmd)
     uart_write_bytes(UART_NUM_1, (const char *) cmdtext, 2);
 }
 
+/**
+ * @brief MCLR timer callback, ends the reset pulse
+ */
+static void rainsensor_release_reset(void *arg)
+{
+    gpio_set_level(CONFIG_RAIN_MCLR_GPIO, 1);
+}
+
 /**
  * @brief Hard reset the rain sensor. Used on system startup to ensure the rain sensor is in the correct mode.
  */
 void rainsensor_reset(void)
 {
     ESP_LOGI(TAG, "Reseting rain sensor...");
-    // Reset the rain sensor
+    if (mclr_timer == NULL) {
+        esp_timer_create_args_t timer_args = {
+            .callback = rainsensor_release_reset,
+            .arg = NULL,
+            .name = "rain_mclr"
+        };
+        if (esp_timer_create(&timer_args, &mclr_timer) != ESP_OK) {
+            ESP_LOGE(TAG, "create MCLR timer failed, resetting in place");
+            gpio_set_level(CONFIG_RAIN_MCLR_GPIO, 0);
+            vTaskDelay(RAINSENSOR_RESET_PULSE_MS / portTICK_RATE_MS);
+            gpio_set_level(CONFIG_RAIN_MCLR_GPIO, 1);
+            return;
+        }
+    }
+    // Hold the sensor in reset and let the timer release it, boot carries on meanwhile
+    esp_timer_stop(mclr_timer);
     gpio_set_level(CONFIG_RAIN_MCLR_GPIO, 0);
-    vTaskDelay(500 / portTICK_RATE_MS);
-    gpio_set_level(CONFIG_RAIN_MCLR_GPIO, 1);
+    esp_timer_start_once(mclr_timer, RAINSENSOR_RESET_PULSE_MS * 1000);
 }
 
 /**
@@ -233,16 +271,13 @@ void rainsensor_read(void)
  */
 rainsensor_parser_handle_t rainsensor_parser_init(void)
 {
-    esp_rainsensor_t *esp_rainsensor = calloc(1, sizeof(esp_rainsensor_t));
-    if (!esp_rainsensor) {
-        ESP_LOGE(TAG, "calloc memory for esp_fps failed");
-        goto err_rainsensor;
-    }
-    esp_rainsensor->buffer = calloc(1, RAINSENSOR_PARSER_RUNTIME_BUFFER_SIZE);
-    if (!esp_rainsensor->buffer) {
-        ESP_LOGE(TAG, "calloc memory for runtime buffer failed");
-        goto err_buffer;
+    esp_rainsensor_t *esp_rainsensor = &rainsensor_instance;
+    if (rainsensor_in_use) {
+        ESP_LOGE(TAG, "Rain Sensor Parser already initialised");
+        return NULL;
     }
+    memset(esp_rainsensor, 0, sizeof(esp_rainsensor_t));
+    esp_rainsensor->buffer = rainsensor_buffer;
 
     gpio_config_t io_conf_mclr = {
         .intr_type = GPIO_PIN_INTR_DISABLE,
@@ -306,19 +341,22 @@ rainsensor_parser_handle_t rainsensor_parser_init(void)
         ESP_LOGE(TAG, "create Rain Sensor Parser task failed");
         goto err_task_create;
     }
+    rainsensor_in_use = true;
+    if (!rainsensor_budgeted) {
+        // The UART driver holds an RX ring of the runtime buffer size
+        mem_budget_add("rain parser", sizeof(rainsensor_instance) + sizeof(rainsensor_buffer),
+                       RAINSENSOR_PARSER_TASK_STACK_SIZE + RAINSENSOR_PARSER_RUNTIME_BUFFER_SIZE);
+        rainsensor_budgeted = true;
+    }
     ESP_LOGI(TAG, "Rain Sensor Parser init OK");
     return esp_rainsensor;
     /*Error Handling*/
 err_task_create:
     esp_event_loop_delete(esp_rainsensor->event_loop_hdl);
 err_eloop:
-err_uart_install:
-    uart_driver_delete(EX_UART_NUM);
 err_uart_config:
-err_buffer:
-    free(esp_rainsensor->buffer);
-err_rainsensor:
-    free(esp_rainsensor);
+    uart_driver_delete(EX_UART_NUM);
+err_uart_install:
     return NULL;
 }
 
@@ -334,8 +372,7 @@ esp_err_t rainsensor_parser_deinit(rainsensor_parser_handle_t rainsensor_hdl)
     vTaskDelete(esp_rainsensor->tsk_hdl);
     esp_event_loop_delete(esp_rainsensor->event_loop_hdl);
     esp_err_t err = uart_driver_delete(EX_UART_NUM);
-    free(esp_rainsensor->buffer);
-    free(esp_rainsensor);
+    rainsensor_in_use = false;
     return err;
 }
 
@@ -373,3 +410,5 @@ esp_err_t rainsensor_parser_remove_handler(rainsensor_parser_handle_t rainsensor
     esp_rainsensor_t *esp_rainsensor = (esp_rainsensor_t *)rainsensor_hdl;
     return esp_event_handler_unregister_with(esp_rainsensor->event_loop_hdl, ESP_RAINSENSOR_EVENT, ESP_EVENT_ANY_ID, event_handler);
 }
+
+#endif
@@ -94,6 +94,8 @@ void rainsensor_read(void);
 
 /**
  * @brief Hard reset the rain sensor. Used on system startup to ensure the rain sensor is in the correct mode.
+ * MCLR is released by a timer, so the call does not block. The sensor sends RAINSENSOR_RESET_COMPLETE
+ * once it has rebooted.
  */
 void rainsensor_reset(void);
 
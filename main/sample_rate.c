@@ -0,0 +1,132 @@
+#include <math.h>
+#include <string.h>
+
+#include "sample_rate.h"
+
+// Smoothing time constants of the value and of its trend
+#define LEVEL_TAU_S (120.0f)
+#define TREND_TAU_S (300.0f)
+
+// Activity above which sampling speeds up, and below which it may slow down again
+#define ACTIVITY_HIGH (1.0f)
+#define ACTIVITY_LOW (0.5f)
+
+typedef struct {
+    sensor_channel_t channel;
+    bool cumulative;            // The reading is a running total, its trend is the rate
+    bool logarithmic;           // Track the log of the reading, for signals spanning decades
+    float significant;          // Rate of change per hour that counts as activity 1
+} sample_rate_signal_t;
+
+static const sample_rate_signal_t signals[SAMPLE_RATE_SIGNALS] = {
+    { SENSOR_CH_TEMPERATURE,  false, false, 3.0f },        // C per hour, above the diurnal swing
+    { SENSOR_CH_PRESSURE,     false, false, 100.0f },      // Pa per hour
+    { SENSOR_CH_LIGHTLEVEL,   false, true,  3.0f },        // log lux per hour
+    { SENSOR_CH_RAINMM,       true,  false, 0.5f },        // mm per hour
+    { SENSOR_CH_BUCKETRAINMM, true,  false, 0.5f },        // mm per hour
+};
+
+static uint32_t clamp_interval(const sample_rate_t *rate, uint32_t interval_ms)
+{
+    if (interval_ms < rate->min_ms)
+    {
+        return rate->min_ms;
+    }
+    if (interval_ms > rate->max_ms)
+    {
+        return rate->max_ms;
+    }
+    return interval_ms;
+}
+
+void sample_rate_init(sample_rate_t *rate, uint32_t min_ms, uint32_t max_ms, uint32_t hold_ms, uint32_t start_ms)
+{
+    memset(rate, 0, sizeof(sample_rate_t));
+    rate->min_ms = min_ms;
+    rate->max_ms = max_ms > min_ms ? max_ms : min_ms;
+    rate->hold_ms = hold_ms;
+    rate->interval_ms = clamp_interval(rate, start_ms);
+    rate->calm_since_us = -1;
+}
+
+/**
+ * @brief Update the trend of a signal and return its rate of change per hour
+ */
+static float track_update(sample_rate_track_t *track, const sample_rate_signal_t *signal, float value,
+                          int64_t time_us)
+{
+    float x = signal->logarithmic ? logf(1.0f + fmaxf(value, 0.0f)) : value;
+    float dt;
+    float alpha;
+    float beta;
+    float predicted;
+    float level;
+
+    // A rain accumulator going backwards was reset: start again from the new total
+    if (!track->seeded || (signal->cumulative && value < track->last))
+    {
+        track->seeded = true;
+        track->time_us = time_us;
+        track->last = value;
+        track->level = x;
+        track->trend = 0.0f;
+        return 0.0f;
+    }
+    dt = (time_us - track->time_us) / 1e6f;
+    if (dt <= 0.0f)
+    {
+        return fabsf(track->trend) * 3600.0f;
+    }
+    alpha = 1.0f - expf(-dt / LEVEL_TAU_S);
+    beta = 1.0f - expf(-dt / TREND_TAU_S);
+    predicted = track->level + track->trend * dt;
+    level = predicted + alpha * (x - predicted);
+    track->trend += beta * ((level - track->level) / dt - track->trend);
+    track->level = level;
+    track->time_us = time_us;
+    track->last = value;
+    return fabsf(track->trend) * 3600.0f;
+}
+
+uint32_t sample_rate_update(sample_rate_t *rate, const sensor_data *sample)
+{
+    float activity = 0.0f;
+
+    for (int i = 0; i < SAMPLE_RATE_SIGNALS; i++)
+    {
+        const sample_rate_signal_t *signal = &signals[i];
+
+        if (sample->valid & SENSOR_CH_BIT(signal->channel))
+        {
+            float per_hour = track_update(&rate->track[i], signal, sample->value[signal->channel], sample->time_us);
+            activity = fmaxf(activity, per_hour / signal->significant);
+        }
+    }
+    rate->activity = activity;
+
+    if (activity > ACTIVITY_HIGH)
+    {
+        // Speed up right away, a front does not wait
+        rate->interval_ms = clamp_interval(rate, rate->interval_ms / 2);
+        rate->calm_since_us = -1;
+    }
+    else if (activity < ACTIVITY_LOW)
+    {
+        if (rate->calm_since_us < 0)
+        {
+            rate->calm_since_us = sample->time_us;
+        }
+        else if (sample->time_us - rate->calm_since_us >= (int64_t)rate->hold_ms * 1000)
+        {
+            // Slow down one step per hold time
+            rate->interval_ms = clamp_interval(rate, rate->interval_ms * 2);
+            rate->calm_since_us = sample->time_us;
+        }
+    }
+    else
+    {
+        // Between the thresholds: keep the interval, but a calm spell has to start over
+        rate->calm_since_us = -1;
+    }
+    return rate->interval_ms;
+}
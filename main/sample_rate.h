@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sensors.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Number of signals the controller watches: temperature, pressure, light, and the rain
+ * rate of the rain sensor and of the tipping bucket
+ */
+#define SAMPLE_RATE_SIGNALS (5)
+
+/**
+ * @brief Trend of one signal, tracked with Holt's double exponential smoothing. The smoothing
+ * weights follow the time between samples, so the trend noise does not grow as the interval
+ * shrinks and the controller cannot talk itself into sampling faster.
+ */
+typedef struct {
+    bool seeded;                /*!< A first sample has been seen */
+    int64_t time_us;            /*!< Time of the last sample */
+    float last;                 /*!< Last input, to spot a reset rain accumulator */
+    float level;                /*!< Smoothed value */
+    float trend;                /*!< Smoothed rate of change per second */
+} sample_rate_track_t;
+
+/**
+ * @brief Adaptive sample interval controller.
+ *
+ * Each sample updates the trend of the watched signals. The activity is the largest rate of change
+ * relative to what counts as a significant change for that signal (3 C/h, 1 hPa/h, light changing
+ * by a factor of e every 20 minutes, 0.5 mm/h of rain). Above 1 the interval is halved at every
+ * sample down to the minimum; it is only doubled again, up to the maximum, once the activity has
+ * stayed below 0.5 for the hold time. The gap between the two thresholds and the hold stop the
+ * interval from flapping on a noisy signal.
+ */
+typedef struct {
+    uint32_t min_ms;            /*!< Fastest interval */
+    uint32_t max_ms;            /*!< Slowest interval */
+    uint32_t hold_ms;           /*!< Calm time before each slow down step */
+    uint32_t interval_ms;       /*!< Current interval */
+    float activity;             /*!< Activity at the last sample */
+    int64_t calm_since_us;      /*!< Start of the current calm spell, -1 while active */
+    sample_rate_track_t track[SAMPLE_RATE_SIGNALS];
+} sample_rate_t;
+
+/**
+ * @brief Set up the controller
+ *
+ * @param rate controller
+ * @param min_ms fastest interval
+ * @param max_ms slowest interval
+ * @param hold_ms calm time before each slow down step
+ * @param start_ms initial interval, clamped to the range
+ */
+void sample_rate_init(sample_rate_t *rate, uint32_t min_ms, uint32_t max_ms, uint32_t hold_ms, uint32_t start_ms);
+
+/**
+ * @brief Feed an acquisition cycle to the controller. Channels without a valid reading are skipped.
+ *
+ * @param rate controller
+ * @param sample readings of the cycle
+ * @return interval to wait before the next cycle in milliseconds
+ */
+uint32_t sample_rate_update(sample_rate_t *rate, const sensor_data *sample);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,211 @@
+#include <string.h>
+#include <math.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "sampler.h"
+#include "boot_metrics.h"
+#include "mem_budget.h"
+#include "pressure_trend.h"
+#ifdef CONFIG_LOCAL_METRICS_ENABLE
+#include "local_metrics.h"
+#endif
+#ifdef CONFIG_ARCHIVE_ENABLE
+#include "archiver.h"
+#endif
+#ifdef CONFIG_SAMPLE_ADAPTIVE
+#include "sample_rate.h"
+#endif
+
+static const char *TAG = "SAMPLER";
+
+#define SAMPLER_TASK_STACK_SIZE (4096)
+#define SAMPLER_TASK_PRIORITY (5)
+
+static QueueHandle_t window_queue = NULL;
+static sensor_window_t window;
+
+#ifdef CONFIG_STATION_PUBLISH_ENABLE
+static StaticQueue_t window_queue_buf;
+static uint8_t window_queue_storage[CONFIG_PUBLISH_QUEUE_LENGTH * sizeof(sensor_window_t)];
+#endif
+static StaticTask_t sampler_tcb;
+static StackType_t sampler_stack[SAMPLER_TASK_STACK_SIZE];
+
+static pressure_trend_t pressure_trend;
+
+#ifdef CONFIG_SAMPLE_ADAPTIVE
+// Windows are closed between samples, so sampling slower than publishing would leave them empty
+#define SAMPLER_MAX_INTERVAL_MS (CONFIG_SAMPLE_INTERVAL_MAX_MS < CONFIG_PUBLISH_INTERVAL_MS ? \
+                                 CONFIG_SAMPLE_INTERVAL_MAX_MS : CONFIG_PUBLISH_INTERVAL_MS)
+
+static sample_rate_t sample_rate;
+#endif
+
+static void window_reset(void)
+{
+    uint32_t seq = window.seq;
+
+    memset(&window, 0, sizeof(sensor_window_t));
+    window.seq = seq + 1;
+    window.tendency = PRESSURE_TENDENCY_UNKNOWN;
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        sensor_stat_reset(&window.stats[ch]);
+    }
+}
+
+static void window_add(const sensor_data *sensorinfo)
+{
+#ifdef CONFIG_LOCAL_METRICS_ENABLE
+    local_metrics_update(sensorinfo);
+#endif
+    if (window.samples++ == 0)
+    {
+        window.first_us = sensorinfo->time_us;
+    }
+    window.last_us = sensorinfo->time_us;
+    if (sensorinfo->valid & SENSOR_CH_BIT(SENSOR_CH_PRESSURE))
+    {
+        pressure_trend_add(&pressure_trend, sensorinfo->time_us, sensorinfo->value[SENSOR_CH_PRESSURE]);
+    }
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (sensorinfo->valid & SENSOR_CH_BIT(ch))
+        {
+            sensor_stat_add(&window.stats[ch], sensorinfo->value[ch]);
+            window.valid |= SENSOR_CH_BIT(ch);
+        }
+        // Keep the age from the end of the window
+        window.age[ch] = sensorinfo->age[ch];
+    }
+}
+
+/**
+ * @brief Fill in the pressure tendency and the forecast from the trend and the window means
+ */
+static void window_forecast(void)
+{
+    const sensor_stat_t *stats = window.stats;
+    float temperature = (window.valid & SENSOR_CH_BIT(SENSOR_CH_TEMPERATURE)) ? stats[SENSOR_CH_TEMPERATURE].mean : NAN;
+    float humidity = (window.valid & SENSOR_CH_BIT(SENSOR_CH_HUMIDITY)) ? stats[SENSOR_CH_HUMIDITY].mean : NAN;
+
+    window.tendency = pressure_trend_tendency(&pressure_trend, &window.pressure_change);
+    if (window.tendency != PRESSURE_TENDENCY_UNKNOWN && (window.valid & SENSOR_CH_BIT(SENSOR_CH_PRESSURE)))
+    {
+        window.forecast = pressure_trend_zambretti(stats[SENSOR_CH_PRESSURE].mean, window.pressure_change,
+                                                   CONFIG_STATION_ALTITUDE_M, temperature, humidity);
+    }
+}
+
+static void window_close(void)
+{
+#ifdef CONFIG_STATION_PUBLISH_ENABLE
+    sensor_window_t dropped;
+#endif
+
+    window_forecast();
+    window.enqueued_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Window %u closed: %u samples, valid channels 0x%03x", window.seq, window.samples, window.valid);
+#ifdef CONFIG_STATION_PUBLISH_ENABLE
+    if (xQueueSend(window_queue, &window, 0) != pdTRUE)
+    {
+        // The publisher is behind: keep the newest data
+        xQueueReceive(window_queue, &dropped, 0);
+        ESP_LOGW(TAG, "Publish queue full, dropped window %u", dropped.seq);
+        xQueueSend(window_queue, &window, 0);
+    }
+#endif
+#ifdef CONFIG_ARCHIVE_ENABLE
+    archiver_submit(&window);
+#endif
+    window_reset();
+}
+
+/**
+ * @brief Time to wait before the next acquisition cycle
+ */
+static uint32_t sampler_next_interval(const sensor_data *sensorinfo)
+{
+#ifdef CONFIG_SAMPLE_ADAPTIVE
+    uint32_t previous = sample_rate.interval_ms;
+    uint32_t interval = sample_rate_update(&sample_rate, sensorinfo);
+
+    if (interval != previous)
+    {
+        ESP_LOGI(TAG, "Sampling every %ums (activity %.2f)", interval, sample_rate.activity);
+    }
+    return interval;
+#else
+    return CONFIG_SAMPLE_INTERVAL_MS;
+#endif
+}
+
+static void sampler_task(void *param)
+{
+    TickType_t last_wake;
+    TickType_t window_start;
+    sensor_data *sensorinfo;
+
+    // Sensor bring-up runs here rather than in app_main, so it overlaps the network connection
+    configure_sensors();
+    boot_metrics_mark(BOOT_STAGE_SENSORS_READY);
+
+    last_wake = xTaskGetTickCount();
+    window_start = last_wake;
+    sensorinfo = get_sensors();
+    window_add(sensorinfo);
+    boot_metrics_mark(BOOT_STAGE_FIRST_SAMPLE);
+    mem_budget_guard_enter();
+
+    for (;;)
+    {
+        // The first window is closed after one sample so a freshly booted station publishes right away
+        if (window.seq == 1 || (xTaskGetTickCount() - window_start) >= pdMS_TO_TICKS(CONFIG_PUBLISH_INTERVAL_MS))
+        {
+            window_close();
+            window_start = xTaskGetTickCount();
+        }
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(sampler_next_interval(sensorinfo)));
+        sensorinfo = get_sensors();
+        window_add(sensorinfo);
+    }
+}
+
+void sampler_start(void)
+{
+    size_t queue_size = 0;
+
+#ifdef CONFIG_STATION_PUBLISH_ENABLE
+    window_queue = xQueueCreateStatic(CONFIG_PUBLISH_QUEUE_LENGTH, sizeof(sensor_window_t), window_queue_storage,
+                                      &window_queue_buf);
+    queue_size = sizeof(window_queue_storage) + sizeof(window_queue_buf);
+#endif
+    pressure_trend_init(&pressure_trend);
+    window_reset();
+#ifdef CONFIG_SAMPLE_ADAPTIVE
+    sample_rate_init(&sample_rate, CONFIG_SAMPLE_INTERVAL_MIN_MS, SAMPLER_MAX_INTERVAL_MS,
+                     CONFIG_SAMPLE_SLOWDOWN_HOLD_S * 1000, CONFIG_SAMPLE_INTERVAL_MS);
+    ESP_LOGI(TAG, "Adaptive sampling between %dms and %dms", CONFIG_SAMPLE_INTERVAL_MIN_MS, SAMPLER_MAX_INTERVAL_MS);
+#endif
+    mem_budget_add("sampler", sizeof(window) + sizeof(pressure_trend) + queue_size +
+                   sizeof(sampler_tcb) + sizeof(sampler_stack), 0);
+    ESP_LOGI(TAG, "Sampling every %dms, publishing every %dms", CONFIG_SAMPLE_INTERVAL_MS, CONFIG_PUBLISH_INTERVAL_MS);
+    xTaskCreateStatic(sampler_task, "sampler", SAMPLER_TASK_STACK_SIZE, NULL, SAMPLER_TASK_PRIORITY, sampler_stack,
+                      &sampler_tcb);
+}
+
+bool sampler_receive(sensor_window_t *out, uint32_t wait)
+{
+    if (window_queue == NULL)
+    {
+        vTaskDelay(wait);
+        return false;
+    }
+    return xQueueReceive(window_queue, out, wait) == pdTRUE;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sensors.h"
+#include "sensor_stats.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Aggregated sensor readings over one publish window
+ */
+typedef struct {
+    uint32_t seq;                               /*!< Window sequence number */
+    uint32_t samples;                           /*!< Acquisition cycles in the window */
+    uint32_t valid;                             /*!< SENSOR_CH_BIT(ch) set when channel ch has at least one good sample */
+    uint32_t age[SENSOR_CH_COUNT];              /*!< Seconds since a stale channel was last read successfully */
+    sensor_stat_t stats[SENSOR_CH_COUNT];       /*!< Statistics of the good samples of each channel */
+    int64_t first_us;                           /*!< Acquisition time of the first sample */
+    int64_t last_us;                            /*!< Acquisition time of the last sample */
+    int64_t enqueued_us;                        /*!< Time the window was closed and queued for publishing */
+    int64_t sent_us;                            /*!< Time the window was handed to MQTT */
+    bool unix_time;                             /*!< Times are Unix time in microseconds, otherwise esp_timer time since boot */
+    int8_t tendency;                            /*!< WMO pressure tendency code of the last three hours, PRESSURE_TENDENCY_UNKNOWN (-1) if not known yet */
+    float pressure_change;                      /*!< Pressure change over the last three hours in Pa, when the tendency is known */
+    char forecast;                              /*!< Zambretti forecast letter 'A' to 'Z', 0 if not known yet */
+} sensor_window_t;
+
+/**
+ * @brief Start the acquisition task. The task brings up the sensors, then samples every
+ * CONFIG_SAMPLE_INTERVAL_MS and closes a window every CONFIG_PUBLISH_INTERVAL_MS. The first window
+ * is closed after a single sample. With CONFIG_SAMPLE_ADAPTIVE the sample interval follows the rate
+ * of change of the weather instead, see sample_rate.h.
+ */
+void sampler_start(void);
+
+/**
+ * @brief Wait for the next closed window. When the publisher falls behind the oldest window is dropped.
+ *
+ * @param window filled in with the window
+ * @param wait ticks to wait for a window
+ * @return true if a window was received
+ */
+bool sampler_receive(sensor_window_t *window, uint32_t wait);
+
+#ifdef __cplusplus
+}
+#endif
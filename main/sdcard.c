@@ -0,0 +1,45 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_SDCARD_MOUNT
+
+#include <stdbool.h>
+
+#include "esp_log.h"
+#include "esp_vfs_fat.h"
+#include "driver/sdmmc_host.h"
+
+#include "sdcard.h"
+
+static const char *TAG = "SDCARD";
+
+// Certificates while connecting, plus the archive's open raw and hourly files and a query
+#define SDCARD_MAX_FILES (5)
+
+static bool mounted = false;
+
+esp_err_t sdcard_mount(void)
+{
+    if (mounted)
+    {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Mounting SD card...");
+    sdmmc_host_t host = SDMMC_HOST_DEFAULT();
+    sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
+    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
+        .format_if_mount_failed = false,
+        .max_files = SDCARD_MAX_FILES,
+    };
+    sdmmc_card_t* card;
+    esp_err_t ret = esp_vfs_fat_sdmmc_mount(SDCARD_MOUNT_POINT, &host, &slot_config, &mount_config, &card);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to mount SD card VFAT filesystem. Error: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    mounted = true;
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Mount point of the SD card
+ */
+#define SDCARD_MOUNT_POINT "/sdcard"
+
+/**
+ * @brief Mount the SD card FAT filesystem on SDCARD_MOUNT_POINT. The card holds the AWS certificates
+ * (CONFIG_AWS_SDCARD_CERTS) and the archive (CONFIG_ARCHIVE_ENABLE); whichever needs it first mounts
+ * it, later calls return ESP_OK. Call from app_main before starting the tasks that use it.
+ *
+ * @return ESP_OK if the card is mounted
+ */
+esp_err_t sdcard_mount(void);
+
+#ifdef __cplusplus
+}
+#endif
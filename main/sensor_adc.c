@@ -1,3 +1,7 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_SENSOR_MOISTURE_ENABLE
+
 #include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
@@ -17,7 +21,7 @@ static const adc_atten_t atten = ADC_ATTEN_DB_11;
 static const adc_unit_t unit = ADC_UNIT_1;
 static const int32_t DEFAULT_VREF = 1100;        //Use adc2_vref_to_gpio() to obtain a better estimate
 
-static esp_adc_cal_characteristics_t *adc_chars = NULL;
+static esp_adc_cal_characteristics_t adc_chars;
 
 static const char *TAG = "MOISTURE_ADC";
 
@@ -47,12 +51,18 @@ static void check_efuse(void)
 #endif
 }
 
-void configure_adc(void)
+esp_err_t configure_adc(void)
 {
     esp_err_t r = 0;
     gpio_num_t moisture_gpio_num = 0;
 
-    ESP_ERROR_CHECK(adc_digi_init());
+    // Failing here leaves the moisture sensor to its health backoff rather than resetting the chip
+    r = adc_digi_init();
+    if (r != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ADC init failed: %s", esp_err_to_name(r));
+        return r;
+    }
 
     check_efuse();
     adc1_config_width(width);
@@ -65,8 +75,7 @@ void configure_adc(void)
     }
     ESP_LOGI(TAG, "Moisture sensor channel %d @ GPIO %d", CONFIG_MOISTURE_ADC_CHANNEL, moisture_gpio_num);
 
-    adc_chars = calloc(1, sizeof(esp_adc_cal_characteristics_t));
-    esp_adc_cal_value_t val_type = esp_adc_cal_characterize(unit, atten, width, DEFAULT_VREF, adc_chars);
+    esp_adc_cal_value_t val_type = esp_adc_cal_characterize(unit, atten, width, DEFAULT_VREF, &adc_chars);
     if (val_type == ESP_ADC_CAL_VAL_EFUSE_TP) {
         ESP_LOGI(TAG, "Characterized using Two Point Value");
     } else if (val_type == ESP_ADC_CAL_VAL_EFUSE_VREF) {
@@ -74,6 +83,7 @@ void configure_adc(void)
     } else {
         ESP_LOGI(TAG, "Characterized using Default Vref");
     }
+    return ESP_OK;
 }
 
 void read_moisture_adc(uint32_t *raw, uint32_t *voltage)
@@ -89,5 +99,7 @@ void read_moisture_adc(uint32_t *raw, uint32_t *voltage)
         *raw = adc_reading/CONFIG_ADC_MULTISAMPLING_COUNT;
 #endif        
         //Convert adc_reading to voltage in mV
-        *voltage = esp_adc_cal_raw_to_voltage(*raw, adc_chars);
+        *voltage = esp_adc_cal_raw_to_voltage(*raw, &adc_chars);
 }
+
+#endif
@@ -1,6 +1,7 @@
 
 #include <stdint.h>
+#include "esp_err.h"
 
-void configure_adc(void);
+esp_err_t configure_adc(void);
 void read_moisture_adc(uint32_t *raw, uint32_t *voltage);
 void read_rain_adc(uint32_t *raw, uint32_t *voltage);
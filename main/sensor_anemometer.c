@@ -0,0 +1,64 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_SENSOR_ANEMOMETER_ENABLE
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include "sensor_driver.h"
+#include "pulse_counter.h"
+
+static const char *TAG = "ANEMOMETER";
+
+static pulse_counter_t wind_counter;
+static uint32_t last_count;
+static int64_t last_us;
+
+static esp_err_t anemometer_driver_init(void)
+{
+    esp_err_t err = pulse_counter_init(&wind_counter, PCNT_UNIT_1, CONFIG_ANEMOMETER_GPIO);
+    if (err == ESP_OK)
+    {
+        // The first speed is averaged from here
+        err = pulse_counter_read(&wind_counter, &last_count);
+        last_us = esp_timer_get_time();
+    }
+    return err;
+}
+
+static esp_err_t anemometer_driver_collect(float *value, uint32_t *produced)
+{
+    uint32_t count;
+    int64_t now;
+    float hz;
+    esp_err_t err = pulse_counter_read(&wind_counter, &count);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not read the anemometer pulse count");
+        return err;
+    }
+    now = esp_timer_get_time();
+    if (now <= last_us)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // Mean speed since the previous sample; the window max is the gust
+    hz = (float)(count - last_count) * 1000000.0f / (float)(now - last_us);
+    last_count = count;
+    last_us = now;
+    value[SENSOR_CH_WINDSPEED] = hz * CONFIG_ANEMOMETER_MMPS_PER_HZ / 1000.0f;
+    *produced = SENSOR_CH_BIT(SENSOR_CH_WINDSPEED);
+    ESP_LOGD(TAG, "%.2fHz, %.2fm/s", hz, value[SENSOR_CH_WINDSPEED]);
+    return ESP_OK;
+}
+
+const sensor_driver_t anemometer_driver = {
+    .name = "Anemometer",
+    .channels = SENSOR_CH_BIT(SENSOR_CH_WINDSPEED),
+    .measure_ms = 0,
+    .init = anemometer_driver_init,
+    .start = NULL,
+    .collect = anemometer_driver_collect,
+};
+
+#endif
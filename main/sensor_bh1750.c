@@ -0,0 +1,65 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_SENSOR_BH1750_ENABLE
+
+#include <string.h>
+#include <esp_log.h>
+
+#include <bh1750.h>
+#include "sensor_driver.h"
+
+static const char *TAG = "BH1750";
+
+static i2c_dev_t light_dev;
+static bool light_desc = false;
+
+static esp_err_t bh1750_driver_init(void)
+{
+    esp_err_t err = ESP_OK;
+
+    // The descriptor owns a mutex: it is created once and kept when a failed device is re-initialised
+    if (!light_desc)
+    {
+        memset(&light_dev, 0, sizeof(i2c_dev_t)); // Zero descriptor
+        err = bh1750_init_desc(&light_dev, BH1750_ADDR_LO, 0, CONFIG_I2C_GPIO_SDA, CONFIG_I2C_GPIO_SCL);
+        light_desc = err == ESP_OK;
+    }
+    if (err == ESP_OK)
+    {
+        err = bh1750_setup(&light_dev, BH1750_MODE_CONTINUOUS, BH1750_RES_HIGH);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not configure BH1750 on SCL pin %d and SDA pin %d", CONFIG_I2C_GPIO_SCL, CONFIG_I2C_GPIO_SDA);
+        return err;
+    }
+    ESP_LOGI(TAG, "BH1750 light sensor found");
+    return ESP_OK;
+}
+
+static esp_err_t bh1750_driver_collect(float *value, uint32_t *produced)
+{
+    uint16_t lightlevel;
+    esp_err_t err = bh1750_read(&light_dev, &lightlevel);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not read lux data");
+        return err;
+    }
+    ESP_LOGD(TAG, "Lux value: %d", lightlevel);
+    value[SENSOR_CH_LIGHTLEVEL] = lightlevel;
+    *produced = SENSOR_CH_BIT(SENSOR_CH_LIGHTLEVEL);
+    return ESP_OK;
+}
+
+const sensor_driver_t bh1750_driver = {
+    .name = "BH1750",
+    .channels = SENSOR_CH_BIT(SENSOR_CH_LIGHTLEVEL),
+    .measure_ms = 0,
+    .bus = SENSOR_BUS_I2C,
+    .init = bh1750_driver_init,
+    .start = NULL,
+    .collect = bh1750_driver_collect,
+};
+
+#endif
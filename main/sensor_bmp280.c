@@ -0,0 +1,68 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_SENSOR_BMP280_ENABLE
+
+#include <string.h>
+#include <esp_log.h>
+
+#include <bmp280.h>
+#include "sensor_driver.h"
+
+static const char *TAG = "BMP280";
+
+static bmp280_params_t bme280_params;
+static bmp280_t bme280_dev;
+static bool bme280p = false;
+static bool bme280_desc = false;
+
+static esp_err_t bmp280_driver_init(void)
+{
+    esp_err_t err = ESP_OK;
+
+    // The descriptor owns a mutex: it is created once and kept when a failed device is re-initialised
+    if (!bme280_desc)
+    {
+        memset(&bme280_dev, 0, sizeof(bmp280_t));
+        err = bmp280_init_desc(&bme280_dev, BMP280_I2C_ADDRESS_0, 0, CONFIG_I2C_GPIO_SDA, CONFIG_I2C_GPIO_SCL);
+        bme280_desc = err == ESP_OK;
+    }
+    bmp280_init_default_params(&bme280_params);
+    if (err == ESP_OK)
+    {
+        err = bmp280_init(&bme280_dev, &bme280_params);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not configure BME280 on SCL pin %d and SDA pin %d", CONFIG_I2C_GPIO_SCL, CONFIG_I2C_GPIO_SDA);
+        return err;
+    }
+    bme280p = bme280_dev.id == BME280_CHIP_ID;
+    ESP_LOGI(TAG, "BMP280: found %s", bme280p ? "BME280" : "BMP280");
+    return ESP_OK;
+}
+
+static esp_err_t bmp280_driver_collect(float *value, uint32_t *produced)
+{
+    esp_err_t err = bmp280_read_float(&bme280_dev, &value[SENSOR_CH_TEMPERATURE], &value[SENSOR_CH_PRESSURE], &value[SENSOR_CH_HUMIDITY]);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Temperature/pressure reading failed");
+        return err;
+    }
+    // Only the BME280 has a humidity sensor
+    *produced = SENSOR_CH_BIT(SENSOR_CH_TEMPERATURE) | SENSOR_CH_BIT(SENSOR_CH_PRESSURE) |
+                (bme280p ? SENSOR_CH_BIT(SENSOR_CH_HUMIDITY) : 0);
+    return ESP_OK;
+}
+
+const sensor_driver_t bmp280_driver = {
+    .name = "BMP280",
+    .channels = SENSOR_CH_BIT(SENSOR_CH_TEMPERATURE) | SENSOR_CH_BIT(SENSOR_CH_PRESSURE) | SENSOR_CH_BIT(SENSOR_CH_HUMIDITY),
+    .measure_ms = 0,
+    .bus = SENSOR_BUS_I2C,
+    .init = bmp280_driver_init,
+    .start = NULL,
+    .collect = bmp280_driver_collect,
+};
+
+#endif
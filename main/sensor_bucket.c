@@ -0,0 +1,44 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_SENSOR_RAIN_BUCKET_ENABLE
+
+#include <esp_log.h>
+
+#include "sensor_driver.h"
+#include "pulse_counter.h"
+
+static const char *TAG = "BUCKET";
+
+static pulse_counter_t bucket_counter;
+
+static esp_err_t bucket_driver_init(void)
+{
+    return pulse_counter_init(&bucket_counter, PCNT_UNIT_0, CONFIG_RAIN_BUCKET_GPIO);
+}
+
+static esp_err_t bucket_driver_collect(float *value, uint32_t *produced)
+{
+    uint32_t tips;
+    esp_err_t err = pulse_counter_read(&bucket_counter, &tips);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not read the bucket tip count");
+        return err;
+    }
+    // Rain since boot, like the total reported by the optical sensor
+    value[SENSOR_CH_BUCKETRAINMM] = (float)((double)tips * CONFIG_RAIN_BUCKET_UM_PER_TIP / 1000.0);
+    *produced = SENSOR_CH_BIT(SENSOR_CH_BUCKETRAINMM);
+    ESP_LOGD(TAG, "%u tips, %.2fmm", tips, value[SENSOR_CH_BUCKETRAINMM]);
+    return ESP_OK;
+}
+
+const sensor_driver_t bucket_driver = {
+    .name = "Rain bucket",
+    .channels = SENSOR_CH_BIT(SENSOR_CH_BUCKETRAINMM),
+    .measure_ms = 0,
+    .init = bucket_driver_init,
+    .start = NULL,
+    .collect = bucket_driver_collect,
+};
+
+#endif
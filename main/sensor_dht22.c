@@ -0,0 +1,39 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_DHT22_ENABLE
+
+#include <esp_log.h>
+
+#include <dht.h>
+#include "sensor_driver.h"
+
+static const char *TAG = "DHT22";
+
+static esp_err_t dht22_driver_init(void)
+{
+    return ESP_OK;
+}
+
+static esp_err_t dht22_driver_collect(float *value, uint32_t *produced)
+{
+    esp_err_t err = dht_read_float_data(DHT_TYPE_AM2301, CONFIG_GPIO_OUTPUT_IO_DHT22, &value[SENSOR_CH_HUMIDITY], &value[SENSOR_CH_TEMPERATURE]);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not read data from sensor on GPIO %d", CONFIG_GPIO_OUTPUT_IO_DHT22);
+        return err;
+    }
+    ESP_LOGD(TAG, "Sensor Read: Temperature: %0.01f Humidity: %0.01f", value[SENSOR_CH_TEMPERATURE], value[SENSOR_CH_HUMIDITY]);
+    *produced = SENSOR_CH_BIT(SENSOR_CH_TEMPERATURE) | SENSOR_CH_BIT(SENSOR_CH_HUMIDITY);
+    return ESP_OK;
+}
+
+const sensor_driver_t dht22_driver = {
+    .name = "DHT22",
+    .channels = SENSOR_CH_BIT(SENSOR_CH_TEMPERATURE) | SENSOR_CH_BIT(SENSOR_CH_HUMIDITY),
+    .measure_ms = 0,
+    .init = dht22_driver_init,
+    .start = NULL,
+    .collect = dht22_driver_collect,
+};
+
+#endif
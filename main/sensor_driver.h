@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"
+#include "sensors.h"
+#ifdef CONFIG_SENSOR_RAIN_ENABLE
+#include "rainsensor.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Returned by start() while a device is still coming up after init. The cycle is skipped
+ * without counting as a failure, so init() does not have to block until the device is ready.
+ */
+#define SENSOR_ERR_NOT_READY (0x7001)
+
+/**
+ * @brief Shared bus a driver talks over. When every driver on a bus has failed, the bus itself is
+ * restarted by the supervisor.
+ */
+typedef enum {
+    SENSOR_BUS_NONE,                    /*!< Dedicated pin or peripheral, nothing shared to restart */
+    SENSOR_BUS_I2C,                     /*!< The i2cdev port shared by the I2C sensors */
+    SENSOR_BUS_UART,                    /*!< The rain sensor UART and its parser task */
+} sensor_bus_t;
+
+/**
+ * @brief Sensor driver descriptor
+ *
+ * Drivers are listed in a compile-time table in sensors.c. Each acquisition cycle starts a
+ * measurement on every healthy driver, waits for the slowest conversion, then collects the
+ * results, so slow conversions overlap. A driver that is disabled in menuconfig compiles to
+ * nothing and is not in the table.
+ */
+typedef struct {
+    const char *name;                   /*!< Driver name used in log messages */
+    uint32_t channels;                  /*!< SENSOR_CH_BIT mask of the channels the driver can produce */
+    uint32_t measure_ms;                /*!< Time between start() and the results being ready */
+    sensor_bus_t bus;                   /*!< Shared bus behind the device */
+    /**
+     * @brief Bring up the device. Also called to re-initialise a failed device.
+     */
+    esp_err_t (*init)(void);
+    /**
+     * @brief Trigger a measurement, NULL if the device measures continuously
+     *
+     * @return ESP_OK, SENSOR_ERR_NOT_READY if the device is still starting up, or an error
+     */
+    esp_err_t (*start)(void);
+    /**
+     * @brief Read the results of the measurement
+     *
+     * @param value readings, indexed by channel
+     * @param produced set to the SENSOR_CH_BIT mask of the channels written to value
+     */
+    esp_err_t (*collect)(float *value, uint32_t *produced);
+} sensor_driver_t;
+
+#ifdef CONFIG_SENSOR_BMP280_ENABLE
+extern const sensor_driver_t bmp280_driver;
+#endif
+#ifdef CONFIG_SENSOR_BH1750_ENABLE
+extern const sensor_driver_t bh1750_driver;
+#endif
+#ifdef CONFIG_SENSOR_DS18X20_ENABLE
+extern const sensor_driver_t ds18x20_driver;
+#endif
+#ifdef CONFIG_DHT22_ENABLE
+extern const sensor_driver_t dht22_driver;
+#endif
+#ifdef CONFIG_SENSOR_MOISTURE_ENABLE
+extern const sensor_driver_t moisture_driver;
+#endif
+#ifdef CONFIG_SENSOR_RAIN_ENABLE
+extern const sensor_driver_t rain_driver;
+
+/**
+ * @brief Latest full report of the rain sensor
+ *
+ * @param data filled in with the report
+ * @return true if the rain sensor has answered since boot
+ */
+bool rain_driver_get_data(rainsensor_t *data);
+
+/**
+ * @brief Tear down the rain sensor UART and parser task and bring them up again. The sensor itself
+ * is reset by the next init().
+ */
+esp_err_t rain_driver_restart(void);
+#endif
+#ifdef CONFIG_SENSOR_RAIN_BUCKET_ENABLE
+extern const sensor_driver_t bucket_driver;
+#endif
+#ifdef CONFIG_SENSOR_ANEMOMETER_ENABLE
+extern const sensor_driver_t anemometer_driver;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,75 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_SENSOR_DS18X20_ENABLE
+
+#include "freertos/FreeRTOS.h"
+#include <esp_log.h>
+
+#include <ds18x20.h>
+#include "sensor_driver.h"
+
+static const char *TAG = "DS18X20";
+
+// Only look for the first sensor on the bus
+#define MAX_DB18X20_SENSORS 1
+
+// Worst case conversion time at 12 bit resolution
+#define DS18X20_CONVERSION_MS 750
+
+// The ROM search result is kept in RTC memory, so waking from deep sleep skips the bus scan
+static RTC_DATA_ATTR ds18x20_addr_t addrs[MAX_DB18X20_SENSORS];
+static RTC_DATA_ATTR bool addrs_cached = false;
+static bool initialised = false;
+
+static esp_err_t ds18x20_driver_init(void)
+{
+    int count;
+
+    // Use the cached address on the first init only. A re-init after a failure always rescans.
+    if (addrs_cached && !initialised)
+    {
+        initialised = true;
+        ESP_LOGI(TAG, "Using cached ds18x20 address");
+        return ESP_OK;
+    }
+    initialised = true;
+    addrs_cached = false;
+    count = ds18x20_scan_devices(CONFIG_DS18X20_GPIO_PIN, addrs, MAX_DB18X20_SENSORS);
+    if (count <= 0)
+    {
+        ESP_LOGE(TAG, "No ds18x20 sensors found on pin %d", CONFIG_DS18X20_GPIO_PIN);
+        return ESP_ERR_NOT_FOUND;
+    }
+    addrs_cached = true;
+    return ESP_OK;
+}
+
+static esp_err_t ds18x20_driver_start(void)
+{
+    // Start the conversion without waiting, the other sensors are read meanwhile
+    return ds18x20_measure(CONFIG_DS18X20_GPIO_PIN, addrs[0], false);
+}
+
+static esp_err_t ds18x20_driver_collect(float *value, uint32_t *produced)
+{
+    esp_err_t err = ds18x20_read_temperature(CONFIG_DS18X20_GPIO_PIN, addrs[0], &value[SENSOR_CH_GROUNDTEMPERATURE]);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not read ds18x20 sensor on pin %d", CONFIG_DS18X20_GPIO_PIN);
+        return err;
+    }
+    ESP_LOGD(TAG, "DS18B20 Ground Temperature: %0.02f", value[SENSOR_CH_GROUNDTEMPERATURE]);
+    *produced = SENSOR_CH_BIT(SENSOR_CH_GROUNDTEMPERATURE);
+    return ESP_OK;
+}
+
+const sensor_driver_t ds18x20_driver = {
+    .name = "DS18X20",
+    .channels = SENSOR_CH_BIT(SENSOR_CH_GROUNDTEMPERATURE),
+    .measure_ms = DS18X20_CONVERSION_MS,
+    .init = ds18x20_driver_init,
+    .start = ds18x20_driver_start,
+    .collect = ds18x20_driver_collect,
+};
+
+#endif
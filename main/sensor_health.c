@@ -0,0 +1,136 @@
+#include "esp_log.h"
+
+#include "sensor_health.h"
+
+static const char *TAG = "HEALTH";
+
+static void set_state(sensor_health_t *health, sensor_health_state_t state)
+{
+    if (health->state != state)
+    {
+        ESP_LOGW(TAG, "%s: %s -> %s (%u consecutive errors, %u total)", health->name,
+                 sensor_health_state_name(health->state), sensor_health_state_name(state),
+                 health->consecutive_errors, health->total_errors);
+        health->state = state;
+    }
+}
+
+static void schedule_retry(sensor_health_t *health, int64_t now)
+{
+    health->next_attempt_us = now + (int64_t)health->backoff_ms * 1000;
+    ESP_LOGW(TAG, "%s: next re-init attempt in %ums", health->name, health->backoff_ms);
+}
+
+void sensor_health_init(sensor_health_t *health, const char *name, bool ok, int64_t now)
+{
+    health->name = name;
+    health->state = SENSOR_HEALTH_OK;
+    health->consecutive_errors = 0;
+    health->total_errors = 0;
+    health->recoveries = 0;
+    health->backoff_ms = CONFIG_SENSOR_BACKOFF_MIN_MS;
+    health->next_attempt_us = 0;
+    health->last_good_us = 0;
+    if (!ok)
+    {
+        // A sensor that did not come up at boot goes straight to the backoff schedule
+        health->consecutive_errors = 1;
+        health->total_errors = 1;
+        set_state(health, SENSOR_HEALTH_FAILED);
+        schedule_retry(health, now);
+    }
+}
+
+bool sensor_health_poll(sensor_health_t *health, int64_t now)
+{
+    if (health->state != SENSOR_HEALTH_FAILED)
+    {
+        return true;
+    }
+    if (now < health->next_attempt_us)
+    {
+        return false;
+    }
+    set_state(health, SENSOR_HEALTH_RECOVERING);
+    return true;
+}
+
+void sensor_health_retry(sensor_health_t *health, int64_t now)
+{
+    if (health->state == SENSOR_HEALTH_FAILED)
+    {
+        health->next_attempt_us = now;
+    }
+}
+
+void sensor_health_started(sensor_health_t *health)
+{
+    if (health->state == SENSOR_HEALTH_RECOVERING)
+    {
+        set_state(health, SENSOR_HEALTH_STARTING);
+    }
+}
+
+void sensor_health_update(sensor_health_t *health, bool ok, int64_t now)
+{
+    if (ok)
+    {
+        if (health->state == SENSOR_HEALTH_RECOVERING || health->state == SENSOR_HEALTH_STARTING)
+        {
+            health->recoveries++;
+        }
+        health->consecutive_errors = 0;
+        health->backoff_ms = CONFIG_SENSOR_BACKOFF_MIN_MS;
+        health->last_good_us = now;
+        set_state(health, SENSOR_HEALTH_OK);
+        return;
+    }
+
+    health->consecutive_errors++;
+    health->total_errors++;
+    switch (health->state)
+    {
+        case SENSOR_HEALTH_OK:
+        case SENSOR_HEALTH_DEGRADED:
+            if (health->consecutive_errors >= CONFIG_SENSOR_FAIL_THRESHOLD)
+            {
+                set_state(health, SENSOR_HEALTH_FAILED);
+                schedule_retry(health, now);
+            }
+            else
+            {
+                set_state(health, SENSOR_HEALTH_DEGRADED);
+            }
+            break;
+        case SENSOR_HEALTH_RECOVERING:
+        case SENSOR_HEALTH_STARTING:
+            health->backoff_ms *= 2;
+            if (health->backoff_ms > CONFIG_SENSOR_BACKOFF_MAX_MS)
+            {
+                health->backoff_ms = CONFIG_SENSOR_BACKOFF_MAX_MS;
+            }
+            set_state(health, SENSOR_HEALTH_FAILED);
+            schedule_retry(health, now);
+            break;
+        case SENSOR_HEALTH_FAILED:
+            break;
+    }
+}
+
+uint32_t sensor_health_age(const sensor_health_t *health, int64_t now)
+{
+    return (uint32_t)((now - health->last_good_us) / 1000000);
+}
+
+const char *sensor_health_state_name(sensor_health_state_t state)
+{
+    switch (state)
+    {
+        case SENSOR_HEALTH_OK:          return "OK";
+        case SENSOR_HEALTH_DEGRADED:    return "DEGRADED";
+        case SENSOR_HEALTH_FAILED:      return "FAILED";
+        case SENSOR_HEALTH_RECOVERING:  return "RECOVERING";
+        case SENSOR_HEALTH_STARTING:    return "STARTING";
+        default:                        return "UNKNOWN";
+    }
+}
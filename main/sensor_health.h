@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Sensor health states
+ *
+ * OK -> DEGRADED on a failed read, DEGRADED -> FAILED after CONFIG_SENSOR_FAIL_THRESHOLD
+ * consecutive failures. A FAILED sensor is left alone until its backoff expires, then it is
+ * RECOVERING: due to be re-initialised. Once re-initialised it is STARTING until its first read,
+ * which may wait for a device that is still booting without it being re-initialised again.
+ * Success returns it to OK, failure back to FAILED with the backoff doubled.
+ */
+typedef enum {
+    SENSOR_HEALTH_OK,
+    SENSOR_HEALTH_DEGRADED,
+    SENSOR_HEALTH_FAILED,
+    SENSOR_HEALTH_RECOVERING,
+    SENSOR_HEALTH_STARTING
+} sensor_health_state_t;
+
+/**
+ * @brief Health tracking for one sensor
+ */
+typedef struct {
+    const char *name;                   /*!< Sensor name used in log messages */
+    sensor_health_state_t state;        /*!< Current state */
+    uint32_t consecutive_errors;        /*!< Failures since the last good reading */
+    uint32_t total_errors;              /*!< Failures since boot */
+    uint32_t recoveries;                /*!< Successful recoveries from FAILED */
+    uint32_t backoff_ms;                /*!< Wait before the next re-init attempt */
+    int64_t next_attempt_us;            /*!< Time of the next re-init attempt */
+    int64_t last_good_us;               /*!< Time of the last good reading, 0 if never */
+} sensor_health_t;
+
+/**
+ * @brief Initialise the health tracking of a sensor
+ *
+ * @param health health object
+ * @param name sensor name used in log messages
+ * @param ok true if the sensor initialised correctly
+ * @param now current time in microseconds
+ */
+void sensor_health_init(sensor_health_t *health, const char *name, bool ok, int64_t now);
+
+/**
+ * @brief Check whether a sensor should be read this cycle. A failed sensor is skipped until its
+ * backoff expires, at which point it moves to RECOVERING and must be re-initialised before reading.
+ *
+ * @param health health object
+ * @param now current time in microseconds
+ * @return true if the sensor should be read
+ */
+bool sensor_health_poll(sensor_health_t *health, int64_t now);
+
+/**
+ * @brief Bring the next re-init attempt of a failed sensor forward to now, e.g. once the bus it is
+ * on has been restarted. The backoff is kept.
+ *
+ * @param health health object
+ * @param now current time in microseconds
+ */
+void sensor_health_retry(sensor_health_t *health, int64_t now);
+
+/**
+ * @brief Record a successful re-init of a RECOVERING sensor, which is then STARTING
+ *
+ * @param health health object
+ */
+void sensor_health_started(sensor_health_t *health);
+
+/**
+ * @brief Record the outcome of a re-init or read attempt
+ *
+ * @param health health object
+ * @param ok true if the attempt succeeded
+ * @param now current time in microseconds
+ */
+void sensor_health_update(sensor_health_t *health, bool ok, int64_t now);
+
+/**
+ * @brief Seconds since the last good reading (or since boot if there never was one)
+ *
+ * @param health health object
+ * @param now current time in microseconds
+ * @return age in seconds
+ */
+uint32_t sensor_health_age(const sensor_health_t *health, int64_t now);
+
+/**
+ * @brief Name of a health state
+ */
+const char *sensor_health_state_name(sensor_health_state_t state);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,33 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_SENSOR_MOISTURE_ENABLE
+
+#include "sensor_driver.h"
+#include "sensor_adc.h"
+
+static esp_err_t moisture_driver_init(void)
+{
+    return configure_adc();
+}
+
+static esp_err_t moisture_driver_collect(float *value, uint32_t *produced)
+{
+    uint32_t raw, voltage;
+
+    read_moisture_adc(&raw, &voltage);
+    value[SENSOR_CH_GROUNDMOISTURE] = raw;
+    value[SENSOR_CH_GROUNDVOLTAGE] = voltage;
+    *produced = SENSOR_CH_BIT(SENSOR_CH_GROUNDMOISTURE) | SENSOR_CH_BIT(SENSOR_CH_GROUNDVOLTAGE);
+    return ESP_OK;
+}
+
+const sensor_driver_t moisture_driver = {
+    .name = "MOISTURE",
+    .channels = SENSOR_CH_BIT(SENSOR_CH_GROUNDMOISTURE) | SENSOR_CH_BIT(SENSOR_CH_GROUNDVOLTAGE),
+    .measure_ms = 0,
+    .init = moisture_driver_init,
+    .start = NULL,
+    .collect = moisture_driver_collect,
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include "sdkconfig.h"
+
+#ifdef CONFIG_SENSOR_RAIN_ENABLE
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "sensor_driver.h"
+#include "rainsensor.h"
+
+static const char *TAG = "RAIN";
+
+// Time for the rain sensor to answer a read command at 9600 baud
+#define RAIN_RESPONSE_MS 200
+
+// Give up waiting for the reboot banner after this long and read anyway
+#define RAIN_BOOT_TIMEOUT_MS 3000
+
+static rainsensor_parser_handle_t rainsensor_hdl = NULL;
+static portMUX_TYPE rain_lock = portMUX_INITIALIZER_UNLOCKED;
+static rainsensor_t rain_data;
+static bool rain_updated = false;
+static bool rain_ready = false;
+static bool rain_seen = false;
+static int64_t rain_reset_us = 0;
+
+/**
+ * @brief Rain Sensor Event Handler
+ *
+ * @param event_handler_arg handler specific arguments
+ * @param event_base event base, here is fixed to ESP_RAINSENSOR_EVENT
+ * @param event_id event id
+ * @param event_data event specific arguments
+ */
+static void rainsensor_event_handler(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    rainsensor_t *rainsensor = NULL;
+    switch (event_id) {
+    case RAINSENSOR_UPDATE:
+        rainsensor = (rainsensor_t *)event_data;
+        /* print information parsed from rain sensor statements */
+        ESP_LOGD(TAG, "Data:\r\n"
+                 "\t\t\t\t\t\tAccumulator = %.02fmm\r\n"
+                 "\t\t\t\t\t\tEvent Accu  = %.02fmm\r\n"
+                 "\t\t\t\t\t\tTotal Rain  = %.02fmm\r\n"
+                 "\t\t\t\t\t\tmmper hour  = %.02fmmph",
+                 rainsensor->current_acc_rain, rainsensor->event_acc_rain, rainsensor->total_rain, rainsensor->mm_per_hour_rain);
+        portENTER_CRITICAL(&rain_lock);
+        rain_data = *rainsensor;
+        rain_updated = true;
+        rain_seen = true;
+        portEXIT_CRITICAL(&rain_lock);
+        break;
+    case RAINSENSOR_RESET_COMPLETE:
+        ESP_LOGW(TAG, "Rain Sensor reset complete");
+        rain_ready = true;
+        break;
+    case RAINSENSOR_EVENT:
+        ESP_LOGW(TAG, "Rain Sensor sent a rain event");
+        break;
+    case RAINSENSOR_UNKNOWN:
+        /* print unknown statements */
+        ESP_LOGW(TAG, "Unknown statement:%s", (char *)event_data);
+        break;
+    default:
+        break;
+    }
+}
+
+static esp_err_t rain_parser_start(void)
+{
+    rainsensor_hdl = rainsensor_parser_init();
+    if (rainsensor_hdl == NULL)
+    {
+        return ESP_FAIL;
+    }
+    rainsensor_parser_add_handler(rainsensor_hdl, rainsensor_event_handler, NULL);
+    return ESP_OK;
+}
+
+static esp_err_t rain_driver_init(void)
+{
+    // The parser, its task and the UART driver are set up once. Recovering the sensor only resets
+    // it; the UART is torn down and set up again by rain_driver_restart() when the supervisor
+    // restarts it.
+    if (rainsensor_hdl == NULL && rain_parser_start() != ESP_OK)
+    {
+        return ESP_FAIL;
+    }
+    // The reset does not block; the sensor is read once it has rebooted
+    rain_ready = false;
+    rain_reset_us = esp_timer_get_time();
+    rainsensor_reset();
+    return ESP_OK;
+}
+
+esp_err_t rain_driver_restart(void)
+{
+    if (rainsensor_hdl != NULL)
+    {
+        rainsensor_parser_remove_handler(rainsensor_hdl, rainsensor_event_handler);
+        rainsensor_parser_deinit(rainsensor_hdl);
+        rainsensor_hdl = NULL;
+    }
+    return rain_parser_start();
+}
+
+static esp_err_t rain_driver_start(void)
+{
+    if (!rain_ready && (esp_timer_get_time() - rain_reset_us) < RAIN_BOOT_TIMEOUT_MS * 1000LL)
+    {
+        return SENSOR_ERR_NOT_READY;
+    }
+    rainsensor_read();
+    return ESP_OK;
+}
+
+static esp_err_t rain_driver_collect(float *value, uint32_t *produced)
+{
+    bool updated;
+
+    portENTER_CRITICAL(&rain_lock);
+    updated = rain_updated;
+    rain_updated = false;
+    value[SENSOR_CH_RAINMM] = rain_data.total_rain;
+    portEXIT_CRITICAL(&rain_lock);
+    if (!updated)
+    {
+        ESP_LOGE(TAG, "No answer from the rain sensor");
+        return ESP_ERR_TIMEOUT;
+    }
+    *produced = SENSOR_CH_BIT(SENSOR_CH_RAINMM);
+    return ESP_OK;
+}
+
+bool rain_driver_get_data(rainsensor_t *data)
+{
+    bool seen;
+
+    portENTER_CRITICAL(&rain_lock);
+    seen = rain_seen;
+    *data = rain_data;
+    portEXIT_CRITICAL(&rain_lock);
+    return seen;
+}
+
+const sensor_driver_t rain_driver = {
+    .name = "RAIN",
+    .channels = SENSOR_CH_BIT(SENSOR_CH_RAINMM),
+    .measure_ms = RAIN_RESPONSE_MS,
+    .bus = SENSOR_BUS_UART,
+    .init = rain_driver_init,
+    .start = rain_driver_start,
+    .collect = rain_driver_collect,
+};
+
+#endif
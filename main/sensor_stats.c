@@ -0,0 +1,38 @@
+#include <math.h>
+#include <string.h>
+
+#include "sensor_stats.h"
+
+void sensor_stat_reset(sensor_stat_t *stat)
+{
+    memset(stat, 0, sizeof(sensor_stat_t));
+}
+
+void sensor_stat_add(sensor_stat_t *stat, float value)
+{
+    double delta;
+
+    if (stat->count == 0)
+    {
+        stat->min = value;
+        stat->max = value;
+    }
+    else
+    {
+        stat->min = fminf(stat->min, value);
+        stat->max = fmaxf(stat->max, value);
+    }
+    stat->count++;
+    delta = value - stat->mean;
+    stat->mean += delta / stat->count;
+    stat->m2 += delta * (value - stat->mean);
+}
+
+float sensor_stat_stddev(const sensor_stat_t *stat)
+{
+    if (stat->count < 2)
+    {
+        return 0.0f;
+    }
+    return (float)sqrt(stat->m2 / (stat->count - 1));
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Running statistics of one channel over a publish window.
+ *
+ * Mean and variance use Welford's online algorithm, which stays numerically stable over long
+ * windows where the naive sum of squares would cancel catastrophically.
+ */
+typedef struct {
+    uint32_t count;         /*!< Number of samples */
+    float min;              /*!< Smallest sample */
+    float max;              /*!< Largest sample */
+    double mean;            /*!< Running mean */
+    double m2;              /*!< Running sum of squared differences from the mean */
+} sensor_stat_t;
+
+/**
+ * @brief Clear the statistics for a new window
+ */
+void sensor_stat_reset(sensor_stat_t *stat);
+
+/**
+ * @brief Add a sample to the statistics
+ */
+void sensor_stat_add(sensor_stat_t *stat, float value);
+
+/**
+ * @brief Sample standard deviation, 0 with fewer than two samples
+ */
+float sensor_stat_stddev(const sensor_stat_t *stat);
+
+#ifdef __cplusplus
+}
+#endif
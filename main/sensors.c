@@ -1,115 +1,278 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <esp_system.h>
+#include <esp_timer.h>
 #include <esp_log.h>
 
 #include <string.h>
 
-#include <bmp280.h>
-#include <ds18x20.h>
+#ifdef CONFIG_SENSOR_I2C_BUS
+#include <i2cdev.h>
+#endif
 #include "sensors.h"
-#include "sensor_adc.h"
-#include <bh1750.h>
+#include "sensor_driver.h"
+#include "sensor_health.h"
+#include "supervisor.h"
+#include "mem_budget.h"
 
 static const char *TAG = "SENSORS";
 
-#define UART_BUF_SIZE (1024)
+/**
+ * @brief Sensor driver registry. Each acquisition cycle walks this table.
+ */
+static const sensor_driver_t *const drivers[] = {
+#ifdef CONFIG_SENSOR_BMP280_ENABLE
+    &bmp280_driver,
+#endif
+#ifdef CONFIG_SENSOR_BH1750_ENABLE
+    &bh1750_driver,
+#endif
+#ifdef CONFIG_SENSOR_DS18X20_ENABLE
+    &ds18x20_driver,
+#endif
+#ifdef CONFIG_DHT22_ENABLE
+    &dht22_driver,
+#endif
+#ifdef CONFIG_SENSOR_MOISTURE_ENABLE
+    &moisture_driver,
+#endif
+#ifdef CONFIG_SENSOR_RAIN_ENABLE
+    &rain_driver,
+#endif
+#ifdef CONFIG_SENSOR_RAIN_BUCKET_ENABLE
+    &bucket_driver,
+#endif
+#ifdef CONFIG_SENSOR_ANEMOMETER_ENABLE
+    &anemometer_driver,
+#endif
+};
 
-// Only look for the first sensor on the bus
-#define MAX_DB18X20_SENSORS 1
+#define DRIVER_COUNT (sizeof(drivers) / sizeof(drivers[0]))
 
-static int ds18x20_sensor_count = 0;
-static i2c_dev_t light_dev;
-static bmp280_params_t bme280_params;
-static bmp280_t bme280_dev;
-static ds18x20_addr_t addrs[MAX_DB18X20_SENSORS];
+static sensor_health_t health[DRIVER_COUNT];
+static bool measuring[DRIVER_COUNT];
 
 static sensor_data sensorinfo = {0};
 
-sensor_data* get_sensors(void)
+/**
+ * @brief Supervisor subsystem behind each shared bus
+ */
+static const supervisor_subsystem_t bus_subsystem[] = {
+    [SENSOR_BUS_I2C] = SUPERVISOR_I2C,
+    [SENSOR_BUS_UART] = SUPERVISOR_UART,
+};
+
+static esp_err_t bus_restart(sensor_bus_t bus)
 {
-#if CONFIG_DHT22_ENABLED
-    if (dht_read_float_data(sensor_type, CONFIG_GPIO_OUTPUT_IO_DHT22, &sensorinfo.humidity, &sensorinfo.temperature) == ESP_OK)
+    switch (bus)
     {
-        ESP_LOGI(TAG, "Sensor Read: Temperature: %0.01f Humidity: %0.01f", sensorinfo.temperature, sensorinfo.humidity);
+#ifdef CONFIG_SENSOR_I2C_BUS
+        case SENSOR_BUS_I2C:
+            i2cdev_done();
+            return i2cdev_init();
+#endif
+#ifdef CONFIG_SENSOR_RAIN_ENABLE
+        case SENSOR_BUS_UART:
+            return rain_driver_restart();
+#endif
+        default:
+            return ESP_OK;
     }
-    else
+}
+
+/**
+ * @brief Restart a shared bus once every driver on it has failed, then retry its drivers straight away
+ */
+static void bus_supervise(sensor_bus_t bus, int64_t now)
+{
+    supervisor_subsystem_t sub = bus_subsystem[bus];
+    bool present = false;
+    bool all_failed = true;
+    esp_err_t err;
+
+    for (int i = 0; i < DRIVER_COUNT; i++)
     {
-        ESP_LOGE(TAG, "Could not read data from sensor on GPIO %d\n", CONFIG_GPIO_OUTPUT_IO_DHT22);
+        if (drivers[i]->bus == bus)
+        {
+            present = true;
+            all_failed = all_failed && health[i].state == SENSOR_HEALTH_FAILED;
+        }
     }
-#endif
-    if (bmp280_read_float(&bme280_dev, &sensorinfo.temperature, &sensorinfo.pressure, &sensorinfo.humidity) != ESP_OK)
+    if (!present)
     {
-        ESP_LOGE(TAG, "Temperature/pressure reading failed");
+        return;
     }
-
-    if (bh1750_read(&light_dev, &sensorinfo.lightlevel) == ESP_OK)
+    if (supervisor_status(sub)->up)
     {
-        ESP_LOGI(TAG, "Lux value: %d", sensorinfo.lightlevel);
+        if (!all_failed)
+        {
+            return;
+        }
+        supervisor_fault(sub, "every device on the bus failed", now);
     }
-    else
+    if (!supervisor_restart_due(sub, now))
+    {
+        return;
+    }
+    // Driver set up allocates, which the sampler task is otherwise not allowed to do
+    mem_budget_guard_leave();
+    err = bus_restart(bus);
+    mem_budget_guard_enter();
+    if (err != ESP_OK)
     {
-        ESP_LOGE(TAG, "Could not read lux data");
+        supervisor_fault(sub, esp_err_to_name(err), now);
+        return;
     }
+    supervisor_up(sub, now);
+    for (int i = 0; i < DRIVER_COUNT; i++)
+    {
+        if (drivers[i]->bus == bus)
+        {
+            sensor_health_retry(&health[i], now);
+        }
+    }
+}
 
-    if (ds18x20_sensor_count==0)
+/**
+ * @brief Start a measurement on a driver, re-initialising it first if it is recovering. A driver is
+ * re-initialised once per recovery: while it reports that the device is still starting up it is
+ * left to finish.
+ *
+ * @return true if the driver has a measurement in progress
+ */
+static bool driver_start(int i, int64_t now)
+{
+    esp_err_t err = ESP_OK;
+
+    // A failed driver is not touched again until its backoff expires
+    if (!sensor_health_poll(&health[i], now))
+    {
+        return false;
+    }
+    if (health[i].state == SENSOR_HEALTH_RECOVERING)
     {
-        ESP_LOGW(TAG, "Rescan for ds18x20 sensors on pin %d", CONFIG_DS18X20_GPIO_PIN);
-        ds18x20_sensor_count = ds18x20_scan_devices(CONFIG_DS18X20_GPIO_PIN, addrs, MAX_DB18X20_SENSORS);
-        if (ds18x20_sensor_count==0)
+        // Like a bus restart, setting a device up again may allocate
+        mem_budget_guard_leave();
+        err = drivers[i]->init();
+        mem_budget_guard_enter();
+        if (err == ESP_OK)
         {
-            ESP_LOGE(TAG, "Rescan found no ds18x20 sensors found on pin %d", CONFIG_DS18X20_GPIO_PIN);
+            sensor_health_started(&health[i]);
         }
     }
-    if (ds18x20_sensor_count>0)
+    if (err == ESP_OK && drivers[i]->start)
     {
-        ds18x20_measure_and_read(CONFIG_DS18X20_GPIO_PIN, addrs[0], &sensorinfo.groundtemperature);
-        ESP_LOGI(TAG, "DS18B20 Ground Temperature: %0.02f", sensorinfo.groundtemperature);
+        err = drivers[i]->start();
     }
-
-    read_moisture_adc(&sensorinfo.groundmoisture, &sensorinfo.groundvoltage);
-
-    return &sensorinfo;
+    if (err == SENSOR_ERR_NOT_READY)
+    {
+        // Still starting up: skip this cycle without counting it against the driver
+        return false;
+    }
+    if (err != ESP_OK)
+    {
+        sensor_health_update(&health[i], false, now);
+        return false;
+    }
+    return true;
 }
 
-void configure_sensors(void)
+/**
+ * @brief Collect the results of a driver and mark its channels as fresh, or as stale with the age of their last good reading
+ */
+static void driver_collect(int i, int64_t now)
 {
-    //ds18x20_addr_t addrs[MAX_DB18X20_SENSORS];
-    memset(&bme280_dev, 0, sizeof(bmp280_t));
-    memset(&light_dev, 0, sizeof(i2c_dev_t)); // Zero descriptor
+    float value[SENSOR_CH_COUNT];
+    uint32_t produced = 0;
+    bool ok = false;
 
-    configure_adc();
+    if (measuring[i])
+    {
+        // Collect into a scratch copy so a failed read cannot leave partial data behind
+        ok = drivers[i]->collect(value, &produced) == ESP_OK;
+        sensor_health_update(&health[i], ok, now);
+    }
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (ok && (produced & SENSOR_CH_BIT(ch)))
+        {
+            sensorinfo.value[ch] = value[ch];
+            sensorinfo.valid |= SENSOR_CH_BIT(ch);
+            sensorinfo.age[ch] = 0;
+        }
+        else if ((drivers[i]->channels & SENSOR_CH_BIT(ch)) && !(sensorinfo.valid & SENSOR_CH_BIT(ch)))
+        {
+            sensorinfo.age[ch] = sensor_health_age(&health[i], now);
+        }
+    }
+}
 
-    bmp280_init_default_params(&bme280_params);
+sensor_data* get_sensors(void)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t wait_ms = 0;
 
-    ds18x20_sensor_count = ds18x20_scan_devices(CONFIG_DS18X20_GPIO_PIN, addrs, MAX_DB18X20_SENSORS);
-    if (ds18x20_sensor_count==0)
+    // Channels without a driver behind them stay invalid, aged from boot
+    sensorinfo.valid = 0;
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
     {
-        ESP_LOGE(TAG, "No ds18x20 sensors found on pin %d", CONFIG_DS18X20_GPIO_PIN);
+        sensorinfo.age[ch] = (uint32_t)(now / 1000000);
     }
 
-    ESP_ERROR_CHECK(i2cdev_init()); // Init library
+    // A failed bus is restarted here, between acquisition cycles, so the other sensors keep being read
+    bus_supervise(SENSOR_BUS_I2C, now);
+    bus_supervise(SENSOR_BUS_UART, now);
 
-    // Setup the light sensor
-    ESP_ERROR_CHECK(bh1750_init_desc(&light_dev, BH1750_ADDR_LO, 0, CONFIG_I2C_GPIO_SDA, CONFIG_I2C_GPIO_SCL));
-    if (bh1750_setup(&light_dev, BH1750_MODE_CONTINUOUS, BH1750_RES_HIGH) == ESP_OK)
+    // Start every measurement first so the conversions run in parallel
+    for (int i = 0; i < DRIVER_COUNT; i++)
     {
-        ESP_LOGI(TAG, "BH1750 light sensor found");
+        measuring[i] = driver_start(i, now);
+        if (measuring[i] && drivers[i]->measure_ms > wait_ms)
+        {
+            wait_ms = drivers[i]->measure_ms;
+        }
     }
-    else
+    if (wait_ms)
     {
-        ESP_LOGE(TAG, "Could not configure BH1750 on SCL pin %d and SDA pin %d", CONFIG_I2C_GPIO_SCL, CONFIG_I2C_GPIO_SDA);
+        vTaskDelay(pdMS_TO_TICKS(wait_ms));
     }
+    now = esp_timer_get_time();
+    sensorinfo.time_us = now;
+    for (int i = 0; i < DRIVER_COUNT; i++)
+    {
+        driver_collect(i, now);
+    }
+
+    return &sensorinfo;
+}
 
-    // Setup the temperature/etc sensor
-    bmp280_init_desc(&bme280_dev, BMP280_I2C_ADDRESS_0, 0, CONFIG_I2C_GPIO_SDA, CONFIG_I2C_GPIO_SCL);
-    if (bmp280_init(&bme280_dev, &bme280_params) == ESP_OK)
+void configure_sensors(void)
+{
+    esp_err_t err;
+
+#ifdef CONFIG_SENSOR_I2C_BUS
+    // A bus that does not come up is restarted by the supervisor, the sensors on it fail until then
+    err = i2cdev_init(); // Init library
+    if (err != ESP_OK)
     {
-        bool bme280p = bme280_dev.id == BME280_CHIP_ID;
-        ESP_LOGI(TAG, "BMP280: found %s", bme280p ? "BME280" : "BMP280");
+        ESP_LOGE(TAG, "I2C init failed: %s", esp_err_to_name(err));
+        supervisor_fault(SUPERVISOR_I2C, esp_err_to_name(err), esp_timer_get_time());
     }
     else
     {
-        ESP_LOGE(TAG, "Could not configure BME280 on SCL pin %d and SDA pin %d", CONFIG_I2C_GPIO_SCL, CONFIG_I2C_GPIO_SCL);
+        supervisor_up(SUPERVISOR_I2C, esp_timer_get_time());
+    }
+#endif
+    supervisor_up(SUPERVISOR_UART, esp_timer_get_time());
+
+    for (int i = 0; i < DRIVER_COUNT; i++)
+    {
+        err = drivers[i]->init();
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "%s init failed: %s", drivers[i]->name, esp_err_to_name(err));
+        }
+        sensor_health_init(&health[i], drivers[i]->name, err == ESP_OK, esp_timer_get_time());
     }
+    ESP_LOGI(TAG, "%d sensor drivers configured", (int)DRIVER_COUNT);
 }
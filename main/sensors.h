@@ -1,21 +1,35 @@
 #pragma once
 
 #include <stdlib.h>
+#include <stdint.h>
 
-typedef struct sensordata 
+/**
+ * @brief Sensor channels. The order is part of the telemetry wire format.
+ */
+typedef enum {
+    SENSOR_CH_TEMPERATURE = 0,
+    SENSOR_CH_HUMIDITY,
+    SENSOR_CH_PRESSURE,
+    SENSOR_CH_GROUNDTEMPERATURE,
+    SENSOR_CH_GROUNDMOISTURE,
+    SENSOR_CH_GROUNDVOLTAGE,
+    SENSOR_CH_RAINMM,
+    SENSOR_CH_UVLEVEL,
+    SENSOR_CH_LIGHTLEVEL,
+    SENSOR_CH_BUCKETRAINMM,
+    SENSOR_CH_WINDSPEED,
+    SENSOR_CH_COUNT
+} sensor_channel_t;
+
+#define SENSOR_CH_BIT(ch) (1UL << (ch))
+
+typedef struct sensordata
 {
-    float temperature;
-    float humidity;
-    float groundtemperature;
-    uint32_t groundmoisture;
-    uint32_t groundvoltage;
-    float pressure;
-    float rainmm;
-    uint16_t uvlevel;
-    uint16_t lightlevel;
+    float value[SENSOR_CH_COUNT];       // Readings, indexed by channel
+    uint32_t valid;                     // SENSOR_CH_BIT(ch) set when channel ch was read successfully this cycle
+    uint32_t age[SENSOR_CH_COUNT];      // Seconds since channel ch was last read successfully
+    int64_t time_us;                    // Monotonic (esp_timer) time the readings were collected
 } sensor_data;
 
 void configure_sensors(void);
-void configure_uart(void);
 sensor_data* get_sensors(void);
-void poll_uart(void);
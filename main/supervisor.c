@@ -0,0 +1,77 @@
+#include "esp_log.h"
+
+#include "supervisor.h"
+
+static const char *TAG = "SUPERVISOR";
+
+static supervisor_status_t status[SUPERVISOR_COUNT] = {
+    [SUPERVISOR_MQTT] = { .name = "mqtt" },
+    [SUPERVISOR_I2C] = { .name = "i2c" },
+    [SUPERVISOR_UART] = { .name = "uart" },
+};
+
+void supervisor_up(supervisor_subsystem_t sub, int64_t now)
+{
+    supervisor_status_t *st = &status[sub];
+
+    if (!st->up && st->faults)
+    {
+        ESP_LOGW(TAG, "%s: restarted (%u restarts, %u faults since boot)", st->name, st->restarts, st->faults);
+    }
+    st->up = true;
+    st->up_since_us = now;
+}
+
+void supervisor_fault(supervisor_subsystem_t sub, const char *reason, int64_t now)
+{
+    supervisor_status_t *st = &status[sub];
+    bool stable = st->up && (now - st->up_since_us) >= (int64_t)CONFIG_SUPERVISOR_BACKOFF_MAX_MS * 1000;
+
+    if (st->backoff_ms == 0 || stable)
+    {
+        st->backoff_ms = CONFIG_SUPERVISOR_BACKOFF_MIN_MS;
+    }
+    else
+    {
+        // A failed restart, or a subsystem that keeps falling over right after coming back
+        st->backoff_ms *= 2;
+        if (st->backoff_ms > CONFIG_SUPERVISOR_BACKOFF_MAX_MS)
+        {
+            st->backoff_ms = CONFIG_SUPERVISOR_BACKOFF_MAX_MS;
+        }
+    }
+    st->up = false;
+    st->faults++;
+    st->last_fault = reason;
+    st->next_restart_us = now + (int64_t)st->backoff_ms * 1000;
+    ESP_LOGE(TAG, "%s: %s, restarting in %ums", st->name, reason, st->backoff_ms);
+}
+
+bool supervisor_restart_due(supervisor_subsystem_t sub, int64_t now)
+{
+    supervisor_status_t *st = &status[sub];
+
+    if (st->up || now < st->next_restart_us)
+    {
+        return false;
+    }
+    st->restarts++;
+    ESP_LOGW(TAG, "%s: restart attempt %u", st->name, st->restarts);
+    return true;
+}
+
+uint32_t supervisor_wait_ms(supervisor_subsystem_t sub, int64_t now)
+{
+    const supervisor_status_t *st = &status[sub];
+
+    if (st->up || now >= st->next_restart_us)
+    {
+        return 0;
+    }
+    return (uint32_t)((st->next_restart_us - now + 999) / 1000);
+}
+
+const supervisor_status_t *supervisor_status(supervisor_subsystem_t sub)
+{
+    return &status[sub];
+}
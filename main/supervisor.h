@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Subsystems that are restarted on their own instead of resetting the chip
+ */
+typedef enum {
+    SUPERVISOR_MQTT,            /*!< MQTT client and its TLS session */
+    SUPERVISOR_I2C,             /*!< I2C bus shared by the BMP280 and BH1750 */
+    SUPERVISOR_UART,            /*!< UART and parser task of the rain sensor */
+    SUPERVISOR_COUNT
+} supervisor_subsystem_t;
+
+/**
+ * @brief Restart bookkeeping of one subsystem.
+ *
+ * A fault takes the subsystem down and schedules a restart after a backoff. The backoff doubles
+ * whenever a restart fails or the subsystem fails again soon after coming back, up to
+ * CONFIG_SUPERVISOR_BACKOFF_MAX_MS, and starts over from CONFIG_SUPERVISOR_BACKOFF_MIN_MS once it
+ * has stayed up for that long. Each subsystem is driven by the one task that owns it; other tasks
+ * only read the counters.
+ */
+typedef struct {
+    const char *name;           /*!< Subsystem name used in log messages and metrics */
+    bool up;                    /*!< Running */
+    uint32_t faults;            /*!< Faults since boot */
+    uint32_t restarts;          /*!< Restart attempts since boot */
+    uint32_t backoff_ms;        /*!< Wait before the next restart attempt */
+    int64_t next_restart_us;    /*!< Time of the next restart attempt */
+    int64_t up_since_us;        /*!< Time the subsystem last came up */
+    const char *last_fault;     /*!< Reason of the last fault, NULL if none */
+} supervisor_status_t;
+
+/**
+ * @brief Record that a subsystem is running, after its first start or a restart
+ *
+ * @param sub subsystem
+ * @param now current time in microseconds
+ */
+void supervisor_up(supervisor_subsystem_t sub, int64_t now);
+
+/**
+ * @brief Record a fault: the subsystem is down until its restart is due
+ *
+ * @param sub subsystem
+ * @param reason static string describing the fault
+ * @param now current time in microseconds
+ */
+void supervisor_fault(supervisor_subsystem_t sub, const char *reason, int64_t now);
+
+/**
+ * @brief Check whether a failed subsystem should be restarted now. Counts a restart attempt when it
+ * returns true; the caller then reports the outcome with supervisor_up() or supervisor_fault().
+ *
+ * @param sub subsystem
+ * @param now current time in microseconds
+ * @return true if the subsystem is down and its backoff has expired
+ */
+bool supervisor_restart_due(supervisor_subsystem_t sub, int64_t now);
+
+/**
+ * @brief Time left before the restart of a failed subsystem is due
+ *
+ * @param sub subsystem
+ * @param now current time in microseconds
+ * @return wait in milliseconds, 0 if the subsystem is up or its restart is due
+ */
+uint32_t supervisor_wait_ms(supervisor_subsystem_t sub, int64_t now);
+
+/**
+ * @brief Restart bookkeeping of a subsystem
+ */
+const supervisor_status_t *supervisor_status(supervisor_subsystem_t sub);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,417 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "sdkconfig.h"
+#include "telemetry.h"
+#include "pressure_trend.h"
+
+typedef struct {
+    const char *name;
+    int32_t scale;
+} telemetry_channel_info_t;
+
+static const telemetry_channel_info_t channel_info[SENSOR_CH_COUNT] = {
+    [SENSOR_CH_TEMPERATURE]       = { "temperature", 100 },
+    [SENSOR_CH_HUMIDITY]          = { "humidity", 10 },
+    [SENSOR_CH_PRESSURE]          = { "pressure", 10 },
+    [SENSOR_CH_GROUNDTEMPERATURE] = { "groundtemperature", 100 },
+    [SENSOR_CH_GROUNDMOISTURE]    = { "groundmoisture", 1 },
+    [SENSOR_CH_GROUNDVOLTAGE]     = { "groundvoltage", 1 },
+    [SENSOR_CH_RAINMM]            = { "rain", 100 },
+    [SENSOR_CH_UVLEVEL]           = { "uvlevel", 1 },
+    [SENSOR_CH_LIGHTLEVEL]        = { "lightlevel", 1 },
+    [SENSOR_CH_BUCKETRAINMM]      = { "bucketrain", 100 },
+    [SENSOR_CH_WINDSPEED]         = { "windspeed", 100 },
+};
+
+const char *telemetry_channel_name(sensor_channel_t ch)
+{
+    return (ch < SENSOR_CH_COUNT) ? channel_info[ch].name : "unknown";
+}
+
+int32_t telemetry_channel_scale(sensor_channel_t ch)
+{
+    return (ch < SENSOR_CH_COUNT) ? channel_info[ch].scale : 1;
+}
+
+static int put_varint(uint8_t *buf, size_t len, size_t *pos, uint64_t value)
+{
+    do
+    {
+        if (*pos >= len)
+        {
+            return -1;
+        }
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        buf[(*pos)++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return 0;
+}
+
+static int get_varint64(const uint8_t *buf, size_t len, size_t *pos, uint64_t *value)
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 70; shift += 7)
+    {
+        if (*pos >= len)
+        {
+            return -1;
+        }
+        uint8_t byte = buf[(*pos)++];
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            *value = result;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int get_varint(const uint8_t *buf, size_t len, size_t *pos, uint32_t *value)
+{
+    uint64_t result;
+    if (get_varint64(buf, len, pos, &result) || result > UINT32_MAX)
+    {
+        return -1;
+    }
+    *value = (uint32_t)result;
+    return 0;
+}
+
+/* Later time relative to an earlier one, clamped at 0 */
+static uint64_t time_delta(int64_t later, int64_t earlier)
+{
+    return (later > earlier) ? (uint64_t)(later - earlier) : 0;
+}
+
+static uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+static int32_t to_fixed(float value, int32_t scale)
+{
+    float scaled = roundf(value * scale);
+    if (isnan(scaled))
+    {
+        return 0;
+    }
+    if (scaled >= (float)INT32_MAX)
+    {
+        return INT32_MAX;
+    }
+    if (scaled <= (float)INT32_MIN)
+    {
+        return INT32_MIN;
+    }
+    return (int32_t)scaled;
+}
+
+static int32_t clamp_fixed(int64_t value)
+{
+    return value > INT32_MAX ? INT32_MAX : value < INT32_MIN ? INT32_MIN : (int32_t)value;
+}
+
+/* Channels with good samples. A mean that is not finite came from a driver returning NaN for a good
+ * read; it has no fixed point or JSON form, so the channel is sent as stale */
+static uint32_t valid_channels(const sensor_window_t *window)
+{
+    uint32_t valid = window->valid;
+
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (!isfinite(window->stats[ch].mean))
+        {
+            valid &= ~SENSOR_CH_BIT(ch);
+        }
+    }
+    return valid;
+}
+
+/* Channels in the legacy JSON payload, in their historical order and precision */
+static const struct {
+    sensor_channel_t ch;
+    int decimals;
+} json_channels[] = {
+    { SENSOR_CH_TEMPERATURE, 1 },
+    { SENSOR_CH_HUMIDITY, 1 },
+    { SENSOR_CH_RAINMM, 1 },
+    { SENSOR_CH_GROUNDTEMPERATURE, 1 },
+    { SENSOR_CH_GROUNDMOISTURE, 0 },
+    { SENSOR_CH_PRESSURE, 2 },
+    { SENSOR_CH_BUCKETRAINMM, 2 },
+    { SENSOR_CH_WINDSPEED, 1 },
+};
+
+static int json_append(char *buf, size_t len, int pos, const char *fmt, ...)
+{
+    va_list args;
+    int written;
+
+    if (pos < 0 || (size_t)pos >= len)
+    {
+        return -1;
+    }
+    va_start(args, fmt);
+    written = vsnprintf(buf + pos, len - pos, fmt, args);
+    va_end(args);
+    return (written < 0 || (size_t)(pos + written) >= len) ? -1 : pos + written;
+}
+
+static int json_append_value(char *buf, size_t len, int pos, const char *name, const char *suffix, int decimals,
+                             int32_t scale, double value)
+{
+    // printf would write nan or inf, which is not JSON
+    if (!isfinite(value))
+    {
+        return json_append(buf, len, pos, ", \"%s%s\": null", name, suffix);
+    }
+    // Held to the range of the binary encoding, which also bounds the payload at TELEMETRY_JSON_MAX
+    value = fmin(fmax(value, (double)INT32_MIN / scale), (double)INT32_MAX / scale);
+    return json_append(buf, len, pos, ", \"%s%s\": %0.*f", name, suffix, decimals, value);
+}
+
+int telemetry_encode_json(const sensor_window_t *window, const char *id, char *buf, size_t len)
+{
+    int pos = json_append(buf, len, 0, "{\"location\":\"%s\", \"type\": \"%s\", \"id\": \"%s\", \"samples\": %u",
+                          CONFIG_DEVICE_LOCATION_NAME, CONFIG_DEVICE_TYPE_NAME, id, window->samples);
+    uint32_t valid = valid_channels(window);
+    bool first = true;
+
+    pos = json_append(buf, len, pos, ", \"clock\": \"%s\", \"acquired\": %lld, \"acquired_first\": %lld, \"enqueued\": %lld, \"sent\": %lld",
+                      window->unix_time ? "unix" : "uptime", (long long)window->last_us, (long long)window->first_us,
+                      (long long)window->enqueued_us, (long long)window->sent_us);
+
+    for (size_t i = 0; i < sizeof(json_channels) / sizeof(json_channels[0]); i++)
+    {
+        sensor_channel_t ch = json_channels[i].ch;
+        const sensor_stat_t *stat = &window->stats[ch];
+        const char *name = channel_info[ch].name;
+        int32_t scale = channel_info[ch].scale;
+        int decimals = json_channels[i].decimals;
+
+        if (!(valid & SENSOR_CH_BIT(ch)))
+        {
+            pos = json_append(buf, len, pos, ", \"%s\": null", name);
+            continue;
+        }
+        // The plain field keeps its meaning for existing consumers: the value over the window
+        pos = json_append_value(buf, len, pos, name, "", decimals, scale, stat->mean);
+        pos = json_append_value(buf, len, pos, name, "_min", decimals, scale, stat->min);
+        pos = json_append_value(buf, len, pos, name, "_max", decimals, scale, stat->max);
+        pos = json_append_value(buf, len, pos, name, "_sd", decimals + 1, scale, sensor_stat_stddev(stat));
+    }
+    pos = json_append(buf, len, pos, ", \"valid\": %u, \"age\": {", valid);
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (!(valid & SENSOR_CH_BIT(ch)))
+        {
+            pos = json_append(buf, len, pos, "%s\"%s\": %u", first ? "" : ", ", channel_info[ch].name, window->age[ch]);
+            first = false;
+        }
+    }
+    pos = json_append(buf, len, pos, "}");
+    if (window->tendency == PRESSURE_TENDENCY_UNKNOWN)
+    {
+        pos = json_append(buf, len, pos, ", \"tendency\": null, \"pressure_change_3h\": null");
+    }
+    else
+    {
+        pos = json_append(buf, len, pos, ", \"tendency\": %d", window->tendency);
+        pos = json_append_value(buf, len, pos, "pressure_change_3h", "", 1, channel_info[SENSOR_CH_PRESSURE].scale,
+                                window->pressure_change);
+    }
+    if (window->forecast == 0)
+    {
+        pos = json_append(buf, len, pos, ", \"forecast\": null");
+    }
+    else
+    {
+        pos = json_append(buf, len, pos, ", \"forecast\": \"%c\"", window->forecast);
+    }
+    return json_append(buf, len, pos, "}");
+}
+
+int telemetry_encode_binary(const sensor_window_t *window, uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+    uint32_t valid = valid_channels(window);
+    uint32_t stale = 0;
+
+    if (len < 1)
+    {
+        return -1;
+    }
+    buf[pos++] = TELEMETRY_SCHEMA_VERSION;
+    if (put_varint(buf, len, &pos, window->seq) ||
+        put_varint(buf, len, &pos, window->samples) ||
+        put_varint(buf, len, &pos, valid))
+    {
+        return -1;
+    }
+    if (put_varint(buf, len, &pos, window->unix_time ? TELEMETRY_TIME_UNIX : 0) ||
+        put_varint(buf, len, &pos, (uint64_t)window->last_us) ||
+        put_varint(buf, len, &pos, time_delta(window->last_us, window->first_us)) ||
+        put_varint(buf, len, &pos, time_delta(window->enqueued_us, window->last_us)) ||
+        put_varint(buf, len, &pos, time_delta(window->sent_us, window->enqueued_us)))
+    {
+        return -1;
+    }
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        const sensor_stat_t *stat = &window->stats[ch];
+        int32_t scale = channel_info[ch].scale;
+        int32_t mean;
+
+        if (!(valid & SENSOR_CH_BIT(ch)))
+        {
+            stale++;
+            continue;
+        }
+        // min and max are sent relative to the mean, which keeps them to a byte or two. Readings
+        // clamped at opposite ends of the range are further apart than an int32 holds
+        mean = to_fixed(stat->mean, scale);
+        if (put_varint(buf, len, &pos, zigzag(mean)) ||
+            put_varint(buf, len, &pos, zigzag(clamp_fixed((int64_t)mean - to_fixed(stat->min, scale)))) ||
+            put_varint(buf, len, &pos, zigzag(clamp_fixed((int64_t)to_fixed(stat->max, scale) - mean))) ||
+            put_varint(buf, len, &pos, zigzag(to_fixed(sensor_stat_stddev(stat), scale))) ||
+            put_varint(buf, len, &pos, stat->count))
+        {
+            return -1;
+        }
+    }
+    if (put_varint(buf, len, &pos, stale))
+    {
+        return -1;
+    }
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (!(valid & SENSOR_CH_BIT(ch)) &&
+            (put_varint(buf, len, &pos, ch) || put_varint(buf, len, &pos, window->age[ch])))
+        {
+            return -1;
+        }
+    }
+    if (put_varint(buf, len, &pos, window->tendency + 1) ||
+        put_varint(buf, len, &pos, zigzag(to_fixed(window->pressure_change, channel_info[SENSOR_CH_PRESSURE].scale))) ||
+        put_varint(buf, len, &pos, window->forecast ? window->forecast - 'A' + 1 : 0))
+    {
+        return -1;
+    }
+    return pos;
+}
+
+int telemetry_decode_binary(const uint8_t *buf, size_t len, sensor_window_t *window)
+{
+    size_t pos = 0;
+    uint32_t stale = 0;
+    uint32_t flags = 0;
+    uint64_t last, span, queued, waited;
+    uint32_t tendency, change, forecast;
+
+    memset(window, 0, sizeof(sensor_window_t));
+    if (len < 1 || buf[pos++] != TELEMETRY_SCHEMA_VERSION)
+    {
+        return -1;
+    }
+    if (get_varint(buf, len, &pos, &window->seq) ||
+        get_varint(buf, len, &pos, &window->samples) ||
+        get_varint(buf, len, &pos, &window->valid))
+    {
+        return -1;
+    }
+    if (get_varint(buf, len, &pos, &flags) ||
+        get_varint64(buf, len, &pos, &last) ||
+        get_varint64(buf, len, &pos, &span) ||
+        get_varint64(buf, len, &pos, &queued) ||
+        get_varint64(buf, len, &pos, &waited))
+    {
+        return -1;
+    }
+    window->unix_time = (flags & TELEMETRY_TIME_UNIX) != 0;
+    window->last_us = (int64_t)last;
+    window->first_us = window->last_us - (int64_t)span;
+    window->enqueued_us = window->last_us + (int64_t)queued;
+    window->sent_us = window->enqueued_us + (int64_t)waited;
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        sensor_stat_t *stat = &window->stats[ch];
+        float scale = channel_info[ch].scale;
+        uint32_t mean, below, above, stddev;
+
+        if (!(window->valid & SENSOR_CH_BIT(ch)))
+        {
+            continue;
+        }
+        if (get_varint(buf, len, &pos, &mean) ||
+            get_varint(buf, len, &pos, &below) ||
+            get_varint(buf, len, &pos, &above) ||
+            get_varint(buf, len, &pos, &stddev) ||
+            get_varint(buf, len, &pos, &stat->count))
+        {
+            return -1;
+        }
+        stat->mean = unzigzag(mean) / scale;
+        stat->min = ((int64_t)unzigzag(mean) - unzigzag(below)) / scale;
+        stat->max = ((int64_t)unzigzag(mean) + unzigzag(above)) / scale;
+        if (stat->count > 1)
+        {
+            double sd = unzigzag(stddev) / scale;
+            stat->m2 = sd * sd * (stat->count - 1);
+        }
+    }
+    if (get_varint(buf, len, &pos, &stale))
+    {
+        return -1;
+    }
+    while (stale--)
+    {
+        uint32_t ch = 0;
+        uint32_t age = 0;
+        if (get_varint(buf, len, &pos, &ch) || get_varint(buf, len, &pos, &age))
+        {
+            return -1;
+        }
+        if (ch < SENSOR_CH_COUNT)
+        {
+            window->age[ch] = age;
+        }
+    }
+    if (get_varint(buf, len, &pos, &tendency) ||
+        get_varint(buf, len, &pos, &change) ||
+        get_varint(buf, len, &pos, &forecast))
+    {
+        return -1;
+    }
+    window->tendency = (tendency >= 1 && tendency <= 9) ? (int8_t)(tendency - 1) : PRESSURE_TENDENCY_UNKNOWN;
+    window->pressure_change = unzigzag(change) / (float)channel_info[SENSOR_CH_PRESSURE].scale;
+    window->forecast = (forecast >= 1 && forecast <= 26) ? (char)('A' + forecast - 1) : 0;
+    return pos;
+}
+
+int telemetry_encode_registration(const char *id, char *buf, size_t len)
+{
+    int written = snprintf(buf, len, "{\"location\":\"%s\", \"type\": \"%s\", \"id\": \"%s\", \"schema\": %d, \"channels\": [",
+                           CONFIG_DEVICE_LOCATION_NAME, CONFIG_DEVICE_TYPE_NAME, id, TELEMETRY_SCHEMA_VERSION);
+    for (int ch = 0; ch < SENSOR_CH_COUNT && written > 0 && (size_t)written < len; ch++)
+    {
+        written += snprintf(buf + written, len - written, "%s{\"name\": \"%s\", \"scale\": %d}",
+                            ch ? ", " : "", channel_info[ch].name, channel_info[ch].scale);
+    }
+    if (written > 0 && (size_t)written < len)
+    {
+        written += snprintf(buf + written, len - written, "]}");
+    }
+    return (written < 0 || (size_t)written >= len) ? -1 : written;
+}
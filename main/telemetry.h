@@ -0,0 +1,124 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+#include "sensors.h"
+#include "sampler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Version of the compact binary telemetry schema. Bump whenever the layout changes.
+ *
+ * Layout (all integers are LEB128 varints, signed values are zigzag encoded, readings are fixed
+ * point, scaled by telemetry_channel_scale()):
+ *   u8      schema version
+ *   varint  window sequence number
+ *   varint  number of acquisition cycles in the window
+ *   varint  valid channel mask, bit n set when statistics of channel n follow
+ *   varint  time flags, TELEMETRY_TIME_UNIX when the times are Unix time rather than uptime
+ *   varint  acquisition time of the last sample in the window, microseconds
+ *   varint  last - first acquisition time in the window, microseconds
+ *   varint  enqueued - last acquisition time, microseconds
+ *   varint  sent - enqueued time, microseconds
+ *   for each channel in the mask, in channel order:
+ *     svarint mean
+ *     svarint mean - min
+ *     svarint max - mean
+ *     svarint standard deviation
+ *     varint  number of good samples
+ *   varint  number of stale channels
+ *   varint  channel number and age in seconds of each stale channel
+ *   varint  WMO pressure tendency code + 1, 0 when not known
+ *   svarint pressure change over the last three hours, at the pressure channel's scale
+ *   varint  Zambretti forecast letter - 'A' + 1, 0 when not known
+ */
+#define TELEMETRY_SCHEMA_VERSION (6)
+
+/**
+ * @brief Time flag: the window times are Unix time in microseconds, otherwise microseconds since boot
+ */
+#define TELEMETRY_TIME_UNIX (1)
+
+/**
+ * @brief Longest device id the JSON payload is sized for, without the terminating 0
+ */
+#define TELEMETRY_ID_MAX (31)
+
+/**
+ * @brief Largest JSON window, including the terminating 0, for a device id of up to TELEMETRY_ID_MAX
+ * characters. Readings are held to the range of the binary encoding, so this covers any window;
+ * tools/hosttest checks it against windows at the extremes.
+ */
+#define TELEMETRY_JSON_MAX (1360 + sizeof(CONFIG_DEVICE_LOCATION_NAME) + sizeof(CONFIG_DEVICE_TYPE_NAME) + \
+                            TELEMETRY_ID_MAX)
+
+/**
+ * @brief Largest binary window: the schema byte, 32 bit varints of up to 5 bytes and 64 bit times of
+ * up to 10, and per channel the larger of its five statistics and its stale entry
+ */
+#define TELEMETRY_BINARY_MAX (1 + 4 * 5 + 4 * 10 + SENSOR_CH_COUNT * 5 * 5 + 5 + 3 * 5)
+
+/**
+ * @brief Name used for a channel in JSON payloads and in the registration message
+ */
+const char *telemetry_channel_name(sensor_channel_t ch);
+
+/**
+ * @brief Fixed point scale applied to a channel before it is varint encoded (e.g. 100 means 0.01 units)
+ */
+int32_t telemetry_channel_scale(sensor_channel_t ch);
+
+/**
+ * @brief Encode a window as the legacy JSON payload. Each reading carries the window mean under its
+ * usual name plus _min, _max and _sd fields. The acquired, acquired_first, enqueued and sent times
+ * are in microseconds, on the clock named by the clock field. Stale readings, and readings that are
+ * not finite, are sent as null, with the valid channel mask and the age of each stale channel
+ * alongside. The WMO pressure tendency, the three hour pressure change in Pa and the Zambretti
+ * forecast letter follow, null until three hours of pressure readings have been seen.
+ *
+ * @param window window to encode
+ * @param id device id string
+ * @param buf output buffer
+ * @param len size of the output buffer
+ * @return number of bytes written (excluding the terminating 0), or -1 if the buffer is too small
+ */
+int telemetry_encode_json(const sensor_window_t *window, const char *id, char *buf, size_t len);
+
+/**
+ * @brief Encode a window in the compact binary format
+ *
+ * @param window window to encode, its sequence number lets the backend detect gaps
+ * @param buf output buffer
+ * @param len size of the output buffer
+ * @return number of bytes written, or -1 if the buffer is too small
+ */
+int telemetry_encode_binary(const sensor_window_t *window, uint8_t *buf, size_t len);
+
+/**
+ * @brief Decode a compact binary message
+ *
+ * @param buf encoded message
+ * @param len length of the encoded message
+ * @param window decoded window
+ * @return number of bytes consumed, or -1 if the message is malformed or of another schema version
+ */
+int telemetry_decode_binary(const uint8_t *buf, size_t len, sensor_window_t *window);
+
+/**
+ * @brief Encode the one-time registration message carrying the static device identity and the schema
+ *
+ * @param id device id string
+ * @param buf output buffer
+ * @param len size of the output buffer
+ * @return number of bytes written (excluding the terminating 0), or -1 if the buffer is too small
+ */
+int telemetry_encode_registration(const char *id, char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,51 @@
+#include <sys/time.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_sntp.h"
+
+#include "timesync.h"
+
+static const char *TAG = "TIMESYNC";
+
+static volatile bool synced = false;
+
+static void timesync_notification(struct timeval *tv)
+{
+    if (!synced)
+    {
+        ESP_LOGI(TAG, "Clock synchronised with %s", CONFIG_SNTP_SERVER);
+    }
+    synced = true;
+}
+
+void timesync_start(void)
+{
+    sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    sntp_setservername(0, CONFIG_SNTP_SERVER);
+    sntp_set_time_sync_notification_cb(timesync_notification);
+    // Slew small corrections instead of stepping the clock
+    sntp_set_sync_mode(SNTP_SYNC_MODE_SMOOTH);
+    sntp_init();
+    ESP_LOGI(TAG, "SNTP started with %s", CONFIG_SNTP_SERVER);
+}
+
+bool timesync_synced(void)
+{
+    return synced;
+}
+
+bool timesync_to_unix_us(int64_t mono_us, int64_t *unix_us)
+{
+    struct timeval tv;
+    int64_t now_us;
+
+    if (!synced)
+    {
+        return false;
+    }
+    now_us = esp_timer_get_time();
+    gettimeofday(&tv, NULL);
+    *unix_us = mono_us + ((int64_t)tv.tv_sec * 1000000LL + tv.tv_usec - now_us);
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Start SNTP against CONFIG_SNTP_SERVER. The system clock is slewed rather than stepped on
+ * each update, so converted times stay monotonic. Call after wifi_setup().
+ */
+void timesync_start(void);
+
+/**
+ * @brief Whether the clock has been set by SNTP since boot
+ */
+bool timesync_synced(void);
+
+/**
+ * @brief Convert an esp_timer timestamp to Unix time. Readings are stamped on the monotonic esp_timer
+ * clock when they are taken and converted when they are sent, so samples taken before the first
+ * SNTP update still get the right time.
+ *
+ * @param mono_us esp_timer time in microseconds
+ * @param unix_us set to the Unix time in microseconds
+ * @return true if the clock is synchronised and unix_us was set
+ */
+bool timesync_to_unix_us(int64_t mono_us, int64_t *unix_us);
+
+#ifdef __cplusplus
+}
+#endif
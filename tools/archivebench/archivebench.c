@@ -0,0 +1,373 @@
+/**
+ * @file archivebench.c
+ * @brief Archive write and query benchmark
+ *
+ * Drives the firmware's archive.c against a directory standing in for the SD card; point --dir at a
+ * loop mounted FAT image to include the filesystem as well. It appends months of simulated windows
+ * with compaction every simulated hour, then reports compression, write amplification (bytes written
+ * to the card per byte of full blocks, checkpoints and rollups included) and the speed and I/O of a
+ * set of range queries. Query results are checked against the generated data.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "archive.h"
+
+#define HOUR_MS (3600000LL)
+#define DAY_MS (24 * HOUR_MS)
+#define QUERY_REPEAT (5)
+
+static const char *bench_dir = "/tmp/archivebench";
+static int days = 90;
+static int interval_ms = 10000;
+static int checkpoint_rows = 30;
+static int retention_days = 0;
+static int64_t start_ms = 1767225600000LL;      // 2026-01-01T00:00:00Z
+
+static uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Deterministic noise in [-1, 1) for row i and a stream
+ */
+static double noise(uint64_t i, int stream)
+{
+    return (double)(splitmix64(i * 16 + stream) >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+static float quantise(double v, double step)
+{
+    return (float)(round(v / step) * step);
+}
+
+static int64_t row_time(uint64_t i)
+{
+    // Windows close on the publish interval with a few milliseconds of scheduling jitter
+    return start_ms + (int64_t)i * interval_ms + (int64_t)(noise(i, 15) * 5);
+}
+
+/**
+ * @brief Simulated window of row i, at the resolution the sensors report
+ */
+static uint32_t row_values(uint64_t i, float *value)
+{
+    double t = (double)(row_time(i) - start_ms) / DAY_MS;
+    double day = sin(2 * M_PI * (t - 0.375));
+    double sun = day > 0 ? day : 0;
+    double season = sin(2 * M_PI * t / 365);
+    uint32_t valid = (1 << SENSOR_CH_COUNT) - 1;
+
+    value[SENSOR_CH_TEMPERATURE] = quantise(8 + 10 * season + 6 * day + 0.3 * noise(i, 0), 0.01);
+    value[SENSOR_CH_HUMIDITY] = quantise(70 - 20 * day + 2 * noise(i, 1), 0.1);
+    value[SENSOR_CH_PRESSURE] = quantise(1013 + 8 * sin(2 * M_PI * t / 4.3) + 0.05 * noise(i, 2), 0.01);
+    value[SENSOR_CH_GROUNDTEMPERATURE] = quantise(9 + 8 * season + 1.5 * sin(2 * M_PI * (t - 0.5)), 0.0625);
+    value[SENSOR_CH_GROUNDMOISTURE] = quantise(40 + 5 * sin(2 * M_PI * t / 9) + noise(i, 4), 1);
+    value[SENSOR_CH_GROUNDVOLTAGE] = quantise(1.6 + 0.2 * sin(2 * M_PI * t / 9) + 0.01 * noise(i, 5), 0.001);
+    value[SENSOR_CH_RAINMM] = quantise(floor(t) * 0.7 + (t - floor(t)) * 0.5, 0.01);
+    value[SENSOR_CH_UVLEVEL] = quantise(8 * sun * (0.8 + 0.2 * noise(i, 7)), 1);
+    value[SENSOR_CH_LIGHTLEVEL] = quantise(60000 * sun * (0.7 + 0.3 * noise(i, 8)), 1);
+    value[SENSOR_CH_BUCKETRAINMM] = quantise(floor(t * 3) * 0.279, 0.279);
+    value[SENSOR_CH_WINDSPEED] = quantise(fabs(3 + 2 * sin(2 * M_PI * t * 2) + 1.5 * noise(i, 10)), 0.1);
+
+    // The UV sensor drops out now and then
+    if (noise(i / 30, 14) > 0.9)
+    {
+        valid &= ~SENSOR_CH_BIT(SENSOR_CH_UVLEVEL);
+    }
+    return valid;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t dir_bytes(const char *path, int *files)
+{
+    char entry_path[1024];
+    struct dirent *entry;
+    struct stat st;
+    uint64_t bytes = 0;
+    DIR *dir = opendir(path);
+
+    if (dir == NULL)
+    {
+        return 0;
+    }
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+        snprintf(entry_path, sizeof(entry_path), "%s/%s", path, entry->d_name);
+        if (stat(entry_path, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            bytes += st.st_size;
+            (*files)++;
+        }
+    }
+    closedir(dir);
+    return bytes;
+}
+
+static void clear_dir(const char *path)
+{
+    char entry_path[1024];
+    struct dirent *entry;
+    DIR *dir = opendir(path);
+
+    if (dir == NULL)
+    {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+        {
+            snprintf(entry_path, sizeof(entry_path), "%s/%s", path, entry->d_name);
+            remove(entry_path);
+        }
+    }
+    closedir(dir);
+}
+
+typedef struct {
+    uint32_t channels;
+    uint64_t points;
+    uint64_t mismatches;
+} check_t;
+
+/**
+ * @brief Compare raw rows with the generator. Row times are unique, so the row index is recovered
+ * from the time.
+ */
+static bool check_raw(const archive_point_t *point, void *arg)
+{
+    check_t *check = arg;
+    float value[SENSOR_CH_COUNT];
+    uint64_t i = (uint64_t)((point->time_ms - start_ms + interval_ms / 2) / interval_ms);
+    uint32_t valid = row_values(i, value);
+
+    check->points++;
+    if (row_time(i) != point->time_ms || point->valid != (valid & check->channels))
+    {
+        check->mismatches++;
+        return true;
+    }
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if ((point->valid & SENSOR_CH_BIT(ch)) && point->value[ch] != value[ch])
+        {
+            check->mismatches++;
+            break;
+        }
+    }
+    return true;
+}
+
+static bool check_hourly(const archive_point_t *point, void *arg)
+{
+    check_t *check = arg;
+
+    check->points++;
+    if (point->time_ms % HOUR_MS != 0)
+    {
+        check->mismatches++;
+    }
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if ((point->valid & SENSOR_CH_BIT(ch))
+            && !(point->min[ch] <= point->value[ch] && point->value[ch] <= point->max[ch]))
+        {
+            check->mismatches++;
+            break;
+        }
+    }
+    return true;
+}
+
+typedef struct {
+    const char *name;
+    archive_level_t level;
+    int64_t from;                       // relative to the end of the data
+    int64_t to;
+    uint32_t channels;
+    bool filter;
+} query_case_t;
+
+static void run_query(const query_case_t *qc, int64_t end_ms)
+{
+    archive_filter_t filter = { SENSOR_CH_TEMPERATURE, 20.0f, 100.0f };
+    archive_query_stats_t stats = { 0 };
+    check_t check = { 0 };
+    double elapsed = 0;
+
+    for (int r = 0; r < QUERY_REPEAT; r++)
+    {
+        double t0;
+
+        memset(&check, 0, sizeof(check));
+        check.channels = qc->channels;
+        t0 = now_sec();
+        archive_query(qc->level, end_ms + qc->from, end_ms + qc->to, qc->channels, qc->filter ? &filter : NULL,
+                      qc->level == ARCHIVE_LEVEL_RAW ? check_raw : check_hourly, &check, &stats);
+        elapsed += now_sec() - t0;
+    }
+    printf("  %-28s %8llu rows %9.3f ms %5u files %6u blocks read %6u skipped %9.1f KiB read%s\n",
+           qc->name, (unsigned long long)check.points, elapsed * 1000 / QUERY_REPEAT, stats.files,
+           stats.blocks_read, stats.blocks_skipped, stats.bytes_read / 1024.0,
+           check.mismatches ? "  MISMATCH" : "");
+}
+
+static void usage(const char *argv0)
+{
+    printf("usage: %s [options]\n"
+           "  --dir PATH          archive directory, wiped first (default %s)\n"
+           "  --days N            days of data to write (default %d)\n"
+           "  --interval MS       window interval (default %d)\n"
+           "  --checkpoint ROWS   checkpoint the open block every ROWS rows, 0 for full blocks only (default %d)\n"
+           "  --retention DAYS    raw days kept after compaction, 0 for all (default %d)\n",
+           argv0, bench_dir, days, interval_ms, checkpoint_rows, retention_days);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "dir", required_argument, NULL, 'd' },
+        { "days", required_argument, NULL, 'n' },
+        { "interval", required_argument, NULL, 'i' },
+        { "checkpoint", required_argument, NULL, 'c' },
+        { "retention", required_argument, NULL, 'r' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    char path[512];
+    float value[SENSOR_CH_COUNT];
+    archive_write_stats_t ws;
+    uint64_t rows, stored = 0;
+    int64_t end_ms, next_compact;
+    double t0, write_sec, compact_sec = 0;
+    int files = 0, opt;
+
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'd': bench_dir = optarg; break;
+        case 'n': days = atoi(optarg); break;
+        case 'i': interval_ms = atoi(optarg); break;
+        case 'c': checkpoint_rows = atoi(optarg); break;
+        case 'r': retention_days = atoi(optarg); break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (days <= 0 || interval_ms <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", bench_dir, i ? "hourly" : "raw");
+        clear_dir(path);
+    }
+    if (archive_open(bench_dir, checkpoint_rows) != 0)
+    {
+        fprintf(stderr, "Could not open the archive in %s\n", bench_dir);
+        return 1;
+    }
+
+    rows = (uint64_t)days * DAY_MS / interval_ms;
+    printf("Writing %llu rows (%d days every %d ms), checkpoint every %d rows\n",
+           (unsigned long long)rows, days, interval_ms, checkpoint_rows);
+    next_compact = start_ms + HOUR_MS;
+    t0 = now_sec();
+    for (uint64_t i = 0; i < rows; i++)
+    {
+        uint32_t valid = row_values(i, value);
+        int64_t t = row_time(i);
+
+        if (archive_append(t, valid, value) != 0)
+        {
+            fprintf(stderr, "Append of row %llu failed\n", (unsigned long long)i);
+            return 1;
+        }
+        if (t >= next_compact)
+        {
+            double c0 = now_sec();
+
+            archive_compact(t, retention_days);
+            compact_sec += now_sec() - c0;
+            next_compact += HOUR_MS;
+        }
+    }
+    write_sec = now_sec() - t0;
+    end_ms = row_time(rows - 1);
+
+    // Reopen, so the queries also cover resuming the partly written blocks
+    archive_get_write_stats(&ws);
+    archive_close();
+    if (archive_open(bench_dir, checkpoint_rows) != 0)
+    {
+        fprintf(stderr, "Could not reopen the archive\n");
+        return 1;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", bench_dir, i ? "hourly" : "raw");
+        stored += dir_bytes(path, &files);
+    }
+
+    printf("\nWrites\n");
+    printf("  rows/s                 %.0f (compaction %.1f%% of the time)\n", rows / write_sec, 100 * compact_sec / write_sec);
+    printf("  logical bytes          %llu (%.1f bytes/row)\n", (unsigned long long)ws.logical_bytes,
+           (double)ws.logical_bytes / ws.rows);
+    printf("  stored bytes           %llu in %d files (%.1f bytes/row)\n", (unsigned long long)stored, files,
+           (double)stored / ws.rows);
+    printf("  compression            %.2fx\n", (double)ws.logical_bytes / stored);
+    printf("  device bytes written   %llu\n", (unsigned long long)ws.device_bytes);
+    // Against the blocks written once each, so deleting old raw files does not skew it
+    printf("  write amplification    %.2fx\n", (double)ws.device_bytes / ((uint64_t)ws.blocks_sealed * ARCHIVE_BLOCK_SIZE));
+    printf("  blocks sealed          %u, checkpoints %u, hourly rows %u\n", ws.blocks_sealed, ws.checkpoints, ws.rollups);
+
+    uint32_t all = (1 << SENSOR_CH_COUNT) - 1;
+    uint32_t temp = SENSOR_CH_BIT(SENSOR_CH_TEMPERATURE);
+    int64_t raw_from = retention_days ? -(int64_t)(retention_days - 1) * DAY_MS : -(int64_t)days * DAY_MS;
+    const query_case_t cases[] = {
+        { "raw last hour, all", ARCHIVE_LEVEL_RAW, -HOUR_MS, 0, all, false },
+        { "raw last day, all", ARCHIVE_LEVEL_RAW, -DAY_MS, 0, all, false },
+        { "raw last day, temperature", ARCHIVE_LEVEL_RAW, -DAY_MS, 0, temp, false },
+        { "raw all kept, temperature", ARCHIVE_LEVEL_RAW, raw_from, 0, temp, false },
+        { "raw all kept, temp >= 20", ARCHIVE_LEVEL_RAW, raw_from, 0, temp, true },
+        { "hourly last month, all", ARCHIVE_LEVEL_HOURLY, -30 * DAY_MS, 0, all, false },
+        { "hourly all, temperature", ARCHIVE_LEVEL_HOURLY, -(int64_t)days * DAY_MS, 0, temp, false },
+        { "hourly all, temp >= 20", ARCHIVE_LEVEL_HOURLY, -(int64_t)days * DAY_MS, 0, temp, true },
+    };
+
+    printf("\nQueries (mean of %d runs)\n", QUERY_REPEAT);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        run_query(&cases[i], end_ms);
+    }
+    archive_close();
+    return 0;
+}
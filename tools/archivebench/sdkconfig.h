@@ -0,0 +1,6 @@
+/*
+ * Host stand-in for the ESP-IDF generated sdkconfig.h, enabling the archive.
+ */
+#pragma once
+
+#define CONFIG_ARCHIVE_ENABLE 1
@@ -0,0 +1,754 @@
+/**
+ * @file backfillbench.c
+ * @brief Historical data query throughput benchmark
+ *
+ * Writes days of simulated windows into an archive with the firmware's archive.c, then plays both
+ * ends of a gap backfill through an MQTT broker (e.g. a local mosquitto). The station end subscribes
+ * to its request topic and answers with the firmware's backfill.c, reading each chunk from the
+ * archive like the station does; the backend end sends a request, acks every chunk and checks that
+ * the rows it gets are in order and match a direct query of the archive.
+ *
+ * For each range it reports the time to the first chunk and to the last, rows, chunks and bytes per
+ * second, and the time spent in archive reads: their share of the total, and the longest single
+ * read, which is how long a station holds off its archiver. --drop loses chunks at the backend, which
+ * then asks again from the last row it has, as a real backend does.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "sdkconfig.h"
+#include "archive.h"
+#include "backfill.h"
+#include "telemetry.h"
+
+#define HOUR_MS (3600000LL)
+#define DAY_MS (24 * HOUR_MS)
+#define CLIENT_IN_SIZE (65536)
+// Largest chunk the station can send, the top of the BACKFILL_CHUNK_SIZE range
+#define CHUNK_MAX (1280)
+#define STATION_ID "synders_bench"
+// The backend asks again when nothing arrives for this long
+#define BACKEND_IDLE_US (1000000)
+#define QUERY_TIMEOUT_US (120 * 1000000LL)
+
+#define MQTT_CONNECT (0x10)
+#define MQTT_CONNACK (0x20)
+#define MQTT_PUBLISH (0x30)
+#define MQTT_SUBSCRIBE (0x82)
+#define MQTT_SUBACK (0x90)
+
+static struct {
+    const char *host;
+    const char *port;
+    const char *dir;
+    int days;
+    int interval_ms;
+    uint32_t window;
+    uint32_t chunk;
+    uint32_t drop_pct;
+} opt = {
+    .host = "127.0.0.1",
+    .port = "1883",
+    .dir = "/tmp/backfillbench",
+    .days = 30,
+    .interval_ms = 10000,
+    .window = CONFIG_BACKFILL_WINDOW,
+    .chunk = CONFIG_BACKFILL_CHUNK_SIZE,
+    .drop_pct = 0,
+};
+
+static int64_t start_ms = 1767225600000LL;      // 2026-01-01T00:00:00Z
+static char request_topic[128];
+static char response_topic[128];
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Simulated archive
+ */
+
+static uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static double noise(uint64_t i, int stream)
+{
+    return (double)(splitmix64(i * 16 + stream) >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+static float quantise(double v, double step)
+{
+    return (float)(round(v / step) * step);
+}
+
+static int64_t row_time(uint64_t i)
+{
+    return start_ms + (int64_t)i * opt.interval_ms + (int64_t)(noise(i, 15) * 5);
+}
+
+static uint32_t row_values(uint64_t i, float *value)
+{
+    double t = (double)(row_time(i) - start_ms) / DAY_MS;
+    double day = sin(2 * M_PI * (t - 0.375));
+    double sun = day > 0 ? day : 0;
+    uint32_t valid = (1 << SENSOR_CH_COUNT) - 1;
+
+    memset(value, 0, SENSOR_CH_COUNT * sizeof(float));
+    value[SENSOR_CH_TEMPERATURE] = quantise(8 + 6 * day + 0.3 * noise(i, 0), 0.01);
+    value[SENSOR_CH_HUMIDITY] = quantise(70 - 20 * day + 2 * noise(i, 1), 0.1);
+    value[SENSOR_CH_PRESSURE] = quantise(1013 + 8 * sin(2 * M_PI * t / 4.3) + 0.05 * noise(i, 2), 0.01);
+    value[SENSOR_CH_GROUNDTEMPERATURE] = quantise(9 + 1.5 * sin(2 * M_PI * (t - 0.5)), 0.0625);
+    value[SENSOR_CH_GROUNDMOISTURE] = quantise(40 + 5 * sin(2 * M_PI * t / 9) + noise(i, 4), 1);
+    value[SENSOR_CH_GROUNDVOLTAGE] = quantise(1.6 + 0.2 * sin(2 * M_PI * t / 9) + 0.01 * noise(i, 5), 0.001);
+    value[SENSOR_CH_RAINMM] = quantise(floor(t) * 0.7 + (t - floor(t)) * 0.5, 0.01);
+    value[SENSOR_CH_UVLEVEL] = quantise(8 * sun, 1);
+    value[SENSOR_CH_LIGHTLEVEL] = quantise(60000 * sun * (0.7 + 0.3 * noise(i, 8)), 1);
+    value[SENSOR_CH_BUCKETRAINMM] = quantise(floor(t * 3) * 0.279, 0.279);
+    value[SENSOR_CH_WINDSPEED] = quantise(fabs(3 + 2 * sin(2 * M_PI * t * 2) + 1.5 * noise(i, 10)), 0.1);
+    if (noise(i / 30, 14) > 0.9)
+    {
+        valid &= ~SENSOR_CH_BIT(SENSOR_CH_UVLEVEL);
+    }
+    return valid;
+}
+
+static void clear_dir(const char *path)
+{
+    char entry_path[1024];
+    struct dirent *entry;
+    DIR *dir = opendir(path);
+
+    if (dir == NULL)
+    {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+        {
+            snprintf(entry_path, sizeof(entry_path), "%s/%s", path, entry->d_name);
+            remove(entry_path);
+        }
+    }
+    closedir(dir);
+}
+
+static int64_t archive_build(void)
+{
+    char path[512];
+    float value[SENSOR_CH_COUNT];
+    uint64_t rows = (uint64_t)opt.days * DAY_MS / opt.interval_ms;
+    int64_t next_compact = start_ms + HOUR_MS;
+
+    for (int i = 0; i < 2; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", opt.dir, i ? "hourly" : "raw");
+        clear_dir(path);
+    }
+    if (archive_open(opt.dir, 30) != 0)
+    {
+        fprintf(stderr, "Could not open the archive in %s\n", opt.dir);
+        exit(1);
+    }
+    printf("Writing %llu rows (%d days every %d ms) to %s\n", (unsigned long long)rows, opt.days, opt.interval_ms, opt.dir);
+    for (uint64_t i = 0; i < rows; i++)
+    {
+        uint32_t valid = row_values(i, value);
+        int64_t t = row_time(i);
+
+        if (archive_append(t, valid, value) != 0)
+        {
+            fprintf(stderr, "Append of row %llu failed\n", (unsigned long long)i);
+            exit(1);
+        }
+        if (t >= next_compact)
+        {
+            archive_compact(t, 0);
+            next_compact += HOUR_MS;
+        }
+    }
+    return row_time(rows - 1);
+}
+
+/*
+ * MQTT framing
+ */
+
+typedef struct {
+    const char *name;
+    int fd;
+    size_t in_len;
+    uint8_t in[CLIENT_IN_SIZE];
+} client_t;
+
+typedef void (*message_cb_t)(const char *topic, size_t topic_len, const uint8_t *payload, size_t len);
+
+static size_t put_remaining_length(uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+    do
+    {
+        uint8_t byte = len % 128;
+        len /= 128;
+        buf[pos++] = byte | (len ? 0x80 : 0);
+    } while (len);
+    return pos;
+}
+
+static size_t put_string(uint8_t *buf, const char *str, size_t len)
+{
+    buf[0] = len >> 8;
+    buf[1] = len & 0xff;
+    memcpy(buf + 2, str, len);
+    return len + 2;
+}
+
+static void client_send(client_t *c, const uint8_t *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(c->fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            fprintf(stderr, "%s: send failed: %s\n", c->name, strerror(errno));
+            exit(1);
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static void client_publish(client_t *c, const char *topic, const void *payload, size_t payload_len)
+{
+    static uint8_t buf[CHUNK_MAX + 256];
+    size_t topic_len = strlen(topic);
+    size_t pos = 0;
+
+    buf[pos++] = MQTT_PUBLISH;
+    pos += put_remaining_length(buf + pos, topic_len + 2 + payload_len);
+    pos += put_string(buf + pos, topic, topic_len);
+    memcpy(buf + pos, payload, payload_len);
+    client_send(c, buf, pos + payload_len);
+}
+
+/**
+ * @brief Connect with a clean session and no keepalive, and subscribe to one topic at QoS0
+ */
+static void client_start(client_t *c, struct addrinfo *broker, const char *client_id, const char *topic)
+{
+    uint8_t buf[256];
+    uint8_t body[256];
+    size_t len = 0;
+    size_t pos = 0;
+    int one = 1;
+
+    c->fd = socket(broker->ai_family, SOCK_STREAM, 0);
+    if (c->fd < 0 || connect(c->fd, broker->ai_addr, broker->ai_addrlen) < 0)
+    {
+        fprintf(stderr, "Cannot connect to %s:%s: %s\n", opt.host, opt.port, strerror(errno));
+        exit(1);
+    }
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    len += put_string(body + len, "MQTT", 4);
+    body[len++] = 4;            // MQTT 3.1.1
+    body[len++] = 0x02;         // Clean session
+    body[len++] = 0;            // No keepalive
+    body[len++] = 0;
+    len += put_string(body + len, client_id, strlen(client_id));
+    buf[pos++] = MQTT_CONNECT;
+    pos += put_remaining_length(buf + pos, len);
+    memcpy(buf + pos, body, len);
+    client_send(c, buf, pos + len);
+    if (recv(c->fd, buf, 4, MSG_WAITALL) != 4 || (buf[0] & 0xf0) != MQTT_CONNACK || buf[3] != 0)
+    {
+        fprintf(stderr, "%s: connection refused by the broker\n", c->name);
+        exit(1);
+    }
+
+    len = 0;
+    body[len++] = 0;
+    body[len++] = 1;            // Packet id
+    len += put_string(body + len, topic, strlen(topic));
+    body[len++] = 0;            // QoS 0
+    pos = 0;
+    buf[pos++] = MQTT_SUBSCRIBE;
+    pos += put_remaining_length(buf + pos, len);
+    memcpy(buf + pos, body, len);
+    client_send(c, buf, pos + len);
+    if (recv(c->fd, buf, 5, MSG_WAITALL) != 5 || (buf[0] & 0xf0) != MQTT_SUBACK || buf[4] == 0x80)
+    {
+        fprintf(stderr, "%s: subscription to %s refused\n", c->name, topic);
+        exit(1);
+    }
+}
+
+/**
+ * @brief Read what has arrived and hand every complete PUBLISH to cb
+ */
+static void client_read(client_t *c, message_cb_t cb)
+{
+    ssize_t n = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, MSG_DONTWAIT);
+    size_t pos = 0;
+
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        fprintf(stderr, "%s: connection closed by the broker\n", c->name);
+        exit(1);
+    }
+    if (n < 0)
+    {
+        return;
+    }
+    c->in_len += n;
+
+    while (pos + 2 <= c->in_len)
+    {
+        size_t remaining = 0;
+        size_t header = 1;
+        int shift = 0;
+        bool complete = false;
+
+        while (pos + header < c->in_len && header <= 4)
+        {
+            uint8_t byte = c->in[pos + header++];
+            remaining |= (size_t)(byte & 0x7f) << shift;
+            shift += 7;
+            if (!(byte & 0x80))
+            {
+                complete = true;
+                break;
+            }
+        }
+        if (!complete || pos + header + remaining > c->in_len)
+        {
+            break;
+        }
+        if ((c->in[pos] & 0xf0) == MQTT_PUBLISH && remaining >= 2)
+        {
+            const uint8_t *body = c->in + pos + header;
+            size_t topic_len = (body[0] << 8) | body[1];
+            size_t skip = 2 + topic_len + (((c->in[pos] >> 1) & 3) ? 2 : 0);
+            if (skip <= remaining)
+            {
+                cb((const char *)body + 2, topic_len, body + skip, remaining - skip);
+            }
+        }
+        pos += header + remaining;
+    }
+    memmove(c->in, c->in + pos, c->in_len - pos);
+    c->in_len -= pos;
+    if (c->in_len == sizeof(c->in))
+    {
+        fprintf(stderr, "%s: message larger than %zu bytes\n", c->name, sizeof(c->in));
+        exit(1);
+    }
+}
+
+/*
+ * Station end: the firmware's backfill.c on the archive
+ */
+
+static client_t station = { .name = "station", .fd = -1 };
+static backfill_session_t session;
+static char chunk[CHUNK_MAX];
+
+static struct {
+    int64_t read_us;                    // Time spent in archive reads
+    int64_t longest_read_us;            // Longest single read, the archiver is held off this long
+    uint32_t malformed;
+} station_stats;
+
+static int timed_query(archive_level_t level, int64_t from_ms, int64_t to_ms, uint32_t channels,
+                       const archive_filter_t *filter, archive_query_cb_t cb, void *arg, archive_query_stats_t *stats)
+{
+    int64_t t0 = now_us();
+    int ret = archive_query(level, from_ms, to_ms, channels, filter, cb, arg, stats);
+    int64_t elapsed = now_us() - t0;
+
+    station_stats.read_us += elapsed;
+    if (elapsed > station_stats.longest_read_us)
+    {
+        station_stats.longest_read_us = elapsed;
+    }
+    return ret;
+}
+
+static void station_message(const char *topic, size_t topic_len, const uint8_t *payload, size_t len)
+{
+    backfill_msg_t msg;
+
+    (void)topic;
+    (void)topic_len;
+    if (backfill_parse((const char *)payload, len, &msg) != 0)
+    {
+        station_stats.malformed++;
+        return;
+    }
+    backfill_handle(&session, &msg, CONFIG_BACKFILL_WINDOW);
+}
+
+static void station_service(void)
+{
+    while (backfill_ready(&session, now_us()))
+    {
+        int len = backfill_next_chunk(&session, timed_query, chunk, opt.chunk);
+        if (len < 0)
+        {
+            fprintf(stderr, "Station: could not build a chunk\n");
+            return;
+        }
+        client_publish(&station, response_topic, chunk, len);
+    }
+}
+
+/*
+ * Backend end: requests, acks and checks
+ */
+
+static client_t backend = { .name = "backend", .fd = -1 };
+
+static struct {
+    uint32_t id;                        // Request the chunks have to belong to
+    archive_level_t level;
+    uint32_t channels;
+    int64_t to_ms;
+    int64_t last_ms;                    // Time of the last row received
+    uint32_t expect_seq;
+    bool done;
+    int64_t requested_us;
+    int64_t first_us;
+    int64_t done_us;
+    int64_t activity_us;
+    uint64_t rows;
+    uint64_t chunks;
+    uint64_t bytes;
+    uint32_t dropped;
+    uint32_t requests;
+    uint32_t errors;
+} query;
+
+static void backend_request(int64_t from_ms)
+{
+    char buf[512];
+    int pos;
+    bool first = true;
+
+    query.id++;
+    query.expect_seq = 0;
+    query.requests++;
+    pos = snprintf(buf, sizeof(buf), "{\"id\": %u, \"from\": %lld, \"to\": %lld, \"level\": \"%s\", \"window\": %u, \"fields\": [",
+                   query.id, (long long)from_ms, (long long)query.to_ms,
+                   query.level == ARCHIVE_LEVEL_HOURLY ? "hourly" : "raw", opt.window);
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        if (query.channels & SENSOR_CH_BIT(ch))
+        {
+            pos += snprintf(buf + pos, sizeof(buf) - pos, "%s\"%s\"", first ? "" : ", ", telemetry_channel_name(ch));
+            first = false;
+        }
+    }
+    pos += snprintf(buf + pos, sizeof(buf) - pos, "]}");
+    query.activity_us = now_us();
+    client_publish(&backend, request_topic, buf, pos);
+}
+
+static bool json_uint(const char *json, const char *key, uint32_t *value)
+{
+    const char *p = strstr(json, key);
+
+    if (p == NULL)
+    {
+        return false;
+    }
+    *value = strtoul(p + strlen(key), NULL, 10);
+    return true;
+}
+
+/**
+ * @brief Count the rows of a chunk and check they follow on from the last one received
+ */
+static bool backend_rows(const char *json)
+{
+    const char *p = strstr(json, "\"rows\": [");
+    int depth = 1;
+
+    if (p == NULL)
+    {
+        return false;
+    }
+    for (p += strlen("\"rows\": ["); *p && depth > 0; p++)
+    {
+        if (*p == '[' && ++depth == 2)
+        {
+            int64_t t = strtoll(p + 1, NULL, 10);
+            if (t <= query.last_ms || t > query.to_ms)
+            {
+                return false;
+            }
+            query.last_ms = t;
+            query.rows++;
+        }
+        else if (*p == ']')
+        {
+            depth--;
+        }
+    }
+    return depth == 0;
+}
+
+static void backend_message(const char *topic, size_t topic_len, const uint8_t *payload, size_t len)
+{
+    static char json[CHUNK_MAX + 1];
+    char ack[64];
+    uint32_t id, seq;
+
+    (void)topic;
+    (void)topic_len;
+    if (len > CHUNK_MAX)
+    {
+        query.errors++;
+        return;
+    }
+    memcpy(json, payload, len);
+    json[len] = 0;
+    if (!json_uint(json, "\"id\": ", &id) || !json_uint(json, "\"seq\": ", &seq))
+    {
+        query.errors++;
+        return;
+    }
+    if (id != query.id || query.done)
+    {
+        // Left over from a request that was replaced
+        return;
+    }
+    query.activity_us = now_us();
+    if (opt.drop_pct && (uint32_t)(rand() % 100) < opt.drop_pct)
+    {
+        query.dropped++;
+        return;
+    }
+    if (seq != query.expect_seq)
+    {
+        // A chunk went missing: ask again from the last row there is
+        backend_request(query.last_ms + 1);
+        return;
+    }
+    if (query.first_us == 0)
+    {
+        query.first_us = now_us();
+    }
+    if (!backend_rows(json))
+    {
+        query.errors++;
+    }
+    query.chunks++;
+    query.bytes += len;
+    query.expect_seq++;
+    snprintf(ack, sizeof(ack), "{\"id\": %u, \"ack\": %u}", id, seq);
+    client_publish(&backend, request_topic, ack, strlen(ack));
+    if (strstr(json, "\"more\": false") != NULL)
+    {
+        query.done = true;
+        query.done_us = now_us();
+    }
+}
+
+/*
+ * Cases
+ */
+
+typedef struct {
+    const char *name;
+    archive_level_t level;
+    int64_t from;                       // relative to the end of the data
+    uint32_t channels;
+} query_case_t;
+
+static bool count_row(const archive_point_t *point, void *arg)
+{
+    (void)point;
+    (*(uint64_t *)arg)++;
+    return true;
+}
+
+static void run_case(const query_case_t *qc, int64_t end_ms)
+{
+    struct pollfd fds[2] = { { .fd = station.fd, .events = POLLIN }, { .fd = backend.fd, .events = POLLIN } };
+    int64_t from_ms = end_ms + qc->from;
+    uint64_t expected = 0;
+    int64_t t0 = now_us();
+    double direct_ms;
+    double total_s;
+
+    archive_query(qc->level, from_ms, end_ms, qc->channels, NULL, count_row, &expected, NULL);
+    direct_ms = (now_us() - t0) / 1000.0;
+
+    memset(&station_stats, 0, sizeof(station_stats));
+    session.stats = (backfill_stats_t){ 0 };
+    uint32_t id = query.id;
+    memset(&query, 0, sizeof(query));
+    query.id = id;
+    query.level = qc->level;
+    query.channels = qc->channels;
+    query.to_ms = end_ms;
+    query.last_ms = from_ms - 1;
+    query.requested_us = now_us();
+    backend_request(from_ms);
+
+    while (!query.done)
+    {
+        int64_t now = now_us();
+
+        if (now - query.requested_us > QUERY_TIMEOUT_US)
+        {
+            fprintf(stderr, "%s: no answer\n", qc->name);
+            break;
+        }
+        if (now - query.activity_us > BACKEND_IDLE_US)
+        {
+            backend_request(query.last_ms + 1);
+        }
+        if (poll(fds, 2, 10) < 0)
+        {
+            break;
+        }
+        if (fds[0].revents)
+        {
+            client_read(&station, station_message);
+        }
+        station_service();
+        if (fds[1].revents)
+        {
+            client_read(&backend, backend_message);
+        }
+    }
+
+    if (!query.done)
+    {
+        query.done_us = now_us();
+    }
+    total_s = (query.done_us - query.requested_us) / 1e6;
+    printf("  %-26s %7llu rows %8.1f ms first %9.1f ms total %8.0f rows/s %6llu chunks %7.1f kB/s  "
+           "reads %4.1f%% longest %6.2f ms  direct %7.1f ms  %u requests%s\n",
+           qc->name, (unsigned long long)query.rows, (query.first_us - query.requested_us) / 1000.0,
+           total_s * 1000, query.rows / total_s, (unsigned long long)query.chunks, query.bytes / total_s / 1000,
+           100.0 * station_stats.read_us / (query.done_us - query.requested_us),
+           station_stats.longest_read_us / 1000.0, direct_ms, query.requests,
+           (query.rows != expected || query.errors || !query.done) ? "  MISMATCH" : "");
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [options]\n"
+           "  --host HOST            broker address (%s)\n"
+           "  --port PORT            broker port (%s)\n"
+           "  --dir PATH             archive directory, wiped first (%s)\n"
+           "  --days N               days of data in the archive (%d)\n"
+           "  --interval MS          window interval (%d)\n"
+           "  --window N             chunks in flight (%u)\n"
+           "  --chunk BYTES          chunk size, %d to %d (%u)\n"
+           "  --drop PCT             chunks lost on the way to the backend (%u)\n",
+           argv0, opt.host, opt.port, opt.dir, opt.days, opt.interval_ms, opt.window, BACKFILL_CHUNK_MIN, CHUNK_MAX,
+           opt.chunk, opt.drop_pct);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "host", required_argument, NULL, 'H' },
+        { "port", required_argument, NULL, 'p' },
+        { "dir", required_argument, NULL, 'd' },
+        { "days", required_argument, NULL, 'n' },
+        { "interval", required_argument, NULL, 'i' },
+        { "window", required_argument, NULL, 'w' },
+        { "chunk", required_argument, NULL, 'c' },
+        { "drop", required_argument, NULL, 'l' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *broker;
+    int64_t end_ms;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "h", options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'H': opt.host = optarg; break;
+        case 'p': opt.port = optarg; break;
+        case 'd': opt.dir = optarg; break;
+        case 'n': opt.days = atoi(optarg); break;
+        case 'i': opt.interval_ms = atoi(optarg); break;
+        case 'w': opt.window = atoi(optarg); break;
+        case 'c': opt.chunk = atoi(optarg); break;
+        case 'l': opt.drop_pct = atoi(optarg); break;
+        default: usage(argv[0]); return c == 'h' ? 0 : 1;
+        }
+    }
+    if (opt.days < 7 || opt.interval_ms <= 0 || opt.window < 1 || opt.window > BACKFILL_WINDOW_MAX ||
+        opt.chunk < BACKFILL_CHUNK_MIN || opt.chunk > CHUNK_MAX || opt.drop_pct >= 100)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    if (getaddrinfo(opt.host, opt.port, &hints, &broker) != 0)
+    {
+        fprintf(stderr, "Cannot resolve %s\n", opt.host);
+        return 1;
+    }
+
+    end_ms = archive_build();
+    snprintf(request_topic, sizeof(request_topic), "%s/%s/backfill/req", CONFIG_AWS_TOPIC, STATION_ID);
+    snprintf(response_topic, sizeof(response_topic), "%s/%s/backfill/resp", CONFIG_AWS_TOPIC, STATION_ID);
+    backfill_init(&session, CONFIG_BACKFILL_ACK_TIMEOUT_MS);
+    client_start(&station, broker, STATION_ID, request_topic);
+    client_start(&backend, broker, "backfillbench_backend", response_topic);
+    srand(1);
+
+    uint32_t all = (1 << SENSOR_CH_COUNT) - 1;
+    uint32_t two = SENSOR_CH_BIT(SENSOR_CH_TEMPERATURE) | SENSOR_CH_BIT(SENSOR_CH_PRESSURE);
+    const query_case_t cases[] = {
+        { "raw last hour, all", ARCHIVE_LEVEL_RAW, -HOUR_MS, all },
+        { "raw last day, all", ARCHIVE_LEVEL_RAW, -DAY_MS, all },
+        { "raw last day, 2 fields", ARCHIVE_LEVEL_RAW, -DAY_MS, two },
+        { "raw last week, 2 fields", ARCHIVE_LEVEL_RAW, -7 * DAY_MS, two },
+        { "hourly last week, all", ARCHIVE_LEVEL_HOURLY, -7 * DAY_MS, all },
+        { "hourly all, 2 fields", ARCHIVE_LEVEL_HOURLY, -(int64_t)opt.days * DAY_MS, two },
+    };
+
+    printf("\nQueries through %s:%s, window %u, %u byte chunks, %u%% dropped\n", opt.host, opt.port, opt.window,
+           opt.chunk, opt.drop_pct);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        run_case(&cases[i], end_ms);
+    }
+    archive_close();
+    freeaddrinfo(broker);
+    return 0;
+}
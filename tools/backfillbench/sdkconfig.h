@@ -0,0 +1,14 @@
+/*
+ * Host stand-in for the ESP-IDF generated sdkconfig.h, enabling the archive and historical data
+ * queries with the project defaults.
+ */
+#pragma once
+
+#define CONFIG_DEVICE_LOCATION_NAME "synders"
+#define CONFIG_DEVICE_TYPE_NAME "weather"
+#define CONFIG_AWS_TOPIC "tms/weather"
+#define CONFIG_ARCHIVE_ENABLE 1
+#define CONFIG_BACKFILL_ENABLE 1
+#define CONFIG_BACKFILL_CHUNK_SIZE 1024
+#define CONFIG_BACKFILL_WINDOW 4
+#define CONFIG_BACKFILL_ACK_TIMEOUT_MS 30000
@@ -0,0 +1,1090 @@
+/**
+ * @file fleetsim.c
+ * @brief Fleet publish load simulator
+ *
+ * Runs thousands of virtual weather stations against an MQTT broker (e.g. a local mosquitto) from a
+ * single epoll event loop. Each station follows the publish path of aws_iot_task(): it connects, sends
+ * the retained registration message in binary mode, then publishes one aggregated window per publish
+ * interval, encoded by the firmware's own telemetry.c. Sensor readings are simulated.
+ *
+ * A monitor connection subscribes to the whole topic tree and measures what the broker delivers:
+ * throughput, and publish latency from the "sent" time each payload carries to its arrival.
+ *
+ * Scenarios: connect ramp, per-publish jitter, a reconnect storm (a fraction of the fleet drops and
+ * reconnects at once) and a rain event (a fraction of the fleet publishes faster for a while).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "sdkconfig.h"
+#include "telemetry.h"
+
+#define STATION_OUT_SIZE (1536)
+#define STATION_IN_SIZE (16)
+#define MONITOR_IN_SIZE (65536)
+#define MAX_EVENTS (256)
+
+#define MQTT_CONNECT (0x10)
+#define MQTT_CONNACK (0x20)
+#define MQTT_PUBLISH (0x30)
+#define MQTT_SUBSCRIBE (0x82)
+#define MQTT_SUBACK (0x90)
+
+typedef enum {
+    STATION_DISCONNECTED,
+    STATION_CONNECTING,
+    STATION_CONNACK_WAIT,
+    STATION_RUNNING
+} station_state_t;
+
+/**
+ * @brief One virtual station. Everything it needs is in here, so memory per station is its size.
+ */
+typedef struct {
+    int fd;
+    station_state_t state;
+    bool connected_before;              /*!< Later connects count as reconnects */
+    uint32_t index;                     /*!< Position in the fleet, also the client id suffix */
+    uint32_t heap_pos;                  /*!< Position in the timer heap */
+    int64_t next_us;                    /*!< Next timer event (connect or publish) */
+    uint32_t seq;                       /*!< Window sequence number */
+    uint32_t rng;                       /*!< xorshift state */
+    float temperature;                  /*!< Simulated readings, random walks */
+    float humidity;
+    float pressure;
+    float rain;
+    uint16_t out_len;                   /*!< Bytes queued in out */
+    uint16_t out_pos;                   /*!< Bytes of out already written */
+    uint8_t in_len;
+    uint8_t in[STATION_IN_SIZE];
+    uint8_t out[STATION_OUT_SIZE];
+} station_t;
+
+typedef struct {
+    const char *host;
+    const char *port;
+    uint32_t stations;
+    uint32_t interval_ms;               /*!< Publish interval */
+    uint32_t sample_ms;                 /*!< Acquisition interval, sets the samples per window */
+    uint32_t jitter_pct;                /*!< Publish interval jitter, +/- percent */
+    uint32_t connect_rate;              /*!< New connections per second during the ramp */
+    uint32_t duration_s;
+    uint32_t report_s;
+    bool binary;
+    int storm_at_s;                     /*!< Reconnect storm time, -1 for none */
+    uint32_t storm_pct;                 /*!< Fleet share dropped by the storm */
+    uint32_t storm_spread_ms;           /*!< Reconnects are spread over this long */
+    int rain_at_s;                      /*!< Rain event start, -1 for none */
+    uint32_t rain_s;                    /*!< Rain event length */
+    uint32_t rain_pct;                  /*!< Fleet share in the rain */
+    uint32_t rain_factor;               /*!< Publish rate multiplier in the rain */
+} options_t;
+
+typedef struct {
+    uint64_t connects;
+    uint64_t reconnects;
+    uint64_t connect_failures;
+    uint64_t publishes;
+    uint64_t publish_bytes;
+    uint64_t backpressure_drops;        /*!< Windows skipped because the previous one was still queued */
+    uint64_t received;
+    uint64_t received_bytes;
+    uint64_t registrations;
+} counters_t;
+
+typedef struct {
+    uint32_t *us;
+    size_t count;
+    size_t size;
+} latency_log_t;
+
+static options_t opt = {
+    .host = "127.0.0.1",
+    .port = "1883",
+    .stations = 1000,
+    .interval_ms = CONFIG_PUBLISH_INTERVAL_MS,
+    .sample_ms = CONFIG_SAMPLE_INTERVAL_MS,
+    .jitter_pct = 10,
+    .connect_rate = 200,
+    .duration_s = 60,
+    .report_s = 5,
+    .binary = false,
+    .storm_at_s = -1,
+    .storm_pct = 50,
+    .storm_spread_ms = 2000,
+    .rain_at_s = -1,
+    .rain_s = 30,
+    .rain_pct = 30,
+    .rain_factor = 5,
+};
+
+static int epfd = -1;
+static station_t *stations;
+static station_t **heap;
+static uint32_t heap_len;
+static struct addrinfo *broker;
+static counters_t total;
+static counters_t last_report;
+static latency_log_t latencies;
+static size_t last_report_latencies;
+static int64_t start_us;
+
+/* The monitor is the subscriber that sees what the broker delivers */
+static int monitor_fd = -1;
+static uint8_t monitor_in[MONITOR_IN_SIZE];
+static size_t monitor_len;
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int64_t unix_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static uint32_t rng_next(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+/* Uniform in [-1, 1) */
+static float rng_unit(uint32_t *state)
+{
+    return (rng_next(state) / 2147483648.0f) - 1.0f;
+}
+
+static long rss_bytes(void)
+{
+    long pages = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+    if (f != NULL)
+    {
+        if (fscanf(f, "%*d %ld", &pages) != 1)
+        {
+            pages = 0;
+        }
+        fclose(f);
+    }
+    return pages * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * Timer heap, ordered by next_us
+ */
+
+static void heap_swap(uint32_t a, uint32_t b)
+{
+    station_t *tmp = heap[a];
+    heap[a] = heap[b];
+    heap[b] = tmp;
+    heap[a]->heap_pos = a;
+    heap[b]->heap_pos = b;
+}
+
+static void heap_up(uint32_t pos)
+{
+    while (pos > 0 && heap[(pos - 1) / 2]->next_us > heap[pos]->next_us)
+    {
+        heap_swap(pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
+}
+
+static void heap_down(uint32_t pos)
+{
+    for (;;)
+    {
+        uint32_t smallest = pos;
+        uint32_t left = 2 * pos + 1;
+        uint32_t right = left + 1;
+        if (left < heap_len && heap[left]->next_us < heap[smallest]->next_us)
+        {
+            smallest = left;
+        }
+        if (right < heap_len && heap[right]->next_us < heap[smallest]->next_us)
+        {
+            smallest = right;
+        }
+        if (smallest == pos)
+        {
+            return;
+        }
+        heap_swap(pos, smallest);
+        pos = smallest;
+    }
+}
+
+static void schedule(station_t *st, int64_t at)
+{
+    int64_t old = st->next_us;
+    st->next_us = at;
+    if (at < old)
+    {
+        heap_up(st->heap_pos);
+    }
+    else
+    {
+        heap_down(st->heap_pos);
+    }
+}
+
+/*
+ * MQTT framing
+ */
+
+static size_t put_remaining_length(uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+    do
+    {
+        uint8_t byte = len % 128;
+        len /= 128;
+        buf[pos++] = byte | (len ? 0x80 : 0);
+    } while (len);
+    return pos;
+}
+
+static size_t put_string(uint8_t *buf, const char *str, size_t len)
+{
+    buf[0] = len >> 8;
+    buf[1] = len & 0xff;
+    memcpy(buf + 2, str, len);
+    return len + 2;
+}
+
+/* Keepalive as the firmware sets it: a few publish intervals, within the range AWS IoT allows */
+static uint16_t keepalive_sec(void)
+{
+    uint32_t sec = opt.interval_ms / 1000 * CONFIG_MQTT_KEEPALIVE_PUBLISH_CYCLES;
+    return sec < 30 ? 30 : (sec > 1200 ? 1200 : sec);
+}
+
+static size_t frame_connect(uint8_t *buf, const char *client_id)
+{
+    uint8_t body[128];
+    size_t len = 0;
+    size_t pos = 0;
+    uint16_t keepalive = keepalive_sec();
+
+    len += put_string(body + len, "MQTT", 4);
+    body[len++] = 4;            // MQTT 3.1.1
+    body[len++] = 0x02;         // Clean session
+    body[len++] = keepalive >> 8;
+    body[len++] = keepalive & 0xff;
+    len += put_string(body + len, client_id, strlen(client_id));
+
+    buf[pos++] = MQTT_CONNECT;
+    pos += put_remaining_length(buf + pos, len);
+    memcpy(buf + pos, body, len);
+    return pos + len;
+}
+
+static size_t frame_publish(uint8_t *buf, size_t size, const char *topic, const void *payload, size_t payload_len, bool retain)
+{
+    size_t topic_len = strlen(topic);
+    size_t len = topic_len + 2 + payload_len;
+    size_t pos = 0;
+
+    if (len + 5 > size)
+    {
+        return 0;
+    }
+    buf[pos++] = MQTT_PUBLISH | (retain ? 1 : 0);
+    pos += put_remaining_length(buf + pos, len);
+    pos += put_string(buf + pos, topic, topic_len);
+    memcpy(buf + pos, payload, payload_len);
+    return pos + payload_len;
+}
+
+/*
+ * Stations
+ */
+
+static void station_id(const station_t *st, char *buf, size_t len)
+{
+    snprintf(buf, len, "%s_sim%06u", CONFIG_DEVICE_LOCATION_NAME, st->index);
+}
+
+static void station_watch(station_t *st, uint32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = st };
+    epoll_ctl(epfd, EPOLL_CTL_MOD, st->fd, &ev);
+}
+
+static void station_drop(station_t *st, int64_t reconnect_at)
+{
+    if (st->fd >= 0)
+    {
+        close(st->fd);
+        st->fd = -1;
+    }
+    st->state = STATION_DISCONNECTED;
+    st->out_len = 0;
+    st->out_pos = 0;
+    st->in_len = 0;
+    schedule(st, reconnect_at);
+}
+
+/* Reconnect after a failure with a random 1 to 5 second delay, like the SDK's reconnect backoff floor */
+static void station_fail(station_t *st)
+{
+    station_drop(st, now_us() + 1000000 + rng_next(&st->rng) % 4000000);
+}
+
+static void station_flush(station_t *st)
+{
+    while (st->out_pos < st->out_len)
+    {
+        ssize_t n = send(st->fd, st->out + st->out_pos, st->out_len - st->out_pos, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                station_watch(st, EPOLLIN | EPOLLOUT);
+                return;
+            }
+            station_fail(st);
+            return;
+        }
+        st->out_pos += n;
+    }
+    st->out_len = 0;
+    st->out_pos = 0;
+    station_watch(st, EPOLLIN);
+}
+
+static bool station_queue(station_t *st, const uint8_t *buf, size_t len)
+{
+    if (st->out_len + len > STATION_OUT_SIZE)
+    {
+        return false;
+    }
+    memcpy(st->out + st->out_len, buf, len);
+    st->out_len += len;
+    return true;
+}
+
+static void station_connect(station_t *st)
+{
+    struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = st };
+    int one = 1;
+
+    st->fd = socket(broker->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (st->fd < 0)
+    {
+        total.connect_failures++;
+        station_fail(st);
+        return;
+    }
+    setsockopt(st->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(st->fd, broker->ai_addr, broker->ai_addrlen) < 0 && errno != EINPROGRESS)
+    {
+        total.connect_failures++;
+        station_fail(st);
+        return;
+    }
+    epoll_ctl(epfd, EPOLL_CTL_ADD, st->fd, &ev);
+    st->state = STATION_CONNECTING;
+    // Connection timeout, as the SDK's TLS handshake timeout
+    schedule(st, now_us() + 5000000);
+}
+
+static bool station_in_rain(const station_t *st, int64_t now)
+{
+    int64_t rain_start = start_us + (int64_t)opt.rain_at_s * 1000000;
+    return opt.rain_at_s >= 0 && now >= rain_start && now < rain_start + (int64_t)opt.rain_s * 1000000 &&
+           (st->index % 100) < opt.rain_pct;
+}
+
+static int64_t station_interval(station_t *st, int64_t now)
+{
+    int64_t interval = (int64_t)opt.interval_ms * 1000;
+    if (station_in_rain(st, now))
+    {
+        interval /= opt.rain_factor;
+    }
+    return interval + (int64_t)(interval * (int)opt.jitter_pct / 100 * rng_unit(&st->rng));
+}
+
+/* Simulate one publish window of readings, as the sampler would aggregate it */
+static void station_window(station_t *st, sensor_window_t *window, int64_t now, bool raining)
+{
+    uint32_t samples = opt.interval_ms / (opt.sample_ms ? opt.sample_ms : 1);
+    int64_t sent = unix_us();
+
+    memset(window, 0, sizeof(sensor_window_t));
+    window->seq = ++st->seq;
+    window->samples = samples ? samples : 1;
+    window->valid = SENSOR_CH_BIT(SENSOR_CH_TEMPERATURE) | SENSOR_CH_BIT(SENSOR_CH_HUMIDITY) |
+                    SENSOR_CH_BIT(SENSOR_CH_PRESSURE) | SENSOR_CH_BIT(SENSOR_CH_RAINMM);
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        sensor_stat_reset(&window->stats[ch]);
+        if (!(window->valid & SENSOR_CH_BIT(ch)))
+        {
+            window->age[ch] = (uint32_t)((now - start_us) / 1000000);
+        }
+    }
+    for (uint32_t i = 0; i < window->samples; i++)
+    {
+        st->temperature += 0.05f * rng_unit(&st->rng);
+        st->humidity += 0.2f * rng_unit(&st->rng);
+        st->pressure += 0.05f * rng_unit(&st->rng);
+        if (raining)
+        {
+            st->rain += 0.01f * (1.0f + rng_unit(&st->rng));
+        }
+        sensor_stat_add(&window->stats[SENSOR_CH_TEMPERATURE], st->temperature);
+        sensor_stat_add(&window->stats[SENSOR_CH_HUMIDITY], st->humidity);
+        sensor_stat_add(&window->stats[SENSOR_CH_PRESSURE], st->pressure);
+        sensor_stat_add(&window->stats[SENSOR_CH_RAINMM], st->rain);
+    }
+    // A steady barometer after the first three hours, so the payload carries the forecast fields
+    window->tendency = 4;
+    window->pressure_change = 0.5f * rng_unit(&st->rng);
+    window->forecast = 'B';
+    window->unix_time = true;
+    window->sent_us = sent;
+    window->enqueued_us = sent - 1000;
+    window->last_us = window->enqueued_us - 500;
+    window->first_us = window->last_us - (int64_t)(window->samples - 1) * opt.sample_ms * 1000;
+}
+
+static void station_publish(station_t *st, int64_t now)
+{
+    static uint8_t payload[1024];
+    static uint8_t frame[STATION_OUT_SIZE];
+    sensor_window_t window;
+    char id[32];
+    char topic[128];
+    int payload_len;
+    size_t frame_len;
+
+    schedule(st, now + station_interval(st, now));
+    if (st->out_len)
+    {
+        // The socket has not drained the previous window: the firmware's queue would drop one too
+        total.backpressure_drops++;
+        return;
+    }
+    station_window(st, &window, now, station_in_rain(st, now));
+    station_id(st, id, sizeof(id));
+    if (opt.binary)
+    {
+        snprintf(topic, sizeof(topic), "%s/%s/bin", CONFIG_AWS_TOPIC, id);
+        payload_len = telemetry_encode_binary(&window, payload, sizeof(payload));
+    }
+    else
+    {
+        snprintf(topic, sizeof(topic), "%s/%s", CONFIG_AWS_TOPIC, id);
+        payload_len = telemetry_encode_json(&window, id, (char *)payload, sizeof(payload));
+    }
+    if (payload_len <= 0)
+    {
+        return;
+    }
+    frame_len = frame_publish(frame, sizeof(frame), topic, payload, payload_len, false);
+    if (frame_len && station_queue(st, frame, frame_len))
+    {
+        total.publishes++;
+        total.publish_bytes += frame_len;
+        station_flush(st);
+    }
+}
+
+static void station_connected(station_t *st)
+{
+    static uint8_t frame[STATION_OUT_SIZE];
+    char payload[1024];
+    char id[32];
+    char topic[128];
+    int payload_len;
+    size_t frame_len;
+
+    st->state = STATION_RUNNING;
+    st->connected_before = true;
+    total.connects++;
+    if (opt.binary)
+    {
+        station_id(st, id, sizeof(id));
+        snprintf(topic, sizeof(topic), "%s/%s/register", CONFIG_AWS_TOPIC, id);
+        payload_len = telemetry_encode_registration(id, payload, sizeof(payload));
+        frame_len = payload_len > 0 ? frame_publish(frame, sizeof(frame), topic, payload, payload_len, true) : 0;
+        if (frame_len && station_queue(st, frame, frame_len))
+        {
+            station_flush(st);
+        }
+    }
+    // The first window goes out straight away, as after a boot
+    schedule(st, now_us());
+}
+
+static void station_writable(station_t *st)
+{
+    uint8_t frame[160];
+    char id[32];
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    if (st->state != STATION_CONNECTING)
+    {
+        station_flush(st);
+        return;
+    }
+    if (getsockopt(st->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err)
+    {
+        total.connect_failures++;
+        station_fail(st);
+        return;
+    }
+    station_id(st, id, sizeof(id));
+    st->state = STATION_CONNACK_WAIT;
+    station_queue(st, frame, frame_connect(frame, id));
+    station_flush(st);
+}
+
+static void station_readable(station_t *st)
+{
+    ssize_t n = recv(st->fd, st->in + st->in_len, STATION_IN_SIZE - st->in_len, 0);
+    if (n <= 0)
+    {
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+        station_fail(st);
+        return;
+    }
+    st->in_len += n;
+    // The broker only ever sends CONNACK (and PINGRESP) to a station
+    while (st->in_len >= 2)
+    {
+        uint8_t packet_len = 2 + st->in[1];
+        if (st->in_len < packet_len)
+        {
+            break;
+        }
+        if ((st->in[0] & 0xf0) == MQTT_CONNACK && st->state == STATION_CONNACK_WAIT)
+        {
+            if (packet_len < 4 || st->in[3] != 0)
+            {
+                total.connect_failures++;
+                station_fail(st);
+                return;
+            }
+            station_connected(st);
+        }
+        memmove(st->in, st->in + packet_len, st->in_len - packet_len);
+        st->in_len -= packet_len;
+    }
+}
+
+static void station_timer(station_t *st, int64_t now)
+{
+    switch (st->state)
+    {
+    case STATION_DISCONNECTED:
+        if (st->connected_before)
+        {
+            total.reconnects++;
+        }
+        station_connect(st);
+        break;
+    case STATION_CONNECTING:
+    case STATION_CONNACK_WAIT:
+        total.connect_failures++;
+        station_fail(st);
+        break;
+    case STATION_RUNNING:
+        station_publish(st, now);
+        break;
+    }
+}
+
+static void reconnect_storm(int64_t now)
+{
+    uint32_t dropped = 0;
+
+    for (uint32_t i = 0; i < opt.stations; i++)
+    {
+        station_t *st = &stations[i];
+        if (st->state == STATION_RUNNING && (st->index % 100) < opt.storm_pct)
+        {
+            station_drop(st, now + rng_next(&st->rng) % (opt.storm_spread_ms * 1000 + 1));
+            dropped++;
+        }
+    }
+    printf("Reconnect storm: dropped %u stations\n", dropped);
+}
+
+/*
+ * Monitor
+ */
+
+static void latency_add(int64_t us)
+{
+    if (latencies.count == latencies.size)
+    {
+        size_t size = latencies.size ? latencies.size * 2 : 65536;
+        uint32_t *grown = realloc(latencies.us, size * sizeof(uint32_t));
+        if (grown == NULL)
+        {
+            return;
+        }
+        latencies.us = grown;
+        latencies.size = size;
+    }
+    latencies.us[latencies.count++] = us < 0 ? 0 : (us > UINT32_MAX ? UINT32_MAX : (uint32_t)us);
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, size_t count, double pct)
+{
+    size_t rank;
+    if (count == 0)
+    {
+        return 0;
+    }
+    rank = (size_t)ceil(pct / 100.0 * count);
+    return sorted[rank ? rank - 1 : 0];
+}
+
+static void monitor_message(const char *topic, size_t topic_len, const uint8_t *payload, size_t payload_len)
+{
+    static char json[2048];
+    sensor_window_t window;
+    const char *sent;
+    size_t suffix = strlen("/register");
+
+    total.received++;
+    total.received_bytes += payload_len;
+    if (topic_len >= suffix && memcmp(topic + topic_len - suffix, "/register", suffix) == 0)
+    {
+        total.registrations++;
+        return;
+    }
+    if (topic_len >= 4 && memcmp(topic + topic_len - 4, "/bin", 4) == 0)
+    {
+        if (telemetry_decode_binary(payload, payload_len, &window) > 0)
+        {
+            latency_add(unix_us() - window.sent_us);
+        }
+        return;
+    }
+    if (payload_len >= sizeof(json))
+    {
+        return;
+    }
+    memcpy(json, payload, payload_len);
+    json[payload_len] = 0;
+    sent = strstr(json, "\"sent\": ");
+    if (sent != NULL)
+    {
+        latency_add(unix_us() - strtoll(sent + 8, NULL, 10));
+    }
+}
+
+static void monitor_readable(void)
+{
+    size_t pos = 0;
+
+    // Level triggered: anything left unread is reported again
+    ssize_t n = recv(monitor_fd, monitor_in + monitor_len, sizeof(monitor_in) - monitor_len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    {
+        return;
+    }
+    if (n <= 0)
+    {
+        fprintf(stderr, "Monitor connection lost\n");
+        exit(1);
+    }
+    monitor_len += n;
+
+    while (monitor_len - pos >= 2)
+    {
+        size_t remaining = 0;
+        size_t header = 1;
+        int shift = 0;
+        bool complete = false;
+
+        while (header < 5 && pos + header < monitor_len)
+        {
+            uint8_t byte = monitor_in[pos + header++];
+            remaining |= (size_t)(byte & 0x7f) << shift;
+            shift += 7;
+            if (!(byte & 0x80))
+            {
+                complete = true;
+                break;
+            }
+        }
+        if (!complete || monitor_len - pos < header + remaining)
+        {
+            break;
+        }
+        if ((monitor_in[pos] & 0xf0) == MQTT_PUBLISH && remaining >= 2)
+        {
+            const uint8_t *body = monitor_in + pos + header;
+            size_t topic_len = (body[0] << 8) | body[1];
+            size_t skip = 2 + topic_len + (((monitor_in[pos] >> 1) & 3) ? 2 : 0);
+            if (skip <= remaining)
+            {
+                monitor_message((const char *)body + 2, topic_len, body + skip, remaining - skip);
+            }
+        }
+        pos += header + remaining;
+    }
+    memmove(monitor_in, monitor_in + pos, monitor_len - pos);
+    monitor_len -= pos;
+    if (monitor_len == sizeof(monitor_in))
+    {
+        fprintf(stderr, "Monitor message larger than %zu bytes\n", sizeof(monitor_in));
+        exit(1);
+    }
+}
+
+static void monitor_start(void)
+{
+    uint8_t buf[256];
+    char topic[128];
+    size_t len = 0;
+    size_t body = 0;
+    uint8_t packet[256];
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+
+    monitor_fd = socket(broker->ai_family, SOCK_STREAM, 0);
+    if (monitor_fd < 0 || connect(monitor_fd, broker->ai_addr, broker->ai_addrlen) < 0)
+    {
+        fprintf(stderr, "Cannot connect to %s:%s: %s\n", opt.host, opt.port, strerror(errno));
+        exit(1);
+    }
+    len = frame_connect(buf, "fleetsim_monitor");
+    if (send(monitor_fd, buf, len, 0) != (ssize_t)len || recv(monitor_fd, buf, 4, MSG_WAITALL) != 4 ||
+        (buf[0] & 0xf0) != MQTT_CONNACK || buf[3] != 0)
+    {
+        fprintf(stderr, "Monitor connection refused by the broker\n");
+        exit(1);
+    }
+
+    snprintf(topic, sizeof(topic), "%s/#", CONFIG_AWS_TOPIC);
+    packet[body++] = 0;
+    packet[body++] = 1;         // Packet id
+    body += put_string(packet + body, topic, strlen(topic));
+    packet[body++] = 0;         // QoS 0
+    len = 0;
+    buf[len++] = MQTT_SUBSCRIBE;
+    len += put_remaining_length(buf + len, body);
+    memcpy(buf + len, packet, body);
+    len += body;
+    if (send(monitor_fd, buf, len, 0) != (ssize_t)len || recv(monitor_fd, buf, 5, MSG_WAITALL) != 5 ||
+        (buf[0] & 0xf0) != MQTT_SUBACK || buf[4] == 0x80)
+    {
+        fprintf(stderr, "Monitor subscription to %s refused\n", topic);
+        exit(1);
+    }
+    fcntl(monitor_fd, F_SETFL, fcntl(monitor_fd, F_GETFL) | O_NONBLOCK);
+    epoll_ctl(epfd, EPOLL_CTL_ADD, monitor_fd, &ev);
+}
+
+/*
+ * Reporting
+ */
+
+static uint32_t connected_stations(void)
+{
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < opt.stations; i++)
+    {
+        n += stations[i].state == STATION_RUNNING;
+    }
+    return n;
+}
+
+static void report(int64_t now, double period_s)
+{
+    size_t count = latencies.count - last_report_latencies;
+    uint32_t *recent = latencies.us + last_report_latencies;
+
+    qsort(recent, count, sizeof(uint32_t), compare_u32);
+    printf("%6.1fs  connected %6u  publish %8.1f/s  broker out %8.1f/s %9.1fkB/s  reconnects %5llu  drops %4llu  "
+           "latency p50 %7.2fms p99 %7.2fms\n",
+           (now - start_us) / 1e6, connected_stations(),
+           (total.publishes - last_report.publishes) / period_s,
+           (total.received - last_report.received) / period_s,
+           (total.received_bytes - last_report.received_bytes) / period_s / 1000.0,
+           (unsigned long long)(total.reconnects - last_report.reconnects),
+           (unsigned long long)(total.backpressure_drops - last_report.backpressure_drops),
+           percentile(recent, count, 50) / 1000.0, percentile(recent, count, 99) / 1000.0);
+    fflush(stdout);
+    last_report = total;
+    last_report_latencies = latencies.count;
+}
+
+static void summary(double duration_s, long rss_before)
+{
+    long rss_after = rss_bytes();
+
+    qsort(latencies.us, latencies.count, sizeof(uint32_t), compare_u32);
+    printf("\nStations          %u (%s payloads)\n", opt.stations, opt.binary ? "binary" : "JSON");
+    printf("Connects          %llu, %llu reconnects, %llu failures\n", (unsigned long long)total.connects,
+           (unsigned long long)total.reconnects, (unsigned long long)total.connect_failures);
+    printf("Published         %llu windows, %.1f/s, %llu dropped on backpressure\n", (unsigned long long)total.publishes,
+           total.publishes / duration_s, (unsigned long long)total.backpressure_drops);
+    printf("Broker delivered  %llu messages, %.1f/s, %.1fkB/s, %llu registrations\n", (unsigned long long)total.received,
+           total.received / duration_s, total.received_bytes / duration_s / 1000.0, (unsigned long long)total.registrations);
+    printf("Latency           p50 %.2fms p90 %.2fms p99 %.2fms p99.9 %.2fms max %.2fms (%zu windows)\n",
+           percentile(latencies.us, latencies.count, 50) / 1000.0, percentile(latencies.us, latencies.count, 90) / 1000.0,
+           percentile(latencies.us, latencies.count, 99) / 1000.0, percentile(latencies.us, latencies.count, 99.9) / 1000.0,
+           percentile(latencies.us, latencies.count, 100) / 1000.0, latencies.count);
+    printf("Client memory     %zu bytes of state per station, %.0f bytes RSS per station\n", sizeof(station_t),
+           (double)(rss_after - rss_before) / opt.stations);
+}
+
+static void usage(const char *argv0)
+{
+    printf("Usage: %s [options]\n"
+           "  --host HOST            broker address (%s)\n"
+           "  --port PORT            broker port (%s)\n"
+           "  --stations N           virtual stations (%u)\n"
+           "  --interval MS          publish interval (%u)\n"
+           "  --sample MS            acquisition interval, sets samples per window (%u)\n"
+           "  --jitter PCT           publish interval jitter, +/- percent (%u)\n"
+           "  --connect-rate N       connections per second during the ramp (%u)\n"
+           "  --duration S           test duration (%u)\n"
+           "  --report S             report period (%u)\n"
+           "  --binary               compact binary payloads instead of JSON\n"
+           "  --storm-at S           drop part of the fleet at S seconds\n"
+           "  --storm-pct PCT        share of the fleet dropped (%u)\n"
+           "  --storm-spread MS      reconnects are spread over this long (%u)\n"
+           "  --rain-at S            start a rain event at S seconds\n"
+           "  --rain-duration S      rain event length (%u)\n"
+           "  --rain-pct PCT         share of the fleet in the rain (%u)\n"
+           "  --rain-factor N        publish rate multiplier in the rain (%u)\n",
+           argv0, opt.host, opt.port, opt.stations, opt.interval_ms, opt.sample_ms, opt.jitter_pct, opt.connect_rate,
+           opt.duration_s, opt.report_s, opt.storm_pct, opt.storm_spread_ms, opt.rain_s, opt.rain_pct, opt.rain_factor);
+}
+
+static void parse_options(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "host", required_argument, NULL, 'H' },
+        { "port", required_argument, NULL, 'p' },
+        { "stations", required_argument, NULL, 'n' },
+        { "interval", required_argument, NULL, 'i' },
+        { "sample", required_argument, NULL, 's' },
+        { "jitter", required_argument, NULL, 'j' },
+        { "connect-rate", required_argument, NULL, 'c' },
+        { "duration", required_argument, NULL, 'd' },
+        { "report", required_argument, NULL, 'r' },
+        { "binary", no_argument, NULL, 'b' },
+        { "storm-at", required_argument, NULL, 'S' },
+        { "storm-pct", required_argument, NULL, 'P' },
+        { "storm-spread", required_argument, NULL, 'W' },
+        { "rain-at", required_argument, NULL, 'R' },
+        { "rain-duration", required_argument, NULL, 'D' },
+        { "rain-pct", required_argument, NULL, 'Q' },
+        { "rain-factor", required_argument, NULL, 'F' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int c;
+
+    while ((c = getopt_long(argc, argv, "h", options, NULL)) != -1)
+    {
+        switch (c)
+        {
+        case 'H': opt.host = optarg; break;
+        case 'p': opt.port = optarg; break;
+        case 'n': opt.stations = strtoul(optarg, NULL, 10); break;
+        case 'i': opt.interval_ms = strtoul(optarg, NULL, 10); break;
+        case 's': opt.sample_ms = strtoul(optarg, NULL, 10); break;
+        case 'j': opt.jitter_pct = strtoul(optarg, NULL, 10); break;
+        case 'c': opt.connect_rate = strtoul(optarg, NULL, 10); break;
+        case 'd': opt.duration_s = strtoul(optarg, NULL, 10); break;
+        case 'r': opt.report_s = strtoul(optarg, NULL, 10); break;
+        case 'b': opt.binary = true; break;
+        case 'S': opt.storm_at_s = atoi(optarg); break;
+        case 'P': opt.storm_pct = strtoul(optarg, NULL, 10); break;
+        case 'W': opt.storm_spread_ms = strtoul(optarg, NULL, 10); break;
+        case 'R': opt.rain_at_s = atoi(optarg); break;
+        case 'D': opt.rain_s = strtoul(optarg, NULL, 10); break;
+        case 'Q': opt.rain_pct = strtoul(optarg, NULL, 10); break;
+        case 'F': opt.rain_factor = strtoul(optarg, NULL, 10); break;
+        default:
+            usage(argv[0]);
+            exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if (opt.stations == 0 || opt.interval_ms == 0 || opt.connect_rate == 0 || opt.report_s == 0 || opt.rain_factor == 0)
+    {
+        fprintf(stderr, "stations, interval, connect-rate, report and rain-factor must be positive\n");
+        exit(1);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct epoll_event events[MAX_EVENTS];
+    struct rlimit limit;
+    int64_t end_us, next_report_us, storm_us, last_report_us;
+    bool storm_done = false;
+    long rss_before;
+    int err;
+
+    parse_options(argc, argv);
+
+    // One socket per station
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+        if (limit.rlim_cur < opt.stations + 16)
+        {
+            fprintf(stderr, "Warning: open file limit %llu is below the station count\n", (unsigned long long)limit.rlim_cur);
+        }
+    }
+    err = getaddrinfo(opt.host, opt.port, &hints, &broker);
+    if (err)
+    {
+        fprintf(stderr, "Cannot resolve %s: %s\n", opt.host, gai_strerror(err));
+        return 1;
+    }
+    epfd = epoll_create1(0);
+    monitor_start();
+
+    rss_before = rss_bytes();
+    stations = calloc(opt.stations, sizeof(station_t));
+    heap = calloc(opt.stations, sizeof(station_t *));
+    if (stations == NULL || heap == NULL)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    start_us = now_us();
+    for (uint32_t i = 0; i < opt.stations; i++)
+    {
+        station_t *st = &stations[i];
+        st->fd = -1;
+        st->index = i;
+        st->rng = i + 1;
+        st->temperature = 15.0f + 10.0f * rng_unit(&st->rng);
+        st->humidity = 60.0f + 20.0f * rng_unit(&st->rng);
+        st->pressure = 1013.0f + 10.0f * rng_unit(&st->rng);
+        // Ramp the connections up at the connect rate
+        st->next_us = start_us + (int64_t)i * 1000000 / opt.connect_rate;
+        st->heap_pos = i;
+        heap[i] = st;
+    }
+    heap_len = opt.stations;
+
+    end_us = start_us + (int64_t)opt.duration_s * 1000000;
+    storm_us = start_us + (int64_t)opt.storm_at_s * 1000000;
+    last_report_us = start_us;
+    next_report_us = start_us + (int64_t)opt.report_s * 1000000;
+    printf("Simulating %u stations against %s:%s for %us\n", opt.stations, opt.host, opt.port, opt.duration_s);
+
+    for (;;)
+    {
+        int64_t now = now_us();
+        int64_t wake = heap[0]->next_us;
+        int timeout;
+        int n;
+
+        if (now >= end_us)
+        {
+            break;
+        }
+        if (wake > next_report_us)
+        {
+            wake = next_report_us;
+        }
+        if (wake > end_us)
+        {
+            wake = end_us;
+        }
+        timeout = wake > now ? (int)((wake - now + 999) / 1000) : 0;
+        n = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+        for (int i = 0; i < n; i++)
+        {
+            station_t *st = events[i].data.ptr;
+            if (st == NULL)
+            {
+                monitor_readable();
+                continue;
+            }
+            if (st->fd < 0)
+            {
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                if (st->state == STATION_CONNECTING)
+                {
+                    total.connect_failures++;
+                }
+                station_fail(st);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT)
+            {
+                station_writable(st);
+            }
+            if (st->fd >= 0 && (events[i].events & EPOLLIN))
+            {
+                station_readable(st);
+            }
+        }
+
+        now = now_us();
+        while (heap[0]->next_us <= now)
+        {
+            station_timer(heap[0], now);
+        }
+        if (opt.storm_at_s >= 0 && !storm_done && now >= storm_us)
+        {
+            reconnect_storm(now);
+            storm_done = true;
+        }
+        if (now >= next_report_us)
+        {
+            report(now, (now - last_report_us) / 1e6);
+            last_report_us = now;
+            next_report_us += (int64_t)opt.report_s * 1000000;
+        }
+    }
+    summary((now_us() - start_us) / 1e6, rss_before);
+    return 0;
+}
@@ -0,0 +1,12 @@
+/*
+ * Host stand-in for the ESP-IDF generated sdkconfig.h, with the project defaults the
+ * telemetry code and the simulator need.
+ */
+#pragma once
+
+#define CONFIG_DEVICE_LOCATION_NAME "synders"
+#define CONFIG_DEVICE_TYPE_NAME "weather"
+#define CONFIG_AWS_TOPIC "tms/weather"
+#define CONFIG_PUBLISH_INTERVAL_MS 10000
+#define CONFIG_SAMPLE_INTERVAL_MS 2000
+#define CONFIG_MQTT_KEEPALIVE_PUBLISH_CYCLES 6
@@ -0,0 +1,21 @@
+/*
+ * Minimal checks for the host tests: a failed check prints where and why, and the test exits
+ * with the number of failures, so ctest reports it.
+ */
+#pragma once
+
+#include <stdio.h>
+
+static int check_failures;
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) \
+        { \
+            check_failures++; \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+#define CHECK_DONE() (check_failures ? (printf("%d checks failed\n", check_failures), 1) : 0)
@@ -0,0 +1,196 @@
+/**
+ * @file pressure_trend_test.c
+ * @brief Pressure tendency against reference traces, and the running slope against a brute force fit
+ *
+ * Each reference trace is three hours of readings every two seconds, a straight line over each
+ * 90 minute half with sensor noise on top, shaped after one characteristic of WMO code table 0200.
+ * Every trace is run from several starting minutes, so the ring is filled from different places
+ * and the fits are rebased at different points, and is checked for its tendency code and its
+ * three hour change.
+ *
+ * The running least squares sums are checked against a regression computed from the ring's
+ * slots from scratch, every minute over several days of a wandering pressure, which laps the
+ * ring many times.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+
+#include "pressure_trend.h"
+#include "check.h"
+
+#define READING_US (2000000LL)
+#define MINUTE_US (60000000LL)
+#define HALF_US (PRESSURE_TREND_HALF * MINUTE_US)
+#define NOISE_PA (3.0)
+#define SLOPE_TOLERANCE (2e-6)
+
+typedef struct {
+    const char *shape;
+    int code;
+    double first;                       /*!< Change over the older 90 minutes, Pa */
+    double second;                      /*!< Change over the newer 90 minutes, Pa */
+    double wobble;                      /*!< Amplitude of a 20 minute oscillation on top, Pa */
+} trace_t;
+
+static const trace_t traces[] = {
+    { "rising then falling, higher", 0, 120.0, -50.0, 0.0 },
+    { "rising then falling, same", 0, 60.0, -60.0, 0.0 },
+    { "rising then steady", 1, 90.0, 0.0, 0.0 },
+    { "rising then rising slower", 1, 120.0, 30.0, 0.0 },
+    { "rising steadily", 2, 60.0, 60.0, 0.0 },
+    { "rising unsteadily", 2, 60.0, 70.0, 8.0 },
+    { "steady then rising", 3, 0.0, 90.0, 0.0 },
+    { "falling then rising, higher", 3, -50.0, 120.0, 0.0 },
+    { "rising then rising faster", 3, 25.0, 100.0, 0.0 },
+    { "steady", 4, 0.0, 0.0, 0.0 },
+    { "falling then rising, same", 5, -60.0, 60.0, 0.0 },
+    { "falling then rising, lower", 5, -120.0, 50.0, 0.0 },
+    { "falling then steady", 6, -90.0, 0.0, 0.0 },
+    { "falling then falling slower", 6, -120.0, -30.0, 0.0 },
+    { "falling steadily", 7, -60.0, -60.0, 0.0 },
+    { "falling unsteadily", 7, -60.0, -70.0, 8.0 },
+    { "steady then falling", 8, 0.0, -90.0, 0.0 },
+    { "rising then falling, lower", 8, 50.0, -120.0, 0.0 },
+    { "falling then falling faster", 8, -25.0, -100.0, 0.0 },
+};
+
+/* Boot minute each trace starts at */
+static const int64_t starts[] = { 0, 1, 89, 179, 1000, 2 * PRESSURE_TREND_SLOTS - 1 };
+
+static double noise(void)
+{
+    return ((double)rand() / RAND_MAX * 2.0 - 1.0) * NOISE_PA;
+}
+
+static double trace_value(const trace_t *trace, int64_t t_us)
+{
+    double wobble = trace->wobble * sin(2.0 * M_PI * t_us / (20.0 * MINUTE_US));
+
+    if (t_us < HALF_US)
+    {
+        return 101000.0 + trace->first * t_us / HALF_US + wobble;
+    }
+    return 101000.0 + trace->first + trace->second * (t_us - HALF_US) / HALF_US + wobble;
+}
+
+static void reference_traces(void)
+{
+    static pressure_trend_t trend;
+
+    srand(40);
+    for (size_t i = 0; i < sizeof(traces) / sizeof(traces[0]); i++)
+    {
+        const trace_t *trace = &traces[i];
+
+        for (size_t s = 0; s < sizeof(starts) / sizeof(starts[0]); s++)
+        {
+            int64_t start_us = starts[s] * MINUTE_US;
+            float change = NAN;
+            int code;
+
+            pressure_trend_init(&trend);
+            for (int64_t t = 0; t < 2 * HALF_US; t += READING_US)
+            {
+                pressure_trend_add(&trend, start_us + t, (float)(trace_value(trace, t) + noise()));
+            }
+            code = pressure_trend_tendency(&trend, &change);
+            CHECK(code == trace->code, "%s from minute %lld: code %d, expected %d", trace->shape,
+                  (long long)starts[s], code, trace->code);
+            // The lines through the noise and the wobble land within a couple of Pa of the true ends
+            CHECK(fabs(change - (trace->first + trace->second)) < 3.0, "%s from minute %lld: change %.2f Pa, expected %.2f",
+                  trace->shape, (long long)starts[s], change, trace->first + trace->second);
+        }
+        printf("%-32s code %d, change %+7.1f Pa\n", trace->shape, trace->code, trace->first + trace->second);
+    }
+
+    // Not enough readings yet
+    pressure_trend_init(&trend);
+    CHECK(pressure_trend_tendency(&trend, NULL) == PRESSURE_TENDENCY_UNKNOWN, "tendency of an empty ring");
+    for (int64_t t = 0; t < HALF_US; t += READING_US)
+    {
+        pressure_trend_add(&trend, t, 101000.0f);
+    }
+    CHECK(pressure_trend_tendency(&trend, NULL) == PRESSURE_TENDENCY_UNKNOWN, "tendency from 90 minutes of readings");
+}
+
+/**
+ * @brief Least squares slope over the filled slots of the ring, from scratch
+ */
+static bool reference_slope(const pressure_trend_t *trend, double *pa_per_hour)
+{
+    long double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, d;
+
+    for (int age = 0; age < PRESSURE_TREND_SLOTS; age++)
+    {
+        int64_t slot = trend->head - age;
+        int i = (int)(slot % PRESSURE_TREND_SLOTS);
+
+        if (slot >= 0 && trend->count[i] > 0)
+        {
+            long double x = -age;
+            long double y = trend->mean[i];
+
+            n++;
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+        }
+    }
+    d = n * sxx - sx * sx;
+    if (n < 2 || d <= 0)
+    {
+        return false;
+    }
+    *pa_per_hour = (double)((n * sxy - sx * sy) / d * (3600 / PRESSURE_TREND_SLOT_S));
+    return true;
+}
+
+static void running_slope(void)
+{
+    static pressure_trend_t trend;
+    double worst = 0.0, worst_raw = 0.0, p = 101325.0, ref;
+    float slope;
+    uint32_t checks = 0;
+
+    srand(41);
+    pressure_trend_init(&trend);
+    // Five days, with gaps of a few minutes now and then so some slots stay empty
+    for (int64_t t = 0; t < 5 * 1440 * MINUTE_US; t += READING_US)
+    {
+        p += ((double)rand() / RAND_MAX - 0.5) * 0.5;
+        if (rand() % 2000 == 0)
+        {
+            t += (rand() % 10) * MINUTE_US;
+        }
+        pressure_trend_add(&trend, t, (float)(p + noise()));
+        if (t % MINUTE_US != 0)
+        {
+            continue;
+        }
+        CHECK(pressure_trend_slope(&trend, &slope) == reference_slope(&trend, &ref), "slope availability at %lld",
+              (long long)(t / MINUTE_US));
+        if (reference_slope(&trend, &ref))
+        {
+            // Up to the rounding of the result to float
+            double error = fabs(slope - ref) - fabs(ref) * FLT_EPSILON;
+
+            worst = error > worst ? error : worst;
+            worst_raw = fabs(slope - ref) > worst_raw ? fabs(slope - ref) : worst_raw;
+            checks++;
+        }
+    }
+    CHECK(worst < SLOPE_TOLERANCE, "running slope off by %g Pa/h", worst);
+    printf("Running slope: %u checks, worst error %.3g Pa/h, %.3g Pa/h beyond float rounding\n", checks, worst_raw,
+           worst);
+}
+
+int main(void)
+{
+    reference_traces();
+    running_slope();
+    return CHECK_DONE();
+}
@@ -0,0 +1,315 @@
+/**
+ * @file pulse_counter_test.c
+ * @brief Pulse train simulator for the PCNT overflow handling in pulse_counter.c
+ *
+ * The PCNT unit is simulated: pulses step its 16 bit counter, which resets to 0 and raises the
+ * high limit event when it reaches the limit pulse_counter_init() configured. The event runs the
+ * driver's interrupt handler straight away or, to model interrupt latency, a few pulses later.
+ * Pulse trains from a slow rain gauge up to several wraps between reads are driven through the
+ * counter, and every read is checked against the true number of pulses, modulo 2^32.
+ *
+ * Reads are raced against the interrupt at the three points where it can land: between the read
+ * of the overflow count and the sample of the counter, after the counter wrapped but before the
+ * interrupt ran, and after the sample but before the overflow count is checked again.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pulse_counter.h"
+#include "check.h"
+
+#define READS (1000000)
+
+typedef enum {
+    RACE_NONE,
+    RACE_ISR_BEFORE_SAMPLE,             /*!< Wrap and interrupt between the overflow read and the sample */
+    RACE_ISR_PENDING,                   /*!< Counter wrapped, interrupt not run when the counter is sampled */
+    RACE_ISR_AFTER_SAMPLE,              /*!< Wrap before the sample, interrupt right after it */
+    RACE_COUNT
+} race_t;
+
+static const char *const race_names[] = {
+    [RACE_NONE] = "no race",
+    [RACE_ISR_BEFORE_SAMPLE] = "interrupt before sample",
+    [RACE_ISR_PENDING] = "interrupt pending at sample",
+    [RACE_ISR_AFTER_SAMPLE] = "interrupt after sample",
+};
+
+/**
+ * @brief Simulated PCNT unit
+ */
+static struct {
+    int16_t limit;                      /*!< High limit from the unit config */
+    int16_t count;                      /*!< Hardware counter */
+    bool running;
+    bool pending;                       /*!< High limit event raised, interrupt not run yet */
+    void (*isr)(void *);
+    void *arg;
+    uint32_t pulses;                    /*!< True pulse count, modulo 2^32 */
+    race_t race;                        /*!< Race to inject into the next counter sample */
+    uint32_t after_wrap;                /*!< Pulses the injected race counts past the wrap */
+    uint32_t samples;                   /*!< Counter samples taken by the driver */
+} sim;
+
+static void sim_interrupt(void)
+{
+    if (sim.pending)
+    {
+        sim.pending = false;
+        sim.isr(sim.arg);
+    }
+}
+
+/**
+ * @brief Count pulses. With defer set an interrupt raised on the way stays pending, otherwise it
+ * runs as soon as the counter wraps.
+ */
+static void sim_pulses(uint32_t n, bool defer)
+{
+    while (n)
+    {
+        // Up to the next wrap in one step, the counter only does anything there
+        uint32_t step = (uint32_t)(sim.limit - sim.count) < n ? (uint32_t)(sim.limit - sim.count) : n;
+
+        sim.count += step;
+        sim.pulses += step;
+        n -= step;
+        if (sim.count == sim.limit)
+        {
+            sim.count = 0;
+            // The hardware raises one event per wrap; a second wrap before it is serviced would be lost
+            CHECK(!sim.pending, "a wrap happened with the previous interrupt still pending");
+            sim.pending = true;
+            if (!defer)
+            {
+                sim_interrupt();
+            }
+        }
+    }
+}
+
+/* Pulses to the next wrap, plus a few after it */
+static uint32_t sim_to_wrap(void)
+{
+    return sim.limit - sim.count + sim.after_wrap;
+}
+
+esp_err_t pcnt_unit_config(const pcnt_config_t *config)
+{
+    CHECK(config->pos_mode == PCNT_COUNT_INC && config->neg_mode == PCNT_COUNT_DIS, "counts rising edges only");
+    sim.limit = config->counter_h_lim;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_set_filter_value(pcnt_unit_t unit, uint16_t value)
+{
+    // The filter value register is 10 bits wide
+    return value < 1024 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t pcnt_filter_enable(pcnt_unit_t unit)
+{
+    return ESP_OK;
+}
+
+esp_err_t pcnt_filter_disable(pcnt_unit_t unit)
+{
+    return ESP_OK;
+}
+
+esp_err_t pcnt_event_enable(pcnt_unit_t unit, pcnt_evt_type_t evt)
+{
+    CHECK(evt == PCNT_EVT_H_LIM, "only the high limit event is used");
+    return ESP_OK;
+}
+
+esp_err_t pcnt_isr_service_install(int intr_alloc_flags)
+{
+    return ESP_OK;
+}
+
+esp_err_t pcnt_isr_handler_add(pcnt_unit_t unit, void (*isr_handler)(void *), void *args)
+{
+    sim.isr = isr_handler;
+    sim.arg = args;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_pause(pcnt_unit_t unit)
+{
+    sim.running = false;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_resume(pcnt_unit_t unit)
+{
+    sim.running = true;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_clear(pcnt_unit_t unit)
+{
+    sim.count = 0;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_get_counter_value(pcnt_unit_t unit, int16_t *count)
+{
+    race_t race = sim.race;
+
+    sim.race = RACE_NONE;
+    sim.samples++;
+    switch (race)
+    {
+        case RACE_ISR_BEFORE_SAMPLE:
+            sim_pulses(sim_to_wrap(), false);
+            break;
+        case RACE_ISR_PENDING:
+            sim_pulses(sim_to_wrap(), true);
+            break;
+        case RACE_ISR_AFTER_SAMPLE:
+            sim_pulses(sim_to_wrap(), true);
+            *count = sim.count;
+            sim_interrupt();
+            return ESP_OK;
+        default:
+            break;
+    }
+    *count = sim.count;
+    return ESP_OK;
+}
+
+static pulse_counter_t counter;
+
+static void setup(void)
+{
+    memset(&sim, 0, sizeof(sim));
+    memset(&counter, 0, sizeof(counter));
+    CHECK(pulse_counter_init(&counter, PCNT_UNIT_0, 4) == ESP_OK, "init failed");
+    CHECK(sim.running && sim.limit > 0 && sim.isr != NULL, "unit not configured");
+}
+
+/**
+ * @brief Read the counter and check it against the true count
+ *
+ * @return false once a read is wrong, so a broken run does not print a million failures
+ */
+static bool check_read(const char *name, uint32_t read)
+{
+    uint32_t total = 0;
+    esp_err_t err = pulse_counter_read(&counter, &total);
+
+    // A pending interrupt runs once the read is over
+    sim_interrupt();
+    CHECK(err == ESP_OK, "%s: read %u failed", name, read);
+    CHECK(total == sim.pulses, "%s: read %u gave %u pulses, expected %u (%u overflows, counter %d)", name, read,
+          total, sim.pulses, counter.overflows, sim.count);
+    return err == ESP_OK && total == sim.pulses;
+}
+
+/* Steady pulse trains, from less than one pulse per read to several wraps per read */
+static void steady_trains(void)
+{
+    static const uint32_t rates[] = { 0, 1, 7, 250, 32766, 32767, 32768, 100000, 1000000 };
+
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        char name[48];
+        snprintf(name, sizeof(name), "%u pulses per read", rates[i]);
+        setup();
+        for (uint32_t read = 0; read < 2000; read++)
+        {
+            sim_pulses(rates[i], false);
+            if (!check_read(name, read))
+            {
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * Random bursts with every read raced against the interrupt. A read that lands between a wrap and
+ * its interrupt sees a counter that went backwards, which is only told apart from a lost wrap when
+ * fewer than a full counter of pulses arrived since the previous read: that race is driven without
+ * a burst before it, and stops short of the count at the previous read.
+ */
+static void raced_reads(void)
+{
+    uint32_t races[RACE_COUNT] = { 0 };
+    uint32_t read;
+
+    setup();
+    srand(31);
+    for (read = 0; read < READS; read++)
+    {
+        race_t race = rand() % RACE_COUNT;
+        int16_t previous = sim.count;
+
+        if (race == RACE_ISR_PENDING && previous == 0)
+        {
+            race = RACE_NONE;
+        }
+        if (race == RACE_ISR_PENDING)
+        {
+            sim.after_wrap = rand() % (previous < 8 ? previous : 8);
+        }
+        else
+        {
+            sim_pulses(rand() % (3 * sim.limit), false);
+            sim.after_wrap = rand() % 8;
+        }
+        sim.race = race;
+        races[race]++;
+        if (!check_read(race_names[race], read))
+        {
+            break;
+        }
+    }
+    printf("%u raced reads, %u counter samples:", read, sim.samples);
+    for (int race = 0; race < RACE_COUNT; race++)
+    {
+        printf(" %s %u%s", race_names[race], races[race], race + 1 < RACE_COUNT ? "," : "\n");
+    }
+    // Each race that folds an overflow in between the two overflow reads forces a second sample
+    CHECK(sim.samples > READS, "no read was retried");
+}
+
+/* Decades of pulses: the total wraps at 2^32 and keeps counting */
+static void total_wrap(void)
+{
+    setup();
+    // Start just short of 2^32, as if the counter had been running for a long time
+    counter.overflows = UINT32_MAX / sim.limit;
+    counter.last_total = counter.overflows * (uint32_t)sim.limit;
+    sim.pulses = counter.last_total;
+    for (uint32_t read = 0; read < 200; read++)
+    {
+        sim_pulses(rand() % (3 * sim.limit), false);
+        sim.race = read % RACE_COUNT == RACE_ISR_PENDING ? RACE_NONE : read % RACE_COUNT;
+        sim.after_wrap = rand() % 8;
+        if (!check_read("2^32 wrap", read))
+        {
+            break;
+        }
+    }
+    CHECK(sim.pulses < (uint32_t)sim.limit * 1000, "the total did not wrap");
+}
+
+int main(void)
+{
+    steady_trains();
+    raced_reads();
+    total_wrap();
+
+    // init on a configured counter is a no-op and keeps the count
+    setup();
+    sim_pulses(100000, false);
+    CHECK(pulse_counter_init(&counter, PCNT_UNIT_0, 4) == ESP_OK && counter.overflows == 100000U / sim.limit,
+          "re-init reset the count");
+    check_read("after re-init", 0);
+    return CHECK_DONE();
+}
@@ -0,0 +1,17 @@
+/*
+ * Host stand-in for the ESP-IDF generated sdkconfig.h, with the project defaults the modules
+ * under test need.
+ */
+#pragma once
+
+#define CONFIG_DEVICE_LOCATION_NAME "synders"
+#define CONFIG_DEVICE_TYPE_NAME "weather"
+#define CONFIG_PUBLISH_INTERVAL_MS 10000
+#define CONFIG_SAMPLE_INTERVAL_MS 2000
+#define CONFIG_SENSOR_RAIN_BUCKET_ENABLE 1
+#define CONFIG_PULSE_FILTER_APB_CYCLES 1023
+#define CONFIG_SENSOR_FAIL_THRESHOLD 3
+#define CONFIG_SENSOR_BACKOFF_MIN_MS 10000
+#define CONFIG_SENSOR_BACKOFF_MAX_MS 600000
+#define CONFIG_SUPERVISOR_BACKOFF_MIN_MS 2000
+#define CONFIG_SUPERVISOR_BACKOFF_MAX_MS 300000
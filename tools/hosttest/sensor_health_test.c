@@ -0,0 +1,131 @@
+/**
+ * @file sensor_health_test.c
+ * @brief Recovery of a failed sensor that takes several cycles to boot
+ *
+ * Replays the acquisition cycle of sensors.c driver_start() and driver_collect() against a
+ * simulated device that fails, is re-initialised and then reports that it is still starting up
+ * for a few cycles, as the rain sensor does after its reset. The device must be re-initialised
+ * exactly once per recovery, however long it takes to come up.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+#include "sensor_health.h"
+#include "check.h"
+
+#define CYCLE_US (2000000LL)
+
+typedef enum {
+    START_OK,
+    START_NOT_READY,
+    START_FAILED,
+} start_result_t;
+
+/**
+ * @brief Simulated device: broken until fixed_at, then starting up for boot_cycles after each init
+ */
+static struct {
+    int64_t fixed_at_us;
+    int boot_cycles;
+    int booting;                        /*!< Cycles left until the device answers */
+    uint32_t inits;
+    uint32_t attempts;                  /*!< Cycles that took the device out of FAILED */
+} device;
+
+static void device_init(void)
+{
+    device.inits++;
+    device.booting = device.boot_cycles;
+}
+
+static start_result_t device_start(int64_t now)
+{
+    if (device.booting > 0)
+    {
+        device.booting--;
+        return START_NOT_READY;
+    }
+    return now >= device.fixed_at_us ? START_OK : START_FAILED;
+}
+
+/* One acquisition cycle, as driver_start() and driver_collect() run it */
+static void cycle(sensor_health_t *health, int64_t now)
+{
+    start_result_t result;
+    bool failed = health->state == SENSOR_HEALTH_FAILED;
+
+    if (!sensor_health_poll(health, now))
+    {
+        return;
+    }
+    if (failed)
+    {
+        device.attempts++;
+    }
+    if (health->state == SENSOR_HEALTH_RECOVERING)
+    {
+        device_init();
+        sensor_health_started(health);
+    }
+    result = device_start(now);
+    if (result != START_NOT_READY)
+    {
+        sensor_health_update(health, result == START_OK, now);
+    }
+}
+
+static void run(int boot_cycles, int64_t broken_us)
+{
+    sensor_health_t health;
+    int64_t now = 0;
+
+    device.boot_cycles = boot_cycles;
+    device.booting = 0;
+    device.inits = 0;
+    device.attempts = 0;
+    device.fixed_at_us = broken_us;
+    sensor_health_init(&health, "test", true, now);
+
+    // Fails from the start; every re-init attempt is one recovery
+    for (; now < broken_us + 3600 * 1000000LL; now += CYCLE_US)
+    {
+        cycle(&health, now);
+    }
+    CHECK(health.state == SENSOR_HEALTH_OK, "boot %d cycles: ended %s", boot_cycles,
+          sensor_health_state_name(health.state));
+    CHECK(health.recoveries == 1, "boot %d cycles: %u recoveries", boot_cycles, health.recoveries);
+    CHECK(device.inits == device.attempts, "boot %d cycles: %u inits for %u recovery attempts", boot_cycles,
+          device.inits, device.attempts);
+    CHECK(health.backoff_ms == CONFIG_SENSOR_BACKOFF_MIN_MS, "boot %d cycles: backoff not reset", boot_cycles);
+    printf("device booting for %d cycles, broken for %llds: %u recovery attempts, %u re-inits\n", boot_cycles,
+           (long long)(broken_us / 1000000), device.attempts, device.inits);
+}
+
+int main(void)
+{
+    for (int boot = 0; boot <= 4; boot++)
+    {
+        run(boot, 15 * 60 * 1000000LL);
+    }
+
+    // A STARTING device that then fails goes back to FAILED with the backoff doubled
+    {
+        sensor_health_t health;
+        sensor_health_init(&health, "test", false, 0);
+        CHECK(sensor_health_poll(&health, CONFIG_SENSOR_BACKOFF_MIN_MS * 1000LL) &&
+              health.state == SENSOR_HEALTH_RECOVERING, "backoff expiry does not recover");
+        sensor_health_started(&health);
+        CHECK(health.state == SENSOR_HEALTH_STARTING, "started is %s", sensor_health_state_name(health.state));
+        CHECK(sensor_health_poll(&health, CONFIG_SENSOR_BACKOFF_MIN_MS * 1000LL) &&
+              health.state == SENSOR_HEALTH_STARTING, "a STARTING device is polled back into recovery");
+        sensor_health_update(&health, false, CONFIG_SENSOR_BACKOFF_MIN_MS * 1000LL);
+        CHECK(health.state == SENSOR_HEALTH_FAILED && health.backoff_ms == 2 * CONFIG_SENSOR_BACKOFF_MIN_MS,
+              "failed start: %s, backoff %u", sensor_health_state_name(health.state), health.backoff_ms);
+        // started() only moves a RECOVERING sensor
+        sensor_health_started(&health);
+        CHECK(health.state == SENSOR_HEALTH_FAILED, "started() moved a FAILED sensor");
+    }
+    return CHECK_DONE();
+}
@@ -0,0 +1,108 @@
+/**
+ * @file sensor_stats_test.c
+ * @brief Welford window statistics against a two-pass reference
+ *
+ * Each sequence is fed to sensor_stat_add() and compared with the mean and variance computed in
+ * two passes in long double over the same float samples. The sequences are the cases that break
+ * a naive sum of squares: a small spread on a large offset (pressure in Pa), long windows, and a
+ * constant signal. The error of the naive single pass sum of squares is reported alongside.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "sensor_stats.h"
+#include "check.h"
+
+typedef struct {
+    const char *name;
+    uint32_t count;
+    double offset;
+    double spread;
+    double drift;                       /*!< Added per sample, a slow trend over the window */
+} sequence_t;
+
+static const sequence_t sequences[] = {
+    { "single sample", 1, 21.5, 0.0, 0.0 },
+    { "two samples", 2, 21.5, 0.5, 0.0 },
+    { "temperature, 5 samples", 5, 12.5, 0.4, 0.0 },
+    { "constant pressure", 100000, 101325.0, 0.0, 0.0 },
+    { "pressure, 0.1 Pa noise", 100000, 101325.0, 0.1, 0.0 },
+    { "pressure, 1e6 samples", 1000000, 101325.0, 2.0, 0.0 },
+    { "light, 1e7 samples with drift", 10000000, 50000.0, 50.0, 1e-3 },
+    { "large offset, tiny spread", 100000, 1e6, 0.05, 0.0 },
+};
+
+static float sample(const sequence_t *seq, uint32_t i)
+{
+    float noise = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+    return (float)(seq->offset + seq->drift * i + noise * seq->spread);
+}
+
+static double relative(double got, double expect)
+{
+    if (expect == 0.0)
+    {
+        return fabs(got);
+    }
+    return fabs(got - expect) / fabs(expect);
+}
+
+static void run(const sequence_t *seq)
+{
+    float *samples = malloc(seq->count * sizeof(float));
+    long double sum = 0, squares = 0;
+    long double mean, variance = 0;
+    double naive_sum = 0, naive_squares = 0, naive_variance = 0;
+    double welford_variance;
+    sensor_stat_t stat;
+    float min = INFINITY, max = -INFINITY;
+
+    srand(seq->count);
+    sensor_stat_reset(&stat);
+    for (uint32_t i = 0; i < seq->count; i++)
+    {
+        samples[i] = sample(seq, i);
+        sensor_stat_add(&stat, samples[i]);
+        sum += samples[i];
+        naive_sum += samples[i];
+        naive_squares += (double)samples[i] * samples[i];
+        min = fminf(min, samples[i]);
+        max = fmaxf(max, samples[i]);
+    }
+    mean = sum / seq->count;
+    for (uint32_t i = 0; i < seq->count; i++)
+    {
+        squares += (samples[i] - mean) * (samples[i] - mean);
+    }
+    if (seq->count > 1)
+    {
+        variance = squares / (seq->count - 1);
+        naive_variance = (naive_squares - naive_sum * naive_sum / seq->count) / (seq->count - 1);
+    }
+    welford_variance = seq->count > 1 ? stat.m2 / (seq->count - 1) : 0.0;
+
+    CHECK(stat.count == seq->count, "%s: count %u", seq->name, stat.count);
+    CHECK(stat.min == min && stat.max == max, "%s: min %f max %f, expected %f %f", seq->name, stat.min, stat.max,
+          min, max);
+    CHECK(relative(stat.mean, mean) < 1e-12, "%s: mean %.12f, expected %.12Lf", seq->name, stat.mean, mean);
+    // A constant signal must give exactly 0, anything else to within the precision of the float samples
+    CHECK(variance == 0 ? welford_variance == 0 : relative(welford_variance, variance) < 1e-7,
+          "%s: variance %.12g, expected %.12Lg", seq->name, welford_variance, variance);
+    CHECK(relative(sensor_stat_stddev(&stat), sqrtl(variance)) < 1e-6, "%s: sd %.9g, expected %.9Lg", seq->name,
+          sensor_stat_stddev(&stat), sqrtl(variance));
+    printf("%-32s %9u %14.6Lg %12.3g %12.3g\n", seq->name, seq->count, variance, relative(welford_variance, variance),
+           relative(naive_variance, variance));
+    free(samples);
+}
+
+int main(void)
+{
+    printf("%-32s %9s %14s %12s %12s\n", "sequence", "samples", "variance", "Welford err", "naive err");
+    for (size_t i = 0; i < sizeof(sequences) / sizeof(sequences[0]); i++)
+    {
+        run(&sequences[i]);
+    }
+    return CHECK_DONE();
+}
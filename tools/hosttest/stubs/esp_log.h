@@ -0,0 +1,22 @@
+/*
+ * Host stand-in for the ESP-IDF log macros. Logs go to stdout when HOSTTEST_LOG is defined and
+ * are dropped otherwise, so test output stays readable. Like the real header it pulls in
+ * sdkconfig.h, which some modules rely on.
+ */
+#pragma once
+
+#include <stdio.h>
+
+#include "sdkconfig.h"
+
+#ifdef HOSTTEST_LOG
+#define HOSTTEST_LOG_PRINT(level, tag, format, ...) printf(level " (%s) " format "\n", tag, ##__VA_ARGS__)
+#else
+#define HOSTTEST_LOG_PRINT(level, tag, format, ...) do { (void)(tag); } while (0)
+#endif
+
+#define ESP_LOGE(tag, format, ...) HOSTTEST_LOG_PRINT("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) HOSTTEST_LOG_PRINT("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) HOSTTEST_LOG_PRINT("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) HOSTTEST_LOG_PRINT("D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) HOSTTEST_LOG_PRINT("V", tag, format, ##__VA_ARGS__)
@@ -0,0 +1,16 @@
+/*
+ * Host stand-in for the FreeRTOS port macros the modules under test use. The tests are single
+ * threaded: critical sections are no-ops and interrupts are called by the test itself.
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef int portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED (0)
+#define portENTER_CRITICAL(mux) do { (void)(mux); } while (0)
+#define portEXIT_CRITICAL(mux) do { (void)(mux); } while (0)
+#define portENTER_CRITICAL_ISR(mux) do { (void)(mux); } while (0)
+#define portEXIT_CRITICAL_ISR(mux) do { (void)(mux); } while (0)
+#define IRAM_ATTR
@@ -0,0 +1,173 @@
+/**
+ * @file supervisor_test.c
+ * @brief Fault injection through the subsystem supervisor
+ *
+ * A simulated clock drives each subsystem the way its owning task does: check whether a restart
+ * is due, try it, and report the outcome. Faults are injected on a schedule: restarts that keep
+ * failing, a subsystem that falls over again right after coming back, and one that stays up for
+ * a while before its next fault. The restart times are checked against the backoff the
+ * supervisor promises, doubling from CONFIG_SUPERVISOR_BACKOFF_MIN_MS up to
+ * CONFIG_SUPERVISOR_BACKOFF_MAX_MS and starting over after a stable period, and the counters of
+ * each subsystem are checked to move on their own.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+#include "supervisor.h"
+#include "check.h"
+
+#define MS (1000LL)
+#define MIN_MS ((int64_t)CONFIG_SUPERVISOR_BACKOFF_MIN_MS)
+#define MAX_MS ((int64_t)CONFIG_SUPERVISOR_BACKOFF_MAX_MS)
+// The owning tasks poll about this often
+#define POLL_MS (10)
+
+static int64_t now;
+
+static int64_t expected_backoff(int failures)
+{
+    int64_t backoff = MIN_MS;
+
+    while (--failures > 0 && backoff < MAX_MS)
+    {
+        backoff *= 2;
+    }
+    return backoff < MAX_MS ? backoff : MAX_MS;
+}
+
+/**
+ * @brief Poll a failed subsystem until its restart is due
+ *
+ * @return time the restart was let through
+ */
+static int64_t wait_restart(supervisor_subsystem_t sub)
+{
+    const supervisor_status_t *st = supervisor_status(sub);
+    uint32_t restarts = st->restarts;
+
+    for (;;)
+    {
+        uint32_t wait = supervisor_wait_ms(sub, now);
+
+        if (supervisor_restart_due(sub, now))
+        {
+            CHECK(wait == 0, "%s: restart due with %ums left", st->name, wait);
+            CHECK(st->restarts == restarts + 1, "%s: restart attempt not counted", st->name);
+            return now;
+        }
+        CHECK(wait > 0 && st->restarts == restarts, "%s: restart held off with %ums left", st->name, wait);
+        now += POLL_MS * MS;
+    }
+}
+
+/* Restarts that keep failing: the wait doubles up to the cap and stays there */
+static void failing_restarts(supervisor_subsystem_t sub)
+{
+    const supervisor_status_t *st = supervisor_status(sub);
+    int64_t fault_at;
+
+    supervisor_up(sub, now);
+    now += 1000 * MS;
+    supervisor_fault(sub, "injected fault", now);
+    for (int failures = 1; failures <= 16; failures++)
+    {
+        int64_t due;
+
+        fault_at = now;
+        CHECK(st->backoff_ms == expected_backoff(failures), "%s: backoff %ums after %d failures, expected %lldms",
+              st->name, st->backoff_ms, failures, (long long)expected_backoff(failures));
+        due = wait_restart(sub);
+        CHECK(due >= fault_at + expected_backoff(failures) * MS && due < fault_at + (expected_backoff(failures) + POLL_MS) * MS,
+              "%s: restart %d after %lldms, expected %lldms", st->name, failures, (long long)((due - fault_at) / MS),
+              (long long)expected_backoff(failures));
+        supervisor_fault(sub, "restart failed", now);
+    }
+    CHECK(st->backoff_ms == MAX_MS, "%s: backoff %ums not capped at %lldms", st->name, st->backoff_ms,
+          (long long)MAX_MS);
+    CHECK(st->faults == 17 && st->restarts == 16, "%s: %u faults %u restarts, expected 17 and 16", st->name,
+          st->faults, st->restarts);
+
+    // Back up, and stable for the whole cap: the next fault starts over from the minimum
+    wait_restart(sub);
+    supervisor_up(sub, now);
+    CHECK(st->up && supervisor_wait_ms(sub, now) == 0 && !supervisor_restart_due(sub, now), "%s: not up", st->name);
+    now += MAX_MS * MS;
+    supervisor_fault(sub, "injected fault", now);
+    CHECK(st->backoff_ms == MIN_MS, "%s: backoff %ums after a stable period, expected %lldms", st->name,
+          st->backoff_ms, (long long)MIN_MS);
+    wait_restart(sub);
+    supervisor_up(sub, now);
+}
+
+/* Restarts that succeed, but the subsystem falls over again before it has been up for the cap */
+static void flapping(supervisor_subsystem_t sub)
+{
+    const supervisor_status_t *st = supervisor_status(sub);
+    uint32_t faults = st->faults;
+
+    // The fault before this one is the first of the run, so the first flap is its second
+    for (int failures = 2; failures <= 13; failures++)
+    {
+        // Up for just short of a stable period
+        now += (MAX_MS - 1) * MS;
+        supervisor_fault(sub, "fell over again", now);
+        CHECK(st->backoff_ms == expected_backoff(failures), "%s: backoff %ums after %d faults, expected %lldms",
+              st->name, st->backoff_ms, failures, (long long)expected_backoff(failures));
+        wait_restart(sub);
+        supervisor_up(sub, now);
+    }
+    CHECK(st->faults == faults + 12, "%s: %u faults, expected %u", st->name, st->faults, faults + 12);
+
+    // Up for exactly the cap counts as stable
+    now += MAX_MS * MS;
+    supervisor_fault(sub, "injected fault", now);
+    CHECK(st->backoff_ms == MIN_MS, "%s: backoff %ums after exactly %lldms up, expected %lldms", st->name,
+          st->backoff_ms, (long long)MAX_MS, (long long)MIN_MS);
+    CHECK(st->last_fault != NULL, "%s: no fault reason", st->name);
+    wait_restart(sub);
+    supervisor_up(sub, now);
+}
+
+int main(void)
+{
+    supervisor_status_t before[SUPERVISOR_COUNT];
+
+    for (int sub = 0; sub < SUPERVISOR_COUNT; sub++)
+    {
+        const supervisor_status_t *st = supervisor_status(sub);
+
+        CHECK(st->name != NULL && st->faults == 0 && st->restarts == 0 && st->last_fault == NULL,
+              "subsystem %d not clear at boot", sub);
+        supervisor_up(sub, now);
+    }
+
+    // Faults in one subsystem leave the counters and the state of the others alone
+    for (int sub = 0; sub < SUPERVISOR_COUNT; sub++)
+    {
+        for (int other = 0; other < SUPERVISOR_COUNT; other++)
+        {
+            before[other] = *supervisor_status(other);
+        }
+        failing_restarts(sub);
+        flapping(sub);
+        for (int other = 0; other < SUPERVISOR_COUNT; other++)
+        {
+            const supervisor_status_t *st = supervisor_status(other);
+
+            if (other == sub)
+            {
+                CHECK(st->up && st->faults == 31 && st->restarts == 31, "%s: %u faults %u restarts, expected 31 and 31",
+                      st->name, st->faults, st->restarts);
+                continue;
+            }
+            CHECK(st->up == before[other].up && st->faults == before[other].faults &&
+                  st->restarts == before[other].restarts && st->backoff_ms == before[other].backoff_ms,
+                  "%s changed by faults in %s", st->name, supervisor_status(sub)->name);
+        }
+        printf("%-6s %u faults, %u restarts, last fault \"%s\"\n", supervisor_status(sub)->name,
+               supervisor_status(sub)->faults, supervisor_status(sub)->restarts, supervisor_status(sub)->last_fault);
+    }
+    return CHECK_DONE();
+}
@@ -0,0 +1,367 @@
+/**
+ * @file telemetry_test.c
+ * @brief Round trip of the binary telemetry encoding against the JSON encoding
+ *
+ * Windows are encoded in binary and decoded again, and every field is checked against the window
+ * to the fixed point resolution of its channel. The JSON encoding of the same window is checked
+ * to carry the same readings to its own precision, so the two formats never disagree on a value.
+ * Covers stale channels, readings that are not finite and the schema version, then reports the
+ * size of each encoding and the time to encode a window.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "telemetry.h"
+#include "pressure_trend.h"
+#include "check.h"
+
+#define BUF_SIZE (2048)
+#define TIMING_LOOPS (200000)
+
+/* Channels in the JSON payload and their decimals, as in telemetry.c */
+static const struct {
+    sensor_channel_t ch;
+    int decimals;
+} json_channels[] = {
+    { SENSOR_CH_TEMPERATURE, 1 },
+    { SENSOR_CH_HUMIDITY, 1 },
+    { SENSOR_CH_RAINMM, 1 },
+    { SENSOR_CH_GROUNDTEMPERATURE, 1 },
+    { SENSOR_CH_GROUNDMOISTURE, 0 },
+    { SENSOR_CH_PRESSURE, 2 },
+    { SENSOR_CH_BUCKETRAINMM, 2 },
+    { SENSOR_CH_WINDSPEED, 1 },
+};
+
+/* Typical reading and spread of each channel */
+static const float channel_base[SENSOR_CH_COUNT][2] = {
+    [SENSOR_CH_TEMPERATURE]       = { 12.5f, 0.4f },
+    [SENSOR_CH_HUMIDITY]          = { 71.0f, 2.0f },
+    [SENSOR_CH_PRESSURE]          = { 101325.0f, 15.0f },
+    [SENSOR_CH_GROUNDTEMPERATURE] = { 9.8f, 0.1f },
+    [SENSOR_CH_GROUNDMOISTURE]    = { 512.0f, 4.0f },
+    [SENSOR_CH_GROUNDVOLTAGE]     = { 1650.0f, 10.0f },
+    [SENSOR_CH_RAINMM]            = { 0.25f, 0.25f },
+    [SENSOR_CH_UVLEVEL]           = { 3.0f, 1.0f },
+    [SENSOR_CH_LIGHTLEVEL]        = { 23000.0f, 500.0f },
+    [SENSOR_CH_BUCKETRAINMM]      = { 0.28f, 0.28f },
+    [SENSOR_CH_WINDSPEED]         = { 4.2f, 1.5f },
+};
+
+static void make_window(sensor_window_t *window, uint32_t valid, uint32_t samples, unsigned seed)
+{
+    memset(window, 0, sizeof(sensor_window_t));
+    srand(seed);
+    window->seq = 1000 + seed;
+    window->samples = samples;
+    window->valid = valid;
+    window->unix_time = true;
+    window->first_us = 1767225600000000LL + seed * 10000000LL;
+    window->last_us = window->first_us + (samples - 1) * 2000000LL;
+    window->enqueued_us = window->last_us + 1500;
+    window->sent_us = window->enqueued_us + 250000;
+    window->tendency = 2;
+    window->pressure_change = 180.0f;
+    window->forecast = 'B';
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        sensor_stat_reset(&window->stats[ch]);
+        if (!(valid & SENSOR_CH_BIT(ch)))
+        {
+            window->age[ch] = 30 + ch;
+            continue;
+        }
+        for (uint32_t i = 0; i < samples; i++)
+        {
+            float noise = (float)rand() / RAND_MAX * 2.0f - 1.0f;
+            sensor_stat_add(&window->stats[ch], channel_base[ch][0] + noise * channel_base[ch][1]);
+        }
+    }
+}
+
+static bool near(double a, double b, double tolerance)
+{
+    return fabs(a - b) <= tolerance;
+}
+
+/* Encode in binary, decode and compare with the window */
+static int check_binary(const char *name, const sensor_window_t *window, uint32_t expect_valid)
+{
+    uint8_t buf[BUF_SIZE];
+    sensor_window_t out;
+    int len = telemetry_encode_binary(window, buf, sizeof(buf));
+
+    CHECK(len > 0, "%s: binary encode failed", name);
+    if (len <= 0)
+    {
+        return len;
+    }
+    CHECK(buf[0] == TELEMETRY_SCHEMA_VERSION, "%s: schema byte %u", name, buf[0]);
+    CHECK(telemetry_decode_binary(buf, len, &out) == len, "%s: decode did not consume the message", name);
+    CHECK(out.seq == window->seq && out.samples == window->samples, "%s: seq or samples", name);
+    CHECK(out.valid == expect_valid, "%s: valid 0x%x, expected 0x%x", name, out.valid, expect_valid);
+    CHECK(out.unix_time == window->unix_time, "%s: clock", name);
+    CHECK(out.first_us == window->first_us && out.last_us == window->last_us &&
+          out.enqueued_us == window->enqueued_us && out.sent_us == window->sent_us, "%s: times", name);
+    CHECK(out.tendency == window->tendency, "%s: tendency %d", name, out.tendency);
+    CHECK(out.forecast == window->forecast, "%s: forecast %d", name, out.forecast);
+    if (isfinite(window->pressure_change))
+    {
+        CHECK(near(out.pressure_change, window->pressure_change, 0.5 / telemetry_channel_scale(SENSOR_CH_PRESSURE)),
+              "%s: pressure change %f", name, out.pressure_change);
+    }
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        const sensor_stat_t *in = &window->stats[ch];
+        const sensor_stat_t *got = &out.stats[ch];
+        // Half a step of the fixed point scale, plus the float rounding of large readings
+        double step = 1.0 / telemetry_channel_scale(ch);
+        double tolerance = step / 2 + fabs(in->mean) * 1e-6;
+
+        if (!(expect_valid & SENSOR_CH_BIT(ch)))
+        {
+            CHECK(out.age[ch] == window->age[ch], "%s: %s age %u", name, telemetry_channel_name(ch), out.age[ch]);
+            continue;
+        }
+        CHECK(got->count == in->count, "%s: %s count", name, telemetry_channel_name(ch));
+        CHECK(near(got->mean, in->mean, tolerance), "%s: %s mean %f, expected %f", name,
+              telemetry_channel_name(ch), got->mean, in->mean);
+        // min and max are sent relative to the rounded mean, so they may be off by a step
+        CHECK(near(got->min, in->min, tolerance + step), "%s: %s min %f, expected %f", name,
+              telemetry_channel_name(ch), got->min, in->min);
+        CHECK(near(got->max, in->max, tolerance + step), "%s: %s max %f, expected %f", name,
+              telemetry_channel_name(ch), got->max, in->max);
+        CHECK(near(sensor_stat_stddev(got), sensor_stat_stddev(in), tolerance), "%s: %s sd %f, expected %f", name,
+              telemetry_channel_name(ch), sensor_stat_stddev(got), sensor_stat_stddev(in));
+    }
+    return len;
+}
+
+/* The JSON of a window carries the same readings as its binary encoding */
+static int check_json(const char *name, const sensor_window_t *window, uint32_t expect_valid)
+{
+    char json[BUF_SIZE];
+    char key[48];
+    const char *p;
+    int len = telemetry_encode_json(window, "test-station", json, sizeof(json));
+
+    CHECK(len > 0, "%s: JSON encode failed", name);
+    if (len <= 0)
+    {
+        return len;
+    }
+    CHECK(strstr(json, "nan") == NULL && strstr(json, "inf") == NULL, "%s: not JSON: %s", name, json);
+    p = strstr(json, "\"valid\": ");
+    CHECK(p != NULL && strtoul(p + 9, NULL, 10) == expect_valid, "%s: JSON valid mask", name);
+    for (size_t i = 0; i < sizeof(json_channels) / sizeof(json_channels[0]); i++)
+    {
+        sensor_channel_t ch = json_channels[i].ch;
+
+        snprintf(key, sizeof(key), "\"%s\": ", telemetry_channel_name(ch));
+        p = strstr(json, key);
+        CHECK(p != NULL, "%s: %s missing from JSON", name, telemetry_channel_name(ch));
+        if (p == NULL)
+        {
+            continue;
+        }
+        p += strlen(key);
+        if (!(expect_valid & SENSOR_CH_BIT(ch)))
+        {
+            CHECK(strncmp(p, "null", 4) == 0, "%s: stale %s is not null", name, telemetry_channel_name(ch));
+        }
+        else
+        {
+            double tolerance = 0.5 * pow(10, -json_channels[i].decimals) + fabs(window->stats[ch].mean) * 1e-6;
+            CHECK(near(strtod(p, NULL), window->stats[ch].mean, tolerance), "%s: JSON %s %s, expected %f", name,
+                  telemetry_channel_name(ch), p, window->stats[ch].mean);
+        }
+    }
+    return len;
+}
+
+/* Every reading at the far end of its fixed point range, and the longest times and counters */
+static void make_worst_window(sensor_window_t *window, uint32_t valid)
+{
+    memset(window, 0, sizeof(sensor_window_t));
+    window->seq = UINT32_MAX;
+    window->samples = UINT32_MAX;
+    window->valid = valid;
+    window->first_us = INT64_MIN;
+    window->last_us = INT64_MIN;
+    window->enqueued_us = INT64_MIN;
+    window->sent_us = INT64_MIN;
+    window->unix_time = false;
+    window->tendency = 8;
+    window->pressure_change = -1e30f;
+    window->forecast = 'Z';
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        window->age[ch] = UINT32_MAX;
+        window->stats[ch].count = UINT32_MAX;
+        window->stats[ch].mean = -1e30;
+        window->stats[ch].min = -1e30f;
+        window->stats[ch].max = -1e30f;
+        window->stats[ch].m2 = 1e60;
+    }
+}
+
+static double encode_ns(const sensor_window_t *window, bool binary)
+{
+    static uint8_t buf[BUF_SIZE];
+    volatile int sink = 0;
+    struct timespec t0, t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < TIMING_LOOPS; i++)
+    {
+        sink += binary ? telemetry_encode_binary(window, buf, sizeof(buf)) :
+                telemetry_encode_json(window, "test-station", (char *)buf, sizeof(buf));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    (void)sink;
+    return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / TIMING_LOOPS;
+}
+
+int main(void)
+{
+    const uint32_t all = (1 << SENSOR_CH_COUNT) - 1;
+    sensor_window_t window;
+    uint8_t buf[BUF_SIZE];
+    int len;
+
+    make_window(&window, all, 5, 1);
+    check_binary("all valid", &window, all);
+    check_json("all valid", &window, all);
+
+    make_window(&window, 0, 5, 2);
+    window.tendency = PRESSURE_TENDENCY_UNKNOWN;
+    window.forecast = 0;
+    window.unix_time = false;
+    check_binary("none valid", &window, 0);
+    check_json("none valid", &window, 0);
+
+    make_window(&window, 0x555, 1, 3);
+    check_binary("alternate channels, one sample", &window, 0x555);
+    check_json("alternate channels, one sample", &window, 0x555);
+
+    // A NaN reading reported as good poisons the mean; both encodings send the channel as stale
+    make_window(&window, all, 5, 4);
+    sensor_stat_add(&window.stats[SENSOR_CH_PRESSURE], NAN);
+    window.age[SENSOR_CH_PRESSURE] = 0;
+    sensor_stat_add(&window.stats[SENSOR_CH_WINDSPEED], INFINITY);
+    window.age[SENSOR_CH_WINDSPEED] = 0;
+    window.pressure_change = NAN;
+    {
+        uint32_t expect = all & ~(SENSOR_CH_BIT(SENSOR_CH_PRESSURE) | SENSOR_CH_BIT(SENSOR_CH_WINDSPEED));
+        check_binary("NaN and infinite readings", &window, expect);
+        check_json("NaN and infinite readings", &window, expect);
+    }
+
+    // Readings past the fixed point range at both ends: min and max go out clamped to the range
+    for (int side = -1; side <= 1; side++)
+    {
+        sensor_window_t out;
+
+        make_window(&window, all, 5, 6);
+        for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+        {
+            window.stats[ch].mean = side * 1e30;
+            window.stats[ch].min = -1e30f;
+            window.stats[ch].max = 1e30f;
+        }
+        len = telemetry_encode_binary(&window, buf, sizeof(buf));
+        CHECK(len > 0 && telemetry_decode_binary(buf, len, &out) == len, "extreme window, mean side %d", side);
+        for (int ch = 0; len > 0 && ch < SENSOR_CH_COUNT; ch++)
+        {
+            double limit = (double)INT32_MAX / telemetry_channel_scale(ch);
+
+            CHECK(out.stats[ch].min <= out.stats[ch].mean && out.stats[ch].mean <= out.stats[ch].max,
+                  "extreme window, mean side %d: %s min %g mean %g max %g out of order", side,
+                  telemetry_channel_name(ch), out.stats[ch].min, out.stats[ch].mean, out.stats[ch].max);
+            // The end on the mean's side is reached, the other is cut short by the clamped delta
+            CHECK(out.stats[ch].min >= -limit * 1.0001 && out.stats[ch].max <= limit * 1.0001 &&
+                  (side > 0 || out.stats[ch].min <= -limit * 0.9999) &&
+                  (side < 0 || out.stats[ch].max >= limit * 0.9999),
+                  "extreme window, mean side %d: %s min %g max %g, expected the ends of +-%g", side,
+                  telemetry_channel_name(ch), out.stats[ch].min, out.stats[ch].max, limit);
+        }
+    }
+
+    // Another schema version, and every truncation, are rejected
+    make_window(&window, all, 5, 5);
+    len = telemetry_encode_binary(&window, buf, sizeof(buf));
+    for (int version = 0; version < 256; version++)
+    {
+        sensor_window_t out;
+        buf[0] = version;
+        CHECK((telemetry_decode_binary(buf, len, &out) < 0) == (version != TELEMETRY_SCHEMA_VERSION),
+              "schema version %d", version);
+    }
+    buf[0] = TELEMETRY_SCHEMA_VERSION;
+    for (int cut = 0; cut < len; cut++)
+    {
+        sensor_window_t out;
+        CHECK(telemetry_decode_binary(buf, cut, &out) < 0, "message cut to %d of %d bytes decoded", cut, len);
+        CHECK(telemetry_encode_binary(&window, buf, cut) < 0, "binary encode into %d of %d bytes", cut, len);
+    }
+
+    // No window, whatever its readings, is longer than the JSON payload is sized for
+    {
+        static char json[4 * BUF_SIZE];
+        char id[TELEMETRY_ID_MAX + 1];
+        int longest = 0;
+
+        memset(id, 'x', TELEMETRY_ID_MAX);
+        id[TELEMETRY_ID_MAX] = 0;
+        for (uint32_t valid = 0; valid < (1 << SENSOR_CH_COUNT); valid++)
+        {
+            make_worst_window(&window, valid);
+            len = telemetry_encode_json(&window, id, json, sizeof(json));
+            CHECK(len > 0 && len < (int)TELEMETRY_JSON_MAX, "worst case JSON with valid 0x%x is %d bytes, over %d",
+                  valid, len, (int)TELEMETRY_JSON_MAX);
+            longest = len > longest ? len : longest;
+        }
+        printf("Longest JSON window %d bytes, TELEMETRY_JSON_MAX %d\n", longest, (int)TELEMETRY_JSON_MAX);
+    }
+
+    // Nor than the binary payload is sized for
+    {
+        uint8_t bin[BUF_SIZE];
+        int longest = 0;
+
+        for (uint32_t valid = 0; valid < (1 << SENSOR_CH_COUNT); valid++)
+        {
+            make_worst_window(&window, valid);
+            len = telemetry_encode_binary(&window, bin, sizeof(bin));
+            CHECK(len > 0 && len <= (int)TELEMETRY_BINARY_MAX, "worst case binary with valid 0x%x is %d bytes, over %d",
+                  valid, len, (int)TELEMETRY_BINARY_MAX);
+            longest = len > longest ? len : longest;
+        }
+        printf("Longest binary window %d bytes, TELEMETRY_BINARY_MAX %d\n", longest, (int)TELEMETRY_BINARY_MAX);
+    }
+
+    printf("%-32s %8s %8s %12s %12s\n", "window", "binary", "JSON", "binary ns", "JSON ns");
+    {
+        static const struct {
+            const char *name;
+            uint32_t valid;
+        } cases[] = {
+            { "no channel valid", 0 },
+            { "BME280 and ground probe", 0x1f },
+            { "all channels valid", (1 << SENSOR_CH_COUNT) - 1 },
+        };
+        for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+        {
+            char json[BUF_SIZE];
+            make_window(&window, cases[i].valid, 5, 10 + i);
+            printf("%-32s %8d %8d %12.0f %12.0f\n", cases[i].name, telemetry_encode_binary(&window, buf, sizeof(buf)),
+                   telemetry_encode_json(&window, "test-station", json, sizeof(json)), encode_ns(&window, true),
+                   encode_ns(&window, false));
+        }
+    }
+    return CHECK_DONE();
+}
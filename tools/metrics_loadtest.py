@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+"""Load test for the station's local metrics endpoint.
+
+Hammers /metrics (or /sensors) from several concurrent keep-alive clients and
+reports requests per second and latency percentiles.
+
+    tools/metrics_loadtest.py 192.168.1.50 --path /metrics --clients 4 --seconds 10
+"""
+import argparse
+import http.client
+import threading
+import time
+
+
+def worker(host, port, path, deadline, latencies, errors, lock):
+    conn = None
+    local = []
+    failed = 0
+    while time.monotonic() < deadline:
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(host, port, timeout=5)
+            start = time.perf_counter()
+            conn.request("GET", path)
+            resp = conn.getresponse()
+            resp.read()
+            elapsed = time.perf_counter() - start
+            if resp.status == 200:
+                local.append(elapsed)
+            else:
+                failed += 1
+        except (OSError, http.client.HTTPException):
+            failed += 1
+            if conn is not None:
+                conn.close()
+            conn = None
+    if conn is not None:
+        conn.close()
+    with lock:
+        latencies.extend(local)
+        errors[0] += failed
+
+
+def percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0.0
+    index = min(len(sorted_values) - 1, int(round(pct / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("host", help="station address")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--path", default="/metrics", help="/metrics or /sensors")
+    parser.add_argument("--clients", type=int, default=4, help="concurrent connections")
+    parser.add_argument("--seconds", type=float, default=10.0, help="test duration")
+    args = parser.parse_args()
+
+    latencies = []
+    errors = [0]
+    lock = threading.Lock()
+    deadline = time.monotonic() + args.seconds
+    threads = [threading.Thread(target=worker, args=(args.host, args.port, args.path, deadline, latencies, errors, lock))
+               for _ in range(args.clients)]
+    started = time.monotonic()
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+    duration = time.monotonic() - started
+
+    latencies.sort()
+    print("requests   %d ok, %d failed in %.1fs" % (len(latencies), errors[0], duration))
+    print("throughput %.1f requests/s" % (len(latencies) / duration))
+    for pct in (50, 90, 99):
+        print("p%-9d %.1fms" % (pct, percentile(latencies, pct) * 1000.0))
+    if latencies:
+        print("max        %.1fms" % (latencies[-1] * 1000.0))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,315 @@
+/**
+ * @file httpd_host.c
+ * @brief Host stand-in for the parts of esp_http_server the metrics endpoint uses
+ *
+ * Like the ESP-IDF server, one thread serves every connection from a poll loop and runs the URI
+ * handlers on it, connections are kept alive between requests, and at most max_open_sockets are
+ * open at a time: with lru_purge_enable the least recently used one is closed to make room for a
+ * new one, otherwise the new one is refused. Only GET requests without a body are understood.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <pthread.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "esp_log.h"
+#include "esp_http_server.h"
+
+static const char *TAG = "HTTPD";
+
+#define HTTPD_MAX_SOCKETS (16)
+#define HTTPD_MAX_HANDLERS (8)
+#define HTTPD_REQUEST_SIZE (1024)
+
+typedef struct {
+    int fd;                             /*!< -1 when the slot is free */
+    uint64_t last_used;                 /*!< Request counter at the last request, for the LRU purge */
+    size_t len;                         /*!< Bytes of the request received so far */
+    char buf[HTTPD_REQUEST_SIZE];
+} httpd_conn_t;
+
+typedef struct {
+    httpd_config_t config;
+    int listen_fd;
+    uint64_t requests;
+    size_t handlers;
+    httpd_uri_t handler[HTTPD_MAX_HANDLERS];
+    httpd_conn_t conn[HTTPD_MAX_SOCKETS];
+    pthread_t thread;
+} httpd_host_t;
+
+static httpd_host_t host;
+
+static void conn_close(httpd_conn_t *conn)
+{
+    close(conn->fd);
+    conn->fd = -1;
+    conn->len = 0;
+}
+
+static bool send_all(int fd, const char *buf, size_t len)
+{
+    while (len)
+    {
+        ssize_t sent = send(fd, buf, len, MSG_NOSIGNAL);
+
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (sent <= 0)
+        {
+            return false;
+        }
+        buf += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    r->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    r->type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    char header[256];
+    size_t len = buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)buf_len;
+    int header_len = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+                              r->status, r->type, len);
+
+    if (!send_all(r->fd, header, header_len) || !send_all(r->fd, buf, len))
+    {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_500(httpd_req_t *r)
+{
+    r->status = "500 Internal Server Error";
+    r->type = "text/html";
+    return httpd_resp_send(r, "Internal Server Error", HTTPD_RESP_USE_STRLEN);
+}
+
+static esp_err_t send_404(httpd_req_t *r)
+{
+    r->status = "404 Not Found";
+    r->type = "text/html";
+    return httpd_resp_send(r, "Not Found", HTTPD_RESP_USE_STRLEN);
+}
+
+/**
+ * @brief Serve the complete requests in the connection's buffer
+ *
+ * @return false if the connection is to be closed
+ */
+static bool conn_serve(httpd_conn_t *conn)
+{
+    char *end;
+
+    while ((end = memmem(conn->buf, conn->len, "\r\n\r\n", 4)) != NULL)
+    {
+        size_t request_len = end + 4 - conn->buf;
+        char method[8];
+        char uri[256];
+        httpd_req_t req = {
+            .handle = &host,
+            .method = HTTP_GET,
+            .uri = uri,
+            .fd = conn->fd,
+            .status = "200 OK",
+            .type = "text/html",
+        };
+        const httpd_uri_t *handler = NULL;
+        esp_err_t err;
+
+        *end = '\0';
+        if (sscanf(conn->buf, "%7s %255s HTTP/1.", method, uri) != 2 || strcmp(method, "GET") != 0)
+        {
+            return false;
+        }
+        for (size_t i = 0; i < host.handlers; i++)
+        {
+            if (strcmp(host.handler[i].uri, uri) == 0 && host.handler[i].method == HTTP_GET)
+            {
+                handler = &host.handler[i];
+            }
+        }
+        if (handler != NULL)
+        {
+            req.user_ctx = handler->user_ctx;
+            err = handler->handler(&req);
+        }
+        else
+        {
+            err = send_404(&req);
+        }
+        if (err != ESP_OK || strcasestr(conn->buf, "\r\nConnection: close") != NULL)
+        {
+            return false;
+        }
+        conn->last_used = ++host.requests;
+        conn->len -= request_len;
+        memmove(conn->buf, conn->buf + request_len, conn->len);
+    }
+    // A request that does not fit is not one the endpoint serves
+    return conn->len < sizeof(conn->buf);
+}
+
+static void accept_conn(void)
+{
+    int fd = accept(host.listen_fd, NULL, NULL);
+    int one = 1;
+    httpd_conn_t *slot = NULL;
+    httpd_conn_t *oldest = NULL;
+
+    if (fd < 0)
+    {
+        return;
+    }
+    for (int i = 0; i < host.config.max_open_sockets; i++)
+    {
+        if (host.conn[i].fd < 0)
+        {
+            slot = &host.conn[i];
+            break;
+        }
+        if (oldest == NULL || host.conn[i].last_used < oldest->last_used)
+        {
+            oldest = &host.conn[i];
+        }
+    }
+    if (slot == NULL && host.config.lru_purge_enable)
+    {
+        ESP_LOGW(TAG, "All %d sockets open, closing the least recently used", host.config.max_open_sockets);
+        conn_close(oldest);
+        slot = oldest;
+    }
+    if (slot == NULL)
+    {
+        close(fd);
+        return;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    slot->fd = fd;
+    slot->len = 0;
+    slot->last_used = ++host.requests;
+}
+
+static void *httpd_thread(void *arg)
+{
+    struct pollfd fds[HTTPD_MAX_SOCKETS + 1];
+
+    for (;;)
+    {
+        int count = host.config.max_open_sockets;
+
+        fds[0].fd = host.listen_fd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < count; i++)
+        {
+            fds[i + 1].fd = host.conn[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+        if (poll(fds, count + 1, -1) < 0)
+        {
+            continue;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            httpd_conn_t *conn = &host.conn[i];
+            ssize_t received;
+
+            if (conn->fd < 0 || fds[i + 1].fd != conn->fd || !(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                continue;
+            }
+            received = recv(conn->fd, conn->buf + conn->len, sizeof(conn->buf) - conn->len, 0);
+            if (received <= 0)
+            {
+                conn_close(conn);
+                continue;
+            }
+            conn->len += received;
+            if (!conn_serve(conn))
+            {
+                conn_close(conn);
+            }
+        }
+        if (fds[0].revents & POLLIN)
+        {
+            accept_conn();
+        }
+    }
+    return arg;
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(config->server_port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    int one = 1;
+
+    if (config->max_open_sockets > HTTPD_MAX_SOCKETS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    host.config = *config;
+    for (int i = 0; i < HTTPD_MAX_SOCKETS; i++)
+    {
+        host.conn[i].fd = -1;
+    }
+    host.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (host.listen_fd < 0)
+    {
+        return ESP_FAIL;
+    }
+    setsockopt(host.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(host.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(host.listen_fd, 8) != 0)
+    {
+        ESP_LOGE(TAG, "Could not listen on port %d: %s", config->server_port, strerror(errno));
+        close(host.listen_fd);
+        return ESP_FAIL;
+    }
+    if (pthread_create(&host.thread, NULL, httpd_thread, NULL) != 0)
+    {
+        close(host.listen_fd);
+        return ESP_ERR_NO_MEM;
+    }
+    *handle = &host;
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    httpd_host_t *server = handle;
+
+    if (server->handlers >= HTTPD_MAX_HANDLERS || server->handlers >= server->config.max_uri_handlers)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    server->handler[server->handlers++] = *uri_handler;
+    return ESP_OK;
+}
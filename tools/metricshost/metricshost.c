@@ -0,0 +1,166 @@
+/**
+ * @file metricshost.c
+ * @brief Host build of the local metrics endpoint
+ *
+ * Runs the firmware's local_metrics.c behind httpd_host.c and feeds it a simulated station: an
+ * acquisition cycle every sample interval with slowly varying readings, a rain sensor report, the
+ * publish burst counters of a publish every publish interval, and now and then a subsystem fault
+ * and restart through the firmware's supervisor.c. Point tools/metrics_loadtest.py at it to
+ * measure the endpoint without a station:
+ *     tools/metrics_loadtest.py 127.0.0.1 --port 8080
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+
+#include "sdkconfig.h"
+#include "local_metrics.h"
+#include "sensor_driver.h"
+#include "radio_power.h"
+#include "supervisor.h"
+
+static int interval_ms = CONFIG_SAMPLE_INTERVAL_MS;
+static int run_s = 0;
+
+static rainsensor_t rain;
+static radio_power_stats_t radio;
+static int64_t start_us;
+static int64_t light_us;               /* Last cycle the light sensor answered */
+
+static int64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool rain_driver_get_data(rainsensor_t *data)
+{
+    *data = rain;
+    return true;
+}
+
+void radio_power_get_stats(radio_power_stats_t *stats)
+{
+    *stats = radio;
+}
+
+static void simulate_cycle(sensor_data *data, uint32_t cycle, int64_t now)
+{
+    double t = now / 1e6;
+
+    memset(data, 0, sizeof(*data));
+    data->time_us = now;
+    data->value[SENSOR_CH_TEMPERATURE] = 12.0 + 3.0 * sin(t / 600.0);
+    data->value[SENSOR_CH_HUMIDITY] = 70.0 - 10.0 * sin(t / 600.0);
+    data->value[SENSOR_CH_PRESSURE] = 101325.0 + 150.0 * sin(t / 3600.0);
+    data->value[SENSOR_CH_LIGHTLEVEL] = 20000.0 + 15000.0 * sin(t / 120.0);
+    data->value[SENSOR_CH_RAINMM] = rain.total_rain;
+    data->valid = SENSOR_CH_BIT(SENSOR_CH_TEMPERATURE) | SENSOR_CH_BIT(SENSOR_CH_HUMIDITY) |
+                  SENSOR_CH_BIT(SENSOR_CH_PRESSURE) | SENSOR_CH_BIT(SENSOR_CH_RAINMM);
+    // The light sensor drops out every tenth cycle, so the age and null paths are served too
+    if (cycle % 10 != 0)
+    {
+        data->valid |= SENSOR_CH_BIT(SENSOR_CH_LIGHTLEVEL);
+        light_us = now;
+    }
+    for (int ch = 0; ch < SENSOR_CH_COUNT; ch++)
+    {
+        data->age[ch] = (data->valid & SENSOR_CH_BIT(ch)) ? 0 : (uint32_t)((now - start_us) / 1000000);
+    }
+    data->age[SENSOR_CH_LIGHTLEVEL] = (uint32_t)((now - light_us) / 1000000);
+
+    rain.current_acc_rain = (cycle % 30) * 0.01f;
+    rain.event_acc_rain += 0.01f;
+    rain.total_rain += 0.01f;
+    rain.mm_per_hour_rain = 0.6f + 0.4f * sinf(cycle / 50.0f);
+}
+
+static void simulate_publish(int64_t burst_us)
+{
+    radio.cycles++;
+    radio.last_cycle_us = (int64_t)CONFIG_PUBLISH_INTERVAL_MS * 1000;
+    radio.last_burst_us = burst_us;
+    radio.total_cycle_us += radio.last_cycle_us;
+    radio.total_burst_us += burst_us;
+}
+
+static void usage(const char *argv0)
+{
+    printf("usage: %s [options]\n"
+           "  --interval MS       acquisition cycle interval (default %d)\n"
+           "  --seconds N         stop after N seconds, 0 to run until killed (default %d)\n"
+           "serves /metrics and /sensors on port %d\n",
+           argv0, interval_ms, run_s, CONFIG_LOCAL_METRICS_PORT);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "interval", required_argument, NULL, 'i' },
+        { "seconds", required_argument, NULL, 's' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    int publish_every, opt;
+    sensor_data data;
+    struct timespec sleep;
+
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'i': interval_ms = atoi(optarg); break;
+        case 's': run_s = atoi(optarg); break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (interval_ms <= 0 || run_s < 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    publish_every = CONFIG_PUBLISH_INTERVAL_MS / interval_ms > 0 ? CONFIG_PUBLISH_INTERVAL_MS / interval_ms : 1;
+
+    if (local_metrics_start() != ESP_OK)
+    {
+        return 1;
+    }
+    start_us = now_us();
+    light_us = start_us;
+    for (int sub = 0; sub < SUPERVISOR_COUNT; sub++)
+    {
+        supervisor_up(sub, start_us);
+    }
+    sleep.tv_sec = interval_ms / 1000;
+    sleep.tv_nsec = (interval_ms % 1000) * 1000000L;
+
+    for (uint32_t cycle = 1; run_s == 0 || now_us() - start_us < (int64_t)run_s * 1000000; cycle++)
+    {
+        int64_t now = now_us();
+
+        // The rain sensor UART falls over every hundred cycles and comes back when the supervisor says so
+        if (cycle % 100 == 0)
+        {
+            supervisor_fault(SUPERVISOR_UART, "no response from the rain sensor", now);
+        }
+        if (supervisor_restart_due(SUPERVISOR_UART, now))
+        {
+            supervisor_up(SUPERVISOR_UART, now);
+        }
+        if (cycle % publish_every == 0)
+        {
+            simulate_publish(250000 + (cycle % 7) * 20000);
+        }
+        simulate_cycle(&data, cycle, now);
+        local_metrics_update(&data);
+        nanosleep(&sleep, NULL);
+    }
+    return 0;
+}
@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for the ESP-IDF generated sdkconfig.h, with the project defaults of the metrics
+ * endpoint and a station with the rain sensor.
+ */
+#pragma once
+
+#define CONFIG_LOCAL_METRICS_ENABLE 1
+#define CONFIG_LOCAL_METRICS_PORT 8080
+#define CONFIG_SENSOR_RAIN_ENABLE 1
+#define CONFIG_DEVICE_LOCATION_NAME "metricshost"
+#define CONFIG_DEVICE_TYPE_NAME "weatherstation"
+#define CONFIG_SAMPLE_INTERVAL_MS 2000
+#define CONFIG_PUBLISH_INTERVAL_MS 10000
+#define CONFIG_SUPERVISOR_BACKOFF_MIN_MS 2000
+#define CONFIG_SUPERVISOR_BACKOFF_MAX_MS 300000
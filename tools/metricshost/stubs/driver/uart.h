@@ -0,0 +1,4 @@
+/*
+ * Host stand-in for the UART driver header rainsensor.h includes. Nothing in it is used here.
+ */
+#pragma once
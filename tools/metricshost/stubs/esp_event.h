@@ -0,0 +1,12 @@
+/*
+ * Host stand-in for the esp_event types rainsensor.h declares its API with
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef const char *esp_event_base_t;
+typedef void (*esp_event_handler_t)(void *event_handler_arg, esp_event_base_t event_base, int32_t event_id,
+                                    void *event_data);
+
+#define ESP_EVENT_DECLARE_BASE(id) extern esp_event_base_t const id
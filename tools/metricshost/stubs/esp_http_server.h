@@ -0,0 +1,60 @@
+/*
+ * Host stand-in for the subset of esp_http_server local_metrics.c uses. Implemented in
+ * httpd_host.c the way the ESP-IDF server works: one task serving every socket from a select
+ * loop, at most max_open_sockets connections, the least recently used one closed to make room
+ * for a new one when lru_purge_enable is set.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "esp_err.h"
+
+#define HTTPD_RESP_USE_STRLEN (-1)
+
+typedef void *httpd_handle_t;
+
+typedef enum {
+    HTTP_GET,
+} httpd_method_t;
+
+typedef struct httpd_req {
+    httpd_handle_t handle;
+    int method;
+    const char *uri;
+    void *user_ctx;
+    int fd;                             /*!< Socket of the request, host build only */
+    const char *status;                 /*!< Status line, host build only */
+    const char *type;                   /*!< Content type, host build only */
+} httpd_req_t;
+
+typedef struct httpd_uri {
+    const char *uri;
+    httpd_method_t method;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+} httpd_uri_t;
+
+typedef struct {
+    uint16_t server_port;
+    uint16_t max_open_sockets;
+    uint16_t max_uri_handlers;
+    bool lru_purge_enable;
+} httpd_config_t;
+
+#define HTTPD_DEFAULT_CONFIG() { \
+        .server_port = 80, \
+        .max_open_sockets = 7, \
+        .max_uri_handlers = 8, \
+        .lru_purge_enable = false, \
+    }
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config);
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler);
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status);
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type);
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len);
+esp_err_t httpd_resp_send_500(httpd_req_t *r);
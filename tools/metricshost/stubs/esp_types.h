@@ -0,0 +1,8 @@
+/*
+ * Host stand-in for esp_types.h
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
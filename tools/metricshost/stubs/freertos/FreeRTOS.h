@@ -0,0 +1,13 @@
+/*
+ * Host stand-in for the FreeRTOS spinlock local_metrics.c takes between the sampler and the
+ * server. The simulated sampler and the server are separate threads, so it is a real mutex.
+ */
+#pragma once
+
+#include <pthread.h>
+
+typedef pthread_mutex_t portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(mux)
@@ -0,0 +1,534 @@
+/**
+ * @file samplesim.c
+ * @brief Adaptive sampling simulator
+ *
+ * Replays a weather trace through the firmware's sample_rate.c controller and through fixed sample
+ * intervals. For each it reports the number of samples taken and how well the samples describe
+ * the trace: the error of rebuilding the trace by linear interpolation between the samples, and
+ * the error of the published window means against the true means.
+ *
+ * Traces are CSV files with one reading per line:
+ *     time_s,temperature_c,pressure_pa,light_lux,rain_mm
+ * where rain_mm is the running total of the rain sensor. Lines that do not start with a number
+ * (headers, comments) are skipped. Without --trace a synthetic trace is generated: three days with
+ * a diurnal cycle, a cold front with a pressure trough and rain, passing clouds and a short
+ * convective downpour, sampled every second with sensor noise.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <math.h>
+
+#include "sdkconfig.h"
+#include "sample_rate.h"
+
+#define SIGNALS (4)
+#define DAY_S (86400.0)
+#define MAX_STRATEGIES (8)
+#define HISTOGRAM_BINS (8)
+
+typedef struct {
+    const char *name;
+    const char *unit;
+    sensor_channel_t channel;
+} signal_info_t;
+
+static const signal_info_t signal_info[SIGNALS] = {
+    { "temperature", "C", SENSOR_CH_TEMPERATURE },
+    { "pressure", "Pa", SENSOR_CH_PRESSURE },
+    { "light", "lux", SENSOR_CH_LIGHTLEVEL },
+    { "rain", "mm", SENSOR_CH_RAINMM },
+};
+
+typedef struct {
+    size_t count;
+    size_t capacity;
+    double *time_s;
+    double *value[SIGNALS];
+} trace_t;
+
+typedef struct {
+    double sum_sq;
+    double max;
+    size_t count;
+} error_t;
+
+typedef struct {
+    char name[48];
+    uint64_t samples;
+    error_t recon[SIGNALS];
+    error_t window[SIGNALS];
+    double time_at[HISTOGRAM_BINS];     // seconds spent at min_ms << bin
+} result_t;
+
+static const char *trace_path = NULL;
+static int synthetic_days = 3;
+static int min_ms = CONFIG_SAMPLE_INTERVAL_MIN_MS;
+static int max_ms = CONFIG_SAMPLE_INTERVAL_MAX_MS;
+static int hold_s = CONFIG_SAMPLE_SLOWDOWN_HOLD_S;
+static int publish_ms = CONFIG_PUBLISH_INTERVAL_MS;
+
+static uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Deterministic noise in [-1, 1) for point i and a stream
+ */
+static double noise(uint64_t i, int stream)
+{
+    return (double)(splitmix64(i * 16 + stream) >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+/**
+ * @brief Smooth pseudo random walk in [0, 1] with a given correlation time, for cloud cover
+ */
+static double smooth_noise(double t, double period, int stream)
+{
+    uint64_t k = (uint64_t)(t / period);
+    double f = t / period - (double)k;
+    double a = noise(k, stream) * 0.5 + 0.5;
+    double b = noise(k + 1, stream) * 0.5 + 0.5;
+
+    f = f * f * (3.0 - 2.0 * f);
+    return a + (b - a) * f;
+}
+
+static double quantise(double v, double step)
+{
+    return round(v / step) * step;
+}
+
+/**
+ * @brief Ramp from 0 to 1 between t0 and t1
+ */
+static double ramp(double t, double t0, double t1)
+{
+    if (t <= t0)
+    {
+        return 0.0;
+    }
+    if (t >= t1)
+    {
+        return 1.0;
+    }
+    return (t - t0) / (t1 - t0);
+}
+
+static void trace_add(trace_t *trace, double time_s, const double *value)
+{
+    if (trace->count == trace->capacity)
+    {
+        trace->capacity = trace->capacity ? trace->capacity * 2 : 4096;
+        trace->time_s = realloc(trace->time_s, trace->capacity * sizeof(double));
+        for (int s = 0; s < SIGNALS; s++)
+        {
+            trace->value[s] = realloc(trace->value[s], trace->capacity * sizeof(double));
+        }
+        if (trace->time_s == NULL || trace->value[SIGNALS - 1] == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    trace->time_s[trace->count] = time_s;
+    for (int s = 0; s < SIGNALS; s++)
+    {
+        trace->value[s][trace->count] = value[s];
+    }
+    trace->count++;
+}
+
+static void trace_synthetic(trace_t *trace, int days)
+{
+    // Cold front on the second afternoon, a convective cell on the third
+    const double front = 1.65 * DAY_S;
+    const double cell = 2.6 * DAY_S;
+    double rain = 0.0;
+    double value[SIGNALS];
+
+    for (uint64_t i = 0; i < (uint64_t)(days * DAY_S); i++)
+    {
+        double t = (double)i;
+        double day_phase = fmod(t, DAY_S) / DAY_S;
+        double sun = fmax(0.0, sin(M_PI * (day_phase - 0.25) / 0.5));
+        double rain_rate;                   // mm per hour
+        double cloud;
+
+        // Diurnal cycle peaking mid afternoon, 5 C colder behind the front
+        value[0] = 12.0 + 6.0 * sin(2.0 * M_PI * (day_phase - 0.375)) - 5.0 * ramp(t, front, front + 1200.0);
+        // Slow drift, a trough ahead of the front and a sharp rise behind it
+        value[1] = 101300.0 + 150.0 * sin(2.0 * M_PI * t / (3.0 * DAY_S)) -
+                   400.0 * ramp(t, front - 6 * 3600.0, front) + 600.0 * ramp(t, front, front + 3 * 3600.0);
+        // Clear first day, overcast around the front, broken clouds on the third day
+        if (t < DAY_S)
+        {
+            cloud = 1.0;
+        }
+        else if (t < 2.0 * DAY_S)
+        {
+            cloud = 0.25 + 0.15 * smooth_noise(t, 1800.0, 1);
+        }
+        else
+        {
+            cloud = smooth_noise(t, 240.0, 2) > 0.5 ? 1.0 : 0.3;
+        }
+        value[2] = 50000.0 * sun * cloud;
+
+        rain_rate = 0.0;
+        if (t >= front - 600.0 && t < front + 5400.0)
+        {
+            rain_rate = 6.0 + 4.0 * smooth_noise(t, 600.0, 3);
+        }
+        if (t >= cell && t < cell + 1200.0)
+        {
+            rain_rate = 25.0 * sin(M_PI * (t - cell) / 1200.0);
+        }
+        rain += rain_rate / 3600.0;
+        value[3] = rain;
+
+        // Sensor noise and resolution
+        value[0] = quantise(value[0] + 0.03 * noise(i, 4), 0.01);
+        value[1] = quantise(value[1] + 3.0 * noise(i, 5), 0.16);
+        value[2] = quantise(value[2] * (1.0 + 0.01 * noise(i, 6)), 1.0);
+        value[3] = quantise(value[3], 0.01);
+        trace_add(trace, t, value);
+    }
+}
+
+static int trace_load(trace_t *trace, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[256];
+    double time_s;
+    double value[SIGNALS];
+
+    if (f == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        if (sscanf(line, "%lf,%lf,%lf,%lf,%lf", &time_s, &value[0], &value[1], &value[2], &value[3]) != 5)
+        {
+            continue;
+        }
+        if (trace->count > 0 && time_s <= trace->time_s[trace->count - 1])
+        {
+            fprintf(stderr, "%s: times must increase (%.3f)\n", path, time_s);
+            fclose(f);
+            return -1;
+        }
+        trace_add(trace, time_s, value);
+    }
+    fclose(f);
+    return 0;
+}
+
+/**
+ * @brief Value of a signal at time t, interpolated between the trace points. *pos is a search
+ * hint that only moves forward.
+ */
+static double trace_at(const trace_t *trace, int signal, double t, size_t *pos)
+{
+    size_t i = *pos;
+
+    while (i + 1 < trace->count && trace->time_s[i + 1] <= t)
+    {
+        i++;
+    }
+    *pos = i;
+    if (i + 1 >= trace->count || t <= trace->time_s[i])
+    {
+        return trace->value[signal][i];
+    }
+    return trace->value[signal][i] + (trace->value[signal][i + 1] - trace->value[signal][i]) *
+           (t - trace->time_s[i]) / (trace->time_s[i + 1] - trace->time_s[i]);
+}
+
+static void error_add(error_t *error, double e)
+{
+    error->sum_sq += e * e;
+    error->max = fmax(error->max, fabs(e));
+    error->count++;
+}
+
+static double error_rms(const error_t *error)
+{
+    return error->count ? sqrt(error->sum_sq / error->count) : 0.0;
+}
+
+/**
+ * @brief Run one strategy over the trace: a fixed interval, or the adaptive controller when
+ * fixed_ms is 0
+ */
+static void simulate(const trace_t *trace, int fixed_ms, result_t *result)
+{
+    size_t cap = 4096, n = 0, pos = 0;
+    double *times = malloc(cap * sizeof(double));
+    double *values = malloc(cap * SIGNALS * sizeof(double));
+    double start = trace->time_s[0];
+    double end = trace->time_s[trace->count - 1];
+    double t = start;
+    sample_rate_t rate;
+    sensor_data sample;
+    int effective_max = max_ms < publish_ms ? max_ms : publish_ms;
+
+    memset(result, 0, sizeof(result_t));
+    if (fixed_ms)
+    {
+        snprintf(result->name, sizeof(result->name), "fixed %dms", fixed_ms);
+    }
+    else
+    {
+        snprintf(result->name, sizeof(result->name), "adaptive %d-%dms", min_ms, effective_max);
+        sample_rate_init(&rate, min_ms, effective_max, hold_s * 1000, CONFIG_SAMPLE_INTERVAL_MS);
+    }
+
+    // Take the samples
+    while (t <= end)
+    {
+        uint32_t interval;
+
+        if (n == cap)
+        {
+            cap *= 2;
+            times = realloc(times, cap * sizeof(double));
+            values = realloc(values, cap * SIGNALS * sizeof(double));
+        }
+        times[n] = t;
+        memset(&sample, 0, sizeof(sample));
+        sample.time_us = (int64_t)llround((t - start) * 1e6);
+        for (int s = 0; s < SIGNALS; s++)
+        {
+            values[n * SIGNALS + s] = trace_at(trace, s, t, &pos);
+            sample.value[signal_info[s].channel] = (float)values[n * SIGNALS + s];
+            sample.valid |= SENSOR_CH_BIT(signal_info[s].channel);
+        }
+        n++;
+        interval = fixed_ms ? (uint32_t)fixed_ms : sample_rate_update(&rate, &sample);
+        for (int b = 0; b < HISTOGRAM_BINS; b++)
+        {
+            if (b == HISTOGRAM_BINS - 1 || interval < (uint32_t)min_ms << (b + 1))
+            {
+                result->time_at[b] += interval / 1000.0;
+                break;
+            }
+        }
+        t += interval / 1000.0;
+    }
+    result->samples = n;
+
+    // Rebuild the trace by linear interpolation between the samples
+    size_t k = 0;
+    for (size_t i = 0; i < trace->count && trace->time_s[i] <= times[n - 1]; i++)
+    {
+        double ti = trace->time_s[i];
+
+        while (k + 1 < n && times[k + 1] <= ti)
+        {
+            k++;
+        }
+        for (int s = 0; s < SIGNALS; s++)
+        {
+            double v = values[k * SIGNALS + s];
+
+            if (k + 1 < n && ti > times[k])
+            {
+                v += (values[(k + 1) * SIGNALS + s] - v) * (ti - times[k]) / (times[k + 1] - times[k]);
+            }
+            error_add(&result->recon[s], v - trace->value[s][i]);
+        }
+    }
+
+    // Compare the window means the station would publish with the true means
+    double window_s = publish_ms / 1000.0;
+    size_t first_sample = 0, first_point = 0;
+    for (double w = start; w + window_s <= end; w += window_s)
+    {
+        size_t sample_end = first_sample, point_end = first_point;
+
+        while (sample_end < n && times[sample_end] < w + window_s)
+        {
+            sample_end++;
+        }
+        while (point_end < trace->count && trace->time_s[point_end] < w + window_s)
+        {
+            point_end++;
+        }
+        if (sample_end > first_sample && point_end > first_point)
+        {
+            for (int s = 0; s < SIGNALS; s++)
+            {
+                double sampled = 0.0, truth = 0.0;
+
+                for (size_t j = first_sample; j < sample_end; j++)
+                {
+                    sampled += values[j * SIGNALS + s];
+                }
+                for (size_t j = first_point; j < point_end; j++)
+                {
+                    truth += trace->value[s][j];
+                }
+                error_add(&result->window[s], sampled / (sample_end - first_sample) - truth / (point_end - first_point));
+            }
+        }
+        first_sample = sample_end;
+        first_point = point_end;
+    }
+    free(times);
+    free(values);
+}
+
+static void print_results(const result_t *results, int count)
+{
+    uint64_t baseline = results[0].samples;
+
+    printf("\n%-24s %9s %7s", "strategy", "samples", "saved");
+    for (int s = 0; s < SIGNALS; s++)
+    {
+        char head[32];
+
+        snprintf(head, sizeof(head), "%s (%s)", signal_info[s].name, signal_info[s].unit);
+        printf(" %21s", head);
+    }
+    printf("\n%-24s %9s %7s", "", "", "");
+    for (int s = 0; s < SIGNALS; s++)
+    {
+        printf(" %21s", "rms / max");
+    }
+    printf("\n");
+    for (int r = 0; r < count; r++)
+    {
+        for (int kind = 0; kind < 2; kind++)
+        {
+            const error_t *errors = kind ? results[r].window : results[r].recon;
+
+            if (kind == 0)
+            {
+                printf("%-24s %9llu %6.1f%%", results[r].name, (unsigned long long)results[r].samples,
+                       100.0 * (1.0 - (double)results[r].samples / baseline));
+            }
+            else
+            {
+                printf("%-24s %9s %7s", "  window means", "", "");
+            }
+            for (int s = 0; s < SIGNALS; s++)
+            {
+                printf(" %10.3f / %8.3f", error_rms(&errors[s]), errors[s].max);
+            }
+            printf("\n");
+        }
+    }
+}
+
+static void print_histogram(const result_t *result)
+{
+    double total = 0.0;
+
+    for (int b = 0; b < HISTOGRAM_BINS; b++)
+    {
+        total += result->time_at[b];
+    }
+    printf("\nTime spent at each interval by %s:\n", result->name);
+    for (int b = 0; b < HISTOGRAM_BINS; b++)
+    {
+        if (result->time_at[b] > 0.0)
+        {
+            printf("  %6d-%-6dms %5.1f%%\n", min_ms << b, (min_ms << (b + 1)) - 1, 100.0 * result->time_at[b] / total);
+        }
+    }
+}
+
+static void usage(const char *argv0)
+{
+    printf("usage: %s [options]\n"
+           "  --trace FILE        CSV trace: time_s,temperature_c,pressure_pa,light_lux,rain_mm\n"
+           "  --days N            days of synthetic trace when no file is given (default %d)\n"
+           "  --min MS            fastest sample interval (default %d)\n"
+           "  --max MS            slowest sample interval, capped at the publish interval (default %d)\n"
+           "  --hold S            calm time before slowing down (default %d)\n"
+           "  --publish MS        publish window for the window mean errors (default %d)\n",
+           argv0, synthetic_days, min_ms, max_ms, hold_s, publish_ms);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "trace", required_argument, NULL, 't' },
+        { "days", required_argument, NULL, 'n' },
+        { "min", required_argument, NULL, 'a' },
+        { "max", required_argument, NULL, 'b' },
+        { "hold", required_argument, NULL, 'o' },
+        { "publish", required_argument, NULL, 'p' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    trace_t trace = { 0 };
+    result_t results[MAX_STRATEGIES];
+    int count = 0, opt, effective_max;
+
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 't': trace_path = optarg; break;
+        case 'n': synthetic_days = atoi(optarg); break;
+        case 'a': min_ms = atoi(optarg); break;
+        case 'b': max_ms = atoi(optarg); break;
+        case 'o': hold_s = atoi(optarg); break;
+        case 'p': publish_ms = atoi(optarg); break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (min_ms <= 0 || max_ms < min_ms || hold_s < 0 || publish_ms < min_ms || synthetic_days <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    effective_max = max_ms < publish_ms ? max_ms : publish_ms;
+
+    if (trace_path != NULL)
+    {
+        if (trace_load(&trace, trace_path) != 0)
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        trace_synthetic(&trace, synthetic_days);
+    }
+    if (trace.count < 2)
+    {
+        fprintf(stderr, "The trace needs at least two points\n");
+        return 1;
+    }
+    printf("Trace: %zu points over %.1f hours%s\n", trace.count,
+           (trace.time_s[trace.count - 1] - trace.time_s[0]) / 3600.0, trace_path ? "" : " (synthetic)");
+
+    // The fastest fixed rate is the reference the savings are measured against
+    simulate(&trace, min_ms, &results[count++]);
+    if (CONFIG_SAMPLE_INTERVAL_MS != min_ms && CONFIG_SAMPLE_INTERVAL_MS != effective_max)
+    {
+        simulate(&trace, CONFIG_SAMPLE_INTERVAL_MS, &results[count++]);
+    }
+    if (effective_max != min_ms)
+    {
+        simulate(&trace, effective_max, &results[count++]);
+    }
+    simulate(&trace, 0, &results[count++]);
+
+    printf("Errors: trace rebuilt by linear interpolation between samples, and %dms window means\n", publish_ms);
+    print_results(results, count);
+    print_histogram(&results[count - 1]);
+    return 0;
+}
@@ -0,0 +1,11 @@
+/*
+ * Host stand-in for the ESP-IDF generated sdkconfig.h, with the project defaults of the sampler.
+ */
+#pragma once
+
+#define CONFIG_SAMPLE_ADAPTIVE 1
+#define CONFIG_SAMPLE_INTERVAL_MS 2000
+#define CONFIG_SAMPLE_INTERVAL_MIN_MS 2000
+#define CONFIG_SAMPLE_INTERVAL_MAX_MS 30000
+#define CONFIG_SAMPLE_SLOWDOWN_HOLD_S 300
+#define CONFIG_PUBLISH_INTERVAL_MS 10000
@@ -0,0 +1,425 @@
+/**
+ * @file tlsbench.c
+ * @brief MQTT TLS connect benchmark
+ *
+ * Connects to a local TLS broker over and over with a client certificate, the way a station does
+ * after a reboot or a lost connection, and times how the certificates are set up before each
+ * handshake:
+ *     files   the PEM files are read and parsed for every connect, as the firmware did with
+ *             CONFIG_AWS_FILESYSTEM_CERTS before the certificate cache
+ *     pem     the PEM is kept in memory and parsed for every connect, as the firmware does with
+ *             CONFIG_AWS_CERT_CACHE (the esp-aws-iot TLS layer parses what it is given on each
+ *             connect)
+ *     context with --context only: the certificates and key are parsed once into a TLS context
+ *             that every connect reuses. The firmware does not do this (the esp-aws-iot TLS
+ *             layer has no way to take a parsed context), so it is a reference for what
+ *             patching that layer would gain, not a measurement of the station.
+ * For each it reports the set up time, the TCP connect plus handshake time (plus MQTT
+ * CONNECT/CONNACK with --mqtt) and the total. The host reads files from its page cache and parses
+ * much faster than an ESP32 reading a FAT SD card, so the set up share is the figure to carry over.
+ *
+ * Any TLS server that asks for a client certificate will do, for example
+ *     openssl s_server -accept 8883 -cert server.crt -key server.key -CAfile ca.crt -Verify 1 -quiet
+ * or mosquitto with require_certificate true (then add --mqtt).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+typedef enum {
+    MODE_FILES,
+    MODE_PEM,
+    MODE_CONTEXT,
+    MODE_COUNT
+} bench_mode_t;
+
+static const char *mode_names[MODE_COUNT] = { "files", "pem", "context" };
+
+typedef struct {
+    double *setup_us;
+    double *connect_us;
+    double *total_us;
+    int failures;
+} result_t;
+
+static const char *host = "localhost";
+static const char *port = "8883";
+static const char *ca_path = NULL;
+static const char *cert_path = NULL;
+static const char *key_path = NULL;
+static int connects = 100;
+static bool mqtt = false;
+static bool verify_host = false;
+static bool context = false;
+
+static char *ca_pem;
+static char *cert_pem;
+static char *key_pem;
+
+static double now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static char *read_file(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    char *buf;
+    long len;
+
+    if (f == NULL)
+    {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = malloc(len + 1);
+    if (buf == NULL || fread(buf, 1, len, f) != (size_t)len)
+    {
+        fprintf(stderr, "%s: read failed\n", path);
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+    buf[len] = 0;
+    fclose(f);
+    return buf;
+}
+
+/**
+ * @brief Load the root CA, the device certificate and the key from PEM strings into a context
+ */
+static bool ctx_load_pem(SSL_CTX *ctx, const char *ca, const char *cert, const char *key)
+{
+    X509_STORE *store = SSL_CTX_get_cert_store(ctx);
+    BIO *bio;
+    X509 *x509;
+    EVP_PKEY *pkey;
+    bool ok = true;
+
+    bio = BIO_new_mem_buf(ca, -1);
+    while ((x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL)) != NULL)
+    {
+        X509_STORE_add_cert(store, x509);
+        X509_free(x509);
+    }
+    ERR_clear_error();
+    BIO_free(bio);
+
+    bio = BIO_new_mem_buf(cert, -1);
+    x509 = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+    ok = x509 != NULL && SSL_CTX_use_certificate(ctx, x509) == 1;
+    X509_free(x509);
+    BIO_free(bio);
+
+    bio = BIO_new_mem_buf(key, -1);
+    pkey = PEM_read_bio_PrivateKey(bio, NULL, NULL, NULL);
+    ok = ok && pkey != NULL && SSL_CTX_use_PrivateKey(ctx, pkey) == 1 && SSL_CTX_check_private_key(ctx) == 1;
+    EVP_PKEY_free(pkey);
+    BIO_free(bio);
+    return ok;
+}
+
+static SSL_CTX *ctx_create(bench_mode_t mode)
+{
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    char *ca = ca_pem, *cert = cert_pem, *key = key_pem;
+    bool ok;
+
+    if (ctx == NULL)
+    {
+        return NULL;
+    }
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
+    // Each connect is a fresh handshake, like the station's after a reboot
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    if (mode == MODE_FILES)
+    {
+        ca = read_file(ca_path);
+        cert = read_file(cert_path);
+        key = read_file(key_path);
+    }
+    ok = ca && cert && key && ctx_load_pem(ctx, ca, cert, key);
+    if (mode == MODE_FILES)
+    {
+        free(ca);
+        free(cert);
+        free(key);
+    }
+    if (!ok)
+    {
+        ERR_print_errors_fp(stderr);
+        SSL_CTX_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+static int tcp_connect(void)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res, *ai;
+    int fd = -1, one = 1;
+
+    if (getaddrinfo(host, port, &hints, &res) != 0)
+    {
+        return -1;
+    }
+    for (ai = res; ai != NULL; ai = ai->ai_next)
+    {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+        {
+            break;
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd >= 0)
+    {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+/**
+ * @brief Send a minimal MQTT 3.1.1 CONNECT and wait for a CONNACK that accepts it
+ */
+static bool mqtt_connect(SSL *ssl, int n)
+{
+    char id[24];
+    uint8_t frame[64];
+    uint8_t ack[4];
+    size_t id_len = snprintf(id, sizeof(id), "tlsbench_%d", n);
+    size_t pos = 0;
+
+    frame[pos++] = 0x10;
+    frame[pos++] = 10 + 2 + id_len;
+    memcpy(frame + pos, "\x00\x04MQTT\x04\x02\x00\x3c", 10);
+    pos += 10;
+    frame[pos++] = 0;
+    frame[pos++] = id_len;
+    memcpy(frame + pos, id, id_len);
+    pos += id_len;
+    return SSL_write(ssl, frame, pos) == (int)pos && SSL_read(ssl, ack, sizeof(ack)) == 4 &&
+           ack[0] == 0x20 && ack[3] == 0;
+}
+
+static bool run_connect(SSL_CTX *ctx, int n)
+{
+    int fd = tcp_connect();
+    SSL *ssl;
+    bool ok;
+
+    if (fd < 0)
+    {
+        return false;
+    }
+    ssl = SSL_new(ctx);
+    SSL_set_fd(ssl, fd);
+    SSL_set_tlsext_host_name(ssl, host);
+    if (verify_host)
+    {
+        SSL_set1_host(ssl, host);
+    }
+    ok = SSL_connect(ssl) == 1 && (!mqtt || mqtt_connect(ssl, n));
+    if (!ok)
+    {
+        ERR_print_errors_fp(stderr);
+    }
+    SSL_shutdown(ssl);
+    SSL_free(ssl);
+    close(fd);
+    return ok;
+}
+
+static bool run_mode(bench_mode_t mode, result_t *result)
+{
+    SSL_CTX *shared = NULL;
+    int done = 0;
+
+    result->setup_us = calloc(connects, sizeof(double));
+    result->connect_us = calloc(connects, sizeof(double));
+    result->total_us = calloc(connects, sizeof(double));
+    result->failures = 0;
+    if (mode == MODE_CONTEXT)
+    {
+        // Parsed once, before the first connect; the cost shows up in no connect
+        shared = ctx_create(mode);
+        if (shared == NULL)
+        {
+            return false;
+        }
+    }
+    for (int i = 0; i < connects; i++)
+    {
+        double start = now_us();
+        SSL_CTX *ctx = shared ? shared : ctx_create(mode);
+        double ready = now_us();
+
+        if (ctx == NULL)
+        {
+            return false;
+        }
+        if (run_connect(ctx, i))
+        {
+            double end = now_us();
+            result->setup_us[done] = ready - start;
+            result->connect_us[done] = end - ready;
+            result->total_us[done] = end - start;
+            done++;
+        }
+        else
+        {
+            result->failures++;
+        }
+        if (ctx != shared)
+        {
+            SSL_CTX_free(ctx);
+        }
+    }
+    SSL_CTX_free(shared);
+    return done > 0 || result->failures == 0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double percentile(double *values, int count, double pct)
+{
+    int rank;
+
+    if (count == 0)
+    {
+        return 0.0;
+    }
+    qsort(values, count, sizeof(double), compare_double);
+    rank = (int)(pct / 100.0 * count + 0.5);
+    return values[rank > 0 ? rank - 1 : 0];
+}
+
+static void usage(const char *argv0)
+{
+    printf("usage: %s --ca FILE --cert FILE --key FILE [options]\n"
+           "  --host HOST         broker host (default %s)\n"
+           "  --port PORT         broker TLS port (default %s)\n"
+           "  --ca FILE           root CA certificate (PEM)\n"
+           "  --cert FILE         device certificate (PEM)\n"
+           "  --key FILE          device private key (PEM)\n"
+           "  --connects N        connects per mode (default %d)\n"
+           "  --mqtt              send MQTT CONNECT and wait for CONNACK after the handshake\n"
+           "  --verify-host       check the broker certificate names the host, as the station does\n"
+           "  --context           also time a context parsed once and reused, which the firmware does not do\n",
+           argv0, host, port, connects);
+}
+
+int main(int argc, char **argv)
+{
+    static const struct option options[] = {
+        { "host", required_argument, NULL, 'H' },
+        { "port", required_argument, NULL, 'p' },
+        { "ca", required_argument, NULL, 'a' },
+        { "cert", required_argument, NULL, 'c' },
+        { "key", required_argument, NULL, 'k' },
+        { "connects", required_argument, NULL, 'n' },
+        { "mqtt", no_argument, NULL, 'm' },
+        { "verify-host", no_argument, NULL, 'v' },
+        { "context", no_argument, NULL, 'x' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+    result_t results[MODE_COUNT];
+    double files_total = 0.0;
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'H': host = optarg; break;
+        case 'p': port = optarg; break;
+        case 'a': ca_path = optarg; break;
+        case 'c': cert_path = optarg; break;
+        case 'k': key_path = optarg; break;
+        case 'n': connects = atoi(optarg); break;
+        case 'm': mqtt = true; break;
+        case 'v': verify_host = true; break;
+        case 'x': context = true; break;
+        default: usage(argv[0]); return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (ca_path == NULL || cert_path == NULL || key_path == NULL || connects <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    ca_pem = read_file(ca_path);
+    cert_pem = read_file(cert_path);
+    key_pem = read_file(key_path);
+    if (ca_pem == NULL || cert_pem == NULL || key_pem == NULL)
+    {
+        return 1;
+    }
+
+    printf("%d connects per mode to %s:%s%s\n", connects, host, port, mqtt ? " with MQTT CONNECT" : "");
+    printf("%-8s %10s %10s %12s %12s %10s %10s %8s\n", "mode", "setup p50", "setup p95", "connect p50",
+           "connect p95", "total p50", "total p95", "failed");
+    for (int mode = 0; mode < MODE_COUNT; mode++)
+    {
+        result_t *r = &results[mode];
+        int ok;
+        double total;
+
+        if (mode == MODE_CONTEXT && !context)
+        {
+            continue;
+        }
+        if (!run_mode(mode, r))
+        {
+            fprintf(stderr, "%s: could not set up the certificates or reach the broker\n", mode_names[mode]);
+            return 1;
+        }
+        ok = connects - r->failures;
+        total = percentile(r->total_us, ok, 50);
+        printf("%-8s %8.0fus %8.0fus %10.0fus %10.0fus %8.0fus %8.0fus %8d\n", mode_names[mode],
+               percentile(r->setup_us, ok, 50), percentile(r->setup_us, ok, 95),
+               percentile(r->connect_us, ok, 50), percentile(r->connect_us, ok, 95),
+               total, percentile(r->total_us, ok, 95), r->failures);
+        if (mode == MODE_FILES)
+        {
+            files_total = total;
+        }
+        else if (files_total > 0.0)
+        {
+            printf("         median connect %.0fus (%.1f%%) faster than files%s\n", files_total - total,
+                   100.0 * (files_total - total) / files_total,
+                   mode == MODE_CONTEXT ? ", not implemented in the firmware" : "");
+        }
+    }
+    return 0;
+}